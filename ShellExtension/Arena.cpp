@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Arena.cpp
+ *  The WinUnionFS Project
+ *
+ *  Bump allocator for objects which share a single lifetime.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include "Arena.hpp"
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+Arena::Arena() {
+    this->next = NULL;
+    this->remaining = 0;
+    this->bytesUsed = 0;
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+Arena::~Arena() {
+    Clear();
+}
+
+
+/// <summary>
+/// Allocates cb bytes, aligned to 4 bytes. Requests larger than a block get a block of their own.
+/// </summary>
+LPVOID Arena::Allocate(ULONG cb) {
+    cb = (cb + 3) & ~3UL;
+
+    if (cb > this->remaining) {
+        ULONG size = max(cb, Arena::blockSize);
+        LPBYTE block = (LPBYTE)HeapAlloc(GetProcessHeap(), 0, size);
+        if (block == NULL) {
+            return NULL;
+        }
+        this->blocks.push_back(block);
+
+        // Keep bump allocating from the current block if the new one was just for this request.
+        if (size - cb >= this->remaining) {
+            this->next = block + cb;
+            this->remaining = size - cb;
+        }
+        this->bytesUsed += cb;
+        return block;
+    }
+
+    LPVOID ret = this->next;
+    this->next += cb;
+    this->remaining -= cb;
+    this->bytesUsed += cb;
+
+    return ret;
+}
+
+
+/// <summary>
+/// Frees all blocks at once.
+/// </summary>
+void Arena::Clear() {
+    for (std::vector<LPBYTE>::const_iterator block = this->blocks.begin(); block != this->blocks.end(); ++block) {
+        HeapFree(GetProcessHeap(), 0, *block);
+    }
+    this->blocks.clear();
+    this->next = NULL;
+    this->remaining = 0;
+    this->bytesUsed = 0;
+}
+
+
+/// <summary>
+/// Returns the number of blocks requested from the heap.
+/// </summary>
+ULONG Arena::BlockCount() const {
+    return ULONG(this->blocks.size());
+}
+
+
+/// <summary>
+/// Returns the number of bytes handed out, including alignment padding.
+/// </summary>
+ULONG Arena::BytesUsed() const {
+    return this->bytesUsed;
+}
@@ -0,0 +1,43 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Arena.hpp
+ *  The WinUnionFS Project
+ *
+ *  Bump allocator for objects which share a single lifetime.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <vector>
+
+class Arena
+{
+public:
+    // Constructor/Destructor
+    explicit Arena();
+    virtual ~Arena();
+
+    // Allocates cb bytes, which stay valid until the arena is cleared or destroyed.
+    LPVOID Allocate(ULONG cb);
+
+    // Frees everything allocated from the arena.
+    void Clear();
+
+    // The number of blocks requested from the heap.
+    ULONG BlockCount() const;
+
+    // The number of bytes handed out.
+    ULONG BytesUsed() const;
+
+private:
+    // The size of a regular block.
+    static const ULONG blockSize = 64*1024;
+
+    // All blocks owned by this arena.
+    std::vector<LPBYTE> blocks;
+
+    // The unused part of the current block.
+    LPBYTE next;
+    ULONG remaining;
+
+    ULONG bytesUsed;
+};
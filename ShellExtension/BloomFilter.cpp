@@ -0,0 +1,120 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  BloomFilter.cpp
+ *  The WinUnionFS Project
+ *
+ *  Remembers which names each member of a folder has, allowing false
+ *  positives but no false negatives.
+ *
+ *  Each member gets 10 bits per name and 7 probes, for a false positive rate
+ *  of about 1%. The probes are derived from the case-insensitive Name::Hash
+ *  by double hashing, so names which are Equal always match.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include "BloomFilter.hpp"
+#include "Name.h"
+
+
+// The number of bits per name, and the number of bits set per name.
+#define BITS_PER_NAME 10
+#define PROBES 7
+
+
+/// <summary>
+/// Derives the step between probes from the hash. It is odd, so that every bit can be reached.
+/// </summary>
+static inline ULONG Step(ULONG hash) {
+    return (((hash >> 17) | (hash << 15)) * 0x9E3779B1) | 1;
+}
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+BloomFilter::BloomFilter(const std::vector<std::vector<ULONG> > &memberHashes) {
+    this->refCount = 1;
+
+    for (std::vector<std::vector<ULONG> >::const_iterator hashes = memberHashes.begin(); hashes != memberHashes.end(); ++hashes) {
+        ULONG offset = ULONG(this->bits.size());
+        ULONG length = ULONG((hashes->size()*BITS_PER_NAME + 63)/64);
+
+        this->offsets.push_back(offset);
+        this->lengths.push_back(length);
+        this->bits.resize(offset + length, 0);
+
+        if (length == 0) {
+            continue;
+        }
+
+        ULONG cBits = length*64;
+        for (std::vector<ULONG>::const_iterator hash = hashes->begin(); hash != hashes->end(); ++hash) {
+            ULONG bit = *hash, step = Step(*hash);
+            for (int probe = 0; probe < PROBES; ++probe, bit += step) {
+                this->bits[offset + (bit % cBits)/64] |= 1ULL << ((bit % cBits) % 64);
+            }
+        }
+    }
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+BloomFilter::~BloomFilter() {
+}
+
+
+/// <summary>
+/// Increments the reference count.
+/// </summary>
+ULONG BloomFilter::AddRef() {
+    return InterlockedIncrement(&this->refCount);
+}
+
+
+/// <summary>
+/// Decrements the reference count, deleting the filter when it reaches 0.
+/// </summary>
+ULONG BloomFilter::Release() {
+    ULONG refCount = InterlockedDecrement(&this->refCount);
+    if (refCount == 0) {
+        delete this;
+    }
+
+    return refCount;
+}
+
+
+/// <summary>
+/// Returns false if the member definitely doesn't have the name. Members the filter wasn't built
+/// for may have anything.
+/// </summary>
+bool BloomFilter::MayContain(size_t member, LPCWSTR name) {
+    if (member >= this->offsets.size()) {
+        return true;
+    }
+
+    ULONG offset = this->offsets[member], cBits = this->lengths[member]*64;
+    if (cBits == 0) {
+        return false;
+    }
+
+    ULONG hash = Name::Hash(name);
+    ULONG bit = hash, step = Step(hash);
+    for (int probe = 0; probe < PROBES; ++probe, bit += step) {
+        if ((this->bits[offset + (bit % cBits)/64] & (1ULL << ((bit % cBits) % 64))) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/// <summary>
+/// Returns the number of bytes used by the filter.
+/// </summary>
+ULONG BloomFilter::Size() {
+    return ULONG(sizeof(BloomFilter) + this->bits.size()*sizeof(ULONGLONG) + this->offsets.size()*2*sizeof(ULONG));
+}
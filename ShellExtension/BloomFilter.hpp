@@ -0,0 +1,38 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  BloomFilter.hpp
+ *  The WinUnionFS Project
+ *
+ *  Remembers which names each member of a folder has, allowing false
+ *  positives but no false negatives.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <vector>
+
+class BloomFilter {
+public:
+    // Builds a filter per member from the Name::Hash of every name the member has.
+    explicit BloomFilter(const std::vector<std::vector<ULONG> > &memberHashes);
+
+    ULONG AddRef();
+    ULONG Release();
+
+    // Returns false if the member definitely doesn't have the name.
+    bool MayContain(size_t member, LPCWSTR name);
+
+    // The number of bytes used by the filter.
+    ULONG Size();
+
+private:
+    virtual ~BloomFilter();
+
+    // The bits of every member, one after another. Each member's filter is a multiple of 64 bits.
+    std::vector<ULONGLONG> bits;
+
+    // Where each member's bits start, and how many there are, in ULONGLONGs.
+    std::vector<ULONG> offsets;
+    std::vector<ULONG> lengths;
+
+    ULONG refCount;
+};
@@ -0,0 +1,62 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Breaker.cpp
+ *  The WinUnionFS Project
+ *
+ *  Circuit breaker which stops us from retrying a failing member folder. Each
+ *  failure opens the breaker for Settings::memberBackoff ms, doubling with
+ *  every further failure in a row up to 32 times that. Once the window has
+ *  passed a single attempt is let through; success closes the breaker.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include "Breaker.hpp"
+#include "Settings.h"
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+Breaker::Breaker() {
+    this->failures = 0;
+    this->openUntil = 0;
+}
+
+
+/// <summary>
+/// Returns false while the breaker is open.
+/// </summary>
+bool Breaker::Allow() {
+    LONGLONG openUntil = this->openUntil;
+
+    if (openUntil == 0) {
+        return true;
+    }
+
+    // Let one caller through once the window has passed. Others keep skipping the member until the
+    // attempt has either succeeded or failed again.
+    LONGLONG now = LONGLONG(GetTickCount64());
+    return now >= openUntil && InterlockedCompareExchange64(&this->openUntil, now + Settings::memberTimeout, openUntil) == openUntil;
+}
+
+
+/// <summary>
+/// Opens the breaker, for longer with every failure in a row.
+/// </summary>
+void Breaker::Failed() {
+    LONG failures = InterlockedIncrement(&this->failures);
+    LONGLONG backoff = LONGLONG(Settings::memberBackoff) << min(failures - 1, 5);
+
+    InterlockedExchange64(&this->openUntil, LONGLONG(GetTickCount64()) + backoff);
+}
+
+
+/// <summary>
+/// Closes the breaker.
+/// </summary>
+void Breaker::Succeeded() {
+    if (this->failures != 0) {
+        InterlockedExchange(&this->failures, 0);
+        InterlockedExchange64(&this->openUntil, 0);
+    }
+}
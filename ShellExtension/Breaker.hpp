@@ -0,0 +1,29 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Breaker.hpp
+ *  The WinUnionFS Project
+ *
+ *  Circuit breaker which stops us from retrying a failing member folder.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+class Breaker
+{
+public:
+    // Constructor
+    explicit Breaker();
+
+    // Returns false while the breaker is open, i.e. the member should not be tried.
+    bool Allow();
+
+    // Records the outcome of an attempt.
+    void Failed();
+    void Succeeded();
+
+private:
+    // The number of failures in a row.
+    volatile LONG failures;
+
+    // The tick count until which the breaker stays open.
+    volatile LONGLONG openUntil;
+};
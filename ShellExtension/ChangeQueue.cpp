@@ -0,0 +1,152 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ChangeQueue.cpp
+ *  The WinUnionFS Project
+ *
+ *  Collects the changes the watcher reports as paths within their groups, and
+ *  applies them to the ListingCache once they have settled. Changes to the
+ *  same folder are merged into one invalidation, which includes everything
+ *  below the folder if any of them did.
+ *
+ *  This is the part of the watcher which doesn't depend on how changes are
+ *  received, so that it can be built and tested on its own. There is no
+ *  inotify source to drive it on other systems: the extension only runs in
+ *  Explorer, and inotify can't watch a tree with one descriptor per member
+ *  root the way ReadDirectoryChangesW does, so such a source would share
+ *  nothing with the one we ship beyond what this already covers.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include "ChangeQueue.hpp"
+#include "ListingCache.h"
+#include "Settings.h"
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+ChangeQueue::ChangeQueue() {
+    this->firstChange = 0;
+    this->lastChange = 0;
+}
+
+
+/// <summary>
+/// Destructor. Whatever is still pending is dropped.
+/// </summary>
+ChangeQueue::~ChangeQueue() {
+    Clear();
+}
+
+
+/// <summary>
+/// Queues the first cchPath characters of path within the group for invalidation.
+/// </summary>
+void ChangeQueue::Queue(LPCWSTR group, LPCWSTR path, size_t cchPath, bool below) {
+    size_t cchGroup = wcslen(group);
+    bool first = this->pending.empty();
+    LPWSTR key = new WCHAR[cchGroup + 1 + cchPath + 1];
+
+    memcpy(key, group, cchGroup*sizeof(WCHAR));
+    if (cchPath != 0) {
+        key[cchGroup] = L'\\';
+        memcpy(key + cchGroup + 1, path, cchPath*sizeof(WCHAR));
+        key[cchGroup + 1 + cchPath] = L'\0';
+    }
+    else {
+        key[cchGroup] = L'\0';
+    }
+
+    PendingMap::iterator iter = this->pending.find(key);
+    if (iter != this->pending.end()) {
+        iter->second = iter->second || below;
+        delete [] key;
+    }
+    else {
+        this->pending[key] = below;
+    }
+
+    this->lastChange = GetTickCount64();
+    if (first) {
+        this->firstChange = this->lastChange;
+    }
+}
+
+
+/// <summary>
+/// Queues the listings affected by a change to the item at name, relative to a member root.
+/// </summary>
+void ChangeQueue::Change(LPCWSTR group, LPCWSTR name, size_t cchName, bool moved) {
+    size_t cchParent = cchName;
+
+    while (cchParent > 0 && name[cchParent - 1] != L'\\') {
+        --cchParent;
+    }
+
+    // The listing of the parent changes in any case. When a folder is removed or renamed,
+    // whatever was cached below its old or new name is stale as well.
+    Queue(group, name, cchParent > 0 ? cchParent - 1 : 0, false);
+    if (moved) {
+        Queue(group, name, cchName, true);
+    }
+}
+
+
+/// <summary>
+/// Returns whether no changes are pending.
+/// </summary>
+bool ChangeQueue::IsEmpty() const {
+    return this->pending.empty();
+}
+
+
+/// <summary>
+/// Returns the number of paths waiting to be invalidated.
+/// </summary>
+size_t ChangeQueue::Size() const {
+    return this->pending.size();
+}
+
+
+/// <summary>
+/// Returns when the pending changes should be applied. We wait for the changes to settle, but
+/// not for longer than a few delays, so that a folder which changes constantly still gets updated.
+/// </summary>
+ULONGLONG ChangeQueue::FlushTime() const {
+    return min(this->lastChange + Settings::watchDelay, this->firstChange + 4*Settings::watchDelay);
+}
+
+
+/// <summary>
+/// Applies all pending invalidations to the ListingCache.
+/// </summary>
+void ChangeQueue::Flush() {
+    for (PendingMap::const_iterator iter = this->pending.begin(); iter != this->pending.end(); ++iter) {
+        LPWSTR group = iter->first;
+        LPWSTR path = wcschr(group, L'\\');
+
+        // Group names can't contain backslashes, so the first one ends the group.
+        if (path != NULL) {
+            *path++ = L'\0';
+        }
+        else {
+            path = group + wcslen(group);
+        }
+
+        ListingCache::Invalidate(group, path, iter->second);
+        delete [] group;
+    }
+    this->pending.clear();
+}
+
+
+/// <summary>
+/// Drops all pending invalidations.
+/// </summary>
+void ChangeQueue::Clear() {
+    for (PendingMap::const_iterator iter = this->pending.begin(); iter != this->pending.end(); ++iter) {
+        delete [] iter->first;
+    }
+    this->pending.clear();
+}
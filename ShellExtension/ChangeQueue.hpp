@@ -0,0 +1,49 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ChangeQueue.hpp
+ *  The WinUnionFS Project
+ *
+ *  Collects the changes the watcher reports as paths within their groups, and
+ *  applies them to the ListingCache once they have settled.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <unordered_map>
+
+#include "Name.h"
+
+class ChangeQueue
+{
+public:
+    // Constructor and destructor
+    explicit ChangeQueue();
+    ~ChangeQueue();
+
+    // Queues the first cchPath characters of path within the group for invalidation, and
+    // optionally everything below them.
+    void Queue(LPCWSTR group, LPCWSTR path, size_t cchPath, bool below);
+
+    // Queues the listings affected by a change to the item at the first cchName characters of
+    // name, which is removed or renamed if moved is set.
+    void Change(LPCWSTR group, LPCWSTR name, size_t cchName, bool moved);
+
+    // Returns whether anything is waiting to be applied, and how many paths are.
+    bool IsEmpty() const;
+    size_t Size() const;
+
+    // Returns the tick count at which the pending changes should be applied.
+    ULONGLONG FlushTime() const;
+
+    // Applies all pending changes to the ListingCache, or drops them.
+    void Flush();
+    void Clear();
+
+private:
+    // Paths waiting to be invalidated, as Group\Path, and whether to include everything below them.
+    typedef std::unordered_map<LPWSTR, bool, Name::Hasher, Name::EqualTo> PendingMap;
+    PendingMap pending;
+
+    // When the first and the latest of the pending changes arrived.
+    ULONGLONG firstChange;
+    ULONGLONG lastChange;
+};
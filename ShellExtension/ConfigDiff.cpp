@@ -0,0 +1,84 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ConfigDiff.cpp
+ *  The WinUnionFS Project
+ *
+ *  Works out what applying a new configuration does to each group, without
+ *  touching any of them.
+ *
+ *  A group is only rebuilt when its member paths differ, ignoring case, or
+ *  appear in a different order. Member indices are stored in listings and
+ *  PIDLs, so any change in order makes those of the old group meaningless.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <unordered_map>
+
+#include "ConfigDiff.h"
+#include "Name.h"
+
+
+typedef std::unordered_map<LPCWSTR, size_t, Name::Hasher, Name::EqualTo> IndexMap;
+
+
+/// <summary>
+/// Returns true if two groups have the same members, in the same order.
+/// </summary>
+static bool SameMembers(const ConfigDiff::GroupConfig &a, const ConfigDiff::GroupConfig &b) {
+    if (a.paths.size() != b.paths.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.paths.size(); ++i) {
+        if (!Name::Equal(a.paths[i], b.paths[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/// <summary>
+/// Compares two configurations, adding a step to steps for each group in after, in order, and then
+/// one for each group in before which isn't in after.
+/// </summary>
+void ConfigDiff::Diff(const std::vector<GroupConfig> &before, const std::vector<GroupConfig> &after, std::vector<Step> *steps) {
+    IndexMap beforeByName;
+    IndexMap afterByName;
+
+    for (size_t i = 0; i < before.size(); ++i) {
+        beforeByName.insert(IndexMap::value_type(before[i].name, i));
+    }
+
+    for (size_t i = 0; i < after.size(); ++i) {
+        if (after[i].name == NULL || !afterByName.insert(IndexMap::value_type(after[i].name, i)).second) {
+            continue;
+        }
+
+        Step step;
+        step.after = i;
+
+        IndexMap::const_iterator previous = beforeByName.find(after[i].name);
+        if (previous == beforeByName.end()) {
+            step.action = ADD;
+            step.before = 0;
+        }
+        else {
+            step.action = SameMembers(before[previous->second], after[i]) ? KEEP : REBUILD;
+            step.before = previous->second;
+        }
+
+        steps->push_back(step);
+    }
+
+    for (size_t i = 0; i < before.size(); ++i) {
+        if (afterByName.find(before[i].name) == afterByName.end()) {
+            Step step;
+            step.action = REMOVE;
+            step.before = i;
+            step.after = 0;
+            steps->push_back(step);
+        }
+    }
+}
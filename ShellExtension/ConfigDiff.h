@@ -0,0 +1,47 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ConfigDiff.h
+ *  The WinUnionFS Project
+ *
+ *  Works out what applying a new configuration does to each group, without
+ *  touching any of them.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <vector>
+
+namespace ConfigDiff {
+    // A group as configured: its name, and the paths of its members in order of precedence.
+    typedef struct {
+        LPCWSTR name;
+        std::vector<LPCWSTR> paths;
+    } GroupConfig;
+
+    // What happens to a group.
+    typedef enum {
+        // The group is new, and is built from scratch.
+        ADD,
+
+        // The group's members are the same, so it is carried over with its bound folders.
+        KEEP,
+
+        // The group's members have changed, so it is built again.
+        REBUILD,
+
+        // The group is no longer configured.
+        REMOVE
+    } Action;
+
+    // What happens to one group. before and after are its indices in the two configurations,
+    // where it has one.
+    typedef struct {
+        Action action;
+        size_t before;
+        size_t after;
+    } Step;
+
+    // Compares two configurations, adding a step to steps for each group in after, in order, and
+    // then one for each group in before which isn't in after. Groups are matched by name, ignoring
+    // case, and only the first of several groups with the same name in after counts.
+    void Diff(const std::vector<GroupConfig> &before, const std::vector<GroupConfig> &after, std::vector<Step> *steps);
+}
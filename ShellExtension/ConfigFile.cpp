@@ -0,0 +1,322 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ConfigFile.cpp
+ *  The WinUnionFS Project
+ *
+ *  The group configuration, in a compact binary format which is read in place.
+ *
+ *  The file starts with a Header, which points to an array of GroupRecords.
+ *  Each of those points to its name and to an array of offsets of its member
+ *  paths. Strings are stored as a DWORD character count followed by the
+ *  NULL-terminated UTF-16 characters. All offsets are from the start of the
+ *  file and DWORD aligned, and are checked as they are followed, so only the
+ *  parts which are actually read are ever paged in.
+ *
+ *  The registry configuration is imported into the same format, so there is
+ *  only one loader.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <strsafe.h>
+
+#include "ConfigFile.hpp"
+
+
+// The first DWORD of every configuration file, "WUFS".
+#define CONFIG_MAGIC 0x53465557
+
+// The version of the format written by this code.
+#define CONFIG_VERSION 1
+
+// Refuse to map anything larger than this.
+#define CONFIG_MAX_SIZE (256*1024*1024)
+
+typedef struct {
+    DWORD magic;
+    USHORT version;
+    USHORT headerSize;
+    DWORD size;             // The size of the whole file.
+    DWORD groupCount;
+    DWORD groupsOffset;     // GroupRecord[groupCount]
+} Header;
+
+typedef struct {
+    DWORD nameOffset;       // String
+    DWORD memberCount;
+    DWORD membersOffset;    // DWORD[memberCount], offsets of Strings
+} GroupRecord;
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+ConfigFile::ConfigFile(const BYTE* base, DWORD size, bool mapped) {
+    this->base = base;
+    this->size = size;
+    this->mapped = mapped;
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+ConfigFile::~ConfigFile() {
+    if (this->mapped) {
+        UnmapViewOfFile(this->base);
+    }
+    else {
+        delete [] this->base;
+    }
+}
+
+
+/// <summary>
+/// Maps a configuration file into memory. Returns NULL if it can't be opened, or its header is
+/// invalid. The rest of the file is validated as it is read.
+/// </summary>
+ConfigFile* ConfigFile::Map(LPCWSTR path) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = NULL;
+    const BYTE* view = NULL;
+
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= LONGLONG(sizeof(Header)) && fileSize.QuadPart <= CONFIG_MAX_SIZE) {
+        mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if (mapping != NULL) {
+        view = (const BYTE*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+
+    if (view == NULL) {
+        return NULL;
+    }
+
+    const Header* header = (const Header*)view;
+    if (header->magic != CONFIG_MAGIC || header->version != CONFIG_VERSION || header->headerSize < sizeof(Header)
+        || header->size != DWORD(fileSize.QuadPart)) {
+        UnmapViewOfFile(view);
+        return NULL;
+    }
+
+    return new ConfigFile(view, DWORD(fileSize.QuadPart), true);
+}
+
+
+/// <summary>
+/// Appends a string to the image, and returns its offset.
+/// </summary>
+static DWORD AppendString(std::vector<BYTE> &image, LPCWSTR string) {
+    DWORD offset = DWORD(image.size());
+    DWORD cch = DWORD(wcslen(string));
+    DWORD cb = sizeof(DWORD) + (cch + 1)*sizeof(WCHAR);
+
+    image.resize(offset + ((cb + 3) & ~3));
+    memcpy(&image[offset], &cch, sizeof(DWORD));
+    memcpy(&image[offset + sizeof(DWORD)], string, (cch + 1)*sizeof(WCHAR));
+
+    return offset;
+}
+
+
+/// <summary>
+/// Reads the Path value of a folder key, whatever its length. The caller must delete [] it.
+/// </summary>
+static LPWSTR ReadPath(HKEY foldersKey, LPCWSTR folderKeyName) {
+    DWORD cbPath = 0;
+
+    if (RegGetValueW(foldersKey, folderKeyName, L"Path", RRF_RT_REG_SZ, NULL, NULL, &cbPath) != ERROR_SUCCESS || cbPath < sizeof(WCHAR)) {
+        return NULL;
+    }
+
+    LPWSTR path = new WCHAR[cbPath/sizeof(WCHAR) + 1];
+    if (RegGetValueW(foldersKey, folderKeyName, L"Path", RRF_RT_REG_SZ, NULL, path, &cbPath) != ERROR_SUCCESS) {
+        delete [] path;
+        return NULL;
+    }
+    path[cbPath/sizeof(WCHAR)] = L'\0';
+
+    return path;
+}
+
+
+/// <summary>
+/// Imports the groups from HKCU\SOFTWARE\WinUnionFS\Groups. Returns NULL if the key can't be
+/// opened.
+/// </summary>
+ConfigFile* ConfigFile::Import() {
+    // HKCU/Software/WinUnionFS/Groups
+    HKEY groupsKey, groupKey, foldersKey;
+
+    if (RegCreateKeyW(HKEY_CURRENT_USER, L"SOFTWARE\\WinUnionFS\\Groups", &groupsKey) != ERROR_SUCCESS) {
+        return NULL;
+    }
+
+    std::vector<BYTE> image(sizeof(Header));
+    std::vector<GroupRecord> groups;
+    std::vector<std::vector<DWORD> > members;
+
+    DWORD groupIndex = 0, cchName = MAX_PATH;
+    WCHAR name[MAX_PATH];
+    while (RegEnumKeyExW(groupsKey, groupIndex++, name, &cchName, NULL, NULL, NULL, NULL) != ERROR_NO_MORE_ITEMS) {
+        GroupRecord group;
+        group.nameOffset = AppendString(image, name);
+        groups.push_back(group);
+        members.push_back(std::vector<DWORD>());
+
+        if (RegCreateKeyW(groupsKey, name, &groupKey) == ERROR_SUCCESS) {
+            if (RegCreateKeyW(groupKey, L"Folders", &foldersKey) == ERROR_SUCCESS) {
+                // Enumerate the folders
+                DWORD folderIndex = 0, cchFolderKeyName = MAX_PATH;
+                WCHAR folderKeyName[MAX_PATH];
+                while (RegEnumKeyExW(foldersKey, folderIndex++, folderKeyName, &cchFolderKeyName, NULL, NULL, NULL, NULL) != ERROR_NO_MORE_ITEMS) {
+                    LPWSTR path = ReadPath(foldersKey, folderKeyName);
+                    if (path != NULL) {
+                        members.back().push_back(AppendString(image, path));
+                        delete [] path;
+                    }
+
+                    cchFolderKeyName = MAX_PATH;
+                }
+
+                RegCloseKey(foldersKey);
+            }
+
+            RegCloseKey(groupKey);
+        }
+
+        cchName = MAX_PATH;
+    }
+
+    RegCloseKey(groupsKey);
+
+    // The member arrays, then the group table.
+    for (size_t i = 0; i < groups.size(); ++i) {
+        groups[i].memberCount = DWORD(members[i].size());
+        groups[i].membersOffset = DWORD(image.size());
+        image.resize(image.size() + members[i].size()*sizeof(DWORD));
+        if (!members[i].empty()) {
+            memcpy(&image[groups[i].membersOffset], &members[i][0], members[i].size()*sizeof(DWORD));
+        }
+    }
+
+    Header header;
+    header.magic = CONFIG_MAGIC;
+    header.version = CONFIG_VERSION;
+    header.headerSize = sizeof(Header);
+    header.groupCount = DWORD(groups.size());
+    header.groupsOffset = DWORD(image.size());
+    image.resize(image.size() + groups.size()*sizeof(GroupRecord));
+    if (!groups.empty()) {
+        memcpy(&image[header.groupsOffset], &groups[0], groups.size()*sizeof(GroupRecord));
+    }
+    header.size = DWORD(image.size());
+    memcpy(&image[0], &header, sizeof(Header));
+
+    BYTE* base = new BYTE[image.size()];
+    memcpy(base, &image[0], image.size());
+
+    return new ConfigFile(base, DWORD(image.size()), false);
+}
+
+
+/// <summary>
+/// Writes the configuration to a file. It is written to a temporary file first, which then
+/// replaces the file, so readers never see a partial configuration.
+/// </summary>
+HRESULT ConfigFile::Save(LPCWSTR path) {
+    size_t cchTemp = wcslen(path) + 5;
+    LPWSTR temp = new WCHAR[cchTemp];
+    StringCchPrintfW(temp, cchTemp, L"%s.tmp", path);
+
+    HRESULT hr = S_OK;
+    HANDLE file = CreateFileW(temp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else {
+        DWORD written = 0;
+        if (!WriteFile(file, this->base, this->size, &written, NULL) || written != this->size) {
+            hr = E_FAIL;
+        }
+        CloseHandle(file);
+
+        if (SUCCEEDED(hr) && !MoveFileExW(temp, path, MOVEFILE_REPLACE_EXISTING)) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+        if (FAILED(hr)) {
+            DeleteFileW(temp);
+        }
+    }
+
+    delete [] temp;
+    return hr;
+}
+
+
+/// <summary>
+/// Returns a pointer to count records of size bytes at offset, or NULL if they don't fit.
+/// </summary>
+const void* ConfigFile::At(DWORD offset, DWORD count, DWORD size) {
+    if ((offset & 3) != 0 || offset > this->size || count > (this->size - offset)/size) {
+        return NULL;
+    }
+
+    return this->base + offset;
+}
+
+
+/// <summary>
+/// Returns the string at offset, or NULL if it doesn't fit or isn't terminated.
+/// </summary>
+LPCWSTR ConfigFile::String(DWORD offset) {
+    const DWORD* cch = (const DWORD*)At(offset, 1, sizeof(DWORD));
+    if (cch == NULL || *cch >= (this->size - offset - sizeof(DWORD))/sizeof(WCHAR)) {
+        return NULL;
+    }
+
+    LPCWSTR string = LPCWSTR(cch + 1);
+    return string[*cch] == L'\0' ? string : NULL;
+}
+
+
+/// <summary>
+/// Returns the number of groups.
+/// </summary>
+DWORD ConfigFile::GroupCount() {
+    const Header* header = (const Header*)this->base;
+    return At(header->groupsOffset, header->groupCount, sizeof(GroupRecord)) != NULL ? header->groupCount : 0;
+}
+
+
+/// <summary>
+/// Returns the name of a group.
+/// </summary>
+LPCWSTR ConfigFile::GroupName(DWORD group) {
+    const Header* header = (const Header*)this->base;
+    return String(((const GroupRecord*)(this->base + header->groupsOffset))[group].nameOffset);
+}
+
+
+/// <summary>
+/// Returns the number of members in a group.
+/// </summary>
+DWORD ConfigFile::MemberCount(DWORD group) {
+    const Header* header = (const Header*)this->base;
+    const GroupRecord* record = (const GroupRecord*)(this->base + header->groupsOffset) + group;
+    return At(record->membersOffset, record->memberCount, sizeof(DWORD)) != NULL ? record->memberCount : 0;
+}
+
+
+/// <summary>
+/// Returns the path of a member of a group.
+/// </summary>
+LPCWSTR ConfigFile::MemberPath(DWORD group, DWORD member) {
+    const Header* header = (const Header*)this->base;
+    const GroupRecord* record = (const GroupRecord*)(this->base + header->groupsOffset) + group;
+    return String(((const DWORD*)(this->base + record->membersOffset))[member]);
+}
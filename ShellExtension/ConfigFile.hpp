@@ -0,0 +1,42 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ConfigFile.hpp
+ *  The WinUnionFS Project
+ *
+ *  The group configuration, in a compact binary format which is read in place.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <vector>
+
+class ConfigFile {
+public:
+    virtual ~ConfigFile();
+
+    // Maps a configuration file. Returns NULL if it doesn't exist or isn't valid.
+    static ConfigFile* Map(LPCWSTR path);
+
+    // Reads the configuration from HKCU\SOFTWARE\WinUnionFS\Groups.
+    static ConfigFile* Import();
+
+    // Writes the configuration to a file, replacing it atomically.
+    HRESULT Save(LPCWSTR path);
+
+    // The strings returned point into the configuration, and are NULL where it is damaged.
+    DWORD GroupCount();
+    LPCWSTR GroupName(DWORD group);
+    DWORD MemberCount(DWORD group);
+    LPCWSTR MemberPath(DWORD group, DWORD member);
+
+private:
+    explicit ConfigFile(const BYTE* base, DWORD size, bool mapped);
+
+    // Returns the record at offset, or NULL if it doesn't fit in the configuration.
+    const void* At(DWORD offset, DWORD count, DWORD size);
+    LPCWSTR String(DWORD offset);
+
+    // The configuration, either a view of a file or a buffer we own.
+    const BYTE* base;
+    DWORD size;
+    bool mapped;
+};
@@ -11,5 +11,5 @@
     #define TRACE  DbgTraceMessage
     void DbgTraceMessage(LPCWSTR format, ...);
 #else
-    #define TRACE
+    #define TRACE  __noop
 #endif
@@ -0,0 +1,381 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  DirectoryTrie.cpp
+ *  The WinUnionFS Project
+ *
+ *  Remembers which members of a group have which folders, so that members
+ *  can be left out of binds and look ups as soon as a path leaves them.
+ *
+ *  Every group has a tree of the folders in it, filled in from listings of
+ *  folders, including hidden ones. A folder whose listing is known records
+ *  each folder in it and the members which have it; a member missing from a
+ *  folder has nothing below it either. Folders forget their listing when the
+ *  watcher reports a change in them, or after Settings::cacheTimeout ms like
+ *  cached listings do, but keep the folders below them.
+ *
+ *  The tree is bounded by Settings::trieSize bytes. The folders whose
+ *  listings were used least recently lose everything below them first.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <list>
+#include <unordered_map>
+
+#include "DirectoryTrie.h"
+#include "ListingCache.h"
+#include "Name.h"
+#include "Settings.h"
+#include "Stats.h"
+
+
+struct Node;
+typedef std::unordered_map<LPCWSTR, Node*, Name::Hasher, Name::EqualTo> NodeMap;
+typedef std::list<Node*> NodeList;
+
+// A folder in a group.
+struct Node {
+    // The name of the folder, or of the group for the top of the tree.
+    LPWSTR name;
+
+    // The members which have this folder, as of the last listing of the parent.
+    std::vector<bool> members;
+
+    // Set while children holds every folder of every member. Until expires, in GetTickCount64 time.
+    bool complete;
+    ULONGLONG expires;
+
+    // The folders in this folder.
+    NodeMap children;
+
+    // The position in the recently used list, for nodes with children.
+    NodeList::iterator used;
+};
+
+// The top of the tree of every group, by group name.
+static NodeMap groups;
+
+// The nodes with children, most recently used first.
+static NodeList recentlyUsed;
+
+// The number of bytes used by all nodes.
+static ULONG bytesUsed = 0;
+
+// Guards everything above.
+static SRWLOCK lock = SRWLOCK_INIT;
+
+
+/// <summary>
+/// Returns the number of bytes charged for a node.
+/// </summary>
+static ULONG NodeSize(Node* node) {
+    return ULONG(sizeof(Node) + sizeof(WCHAR)*(wcslen(node->name) + 1) + (node->members.size() + 7)/8);
+}
+
+
+/// <summary>
+/// Creates a node. The lock must be held exclusively.
+/// </summary>
+static Node* CreateNode(LPCWSTR name, size_t memberCount) {
+    Node* node = new Node();
+    node->name = _wcsdup(name);
+    node->members.resize(memberCount, false);
+    node->complete = false;
+    node->expires = 0;
+    node->used = recentlyUsed.end();
+
+    bytesUsed += NodeSize(node);
+
+    return node;
+}
+
+
+/// <summary>
+/// Deletes everything below the node. The lock must be held exclusively.
+/// </summary>
+static void DeleteChildren(Node* node) {
+    for (NodeMap::const_iterator child = node->children.begin(); child != node->children.end(); ++child) {
+        DeleteChildren(child->second);
+        bytesUsed -= NodeSize(child->second);
+        free(child->second->name);
+        delete child->second;
+    }
+    node->children.clear();
+    node->complete = false;
+
+    if (node->used != recentlyUsed.end()) {
+        recentlyUsed.erase(node->used);
+        node->used = recentlyUsed.end();
+    }
+}
+
+
+/// <summary>
+/// Deletes a node and everything below it. The lock must be held exclusively.
+/// </summary>
+static void DeleteNode(Node* node) {
+    DeleteChildren(node);
+    bytesUsed -= NodeSize(node);
+    free(node->name);
+    delete node;
+}
+
+
+/// <summary>
+/// Marks the node as recently used. The lock must be held exclusively.
+/// </summary>
+static void Touch(Node* node) {
+    if (node->used != recentlyUsed.end()) {
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, node->used);
+    }
+    else if (!node->children.empty()) {
+        recentlyUsed.push_front(node);
+        node->used = recentlyUsed.begin();
+    }
+}
+
+
+/// <summary>
+/// Returns true if the node's children are every folder of every member.
+/// </summary>
+static bool IsComplete(Node* node) {
+    return node->complete && GetTickCount64() < node->expires;
+}
+
+
+/// <summary>
+/// Splits off the next part of a path. Returns the length of the part, and moves path past it and
+/// the separator after it.
+/// </summary>
+static size_t NextPart(LPCWSTR *path) {
+    size_t cchPart = wcscspn(*path, L"\\/");
+
+    *path += cchPart;
+    if (**path != L'\0') {
+        ++*path;
+    }
+
+    return cchPart;
+}
+
+
+/// <summary>
+/// Finds the node of the folder at path within the group. Returns NULL if it isn't in the tree, or
+/// creates it if asked to. The lock must be held, exclusively when creating.
+/// </summary>
+static Node* Find(LPCWSTR group, LPCWSTR path, size_t memberCount, bool create) {
+    NodeMap::iterator iter = groups.find(group);
+    Node* node;
+
+    if (iter != groups.end()) {
+        node = iter->second;
+    }
+    else if (create) {
+        node = CreateNode(group, memberCount);
+        groups[node->name] = node;
+    }
+    else {
+        return NULL;
+    }
+
+    LPWSTR part = new WCHAR[wcslen(path) + 1];
+    while (node != NULL && *path != L'\0') {
+        LPCWSTR start = path;
+        size_t cchPart = NextPart(&path);
+        if (cchPart == 0) {
+            continue;
+        }
+
+        memcpy(part, start, sizeof(WCHAR)*cchPart);
+        part[cchPart] = L'\0';
+
+        NodeMap::iterator child = node->children.find(part);
+        if (child != node->children.end()) {
+            node = child->second;
+        }
+        else if (create) {
+            // The parent's listing didn't have this folder, so it is out of date.
+            Node* parent = node;
+            node = CreateNode(part, memberCount);
+            parent->children[node->name] = node;
+            parent->complete = false;
+            Touch(parent);
+        }
+        else {
+            node = NULL;
+        }
+    }
+    delete [] part;
+
+    return node;
+}
+
+
+/// <summary>
+/// Records the folders every member has in the folder at path, from a complete listing of the
+/// folders in all members. Folders already in the tree keep what is known below them.
+/// </summary>
+void DirectoryTrie::Store(LPCWSTR group, LPCWSTR path, ULONG generation, size_t memberCount, const std::vector<MemberFolder> &folders) {
+    if (Settings::trieSize == 0) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&lock);
+    if (generation != ListingCache::Generation(group)) {
+        ReleaseSRWLockExclusive(&lock);
+        return;
+    }
+
+    Node* node = Find(group, path, memberCount, true);
+
+    // Start over with what the members have now.
+    for (NodeMap::const_iterator child = node->children.begin(); child != node->children.end(); ++child) {
+        child->second->members.assign(child->second->members.size(), false);
+    }
+
+    for (std::vector<MemberFolder>::const_iterator folder = folders.begin(); folder != folders.end(); ++folder) {
+        NodeMap::iterator iter = node->children.find(folder->first);
+        Node* child;
+
+        if (iter != node->children.end()) {
+            child = iter->second;
+        }
+        else {
+            child = CreateNode(folder->first, memberCount);
+            node->children[child->name] = child;
+        }
+
+        if (folder->second < child->members.size()) {
+            child->members[folder->second] = true;
+        }
+    }
+
+    // Folders no member has anymore are gone.
+    for (NodeMap::iterator child = node->children.begin(); child != node->children.end();) {
+        NodeMap::iterator next = child;
+        ++next;
+
+        bool any = false;
+        for (std::vector<bool>::const_iterator member = child->second->members.begin(); member != child->second->members.end(); ++member) {
+            any = any || *member;
+        }
+        if (!any) {
+            Node* gone = child->second;
+            node->children.erase(child);
+            DeleteNode(gone);
+        }
+
+        child = next;
+    }
+
+    node->complete = true;
+    node->expires = GetTickCount64() + Settings::cacheTimeout;
+    Touch(node);
+
+    while (bytesUsed > Settings::trieSize && !recentlyUsed.empty()) {
+        DeleteChildren(recentlyUsed.back());
+        Stats::Add(Stats::TRIE_EVICTIONS, 1);
+    }
+    ReleaseSRWLockExclusive(&lock);
+}
+
+
+/// <summary>
+/// Clears the members which are known not to have one of the folders on path within the group.
+/// The last part of the path is only checked if lastIsFolder is set.
+/// </summary>
+void DirectoryTrie::Prune(LPCWSTR group, LPCWSTR path, bool lastIsFolder, std::vector<bool> *mayHave) {
+    if (Settings::trieSize == 0) {
+        return;
+    }
+
+    LPWSTR part = new WCHAR[wcslen(path) + 1];
+
+    AcquireSRWLockExclusive(&lock);
+    NodeMap::iterator iter = groups.find(group);
+    Node* node = iter != groups.end() ? iter->second : NULL;
+
+    while (node != NULL && *path != L'\0') {
+        LPCWSTR start = path;
+        size_t cchPart = NextPart(&path);
+        if (cchPart == 0) {
+            continue;
+        }
+        if (*path == L'\0' && !lastIsFolder) {
+            break;
+        }
+
+        memcpy(part, start, sizeof(WCHAR)*cchPart);
+        part[cchPart] = L'\0';
+
+        // Listings don't show short names or streams, so nothing below one can be ruled out.
+        if (Name::MayBeAlias(part)) {
+            break;
+        }
+
+        NodeMap::iterator child = node->children.find(part);
+        bool complete = IsComplete(node);
+
+        if (complete) {
+            Touch(node);
+        }
+
+        if (child == node->children.end()) {
+            // No member has the folder at all.
+            if (complete) {
+                for (size_t i = 0; i < mayHave->size(); ++i) {
+                    if ((*mayHave)[i]) {
+                        (*mayHave)[i] = false;
+                        Stats::Add(Stats::TRIE_PRUNES, 1);
+                    }
+                }
+            }
+            break;
+        }
+
+        if (complete) {
+            for (size_t i = 0; i < mayHave->size() && i < child->second->members.size(); ++i) {
+                if ((*mayHave)[i] && !child->second->members[i]) {
+                    (*mayHave)[i] = false;
+                    Stats::Add(Stats::TRIE_PRUNES, 1);
+                }
+            }
+        }
+
+        node = child->second;
+    }
+    ReleaseSRWLockExclusive(&lock);
+
+    delete [] part;
+}
+
+
+/// <summary>
+/// Forgets the listing of the folder at path within the group. With below set, everything below
+/// the folder is forgotten as well.
+/// </summary>
+void DirectoryTrie::Invalidate(LPCWSTR group, LPCWSTR path, bool below) {
+    AcquireSRWLockExclusive(&lock);
+    Node* node = Find(group, path, 0, false);
+
+    if (node != NULL) {
+        if (below) {
+            DeleteChildren(node);
+        }
+        node->complete = false;
+    }
+    ReleaseSRWLockExclusive(&lock);
+}
+
+
+/// <summary>
+/// Forgets everything.
+/// </summary>
+void DirectoryTrie::Clear() {
+    AcquireSRWLockExclusive(&lock);
+    for (NodeMap::const_iterator node = groups.begin(); node != groups.end(); ++node) {
+        DeleteNode(node->second);
+    }
+    groups.clear();
+    ReleaseSRWLockExclusive(&lock);
+}
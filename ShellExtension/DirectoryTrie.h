@@ -0,0 +1,29 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  DirectoryTrie.h
+ *  The WinUnionFS Project
+ *
+ *  Remembers which members of a group have which folders, so that members
+ *  can be left out of binds and look ups as soon as a path leaves them.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <utility>
+#include <vector>
+
+namespace DirectoryTrie {
+    // A folder some member has, and the index of that member.
+    typedef std::pair<LPCWSTR, size_t> MemberFolder;
+
+    // Records the folders every member has in the folder at path, from a complete listing. Nothing
+    // is recorded if the ListingCache was invalidated since generation was read.
+    void Store(LPCWSTR group, LPCWSTR path, ULONG generation, size_t memberCount, const std::vector<MemberFolder> &folders);
+
+    // Clears the members which are known not to have the folders on path. The last part of the
+    // path is only checked if it has to be a folder as well.
+    void Prune(LPCWSTR group, LPCWSTR path, bool lastIsFolder, std::vector<bool> *mayHave);
+
+    // Forgets what is in the folder at path, and optionally everything below it.
+    void Invalidate(LPCWSTR group, LPCWSTR path, bool below);
+    void Clear();
+}
@@ -8,8 +8,8 @@
 #include <Windows.h>
 #include <ShObjIdl.h>
 
+#include "Debug.h"
 #include "EnumIDList.hpp"
-#include "Macros.h"
 #include "PIDL.h"
 
 
@@ -23,19 +23,36 @@ extern long objectCounter;
 EnumIDList::EnumIDList() {
     this->refCount = 1;
     this->position = 0;
+    this->source = NULL;
     
     InterlockedIncrement(&::objectCounter);
 }
 
 
+/// <summary>
+/// Creates a list which enumerates the items of source, without copying them. The source must
+/// not be added to afterwards.
+/// </summary>
+EnumIDList::EnumIDList(EnumIDList* source) {
+    this->refCount = 1;
+    this->position = 0;
+    this->source = source->source != NULL ? source->source : source;
+    this->source->AddRef();
+
+    InterlockedIncrement(&::objectCounter);
+}
+
+
 /// <summary>
 /// Destructor.
 /// </summary>
 EnumIDList::~EnumIDList() {
-    for (std::vector<PITEMID_CHILD>::iterator iter = this->items.begin(); iter != this->items.end(); ++iter) {
-        CoTaskMemFree(*iter);
+    if (this->source != NULL) {
+        this->source->Release();
+    }
+    else {
+        TRACE(L"EnumIDList: %u items, %u blocks, %u bytes", (ULONG)this->items.size(), this->arena.BlockCount(), this->arena.BytesUsed());
     }
-    this->items.clear();
 
     InterlockedDecrement(&::objectCounter);
 }
@@ -91,11 +108,8 @@ HRESULT EnumIDList::QueryInterface(REFIID riid, void **ppvObject) {
 /// Creates a new item enumeration object with the same contents and state as the current one.
 /// </summary>
 HRESULT EnumIDList::Clone(IEnumIDList **ppenum) {
-    EnumIDList* clone = new EnumIDList();
-
-    for (std::vector<LPITEMIDLIST>::iterator iter = this->items.begin(); iter != this->items.end(); ++iter) {
-        clone->AddItem(PIDL::Copy(*iter));
-    }
+    // Lists are complete by the time they are handed out, so the clone can share our items.
+    EnumIDList* clone = new EnumIDList(this);
     clone->position = this->position;
 
     *ppenum = clone;
@@ -110,10 +124,11 @@ HRESULT EnumIDList::Clone(IEnumIDList **ppenum) {
 /// the current position by the number of items retrieved.
 /// </summary>
 HRESULT EnumIDList::Next(ULONG celt, LPITEMIDLIST *rgelt, ULONG *pceltFetched) {
+    const std::vector<LPITEMIDLIST> &items = Items();
     ULONG fetched = 0;
 
-    for (ULONG i = 0; this->position != this->items.size() && fetched < celt; ++i) {
-        rgelt[i] = PIDL::Copy(this->items[this->position++]);
+    for (ULONG i = 0; this->position != items.size() && fetched < celt; ++i) {
+        rgelt[i] = PIDL::Copy(items[this->position++]);
         ++fetched;
     }
 
@@ -140,25 +155,88 @@ HRESULT EnumIDList::Reset() {
 /// Skips the specified number of elements in the enumeration sequence.
 /// </summary>
 HRESULT EnumIDList::Skip(ULONG celt) {
-    this->position = max((ULONG)this->items.size(), this->position + celt);
+    ULONG count = (ULONG)Items().size();
+
+    if (celt > count - this->position) {
+        this->position = count;
+        return S_FALSE;
+    }
+
+    this->position += celt;
     return S_OK;
 }
 
 
 /// <summary>
 /// EnumIDList::AddItem
-/// Skips the specified number of elements in the enumeration sequence.
+/// Adds an item to the end of the list. Items whose names are already in the list, ignoring case,
+/// are dropped, so the first folder to provide a name wins.
 /// </summary>
-void EnumIDList::AddItem(LPITEMIDLIST item) {
-    // Remove duplicate folders.
-    if (FLAGSET(PIDL::Item(item)->attributes, SFGAO_FOLDER)) {
-        LPCWSTR name = PIDL::Item(item)->name;
-        for (std::vector<LPITEMIDLIST>::const_iterator iter = this->items.begin(); iter != this->items.end(); ++iter) {
-            PIDL::PIDLItem* p = PIDL::Item(*iter);
-            if (FLAGSET(p->attributes, SFGAO_FOLDER) && wcscmp(name, p->name) == 0) {
-                return;
-            }
-        }
+bool EnumIDList::AddItem(LPCWSTR name, SFGAOF attributes, USHORT folder, USHORT knownMembers) {
+    if (this->names.find(name) != this->names.end()) {
+        return false;
+    }
+
+    LPITEMIDLIST item = (LPITEMIDLIST)this->arena.Allocate(PIDL::ChildSize(name, knownMembers));
+    if (item == NULL) {
+        return false;
     }
+    PIDL::Init(item, name, attributes, folder, knownMembers);
+
+    this->names[PIDL::GetName(item)] = item;
     this->items.push_back(item);
+    return true;
+}
+
+
+/// <summary>
+/// EnumIDList::AddItem
+/// Adds a copy of an existing item to the end of the list.
+/// </summary>
+bool EnumIDList::AddItem(PCUITEMID_CHILD item) {
+    if (this->names.find(PIDL::GetName(item)) != this->names.end()) {
+        return false;
+    }
+
+    LPITEMIDLIST copy = (LPITEMIDLIST)this->arena.Allocate(item->mkid.cb + sizeof(USHORT));
+    if (copy == NULL) {
+        return false;
+    }
+    memcpy(copy, item, item->mkid.cb);
+    PIDL::Next(copy)->mkid.cb = 0;
+
+    this->names[PIDL::GetName(copy)] = copy;
+    this->items.push_back(copy);
+    return true;
+}
+
+
+/// <summary>
+/// EnumIDList::AddMember
+/// Records that member has the item with the specified name as well.
+/// </summary>
+void EnumIDList::AddMember(LPCWSTR name, USHORT member) {
+    std::unordered_map<LPCWSTR, LPITEMIDLIST, Name::Hasher, Name::EqualTo>::const_iterator iter = this->names.find(name);
+
+    if (iter != this->names.end()) {
+        PIDL::AddMember(iter->second, member);
+    }
+}
+
+
+/// <summary>
+/// EnumIDList::Size
+/// Returns the approximate number of bytes used by the items, including the name index.
+/// </summary>
+ULONG EnumIDList::Size() {
+    // Each item costs a pointer in the vector, and a node and bucket in the name map.
+    return this->arena.BytesUsed() + ULONG(this->items.size()*(sizeof(LPITEMIDLIST) + 5*sizeof(void*)));
+}
+
+
+/// <summary>
+/// Returns the items being enumerated.
+/// </summary>
+const std::vector<LPITEMIDLIST>& EnumIDList::Items() {
+    return this->source != NULL ? this->source->items : this->items;
 }
@@ -7,11 +7,16 @@
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 #pragma once
 
+#include <unordered_map>
 #include <vector>
 
+#include "Arena.hpp"
+#include "Name.h"
+
 class EnumIDList : public IEnumIDList  {
 public:
     explicit EnumIDList();
+    explicit EnumIDList(EnumIDList* source);
     virtual ~EnumIDList();
 
     // IUnknown
@@ -26,10 +31,29 @@ public:
     STDMETHOD(Skip) (ULONG);
 
     //
-    void AddItem(LPITEMIDLIST item);
+    bool AddItem(LPCWSTR name, SFGAOF attributes, USHORT folder, USHORT knownMembers);
+    bool AddItem(PCUITEMID_CHILD item);
+    void AddMember(LPCWSTR name, USHORT member);
+
+    // The approximate number of bytes used by the items.
+    ULONG Size();
 
 private:
+    // The items being enumerated. Either our own, or those of the list we are a view of.
+    const std::vector<LPITEMIDLIST>& Items();
+
+    // When set, we enumerate the items of this list rather than our own.
+    EnumIDList* source;
+
+    // Backing storage for the items, freed in one go with the list.
+    Arena arena;
+
+    // The items, in enumeration order. These point into the arena.
     std::vector<LPITEMIDLIST> items;
+
+    // The items, by name. Used to drop duplicates. The names point into the items.
+    std::unordered_map<LPCWSTR, LPITEMIDLIST, Name::Hasher, Name::EqualTo> names;
+
     ULONG position;
     ULONG refCount;
 };
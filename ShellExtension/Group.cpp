@@ -8,22 +8,75 @@
 #include <Windows.h>
 #include <Shlobj.h>
 #include <Shlwapi.h>
+#include <ctxtcall.h>
 
+#include "ConfigDiff.h"
+#include "ConfigFile.hpp"
+#include "Debug.h"
+#include "DirectoryTrie.h"
 #include "Group.hpp"
+#include "ListingCache.h"
+#include "Macros.h"
+#include "ParseTask.hpp"
+#include "PIDL.h"
+#include "Settings.h"
+#include "Stats.h"
+#include "Watcher.h"
 
 
+// The handle of this DLL.
+extern HMODULE module;
+
+// The number of in-use objects.
+extern long objectCounter;
+
 // The number of live objects which use this class
 ULONG Group::userCount = 0;
 
-// The currently loaded groups
-std::vector<Group*> Group::groups;
+// Serializes loading and unloading the groups
+SRWLOCK Group::loadLock = SRWLOCK_INIT;
+
+// Set while a load is binding members, and the thread doing it
+bool Group::loading = false;
+DWORD Group::loadingThread = 0;
+
+// Signaled when a load has published its snapshot
+CONDITION_VARIABLE Group::loaded = CONDITION_VARIABLE_INIT;
+
+// Set once the configuration has changed since the groups were loaded
+volatile LONG Group::changed = 0;
+
+// Unloads the groups once they have been unused for Settings::idleTimeout ms
+PTP_TIMER Group::idleTimer = NULL;
+
+// Set while the groups are kept loaded without any users
+bool Group::retained = false;
+
+// The configuration key, and an event which is signaled when anything below it changes
+HKEY Group::configKey = NULL;
+HANDLE Group::configChanged = NULL;
+
+// Signaled when the directory of the configuration file changes
+HANDLE Group::configFileChanged = NULL;
+
+// Set changed when configChanged and configFileChanged are signaled
+PTP_WAIT Group::configWait = NULL;
+PTP_WAIT Group::configFileWait = NULL;
 
 
 /// <summary>
 /// Should be called when a new object which uses groups is created.
 /// </summary>
 void Group::AddUser() {
-    if (InterlockedIncrement(&Group::userCount) == 1) {
+    InterlockedIncrement(&Group::userCount);
+
+    // Usually the groups are loaded and the configuration hasn't changed, which readers can
+    // check side by side.
+    AcquireSRWLockShared(&Group::loadLock);
+    bool current = GroupSnapshot::IsPublished() && Group::changed == 0;
+    ReleaseSRWLockShared(&Group::loadLock);
+
+    if (!current) {
         Load();
     }
 }
@@ -34,60 +87,382 @@ void Group::AddUser() {
 /// </summary>
 void Group::RemoveUser() {
     if (InterlockedDecrement(&Group::userCount) == 0) {
-        // Erase all groups
-        for (std::vector<Group*>::const_iterator group = Group::groups.begin(); group != Group::groups.end(); ++group) {
-            delete *group;
+        GroupSnapshot* unloaded = NULL;
+
+        AcquireSRWLockExclusive(&Group::loadLock);
+
+        // Someone may have started using the groups again while we waited for the lock.
+        if (Group::userCount == 0 && GroupSnapshot::IsPublished()) {
+            if (Settings::idleTimeout == 0) {
+                unloaded = Unload();
+            }
+            else {
+                if (Group::idleTimer == NULL) {
+                    TP_CALLBACK_ENVIRON environment;
+                    InitializeThreadpoolEnvironment(&environment);
+                    SetThreadpoolCallbackLibrary(&environment, ::module);
+                    Group::idleTimer = CreateThreadpoolTimer(OnIdle, NULL, &environment);
+                    DestroyThreadpoolEnvironment(&environment);
+                }
+
+                if (Group::idleTimer != NULL) {
+                    // The groups keep the DLL loaded until the timer has unloaded them.
+                    if (!Group::retained) {
+                        Group::retained = true;
+                        InterlockedIncrement(&::objectCounter);
+                    }
+
+                    ULARGE_INTEGER due;
+                    due.QuadPart = ULONGLONG(-LONGLONG(Settings::idleTimeout)*10000);
+                    FILETIME dueTime;
+                    dueTime.dwLowDateTime = due.LowPart;
+                    dueTime.dwHighDateTime = due.HighPart;
+                    SetThreadpoolTimer(Group::idleTimer, &dueTime, 0, 0);
+                }
+                else {
+                    unloaded = Unload();
+                }
+            }
+        }
+
+        ReleaseSRWLockExclusive(&Group::loadLock);
+
+        if (unloaded != NULL) {
+            unloaded->Release();
+        }
+    }
+}
+
+
+/// <summary>
+/// Unloads the groups, unless someone started using them again while they were idle.
+/// </summary>
+void CALLBACK Group::OnIdle(PTP_CALLBACK_INSTANCE /* instance */, PVOID /* context */, PTP_TIMER timer) {
+    GroupSnapshot* unloaded = NULL;
+
+    AcquireSRWLockExclusive(&Group::loadLock);
+    if (Group::userCount == 0) {
+        unloaded = Unload();
+    }
+    if (Group::retained) {
+        Group::retained = false;
+        InterlockedDecrement(&::objectCounter);
+    }
+    if (Group::userCount == 0) {
+        CloseThreadpoolTimer(timer);
+        Group::idleTimer = NULL;
+    }
+    ReleaseSRWLockExclusive(&Group::loadLock);
+
+    // The members are released in the apartments which bound them, by calls from this one.
+    if (unloaded != NULL) {
+        HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        unloaded->Release();
+        if (SUCCEEDED(hr)) {
+            CoUninitialize();
         }
-        Group::groups.clear();
     }
 }
 
 
 /// <summary>
-/// Loads the groups from the registry.
+/// Drops the loaded groups, and everything derived from them. The load lock must be held. Returns
+/// the snapshot which was loaded, for the caller to Release once it has let go of the lock.
+/// </summary>
+GroupSnapshot* Group::Unload() {
+    // Cached listings refer to the groups by name, and keep the DLL loaded.
+    Watcher::Stop();
+    ListingCache::Clear();
+
+    CloseWait(&Group::configWait);
+    CloseWait(&Group::configFileWait);
+
+    if (Group::configKey != NULL) {
+        RegCloseKey(Group::configKey);
+        Group::configKey = NULL;
+    }
+    if (Group::configFileChanged != NULL) {
+        FindCloseChangeNotification(Group::configFileChanged);
+        Group::configFileChanged = NULL;
+    }
+
+    // The groups go away once the last reference to them does. Releasing members may call into
+    // the apartments which bound them, so it mustn't happen under the load lock.
+    return GroupSnapshot::Publish(NULL);
+}
+
+
+/// <summary>
+/// Records that the configuration has changed, so that the next user reloads it.
+/// </summary>
+void CALLBACK Group::OnConfigurationChanged(PTP_CALLBACK_INSTANCE /* instance */, PVOID /* context */, PTP_WAIT /* wait */, TP_WAIT_RESULT /* result */) {
+    InterlockedExchange(&Group::changed, 1);
+}
+
+
+/// <summary>
+/// Sets changed once handle is signaled, creating the wait if there is none yet.
+/// </summary>
+void Group::StartWait(PTP_WAIT* wait, HANDLE handle) {
+    if (*wait == NULL) {
+        TP_CALLBACK_ENVIRON environment;
+        InitializeThreadpoolEnvironment(&environment);
+        SetThreadpoolCallbackLibrary(&environment, ::module);
+        *wait = CreateThreadpoolWait(OnConfigurationChanged, NULL, &environment);
+        DestroyThreadpoolEnvironment(&environment);
+    }
+
+    if (*wait != NULL) {
+        SetThreadpoolWait(*wait, handle, NULL);
+    }
+}
+
+
+/// <summary>
+/// Stops a wait started by StartWait, so that its handle may be closed.
+/// </summary>
+void Group::StopWait(PTP_WAIT wait) {
+    if (wait != NULL) {
+        SetThreadpoolWait(wait, NULL, NULL);
+        WaitForThreadpoolWaitCallbacks(wait, TRUE);
+    }
+}
+
+
+/// <summary>
+/// Stops and closes a wait started by StartWait.
+/// </summary>
+void Group::CloseWait(PTP_WAIT* wait) {
+    if (*wait != NULL) {
+        StopWait(*wait);
+        CloseThreadpoolWait(*wait);
+        *wait = NULL;
+    }
+}
+
+
+/// <summary>
+/// Arranges for configChanged to be signaled when anything in the configuration changes.
+/// </summary>
+void Group::WatchConfiguration() {
+    StopWait(Group::configWait);
+
+    if (Group::configKey != NULL) {
+        RegCloseKey(Group::configKey);
+        Group::configKey = NULL;
+    }
+
+    if (Group::configChanged == NULL) {
+        Group::configChanged = CreateEventW(NULL, TRUE, FALSE, NULL);
+    }
+    else {
+        ResetEvent(Group::configChanged);
+    }
+
+    if (Group::configChanged == NULL || RegOpenKeyExW(HKEY_CURRENT_USER, L"SOFTWARE\\WinUnionFS", 0, KEY_NOTIFY, &Group::configKey) != ERROR_SUCCESS) {
+        Group::configKey = NULL;
+        return;
+    }
+
+    // The notification must outlive the calling thread, which may be any of Explorer's. Before
+    // Windows 8 it can't, and the worst we get is an unnecessary reload.
+    DWORD filter = REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET;
+    if (RegNotifyChangeKeyValue(Group::configKey, TRUE, filter | REG_NOTIFY_THREAD_AGNOSTIC, Group::configChanged, TRUE) != ERROR_SUCCESS) {
+        RegNotifyChangeKeyValue(Group::configKey, TRUE, filter, Group::configChanged, TRUE);
+    }
+
+    StartWait(&Group::configWait, Group::configChanged);
+}
+
+
+/// <summary>
+/// Arranges for configFileChanged to be signaled when the directory holding the configuration
+/// file changes. Must be called after the settings have been loaded.
+/// </summary>
+void Group::WatchConfigFile() {
+    StopWait(Group::configFileWait);
+
+    if (Group::configFileChanged != NULL) {
+        FindCloseChangeNotification(Group::configFileChanged);
+        Group::configFileChanged = NULL;
+    }
+
+    if (Settings::configFile == NULL) {
+        return;
+    }
+
+    LPWSTR directory = _wcsdup(Settings::configFile);
+    LPWSTR separator = wcsrchr(directory, L'\\');
+    if (separator != NULL) {
+        *separator = L'\0';
+        HANDLE handle = FindFirstChangeNotificationW(directory, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+        if (handle != INVALID_HANDLE_VALUE) {
+            Group::configFileChanged = handle;
+            StartWait(&Group::configFileWait, handle);
+        }
+    }
+    free(directory);
+}
+
+
+/// <summary>
+/// Loads the groups from the configuration file, or from the registry. If groups are loaded
+/// already, only the differences are applied. Members are bound without holding the load lock,
+/// since binding may pump messages which create more users, and only the result is published
+/// under it. One load runs at a time; users which arrive meanwhile keep the groups as they are,
+/// or wait for them if there are none yet.
 /// </summary>
 HRESULT Group::Load() {
-    // HKCU/Software/WinUnionFS/Groups
-    HKEY groupsKey, groupKey, foldersKey;
+    ConfigFile* config = NULL;
+
+    AcquireSRWLockExclusive(&Group::loadLock);
+
+    if (Group::loading) {
+        // The loading thread itself may get here through the messages it pumps.
+        while (Group::loading && !GroupSnapshot::IsPublished() && Group::loadingThread != GetCurrentThreadId()) {
+            SleepConditionVariableSRW(&Group::loaded, &Group::loadLock, INFINITE, 0);
+        }
+        ReleaseSRWLockExclusive(&Group::loadLock);
+        return S_FALSE;
+    }
 
-    if (RegCreateKeyW(HKEY_CURRENT_USER, L"SOFTWARE\\WinUnionFS\\Groups", &groupsKey) != ERROR_SUCCESS) {
+    // Another user may have loaded the groups while we waited for the lock.
+    if (GroupSnapshot::IsPublished() && Group::changed == 0) {
+        ReleaseSRWLockExclusive(&Group::loadLock);
+        return S_FALSE;
+    }
+
+    // Start watching before reading, so that changes made while we read aren't missed.
+    InterlockedExchange(&Group::changed, 0);
+    WatchConfiguration();
+    Settings::Load();
+    WatchConfigFile();
+
+    // Use the configuration file if there is one. If it has been configured, but doesn't exist
+    // yet, it is created from the registry.
+    if (Settings::configFile != NULL) {
+        config = ConfigFile::Map(Settings::configFile);
+        if (config == NULL) {
+            config = ConfigFile::Import();
+            if (config != NULL && FAILED(config->Save(Settings::configFile))) {
+                TRACE(L"Failed to write %s", Settings::configFile);
+            }
+        }
+    }
+    else {
+        config = ConfigFile::Import();
+    }
+
+    if (config == NULL) {
+        if (!GroupSnapshot::IsPublished()) {
+            GroupSnapshot::Publish(new GroupSnapshot());
+        }
+        ReleaseSRWLockExclusive(&Group::loadLock);
         return E_UNEXPECTED;
     }
 
-    DWORD groupIndex = 0, cchName = MAX_PATH;
-    WCHAR name[MAX_PATH];
-    while (RegEnumKeyExW(groupsKey, groupIndex++, name, &cchName, NULL, NULL, NULL, NULL) != ERROR_NO_MORE_ITEMS) {
-        Group* group = new Group(name);
+    // The groups can't be unloaded while we bind, since our caller is one of their users.
+    GroupSnapshot* current = GroupSnapshot::Current();
+    Group::loading = true;
+    Group::loadingThread = GetCurrentThreadId();
+    ReleaseSRWLockExclusive(&Group::loadLock);
 
-        RegCreateKeyW(groupsKey, name, &groupKey);
+    GroupSnapshot* snapshot = Apply(current, config);
+    delete config;
+    if (current != NULL) {
+        current->Release();
+    }
 
-        RegCreateKeyW(groupKey, L"Folders", &foldersKey);
+    AcquireSRWLockExclusive(&Group::loadLock);
+    GroupSnapshot* old = GroupSnapshot::Publish(snapshot);
+    Group::loading = false;
+    Group::loadingThread = 0;
+    ReleaseSRWLockExclusive(&Group::loadLock);
 
-        // Enumerate the folders
-        DWORD folderIndex = 0, cchFolderKeyName = MAX_PATH;
-        WCHAR folderKeyName[MAX_PATH];
-        while (RegEnumKeyExW(foldersKey, folderIndex++, folderKeyName, &cchFolderKeyName, NULL, NULL, NULL, NULL) != ERROR_NO_MORE_ITEMS) {
-            DWORD cbFolderPath = MAX_PATH*sizeof(WCHAR);
-            WCHAR folderPath[MAX_PATH];
+    WakeAllConditionVariable(&Group::loaded);
 
-            RegGetValueW(foldersKey, folderKeyName, L"Path", RRF_RT_REG_SZ, NULL, &folderPath, &cbFolderPath);
+    if (old != NULL) {
+        old->Release();
+    }
+
+    return S_OK;
+}
 
-            group->AddPath(folderPath);
 
-            cchFolderKeyName = MAX_PATH;
+/// <summary>
+/// Builds a snapshot of the groups in config. Groups in current whose members haven't changed are
+/// carried over as they are, along with their bound folders and cached listings. Groups whose
+/// members have changed are rebuilt, reusing the members which are still there. Only the loading
+/// thread may call this, without holding the load lock, and current may be NULL.
+/// </summary>
+GroupSnapshot* Group::Apply(GroupSnapshot* current, ConfigFile* config) {
+    GroupSnapshot* snapshot = new GroupSnapshot();
+    std::vector<ConfigDiff::GroupConfig> before;
+    std::vector<ConfigDiff::GroupConfig> after;
+    std::vector<ConfigDiff::Step> steps;
+
+    if (current != NULL) {
+        before.resize(current->Count());
+        for (size_t i = 0; i < current->Count(); ++i) {
+            Group* group = current->Get(i);
+            before[i].name = group->name;
+            for (std::vector<Member*>::const_iterator member = group->members.begin(); member != group->members.end(); ++member) {
+                before[i].paths.push_back((*member)->path);
+            }
         }
+    }
 
-        RegCloseKey(foldersKey);
+    after.resize(config->GroupCount());
+    for (DWORD i = 0; i < config->GroupCount(); ++i) {
+        after[i].name = config->GroupName(i);
+        for (DWORD j = 0; j < config->MemberCount(i); ++j) {
+            LPCWSTR path = config->MemberPath(i, j);
+            if (path != NULL) {
+                after[i].paths.push_back(path);
+            }
+        }
+    }
+
+    ConfigDiff::Diff(before, after, &steps);
+
+    for (std::vector<ConfigDiff::Step>::const_iterator step = steps.begin(); step != steps.end(); ++step) {
+        if (step->action == ConfigDiff::KEEP) {
+            Group* previous = current->Get(step->before);
+            previous->AddRef();
+            snapshot->Add(previous);
+            Stats::Add(Stats::CONFIG_GROUPS_KEPT, 1);
+        }
+        else if (step->action == ConfigDiff::REMOVE) {
+            // Let go of whatever belonged to groups which are gone.
+            Watcher::Remove(before[step->before].name);
+            ListingCache::Invalidate(before[step->before].name, L"", true);
+        }
+        else {
+            const ConfigDiff::GroupConfig &configured = after[step->after];
+            Group* previous = NULL;
+            Group* group = new Group(configured.name);
+
+            if (step->action == ConfigDiff::REBUILD) {
+                // Member indices are stored in listings and PIDLs, and may have shifted.
+                previous = current->Get(step->before);
+                Watcher::Remove(configured.name);
+                ListingCache::Invalidate(configured.name, L"", true);
+                Stats::Add(Stats::CONFIG_GROUPS_REBUILT, 1);
+            }
 
-        RegCloseKey(groupKey);
+            for (std::vector<LPCWSTR>::const_iterator path = configured.paths.begin(); path != configured.paths.end(); ++path) {
+                group->AddPath(*path, previous);
+            }
 
-        Group::groups.push_back(group);
-        cchName = MAX_PATH;
+            snapshot->Add(group);
+        }
     }
 
-    RegCloseKey(groupsKey);
+    if (current != NULL) {
+        Stats::Add(Stats::CONFIG_RELOADS, 1);
+    }
 
-    return S_OK;
+    return snapshot;
 }
 
 
@@ -95,7 +470,38 @@ HRESULT Group::Load() {
 /// Constructor.
 /// </summary>
 Group::Group(LPCWSTR name) {
+    this->refCount = 1;
     this->name = _wcsdup(name);
+    InitializeSRWLock(&this->bindLock);
+}
+
+
+/// <summary>
+/// Releases the object passed to ContextCallback.
+/// </summary>
+static HRESULT __stdcall ReleaseCallback(ComCallData* data) {
+    ((IUnknown*)data->pUserDefined)->Release();
+    return S_OK;
+}
+
+
+/// <summary>
+/// Releases a member's folder in the context it was bound in. The folder may be apartment
+/// threaded, and the group may be released on any thread, such as the idle timer's. If that
+/// apartment is gone the folder is leaked, as there is no safe way to release it.
+/// </summary>
+static void ReleaseInContext(IShellFolder* folder, IContextCallback* context) {
+    if (context == NULL) {
+        folder->Release();
+        return;
+    }
+
+    ComCallData data = { 0, 0, folder };
+    HRESULT hr = context->ContextCallback(ReleaseCallback, &data, IID_ICallbackWithNoReentrancyToApplicationSTA, 5, NULL);
+    if (FAILED(hr)) {
+        TRACE(L"Failed to release a member in its apartment (%x)", hr);
+    }
+    context->Release();
 }
 
 
@@ -103,90 +509,398 @@ Group::Group(LPCWSTR name) {
 /// Destructor.
 /// </summary>
 Group::~Group() {
-    for (std::vector<IShellFolder*>::const_iterator folder = this->folders.begin(); folder != this->folders.end(); ++folder) {
-        (*folder)->Release();
+    for (std::vector<Member*>::const_iterator member = this->members.begin(); member != this->members.end(); ++member) {
+        if ((*member)->folder != NULL) {
+            ReleaseInContext((*member)->folder, (*member)->context);
+        }
+        CoTaskMemFree((*member)->idList);
+        free((*member)->path);
+        delete *member;
     }
+    this->probeStats.Publish(this->name);
     free((LPVOID)this->name);
 }
 
 
 /// <summary>
-/// Adds a folder to this group.
+/// Increments the reference count.
+/// </summary>
+ULONG Group::AddRef() {
+    return InterlockedIncrement(&this->refCount);
+}
+
+
+/// <summary>
+/// Decrements the reference count, deleting the group when it reaches 0.
+/// </summary>
+ULONG Group::Release() {
+    ULONG refCount = InterlockedDecrement(&this->refCount);
+    if (refCount == 0) {
+        delete this;
+    }
+
+    return refCount;
+}
+
+
+/// <summary>
+/// Adds a folder to this group. If previous has a bound member with the same path, its folder is
+/// shared rather than bound again.
+/// </summary>
+HRESULT Group::AddPath(LPCWSTR path, Group* previous) {
+    Member* member = new Member();
+    member->path = _wcsdup(path);
+    member->idList = NULL;
+    member->folder = NULL;
+    member->context = NULL;
+
+    this->members.push_back(member);
+
+    if (previous != NULL) {
+        AcquireSRWLockShared(&previous->bindLock);
+        for (std::vector<Member*>::const_iterator iter = previous->members.begin(); iter != previous->members.end(); ++iter) {
+            if ((*iter)->folder != NULL && Name::Equal((*iter)->path, path)) {
+                member->idList = ILClone((*iter)->idList);
+                member->folder = (*iter)->folder;
+                member->folder->AddRef();
+                member->context = (*iter)->context;
+                if (member->context != NULL) {
+                    member->context->AddRef();
+                }
+                break;
+            }
+        }
+        ReleaseSRWLockShared(&previous->bindLock);
+
+        if (member->folder != NULL) {
+            Watcher::Add(this->name, member->idList);
+            return S_OK;
+        }
+    }
+
+    return BindMember(member);
+}
+
+
+/// <summary>
+/// Resolves the path of a member which has not been bound yet. Gives up after
+/// Settings::memberTimeout ms, and doesn't try at all while the member's breaker is open.
 /// </summary>
-HRESULT Group::AddPath(LPCWSTR path) {
-    IShellFolder *desktopFolder = NULL, *folder;
+HRESULT Group::BindMember(Member* member) {
     PIDLIST_ABSOLUTE idList = NULL;
+    IShellFolder* folder = NULL;
     HRESULT hr;
 
-    hr = SHGetDesktopFolder(&desktopFolder);
+    if (!member->breaker.Allow()) {
+        Stats::Add(Stats::MEMBER_SKIPPED, 1);
+        return E_ABORT;
+    }
+
+    ParseTask* task = new ParseTask(NULL, member->path);
+    task->Start();
+    hr = task->Finish(Settings::memberTimeout, &idList);
+    task->Release();
 
     if (SUCCEEDED(hr)) {
-        hr = desktopFolder->ParseDisplayName(NULL, NULL, (LPWSTR)path, NULL, &idList, NULL);
+        hr = SHBindToObject(NULL, idList, NULL, IID_IShellFolder, reinterpret_cast<LPVOID*>(&folder));
     }
 
-    if (SUCCEEDED(hr)) {
-        hr = desktopFolder->BindToObject(idList, NULL, IID_IShellFolder, reinterpret_cast<LPVOID*>(&folder));
+    if (FAILED(hr)) {
+        TRACE(L"Failed to bind %s (%x)", member->path, hr);
+        Stats::Add(hr == E_PENDING ? Stats::MEMBER_TIMEOUTS : Stats::MEMBER_FAILURES, 1);
+        member->breaker.Failed();
+        CoTaskMemFree(idList);
+        return hr;
     }
 
-    if (SUCCEEDED(hr)) {
-        this->folders.push_back(folder);
+    member->breaker.Succeeded();
+
+    // The folder belongs to this thread's apartment, and has to be released in it.
+    IContextCallback* context = NULL;
+    if (FAILED(CoGetObjectContext(IID_IContextCallback, reinterpret_cast<LPVOID*>(&context)))) {
+        context = NULL;
     }
 
-    if (idList != NULL) {
+    // Another thread may have bound the member while we were waiting.
+    AcquireSRWLockExclusive(&this->bindLock);
+    if (member->folder == NULL) {
+        member->idList = idList;
+        member->folder = folder;
+        member->context = context;
+        idList = NULL;
+        folder = NULL;
+    }
+    ReleaseSRWLockExclusive(&this->bindLock);
+
+    if (folder != NULL) {
+        folder->Release();
+        if (context != NULL) {
+            context->Release();
+        }
         CoTaskMemFree(idList);
     }
+    else {
+        Watcher::Add(this->name, member->idList);
+    }
+
+    return S_OK;
+}
+
 
-    if (desktopFolder != NULL) {
-        desktopFolder->Release();
+/// <summary>
+/// Gets the folder and ID list of a member which has been bound, and returns true. Returns false if
+/// it hasn't been, or the ID list couldn't be copied. The caller must Release the folder and free
+/// the ID list.
+/// </summary>
+bool Group::GetBoundMember(Member* member, IShellFolder** folder, PIDLIST_ABSOLUTE* idList) {
+    *folder = NULL;
+    *idList = NULL;
+
+    // Both are published together by BindMember, and only under the lock.
+    AcquireSRWLockShared(&this->bindLock);
+    if (member->folder != NULL) {
+        *idList = ILClone(member->idList);
+        if (*idList != NULL) {
+            *folder = member->folder;
+            (*folder)->AddRef();
+        }
     }
+    ReleaseSRWLockShared(&this->bindLock);
 
-    return hr;
+    return *folder != NULL;
 }
 
 
 /// <summary>
-/// Retrives IShellFolder pointers for all folders in this group.
+/// Retrives IShellFolder pointers for all folders in this group. The output has one entry per
+/// member, in order; members which don't contain the path, or didn't respond in time, get NULL.
+/// unanswered gets an entry per member as well, set for the members whose NULL is because they
+/// didn't answer, rather than because they lack the path.
 /// </summary>
-void Group::GetShellFoldersFor(LPCWSTR path, std::vector<IShellFolder*> *out) {
-    PIDLIST_ABSOLUTE idList = NULL;
-    IShellFolder *targetFolder;
+void Group::GetShellFoldersFor(LPCWSTR path, std::vector<IShellFolder*> *out, std::vector<bool> *unanswered) {
+    std::vector<ParseTask*> tasks(this->members.size(), (ParseTask*)NULL);
+    ULONG generation = ListingCache::Generation(this->name);
+
+    // No member had this path a moment ago.
+    if (path[0] != '\0' && ListingCache::IsAbsent(this->name, path)) {
+        out->resize(out->size() + this->members.size(), NULL);
+        unanswered->resize(unanswered->size() + this->members.size(), false);
+        return;
+    }
+
+    // The members which might have the path, even though they didn't say so.
+    std::vector<bool> unsure(this->members.size(), false);
+
+    // Members which are known to lack a folder on the way aren't asked.
+    std::vector<bool> mayHave(this->members.size(), true);
+    DirectoryTrie::Prune(this->name, path, true, &mayHave);
+
+    // Bind any members which were unavailable before, and start parsing the path in all of them at once.
+    std::vector<IShellFolder*> folders(this->members.size(), (IShellFolder*)NULL);
+    for (size_t i = 0; i < this->members.size(); ++i) {
+        Member* member = this->members[i];
+        PIDLIST_ABSOLUTE idList = NULL;
+
+        if (!mayHave[i]) {
+            continue;
+        }
+
+        if (!GetBoundMember(member, &folders[i], &idList) && (FAILED(BindMember(member)) || !GetBoundMember(member, &folders[i], &idList))) {
+            unsure[i] = true;
+            continue;
+        }
+
+        if (path[0] != '\0') {
+            if (member->breaker.Allow()) {
+                tasks[i] = new ParseTask(idList, path);
+                tasks[i]->Start();
+            }
+            else {
+                Stats::Add(Stats::MEMBER_SKIPPED, 1);
+                unsure[i] = true;
+            }
+        }
+
+        CoTaskMemFree(idList);
+    }
+
+    ULONGLONG deadline = GetTickCount64() + Settings::memberTimeout;
+
+    // Only a path which every member answered it lacks is remembered as such.
+    bool absent = true;
+
+    for (size_t i = 0; i < this->members.size(); ++i) {
+        Member* member = this->members[i];
+        IShellFolder* targetFolder = NULL;
 
-    for (std::vector<IShellFolder*>::const_iterator folder = this->folders.begin(); folder != this->folders.end(); ++folder) {
         if (path[0] == '\0') {
-            out->push_back(*folder);
-            (*folder)->AddRef();
+            targetFolder = folders[i];
+            folders[i] = NULL;
         }
-        else {
-            if (SUCCEEDED((*folder)->ParseDisplayName(NULL, NULL, (LPWSTR)path, NULL,  &idList, NULL))) {
-                if (SUCCEEDED((*folder)->BindToObject(idList, NULL, IID_IShellFolder, reinterpret_cast<LPVOID*>(&targetFolder)))) {
-                    out->push_back(targetFolder);
+        else if (tasks[i] != NULL) {
+            PIDLIST_ABSOLUTE idList = NULL;
+            ULONGLONG now = GetTickCount64();
+            HRESULT hr = tasks[i]->Finish(now < deadline ? DWORD(deadline - now) : 0, &idList);
+
+            if (hr == E_PENDING) {
+                TRACE(L"%s did not parse %s in time", member->path, path);
+                Stats::Add(Stats::MEMBER_TIMEOUTS, 1);
+                member->breaker.Failed();
+            }
+            else {
+                member->breaker.Succeeded();
+                if (SUCCEEDED(hr)) {
+                    hr = SHBindToObject(NULL, idList, NULL, IID_IShellFolder, reinterpret_cast<LPVOID*>(&targetFolder));
                 }
-                CoTaskMemFree(idList);
             }
+            if (FAILED(hr) && !NOTFOUND(hr)) {
+                unsure[i] = true;
+            }
+
+            CoTaskMemFree(idList);
+            tasks[i]->Release();
+        }
+
+        if (targetFolder != NULL || unsure[i]) {
+            absent = false;
+        }
+
+        if (folders[i] != NULL) {
+            folders[i]->Release();
         }
+
+        out->push_back(targetFolder);
+        unanswered->push_back(unsure[i]);
+    }
+
+    if (path[0] != '\0' && absent) {
+        ListingCache::StoreAbsent(this->name, path, generation);
     }
 }
 
 
 /// <summary>
-/// Finds an existing group with the specified name.
+/// Retrieves the folders making up the child of a folder whose member folders are parents, one per
+/// member like GetShellFoldersFor. Only the child's name is bound, relative to each parent, so the
+/// cost doesn't grow with depth. Members which the child's PIDL says don't have it aren't asked.
+/// Members which didn't answer for the parent, or don't answer for the child, are set in
+/// unanswered.
 /// </summary>
-Group* Group::Find(LPCWSTR name) {
-    int index = 0;
-    Group* group;
-    while ((group = Find(index++)) != NULL) {
-        if (wcscmp(name, group->name) == 0) {
-            break;
+void Group::GetChildFoldersFor(const std::vector<IShellFolder*> &parents, const std::vector<bool> &parentsUnanswered, PCUITEMID_CHILD child, std::vector<IShellFolder*> *out, std::vector<bool> *unanswered) {
+    LPWSTR name = (LPWSTR)PIDL::GetName(child);
+
+    for (size_t i = 0; i < parents.size(); ++i) {
+        IShellFolder* parent = parents[i];
+        IShellFolder* childFolder = NULL;
+        bool unsure = i < parentsUnanswered.size() && parentsUnanswered[i];
+
+        if (parent != NULL && PIDL::MayHaveMember(child, i)) {
+            if (IsMemberAvailable(i)) {
+                PIDLIST_RELATIVE childIdList = NULL;
+                LONGLONG start = Stats::Now();
+                ULONGLONG started = GetTickCount64();
+
+                HRESULT hr = parent->ParseDisplayName(NULL, NULL, name, NULL, &childIdList, NULL);
+                if (SUCCEEDED(hr)) {
+                    hr = parent->BindToObject(childIdList, NULL, IID_IShellFolder, reinterpret_cast<LPVOID*>(&childFolder));
+                    CoTaskMemFree(childIdList);
+                }
+                if (FAILED(hr) && !NOTFOUND(hr)) {
+                    unsure = true;
+                }
+
+                Stats::Add(Stats::MEMBER_BINDS, 1);
+                Stats::Add(Stats::MEMBER_BIND_TIME, Stats::Now() - start);
+
+                // We can't abandon a call on the caller's own folders, but we can keep a member which
+                // was too slow out of the next ones.
+                if (GetTickCount64() - started > Settings::memberTimeout) {
+                    Stats::Add(Stats::MEMBER_TIMEOUTS, 1);
+                    MemberFailed(i);
+                }
+            }
+            else {
+                Stats::Add(Stats::MEMBER_SKIPPED, 1);
+                unsure = true;
+            }
         }
+
+        out->push_back(childFolder);
+        unanswered->push_back(unsure);
     }
+}
 
-    return group;
+
+/// <summary>
+/// Returns false while the member's circuit breaker is open.
+/// </summary>
+bool Group::IsMemberAvailable(size_t member) {
+    return member < this->members.size() && this->members[member]->breaker.Allow();
 }
 
 
 /// <summary>
-/// Returns group # index if it exists, otherwise NULL.
+/// Records that a member failed to respond in time.
 /// </summary>
-Group* Group::Find(int index) {
-    return index < Group::groups.size() ? Group::groups[index] : NULL;
+void Group::MemberFailed(size_t member) {
+    if (member < this->members.size()) {
+        this->members[member]->breaker.Failed();
+    }
+}
+
+
+/// <summary>
+/// Records that a member responded in time.
+/// </summary>
+void Group::MemberSucceeded(size_t member) {
+    if (member < this->members.size()) {
+        this->members[member]->breaker.Succeeded();
+    }
+}
+
+
+/// <summary>
+/// Fills order with the indices of all members, those which names in the folder at path are most
+/// likely to be found in first.
+/// </summary>
+void Group::GetProbeOrder(LPCWSTR path, std::vector<size_t> *order) {
+    this->probeStats.GetOrder(path, this->members.size(), order);
+}
+
+
+/// <summary>
+/// Records that a member was asked for a name in the folder at path, and whether it had it.
+/// </summary>
+void Group::ProbeFinished(LPCWSTR path, size_t member, bool found, LONGLONG time) {
+    this->probeStats.Record(path, member, found, time);
+    Stats::Add(Stats::PROBES, 1);
+    Stats::Add(Stats::PROBE_TIME, time);
+}
+
+
+/// <summary>
+/// Writes where names have been found in the group to the registry, with the process-wide counters.
+/// </summary>
+void Group::PublishStats() {
+    this->probeStats.Publish(this->name);
+}
+
+
+/// <summary>
+/// Finds an existing group with the specified name, ignoring case. The caller must Release the
+/// group. Returns NULL if there is none.
+/// </summary>
+Group* Group::Find(LPCWSTR name) {
+    GroupSnapshot* snapshot = GroupSnapshot::Current();
+    Group* group = NULL;
+
+    if (snapshot != NULL) {
+        group = snapshot->Find(name);
+        if (group != NULL) {
+            group->AddRef();
+        }
+        snapshot->Release();
+    }
+
+    return group;
 }
@@ -9,6 +9,13 @@
 
 #include <vector>
 
+#include "Breaker.hpp"
+#include "GroupSnapshot.hpp"
+#include "ProbeStats.hpp"
+
+class ConfigFile;
+struct IContextCallback;
+
 class Group
 {
 public:
@@ -19,23 +26,89 @@ public:
     static Group* Create(LPCWSTR name);
     static void Delete(LPCWSTR name);
     static Group* Find(LPCWSTR name);
-    static Group* Find(int index);
+
+    // Reference counting
+    ULONG AddRef();
+    ULONG Release();
 
     // Instance methods
-    void GetShellFoldersFor(LPCWSTR path, std::vector<IShellFolder*> *out);
+    void GetShellFoldersFor(LPCWSTR path, std::vector<IShellFolder*> *out, std::vector<bool> *unanswered);
+    void GetChildFoldersFor(const std::vector<IShellFolder*> &parents, const std::vector<bool> &parentsUnanswered, PCUITEMID_CHILD child, std::vector<IShellFolder*> *out, std::vector<bool> *unanswered);
+
+    // Circuit breakers of the members, by index.
+    bool IsMemberAvailable(size_t member);
+    void MemberFailed(size_t member);
+    void MemberSucceeded(size_t member);
+
+    // Which members names in the folder at path are likely to be found in.
+    void GetProbeOrder(LPCWSTR path, std::vector<size_t> *order);
+    void ProbeFinished(LPCWSTR path, size_t member, bool found, LONGLONG time);
+    void PublishStats();
 
     // The name of the group
     LPCWSTR name;
 
 private:
+    // A folder which is part of this group.
+    typedef struct {
+        // The path as configured.
+        LPWSTR path;
+
+        // The bound folder and its absolute ID list, NULL until the path has been resolved.
+        PIDLIST_ABSOLUTE idList;
+        IShellFolder* folder;
+
+        // The context the folder was bound in, which it must be released in.
+        IContextCallback* context;
+
+        // Keeps us from retrying a member which failed to respond in time.
+        Breaker breaker;
+    } Member;
+
     //
     static HRESULT Load();
+    static GroupSnapshot* Apply(GroupSnapshot* current, ConfigFile* config);
+    static GroupSnapshot* Unload();
+    static void WatchConfiguration();
+    static void WatchConfigFile();
+    static void StartWait(PTP_WAIT* wait, HANDLE handle);
+    static void StopWait(PTP_WAIT wait);
+    static void CloseWait(PTP_WAIT* wait);
+    static void CALLBACK OnConfigurationChanged(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WAIT wait, TP_WAIT_RESULT result);
+    static void CALLBACK OnIdle(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_TIMER timer);
 
     // The number of live objects which use this class
     static ULONG userCount;
 
-    // The currently loaded groups
-    static std::vector<Group*> groups;
+    // Serializes loading and unloading the groups
+    static SRWLOCK loadLock;
+
+    // Set while a load is binding members, and the thread doing it
+    static bool loading;
+    static DWORD loadingThread;
+
+    // Signaled when a load has published its snapshot
+    static CONDITION_VARIABLE loaded;
+
+    // Set once the configuration has changed since the groups were loaded
+    static volatile LONG changed;
+
+    // Unloads the groups once they have been unused for Settings::idleTimeout ms
+    static PTP_TIMER idleTimer;
+
+    // Set while the groups are kept loaded without any users
+    static bool retained;
+
+    // The configuration key, and an event which is signaled when anything below it changes
+    static HKEY configKey;
+    static HANDLE configChanged;
+
+    // Signaled when the directory of the configuration file changes
+    static HANDLE configFileChanged;
+
+    // Set changed when configChanged and configFileChanged are signaled
+    static PTP_WAIT configWait;
+    static PTP_WAIT configFileWait;
 
 
     // Constructor/Destructor
@@ -43,8 +116,18 @@ private:
     virtual ~Group();
     
     // Instance methods
-    HRESULT AddPath(LPCWSTR path);
+    HRESULT AddPath(LPCWSTR path, Group* previous);
+    HRESULT BindMember(Member* member);
+    bool GetBoundMember(Member* member, IShellFolder** folder, PIDLIST_ABSOLUTE* idList);
+
+    // The folders which make up this group, in order of precedence
+    std::vector<Member*> members;
+
+    // Guards the folder and ID list of members, which are published together once bound.
+    SRWLOCK bindLock;
+
+    // Where names have been found, by member and subtree.
+    ProbeStats probeStats;
 
-    // The IShellFolders which make up this group
-    std::vector<IShellFolder*> folders;
+    ULONG refCount;
 };
@@ -0,0 +1,136 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  GroupSnapshot.cpp
+ *  The WinUnionFS Project
+ *
+ *  An immutable set of loaded groups. A snapshot is built completely before
+ *  it is published, and never changes afterwards, so any number of threads
+ *  can read it without locking for as long as they hold a reference.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include "Group.hpp"
+#include "GroupSnapshot.hpp"
+
+
+// The snapshot readers get, NULL while none is published.
+GroupSnapshot* GroupSnapshot::current = NULL;
+
+// Guards reading and swapping the current pointer. Readers hold it just long enough to take a
+// reference, so the old snapshot can't be deleted between reading the pointer and the AddRef.
+SRWLOCK GroupSnapshot::currentLock = SRWLOCK_INIT;
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+GroupSnapshot::GroupSnapshot() {
+    this->refCount = 1;
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+GroupSnapshot::~GroupSnapshot() {
+    for (std::vector<Group*>::const_iterator group = this->groups.begin(); group != this->groups.end(); ++group) {
+        (*group)->Release();
+    }
+}
+
+
+/// <summary>
+/// Returns the published snapshot, which the caller must Release, or NULL if none is published.
+/// </summary>
+GroupSnapshot* GroupSnapshot::Current() {
+    AcquireSRWLockShared(&GroupSnapshot::currentLock);
+    GroupSnapshot* snapshot = GroupSnapshot::current;
+    if (snapshot != NULL) {
+        snapshot->AddRef();
+    }
+    ReleaseSRWLockShared(&GroupSnapshot::currentLock);
+
+    return snapshot;
+}
+
+
+/// <summary>
+/// Returns whether a snapshot is published.
+/// </summary>
+bool GroupSnapshot::IsPublished() {
+    AcquireSRWLockShared(&GroupSnapshot::currentLock);
+    bool published = GroupSnapshot::current != NULL;
+    ReleaseSRWLockShared(&GroupSnapshot::currentLock);
+
+    return published;
+}
+
+
+/// <summary>
+/// Replaces the published snapshot, taking over the caller's reference. Readers which hold the
+/// old one keep using it until they let go. Returns the old snapshot, for the caller to Release.
+/// </summary>
+GroupSnapshot* GroupSnapshot::Publish(GroupSnapshot* snapshot) {
+    AcquireSRWLockExclusive(&GroupSnapshot::currentLock);
+    GroupSnapshot* old = GroupSnapshot::current;
+    GroupSnapshot::current = snapshot;
+    ReleaseSRWLockExclusive(&GroupSnapshot::currentLock);
+
+    return old;
+}
+
+
+/// <summary>
+/// Increments the reference count.
+/// </summary>
+ULONG GroupSnapshot::AddRef() {
+    return InterlockedIncrement(&this->refCount);
+}
+
+
+/// <summary>
+/// Decrements the reference count, deleting the snapshot when it reaches 0.
+/// </summary>
+ULONG GroupSnapshot::Release() {
+    ULONG refCount = InterlockedDecrement(&this->refCount);
+    if (refCount == 0) {
+        delete this;
+    }
+
+    return refCount;
+}
+
+
+/// <summary>
+/// Adds a group to the end of the snapshot. The snapshot takes over the caller's reference.
+/// </summary>
+void GroupSnapshot::Add(Group* group) {
+    this->groups.push_back(group);
+    this->groupsByName[group->name] = group;
+}
+
+
+/// <summary>
+/// Finds the group with the specified name, ignoring case. Returns NULL if there is none.
+/// </summary>
+Group* GroupSnapshot::Find(LPCWSTR name) const {
+    std::unordered_map<LPCWSTR, Group*, Name::Hasher, Name::EqualTo>::const_iterator group = this->groupsByName.find(name);
+    return group != this->groupsByName.end() ? group->second : NULL;
+}
+
+
+/// <summary>
+/// Returns group # index if it exists, otherwise NULL.
+/// </summary>
+Group* GroupSnapshot::Get(size_t index) const {
+    return index < this->groups.size() ? this->groups[index] : NULL;
+}
+
+
+/// <summary>
+/// Returns the number of groups.
+/// </summary>
+size_t GroupSnapshot::Count() const {
+    return this->groups.size();
+}
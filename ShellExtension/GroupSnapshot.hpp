@@ -0,0 +1,55 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  GroupSnapshot.hpp
+ *  The WinUnionFS Project
+ *
+ *  An immutable set of loaded groups.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "Name.h"
+
+class Group;
+
+class GroupSnapshot {
+public:
+    explicit GroupSnapshot();
+
+    // Returns the published snapshot, which the caller must Release, or NULL if there is none.
+    static GroupSnapshot* Current();
+    static bool IsPublished();
+
+    // Replaces the published snapshot, taking over the caller's reference. Returns the old one.
+    static GroupSnapshot* Publish(GroupSnapshot* snapshot);
+
+    ULONG AddRef();
+    ULONG Release();
+
+    // Adds a group, taking over the caller's reference. Only while the snapshot is being built.
+    void Add(Group* group);
+
+    // The groups returned are only valid while the snapshot is referenced.
+    Group* Find(LPCWSTR name) const;
+    Group* Get(size_t index) const;
+    size_t Count() const;
+
+private:
+    virtual ~GroupSnapshot();
+
+    // The snapshot readers get, NULL while none is published.
+    static GroupSnapshot* current;
+
+    // Guards reading and swapping the current pointer.
+    static SRWLOCK currentLock;
+
+    // The groups, in the order they were loaded.
+    std::vector<Group*> groups;
+
+    // The groups, by name, ignoring case.
+    std::unordered_map<LPCWSTR, Group*, Name::Hasher, Name::EqualTo> groupsByName;
+
+    ULONG refCount;
+};
@@ -0,0 +1,424 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ListingCache.cpp
+ *  The WinUnionFS Project
+ *
+ *  Keeps recently merged folder listings, so that returning to a folder does
+ *  not enumerate every member again.
+ *
+ *  Listings are keyed by the enumeration flags, the group name and the path
+ *  within the group, ignoring case. The cache is bounded by Settings::cacheSize
+ *  bytes, evicting the least recently used listing first, and every listing
+ *  expires Settings::cacheTimeout ms after it was stored.
+ *
+ *  The Bloom filters of the names in each member folder are kept alongside
+ *  the listings they were built from, under the same rules, as are the paths
+ *  which turned out not to exist in any member. Invalidations are passed on
+ *  to the DirectoryTrie as well.
+ *
+ *  Each group has a generation of its own, which changes whenever anything
+ *  in it is invalidated. Entries read before an invalidation of their group
+ *  are not stored, while other groups carry on unaffected.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+#include <strsafe.h>
+
+#include <list>
+#include <unordered_map>
+
+#include "BloomFilter.hpp"
+#include "DirectoryTrie.h"
+#include "EnumIDList.hpp"
+#include "ListingCache.h"
+#include "Name.h"
+#include "Settings.h"
+#include "Stats.h"
+
+
+// A cached listing, filter, or absent path.
+typedef struct {
+    // Flags, group and path, as built by MakeKey.
+    LPWSTR key;
+
+    // The listing. Served through views, so it is never added to once stored.
+    EnumIDList* list;
+
+    // The member filters, for entries which hold filters rather than listings. Entries for absent
+    // paths hold neither.
+    BloomFilter* filter;
+
+    // The number of bytes charged against the budget for this entry.
+    ULONG size;
+
+    // When the listing expires, in GetTickCount64 time.
+    ULONGLONG expires;
+} Entry;
+
+typedef std::list<Entry> EntryList;
+typedef std::unordered_map<LPCWSTR, EntryList::iterator, Name::Hasher, Name::EqualTo> EntryMap;
+
+// The listings, most recently used first.
+static EntryList entries;
+
+// The listings, by key.
+static EntryMap byKey;
+
+// The number of bytes charged for all listings.
+static ULONG bytesUsed = 0;
+
+typedef std::unordered_map<LPCWSTR, ULONG, Name::Hasher, Name::EqualTo> GenerationMap;
+
+// Incremented by every invalidation. Each group's generation is the value this had when it was
+// last invalidated, or when everything was, so a busy group doesn't hold up the others.
+static ULONG generation = 0;
+static ULONG clearedGeneration = 0;
+static GenerationMap generations;
+
+// Guards everything above.
+static SRWLOCK lock = SRWLOCK_INIT;
+
+// The number of characters used for the flags at the start of a key, including the separator.
+#define FLAGS_LENGTH 9
+
+// Takes the place of the flags in the keys of filters. Flags are always hexadecimal.
+#define FILTER_KIND L"*FILTER*"
+#define ABSENT_KIND L"*ABSENT*"
+
+
+/// <summary>
+/// Builds the key of an entry, in the form Kind:Group\Path, where kind is 8 characters long. The
+/// caller must delete [] it.
+/// </summary>
+static LPWSTR MakeKey(LPCWSTR group, LPCWSTR path, LPCWSTR kind) {
+    size_t cchKey = FLAGS_LENGTH + wcslen(group) + 1 + wcslen(path) + 1;
+    LPWSTR key = new WCHAR[cchKey];
+
+    if (*path != L'\0') {
+        StringCchPrintfW(key, cchKey, L"%s:%s\\%s", kind, group, path);
+    }
+    else {
+        StringCchPrintfW(key, cchKey, L"%s:%s", kind, group);
+    }
+
+    return key;
+}
+
+
+/// <summary>
+/// Builds the key of a listing, in the form FFFFFFFF:Group\Path. The caller must delete [] it.
+/// </summary>
+static LPWSTR MakeKey(LPCWSTR group, LPCWSTR path, SHCONTF flags) {
+    WCHAR kind[FLAGS_LENGTH];
+    StringCchPrintfW(kind, FLAGS_LENGTH, L"%08X", flags);
+
+    return MakeKey(group, path, kind);
+}
+
+
+/// <summary>
+/// Returns true if the path part of the key is prefix, or lies below it when below is set.
+/// </summary>
+static bool IsAtOrBelow(LPCWSTR key, LPCWSTR prefix, bool below) {
+    LPCWSTR path = key + FLAGS_LENGTH;
+
+    for (; *prefix != L'\0'; ++prefix, ++path) {
+        if (Name::Fold(*prefix) != Name::Fold(*path)) {
+            return false;
+        }
+    }
+
+    return *path == L'\0' || (below && *path == L'\\');
+}
+
+
+/// <summary>
+/// Returns the generation of the group. The lock must be held.
+/// </summary>
+static ULONG GroupGeneration(LPCWSTR group) {
+    GenerationMap::const_iterator iter = generations.find(group);
+
+    return iter != generations.end() ? max(iter->second, clearedGeneration) : clearedGeneration;
+}
+
+
+/// <summary>
+/// Removes an entry. The lock must be held exclusively.
+/// </summary>
+static void Remove(EntryList::iterator entry) {
+    byKey.erase(entry->key);
+    bytesUsed -= entry->size;
+    if (entry->list != NULL) {
+        entry->list->Release();
+    }
+    if (entry->filter != NULL) {
+        entry->filter->Release();
+    }
+    delete [] entry->key;
+    entries.erase(entry);
+}
+
+
+/// <summary>
+/// Adds an entry, replacing any previous one with the same key, and evicts the least recently used
+/// entries until the cache is back within its budget. Takes ownership of the key, and a reference
+/// to the list or filter, if any. Nothing is added if something in the group was invalidated since
+/// generation was read.
+/// </summary>
+static void Insert(LPCWSTR group, LPWSTR key, ULONG generation, EnumIDList* list, BloomFilter* filter) {
+    ULONG size = ULONG(sizeof(WCHAR)*(wcslen(key) + 1) + sizeof(Entry));
+    if (list != NULL) {
+        size += list->Size();
+    }
+    if (filter != NULL) {
+        size += filter->Size();
+    }
+
+    // An entry which would take up more than the whole budget would just evict everything.
+    if (size > Settings::cacheSize) {
+        delete [] key;
+        return;
+    }
+
+    AcquireSRWLockExclusive(&lock);
+    if (generation != GroupGeneration(group)) {
+        ReleaseSRWLockExclusive(&lock);
+        delete [] key;
+        return;
+    }
+
+    EntryMap::iterator iter = byKey.find(key);
+    if (iter != byKey.end()) {
+        Remove(iter->second);
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.list = list;
+    entry.filter = filter;
+    entry.size = size;
+    entry.expires = GetTickCount64() + Settings::cacheTimeout;
+
+    if (list != NULL) {
+        list->AddRef();
+    }
+    if (filter != NULL) {
+        filter->AddRef();
+    }
+    entries.push_front(entry);
+    byKey[key] = entries.begin();
+    bytesUsed += size;
+
+    while (bytesUsed > Settings::cacheSize) {
+        Remove(--entries.end());
+        Stats::Add(Stats::CACHE_EVICTIONS, 1);
+    }
+    ReleaseSRWLockExclusive(&lock);
+}
+
+
+/// <summary>
+/// Retrieves a cached listing. Returns false if there is none, or it has expired.
+/// </summary>
+bool ListingCache::Lookup(LPCWSTR group, LPCWSTR path, SHCONTF flags, IEnumIDList **ppenumIDList) {
+    if (Settings::cacheSize == 0) {
+        return false;
+    }
+
+    LPWSTR key = MakeKey(group, path, flags);
+    bool found = false;
+
+    AcquireSRWLockExclusive(&lock);
+    EntryMap::iterator iter = byKey.find(key);
+    if (iter != byKey.end()) {
+        EntryList::iterator entry = iter->second;
+
+        if (GetTickCount64() < entry->expires) {
+            entries.splice(entries.begin(), entries, entry);
+            *ppenumIDList = new EnumIDList(entry->list);
+            found = true;
+        }
+        else {
+            Remove(entry);
+        }
+    }
+    ReleaseSRWLockExclusive(&lock);
+
+    delete [] key;
+
+    Stats::Add(found ? Stats::CACHE_HITS : Stats::CACHE_MISSES, 1);
+
+    return found;
+}
+
+
+/// <summary>
+/// Stores a complete listing, replacing any previous one. The listing is not stored if something
+/// was invalidated since generation was read.
+/// </summary>
+void ListingCache::Store(LPCWSTR group, LPCWSTR path, SHCONTF flags, ULONG generation, EnumIDList* list) {
+    if (Settings::cacheSize == 0) {
+        return;
+    }
+
+    Insert(group, MakeKey(group, path, flags), generation, list, NULL);
+}
+
+
+/// <summary>
+/// Retrieves the member filters of a folder, which the caller must Release. Returns NULL if there
+/// are none, or they have expired.
+/// </summary>
+BloomFilter* ListingCache::LookupFilter(LPCWSTR group, LPCWSTR path) {
+    if (Settings::cacheSize == 0) {
+        return NULL;
+    }
+
+    LPWSTR key = MakeKey(group, path, FILTER_KIND);
+    BloomFilter* filter = NULL;
+
+    AcquireSRWLockExclusive(&lock);
+    EntryMap::iterator iter = byKey.find(key);
+    if (iter != byKey.end()) {
+        EntryList::iterator entry = iter->second;
+
+        if (GetTickCount64() < entry->expires) {
+            entries.splice(entries.begin(), entries, entry);
+            filter = entry->filter;
+            filter->AddRef();
+        }
+        else {
+            Remove(entry);
+        }
+    }
+    ReleaseSRWLockExclusive(&lock);
+
+    delete [] key;
+
+    return filter;
+}
+
+
+/// <summary>
+/// Stores the member filters of a folder, built from a complete listing of everything in it. The
+/// filters are not stored if something was invalidated since generation was read.
+/// </summary>
+void ListingCache::StoreFilter(LPCWSTR group, LPCWSTR path, ULONG generation, BloomFilter* filter) {
+    if (Settings::cacheSize == 0) {
+        return;
+    }
+
+    Insert(group, MakeKey(group, path, FILTER_KIND), generation, NULL, filter);
+}
+
+
+/// <summary>
+/// Returns true if the path within the group was recently found not to exist in any member.
+/// </summary>
+bool ListingCache::IsAbsent(LPCWSTR group, LPCWSTR path) {
+    if (Settings::cacheSize == 0) {
+        return false;
+    }
+
+    LPWSTR key = MakeKey(group, path, ABSENT_KIND);
+    bool found = false;
+
+    AcquireSRWLockExclusive(&lock);
+    EntryMap::iterator iter = byKey.find(key);
+    if (iter != byKey.end()) {
+        EntryList::iterator entry = iter->second;
+
+        if (GetTickCount64() < entry->expires) {
+            entries.splice(entries.begin(), entries, entry);
+            found = true;
+        }
+        else {
+            Remove(entry);
+        }
+    }
+    ReleaseSRWLockExclusive(&lock);
+
+    delete [] key;
+
+    Stats::Add(found ? Stats::ABSENT_HITS : Stats::ABSENT_MISSES, 1);
+
+    return found;
+}
+
+
+/// <summary>
+/// Records that no member has the path within the group. Nothing is recorded if something was
+/// invalidated since generation was read.
+/// </summary>
+void ListingCache::StoreAbsent(LPCWSTR group, LPCWSTR path, ULONG generation) {
+    if (Settings::cacheSize == 0) {
+        return;
+    }
+
+    Insert(group, MakeKey(group, path, ABSENT_KIND), generation, NULL, NULL);
+    Stats::Add(Stats::ABSENT_STORES, 1);
+}
+
+
+/// <summary>
+/// Drops the listings of the folder at path within the group, and of every folder below it if
+/// below is set. Absent paths are dropped by any change above them, as whatever was created may
+/// be one of the folders they lie in.
+/// </summary>
+void ListingCache::Invalidate(LPCWSTR group, LPCWSTR path, bool below) {
+    LPWSTR prefix = MakeKey(group, path, SHCONTF(0));
+
+    AcquireSRWLockExclusive(&lock);
+    GenerationMap::iterator iter = generations.find(group);
+    if (iter == generations.end()) {
+        iter = generations.insert(GenerationMap::value_type(_wcsdup(group), 0)).first;
+    }
+    iter->second = ++::generation;
+
+    for (EntryList::iterator entry = entries.begin(); entry != entries.end();) {
+        EntryList::iterator next = entry;
+        ++next;
+        bool absent = wcsncmp(entry->key, ABSENT_KIND, FLAGS_LENGTH - 1) == 0;
+        if (IsAtOrBelow(entry->key, prefix + FLAGS_LENGTH, below || absent)) {
+            Remove(entry);
+            Stats::Add(Stats::CACHE_INVALIDATIONS, 1);
+        }
+        entry = next;
+    }
+    ReleaseSRWLockExclusive(&lock);
+
+    delete [] prefix;
+
+    DirectoryTrie::Invalidate(group, path, below);
+}
+
+
+/// <summary>
+/// Drops all listings, and invalidates every group.
+/// </summary>
+void ListingCache::Clear() {
+    AcquireSRWLockExclusive(&lock);
+    clearedGeneration = ++::generation;
+    for (GenerationMap::const_iterator iter = generations.begin(); iter != generations.end(); ++iter) {
+        free((LPVOID)iter->first);
+    }
+    generations.clear();
+    while (!entries.empty()) {
+        Remove(entries.begin());
+    }
+    ReleaseSRWLockExclusive(&lock);
+
+    DirectoryTrie::Clear();
+}
+
+
+/// <summary>
+/// Returns the current invalidation generation of the group.
+/// </summary>
+ULONG ListingCache::Generation(LPCWSTR group) {
+    AcquireSRWLockShared(&lock);
+    ULONG generation = GroupGeneration(group);
+    ReleaseSRWLockShared(&lock);
+
+    return generation;
+}
@@ -0,0 +1,35 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ListingCache.h
+ *  The WinUnionFS Project
+ *
+ *  Keeps recently merged folder listings, so that returning to a folder does
+ *  not enumerate every member again.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+class BloomFilter;
+class EnumIDList;
+
+namespace ListingCache {
+    bool Lookup(LPCWSTR group, LPCWSTR path, SHCONTF flags, IEnumIDList **ppenumIDList);
+    void Store(LPCWSTR group, LPCWSTR path, SHCONTF flags, ULONG generation, EnumIDList* list);
+
+    // The names each member has in the folder at path, kept and invalidated like the listings.
+    // The caller must Release the filter returned by LookupFilter.
+    BloomFilter* LookupFilter(LPCWSTR group, LPCWSTR path);
+    void StoreFilter(LPCWSTR group, LPCWSTR path, ULONG generation, BloomFilter* filter);
+
+    // Paths which no member has, so that looking for them again doesn't ask every member. They are
+    // dropped by any change in or above the folder they would be in.
+    bool IsAbsent(LPCWSTR group, LPCWSTR path);
+    void StoreAbsent(LPCWSTR group, LPCWSTR path, ULONG generation);
+
+    // Drops the listings of the folder at path, and optionally of everything below it.
+    void Invalidate(LPCWSTR group, LPCWSTR path, bool below);
+    void Clear();
+
+    // Changes whenever listings in the group are invalidated. Listings which were started before
+    // an invalidation of their group are not stored.
+    ULONG Generation(LPCWSTR group);
+}
@@ -8,3 +8,6 @@
 #pragma once
 
 #define FLAGSET(var,flag) (((var) & (flag)) == (flag))
+
+// True for the errors a folder returns for names it doesn't have.
+#define NOTFOUND(hr) ((hr) == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) || (hr) == HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND))
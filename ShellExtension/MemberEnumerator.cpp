@@ -0,0 +1,396 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  MemberEnumerator.cpp
+ *  The WinUnionFS Project
+ *
+ *  Enumerates one member folder of a group, in batches. Each batch costs one
+ *  IEnumIDList::Next call and a GetDisplayNameOf per item, followed by one
+ *  IShellFolder::GetAttributesOf call for each kind of item in the batch.
+ *  Items are never asked for their attributes one at a time, unless they are
+ *  outside the file system.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+#include <Shlobj.h>
+#include <Shlwapi.h>
+
+#include "Macros.h"
+#include "MemberEnumerator.hpp"
+#include "Settings.h"
+#include "Stats.h"
+
+
+// The most batches a worker reads ahead of the caller before it waits for them to be taken.
+#define MAX_QUEUED_BATCHES 4
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+MemberEnumerator::MemberEnumerator(IShellFolder* folder, HWND hwndOwner, SHCONTF flags) : Task(false) {
+    this->folder = folder;
+    this->folder->AddRef();
+    this->idList = NULL;
+    this->hwndOwner = hwndOwner;
+    this->pass = 0;
+    this->enumerator = NULL;
+    this->started = false;
+    this->finished = false;
+    this->cancelled = 0;
+    this->available = CreateEventW(NULL, FALSE, FALSE, NULL);
+    this->drained = CreateEventW(NULL, FALSE, FALSE, NULL);
+    InitializeSRWLock(&this->lock);
+
+    if (FLAGSET(flags, SHCONTF_FOLDERS)) {
+        this->passes.push_back(flags & ~SHCONTF_NONFOLDERS);
+    }
+    if (FLAGSET(flags, SHCONTF_NONFOLDERS)) {
+        this->passes.push_back(flags & ~SHCONTF_FOLDERS);
+    }
+    if (this->passes.empty()) {
+        this->passes.push_back(flags);
+    }
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+MemberEnumerator::~MemberEnumerator() {
+    for (std::deque<Batch*>::const_iterator batch = this->batches.begin(); batch != this->batches.end(); ++batch) {
+        delete *batch;
+    }
+    if (this->enumerator != NULL) {
+        this->enumerator->Release();
+    }
+    if (this->idList != NULL) {
+        CoTaskMemFree(this->idList);
+    }
+    if (this->available != NULL) {
+        CloseHandle(this->available);
+    }
+    if (this->drained != NULL) {
+        CloseHandle(this->drained);
+    }
+    if (this->folder != NULL) {
+        this->folder->Release();
+    }
+}
+
+
+/// <summary>
+/// Starts reading the folder on the worker pool.
+/// </summary>
+void MemberEnumerator::Start() {
+    if (this->available != NULL && this->drained != NULL && SUCCEEDED(SHGetIDListFromObject(this->folder, &this->idList))) {
+        this->started = Submit();
+    }
+
+    // The worker binds its own copy of the folder, and the last reference to this object may well be
+    // released on the worker. Let go of the caller's folder while we are still on its thread.
+    if (this->started) {
+        this->folder->Release();
+        this->folder = NULL;
+    }
+}
+
+
+/// <summary>
+/// Asks a running enumeration to stop after the current batch.
+/// </summary>
+void MemberEnumerator::Cancel() {
+    InterlockedExchange(&this->cancelled, 1);
+    if (this->drained != NULL) {
+        SetEvent(this->drained);
+    }
+}
+
+
+/// <summary>
+/// Retrieves the next batch, waiting up to timeout ms for the worker to produce it. Time spent
+/// waiting for a free worker doesn't count against the member.
+/// </summary>
+HRESULT MemberEnumerator::NextBatch(DWORD timeout, Batch **batch) {
+    if (!this->started) {
+        *batch = ReadBatch(this->folder, this->hwndOwner);
+        return *batch != NULL ? S_OK : S_FALSE;
+    }
+
+    if (!WaitStarted(timeout*Task::queueDeadlines)) {
+        *batch = NULL;
+        return E_PENDING;
+    }
+
+    ULONGLONG deadline = GetTickCount64() + timeout;
+
+    for (;;) {
+        bool finished;
+
+        *batch = NULL;
+
+        AcquireSRWLockExclusive(&this->lock);
+        if (!this->batches.empty()) {
+            *batch = this->batches.front();
+            this->batches.pop_front();
+        }
+        finished = this->finished;
+        ReleaseSRWLockExclusive(&this->lock);
+
+        if (*batch != NULL) {
+            SetEvent(this->drained);
+            return S_OK;
+        }
+        if (finished) {
+            return S_FALSE;
+        }
+
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline || !Task::WaitFor(this->available, DWORD(deadline - now))) {
+            return E_PENDING;
+        }
+    }
+}
+
+
+/// <summary>
+/// Task::Execute
+/// Binds the folder on this worker thread and reads it until it is exhausted or cancelled. The
+/// worker stays at most MAX_QUEUED_BATCHES ahead of the caller, so that a listing nobody reads
+/// doesn't pile up in memory, or keep a slow folder busy.
+/// </summary>
+void MemberEnumerator::Execute() {
+    IShellFolder *desktopFolder = NULL, *folder = NULL;
+
+    if (SUCCEEDED(SHGetDesktopFolder(&desktopFolder))) {
+        if (this->idList->mkid.cb == 0) {
+            folder = desktopFolder;
+            folder->AddRef();
+        }
+        else {
+            desktopFolder->BindToObject(this->idList, NULL, IID_IShellFolder, reinterpret_cast<LPVOID*>(&folder));
+        }
+        desktopFolder->Release();
+    }
+
+    if (folder != NULL) {
+        Batch* batch;
+
+        // No UI may be shown from a worker thread, so no owner window is passed on.
+        while (this->cancelled == 0 && (batch = ReadBatch(folder, NULL)) != NULL) {
+            bool full;
+
+            AcquireSRWLockExclusive(&this->lock);
+            this->batches.push_back(batch);
+            full = this->batches.size() >= MAX_QUEUED_BATCHES;
+            ReleaseSRWLockExclusive(&this->lock);
+            SetEvent(this->available);
+
+            while (full && this->cancelled == 0) {
+                WaitForSingleObject(this->drained, INFINITE);
+
+                AcquireSRWLockExclusive(&this->lock);
+                full = this->batches.size() >= MAX_QUEUED_BATCHES;
+                ReleaseSRWLockExclusive(&this->lock);
+            }
+        }
+
+        // The enumerator belongs to this thread's apartment.
+        if (this->enumerator != NULL) {
+            this->enumerator->Release();
+            this->enumerator = NULL;
+        }
+        folder->Release();
+    }
+
+    AcquireSRWLockExclusive(&this->lock);
+    this->finished = true;
+    ReleaseSRWLockExclusive(&this->lock);
+    SetEvent(this->available);
+}
+
+
+/// <summary>
+/// Reads up to Settings::enumBatchSize items from the folder, getting their names and then their
+/// attributes.
+/// </summary>
+MemberEnumerator::Batch* MemberEnumerator::ReadBatch(IShellFolder* folder, HWND hwndOwner) {
+    std::vector<LPITEMIDLIST> ids(Settings::enumBatchSize);
+
+    while (this->pass < this->passes.size()) {
+        SHCONTF passFlags = this->passes[this->pass];
+        ULONG fetched = 0;
+        LONGLONG start;
+        HRESULT hr;
+
+        if (this->enumerator == NULL) {
+            if (folder->EnumObjects(hwndOwner, passFlags, &this->enumerator) != S_OK) {
+                // S_FALSE means there is nothing to enumerate, and no enumerator was returned.
+                this->enumerator = NULL;
+                ++this->pass;
+                continue;
+            }
+        }
+
+        start = Stats::Now();
+        hr = this->enumerator->Next(ULONG(ids.size()), &ids[0], &fetched);
+        Stats::Add(Stats::ENUM_NEXT_TIME, Stats::Now() - start);
+        Stats::Add(Stats::ENUM_NEXT_CALLS, 1);
+
+        if (FAILED(hr)) {
+            fetched = 0;
+        }
+        if (hr != S_OK) {
+            this->enumerator->Release();
+            this->enumerator = NULL;
+            ++this->pass;
+        }
+        if (fetched == 0) {
+            continue;
+        }
+
+        bool mixed = !FLAGSET(passFlags, SHCONTF_FOLDERS) && !FLAGSET(passFlags, SHCONTF_NONFOLDERS);
+
+        Batch* batch = new Batch();
+        std::vector<PCUITEMID_CHILD> entryIds;
+        std::vector<DWORD> fileAttributes;
+        batch->entries.reserve(fetched);
+        entryIds.reserve(fetched);
+        fileAttributes.reserve(fetched);
+
+        start = Stats::Now();
+        for (ULONG i = 0; i < fetched; ++i) {
+            LPWSTR fileName;
+            STRRET name;
+            Entry entry;
+
+            if (SUCCEEDED(folder->GetDisplayNameOf(ids[i], SHGDN_INFOLDER | SHGDN_FORPARSING, &name)) && SUCCEEDED(StrRetToStrW(&name, ids[i], &fileName))) {
+                ULONG cbName = ULONG(sizeof(WCHAR)*(wcslen(fileName) + 1));
+                LPWSTR copy = (LPWSTR)batch->names.Allocate(cbName);
+                memcpy(copy, fileName, cbName);
+                CoTaskMemFree(fileName);
+
+                entry.name = copy;
+                entry.attributes = 0;
+                batch->entries.push_back(entry);
+                entryIds.push_back(ids[i]);
+                fileAttributes.push_back(GetFileAttributesOf(folder, ids[i]));
+            }
+        }
+        Stats::Add(Stats::ENUM_DISPLAYNAME_TIME, Stats::Now() - start);
+        Stats::Add(Stats::ENUM_DISPLAYNAME_CALLS, fetched);
+        Stats::Add(Stats::ENUM_ITEMS, fetched);
+
+        start = Stats::Now();
+        ReadAttributes(folder, batch, entryIds, fileAttributes, mixed);
+        Stats::Add(Stats::ENUM_ATTRIBUTES_TIME, Stats::Now() - start);
+
+        for (ULONG i = 0; i < fetched; ++i) {
+            ILFree(ids[i]);
+        }
+
+        // In a mixed pass, the pass can't tell folders from files.
+        for (std::vector<Entry>::iterator entry = batch->entries.begin(); entry != batch->entries.end(); ++entry) {
+            if (FLAGSET(passFlags, SHCONTF_FOLDERS) || (mixed && FLAGSET(entry->attributes, SFGAO_FOLDER))) {
+                entry->attributes = (entry->attributes & MemberEnumerator::attributeMask) | SFGAO_FOLDER | SFGAO_BROWSABLE | SFGAO_HASSUBFOLDER;
+            }
+            else {
+                entry->attributes &= MemberEnumerator::attributeMask;
+            }
+        }
+
+        if (!batch->entries.empty()) {
+            return batch;
+        }
+        delete batch;
+    }
+
+    return NULL;
+}
+
+
+/// <summary>
+/// Reads the file attributes an item ID carries itself, without going to the disk. Returns
+/// INVALID_FILE_ATTRIBUTES for items which aren't in the file system.
+/// </summary>
+DWORD MemberEnumerator::GetFileAttributesOf(IShellFolder* folder, PCUITEMID_CHILD id) {
+    WIN32_FIND_DATAW findData;
+
+    if (FAILED(SHGetDataFromIDListW(folder, id, SHGDFIL_FINDDATA, &findData, sizeof(findData)))) {
+        return INVALID_FILE_ATTRIBUTES;
+    }
+
+    return findData.dwFileAttributes;
+}
+
+
+/// <summary>
+/// Returns true if a and b are bound to agree on SFGAO_LINK. Whether a file is a shortcut depends
+/// on its type, and only folders marked read-only or system can be folder shortcuts.
+/// </summary>
+bool MemberEnumerator::SameKind(LPCWSTR aName, DWORD aAttributes, LPCWSTR bName, DWORD bAttributes) {
+    if (aAttributes == INVALID_FILE_ATTRIBUTES || bAttributes == INVALID_FILE_ATTRIBUTES) {
+        return false;
+    }
+    if (FLAGSET(aAttributes, FILE_ATTRIBUTE_DIRECTORY) != FLAGSET(bAttributes, FILE_ATTRIBUTE_DIRECTORY)) {
+        return false;
+    }
+    if (FLAGSET(aAttributes, FILE_ATTRIBUTE_DIRECTORY)) {
+        return ((aAttributes | bAttributes) & (FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_SYSTEM)) == 0;
+    }
+
+    return StrCmpIW(PathFindExtensionW(aName), PathFindExtensionW(bName)) == 0;
+}
+
+
+/// <summary>
+/// Fills in the attributes of a batch's entries. GetAttributesOf only reports the bits all items
+/// it is given have in common, so an item lacking a bit says nothing about the others. Instead,
+/// items in the file system take SFGAO_HIDDEN, SFGAO_READONLY and SFGAO_FOLDER from the file
+/// attributes in their IDs, and are asked for SFGAO_LINK together with the items of the same kind,
+/// which all agree on it. Items outside the file system carry nothing to go by, and are asked alone.
+/// </summary>
+void MemberEnumerator::ReadAttributes(IShellFolder* folder, Batch* batch, const std::vector<PCUITEMID_CHILD> &ids, const std::vector<DWORD> &fileAttributes, bool mixed) {
+    std::vector<bool> done(ids.size(), false);
+    std::vector<PCUITEMID_CHILD> kindIds;
+    std::vector<size_t> kind;
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (done[i]) {
+            continue;
+        }
+
+        kind.clear();
+        kindIds.clear();
+        for (size_t j = i; j < ids.size(); ++j) {
+            if (j == i || (!done[j] && SameKind(batch->entries[i].name, fileAttributes[i], batch->entries[j].name, fileAttributes[j]))) {
+                kind.push_back(j);
+                kindIds.push_back(ids[j]);
+                done[j] = true;
+            }
+        }
+
+        SFGAOF asked = SFGAO_LINK;
+        if (fileAttributes[i] == INVALID_FILE_ATTRIBUTES) {
+            asked = MemberEnumerator::attributeMask | (mixed ? SFGAO_FOLDER : 0);
+        }
+
+        SFGAOF common = asked;
+        if (FAILED(folder->GetAttributesOf(UINT(kindIds.size()), &kindIds[0], &common))) {
+            common = 0;
+        }
+        Stats::Add(Stats::ENUM_ATTRIBUTES_CALLS, 1);
+
+        for (std::vector<size_t>::const_iterator j = kind.begin(); j != kind.end(); ++j) {
+            SFGAOF attributes = common & asked;
+            DWORD itemAttributes = fileAttributes[*j];
+
+            if (itemAttributes != INVALID_FILE_ATTRIBUTES) {
+                attributes |= FLAGSET(itemAttributes, FILE_ATTRIBUTE_HIDDEN) ? SFGAO_HIDDEN : 0;
+                attributes |= FLAGSET(itemAttributes, FILE_ATTRIBUTE_READONLY) ? SFGAO_READONLY : 0;
+                attributes |= FLAGSET(itemAttributes, FILE_ATTRIBUTE_DIRECTORY) ? SFGAO_FOLDER : 0;
+            }
+
+            batch->entries[*j].attributes = attributes;
+        }
+    }
+}
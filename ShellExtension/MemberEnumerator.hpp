@@ -0,0 +1,100 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  MemberEnumerator.hpp
+ *  The WinUnionFS Project
+ *
+ *  Enumerates one member folder of a group, in batches.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Task.hpp"
+
+class MemberEnumerator : public Task
+{
+public:
+    // An item read from the member folder.
+    typedef struct {
+        LPCWSTR name;
+        SFGAOF attributes;
+    } Entry;
+
+    // A batch of items. The names are stored in the batch's arena.
+    class Batch {
+    public:
+        Arena names;
+        std::vector<Entry> entries;
+    };
+
+    // Constructor
+    explicit MemberEnumerator(IShellFolder* folder, HWND hwndOwner, SHCONTF flags);
+
+    // Starts reading the folder on the worker pool. If the folder can't be bound again on a worker,
+    // it is read on the calling thread as batches are asked for instead.
+    void Start();
+
+    // Retrieves the next batch, which the caller must delete. Returns S_FALSE once the folder is
+    // exhausted, and E_PENDING if the worker did not produce a batch within timeout ms.
+    HRESULT NextBatch(DWORD timeout, Batch **batch);
+
+    // Asks a running enumeration to stop early.
+    void Cancel();
+
+protected:
+    // Destructor
+    virtual ~MemberEnumerator();
+
+    // Task
+    void Execute();
+
+private:
+    // Reads the next batch from folder. Returns NULL once every pass is done.
+    Batch* ReadBatch(IShellFolder* folder, HWND hwndOwner);
+
+    // Fills in the attributes of a batch's entries, whose item IDs are ids.
+    static void ReadAttributes(IShellFolder* folder, Batch* batch, const std::vector<PCUITEMID_CHILD> &ids, const std::vector<DWORD> &fileAttributes, bool mixed);
+
+    // Reads the file attributes an item ID carries, or INVALID_FILE_ATTRIBUTES if it has none.
+    static DWORD GetFileAttributesOf(IShellFolder* folder, PCUITEMID_CHILD id);
+
+    // True if two items are bound to agree on SFGAO_LINK.
+    static bool SameKind(LPCWSTR aName, DWORD aAttributes, LPCWSTR bName, DWORD bAttributes);
+
+    // The attributes which are copied over from the member folders' items.
+    static const SFGAOF attributeMask = SFGAO_HIDDEN | SFGAO_READONLY | SFGAO_LINK;
+
+    // The folder, as bound by the thread which created the enumerator.
+    IShellFolder* folder;
+
+    // The absolute ID list of the folder, used to bind it again on a worker thread.
+    PIDLIST_ABSOLUTE idList;
+
+    // The arguments to pass on to IShellFolder::EnumObjects.
+    HWND hwndOwner;
+
+    // Folders and non-folders are enumerated in separate passes, so that every item of a batch is
+    // known to be a folder or not without asking it.
+    std::vector<SHCONTF> passes;
+
+    // The pass currently being enumerated, and its enumerator.
+    size_t pass;
+    IEnumIDList* enumerator;
+
+    // True if the enumeration runs on the worker pool.
+    bool started;
+
+    // Batches which have been read on the worker, but not handed out yet.
+    SRWLOCK lock;
+    std::deque<Batch*> batches;
+    bool finished;
+    volatile LONG cancelled;
+
+    // Signaled when a batch is queued, or the enumeration finishes.
+    HANDLE available;
+
+    // Signaled when a batch is taken off the queue, or the enumeration is cancelled.
+    HANDLE drained;
+};
@@ -0,0 +1,322 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Name.cpp
+ *  The WinUnionFS Project
+ *
+ *  Case-insensitive comparison and hashing of item names.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <intrin.h>
+
+#include "Name.h"
+
+
+// The number of code units the vector paths handle at once.
+#define VECTOR_UNITS 8
+
+// The most digits a single number in a sort key holds.
+#define MAX_KEY_DIGITS 255
+
+
+// The upper case mapping of every UTF-16 code unit.
+static WCHAR upcase[0x10000];
+
+// Lookup table for CRC-32C (Castagnoli), reflected.
+static ULONG crcTable[256];
+
+// Set if the processor has the SSE4.2 CRC32 instruction, which computes CRC-32C.
+static bool hasCrc32 = false;
+
+// Guards the one-time initialization of the tables above.
+static INIT_ONCE initOnce = INIT_ONCE_STATIC_INIT;
+
+
+/// <summary>
+/// Maps a range of code units to upper case through the invariant locale. This is the same simple,
+/// locale-independent case mapping NTFS uses to compare file names.
+/// </summary>
+static void MapRange(ULONG first, ULONG last) {
+    int count = int(last - first);
+    LPWSTR source = upcase + first;
+    LPWSTR mapped = new WCHAR[count];
+
+    if (LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_UPPERCASE, source, count, mapped, count, NULL, NULL, 0) == count) {
+        memcpy(source, mapped, count*sizeof(WCHAR));
+    }
+
+    delete [] mapped;
+}
+
+
+/// <summary>
+/// Builds the case mapping and CRC tables.
+/// </summary>
+static BOOL CALLBACK InitializeTables(PINIT_ONCE, PVOID, PVOID*) {
+    for (ULONG c = 0; c < 0x10000; ++c) {
+        upcase[c] = WCHAR(c);
+    }
+    for (ULONG c = 'a'; c <= 'z'; ++c) {
+        upcase[c] = WCHAR(c - 'a' + 'A');
+    }
+
+    // Surrogates have no case mapping, and would confuse LCMapStringEx.
+    MapRange(0x80, 0xD800);
+    MapRange(0xE000, 0x10000);
+
+    for (ULONG i = 0; i < 256; ++i) {
+        ULONG crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+        }
+        crcTable[i] = crc;
+    }
+
+    int info[4];
+    __cpuid(info, 1);
+    hasCrc32 = (info[2] & (1 << 20)) != 0;
+
+    return TRUE;
+}
+
+
+/// <summary>
+/// Makes sure the lookup tables have been built.
+/// </summary>
+static inline void EnsureTables() {
+    InitOnceExecuteOnce(&initOnce, InitializeTables, NULL, NULL);
+}
+
+
+/// <summary>
+/// Returns true if a vector can be loaded from p without touching the next page. Names are NUL
+/// terminated rather than counted, so a load may run past the end of the name, but it must never
+/// run into memory which might not be mapped.
+/// </summary>
+static inline bool CanLoad(LPCWSTR p) {
+    return (ULONG_PTR(p) & 0xFFF) <= 0x1000 - sizeof(__m128i);
+}
+
+
+/// <summary>
+/// Returns true if any of the code units is NUL.
+/// </summary>
+static inline bool HasNul(__m128i units) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(units, _mm_setzero_si128())) != 0;
+}
+
+
+/// <summary>
+/// Upper cases a vector of code units, provided they are all ASCII. Only a-z change case in that
+/// range, which matches the upcase table.
+/// </summary>
+static inline bool FoldAscii(__m128i units, __m128i *folded) {
+    __m128i high = _mm_and_si128(units, _mm_set1_epi16(short(0xFF80)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi16(units, _mm_set1_epi16('a' - 1)),
+                                  _mm_cmplt_epi16(units, _mm_set1_epi16('z' + 1)));
+    *folded = _mm_sub_epi16(units, _mm_and_si128(lower, _mm_set1_epi16('a' - 'A')));
+    return true;
+}
+
+
+/// <summary>
+/// Feeds a vector of code units to the CRC32 instruction, lowest address first.
+/// </summary>
+static inline ULONG Crc32(ULONG crc, __m128i units) {
+#if defined(_M_X64)
+    crc = ULONG(_mm_crc32_u64(crc, _mm_cvtsi128_si64(units)));
+    crc = ULONG(_mm_crc32_u64(crc, _mm_cvtsi128_si64(_mm_srli_si128(units, 8))));
+#else
+    for (int i = 0; i < 4; ++i) {
+        crc = _mm_crc32_u32(crc, _mm_cvtsi128_si32(units));
+        units = _mm_srli_si128(units, 4);
+    }
+#endif
+    return crc;
+}
+
+
+/// <summary>
+/// Returns true if the two names are equal, ignoring case. Runs of ASCII are compared a vector at
+/// a time, anything else goes through the upcase table.
+/// </summary>
+bool Name::Equal(LPCWSTR name1, LPCWSTR name2) {
+    EnsureTables();
+
+    for (;;) {
+        if (CanLoad(name1) && CanLoad(name2)) {
+            __m128i units1 = _mm_loadu_si128((const __m128i*)name1);
+            __m128i units2 = _mm_loadu_si128((const __m128i*)name2);
+
+            // With no NUL in the first name, a difference anywhere means the names differ.
+            if (!HasNul(units1)) {
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(units1, units2)) == 0xFFFF) {
+                    name1 += VECTOR_UNITS;
+                    name2 += VECTOR_UNITS;
+                    continue;
+                }
+
+                __m128i folded1, folded2;
+                if (FoldAscii(units1, &folded1) && FoldAscii(units2, &folded2)) {
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi16(folded1, folded2)) != 0xFFFF) {
+                        return false;
+                    }
+                    name1 += VECTOR_UNITS;
+                    name2 += VECTOR_UNITS;
+                    continue;
+                }
+            }
+        }
+
+        for (int i = 0; i < VECTOR_UNITS; ++i, ++name1, ++name2) {
+            if (upcase[*name1] != upcase[*name2]) {
+                return false;
+            }
+            if (*name1 == L'\0') {
+                return true;
+            }
+        }
+    }
+}
+
+
+/// <summary>
+/// Orders two names the way Equal compares them, by their upper cased code units.
+/// </summary>
+int Name::Compare(LPCWSTR name1, LPCWSTR name2) {
+    EnsureTables();
+
+    while (upcase[*name1] == upcase[*name2]) {
+        if (*name1 == L'\0') {
+            return 0;
+        }
+        ++name1;
+        ++name2;
+    }
+
+    return int(upcase[*name1]) - int(upcase[*name2]);
+}
+
+
+/// <summary>
+/// Returns the upper case form of a single code unit.
+/// </summary>
+WCHAR Name::Fold(WCHAR c) {
+    EnsureTables();
+    return upcase[c];
+}
+
+
+/// <summary>
+/// Returns a case-insensitive 32-bit hash of the name. This is the CRC-32C of the upper cased
+/// UTF-16LE code units, so names which are Equal always hash to the same value. The hash is
+/// stored in PIDLs and filters, so every path below must produce exactly the same value.
+/// </summary>
+ULONG Name::Hash(LPCWSTR name) {
+    EnsureTables();
+
+    ULONG crc = 0xFFFFFFFF;
+    if (!hasCrc32) {
+        for (; *name != L'\0'; ++name) {
+            WCHAR c = upcase[*name];
+            crc = crcTable[(crc ^ c) & 0xFF] ^ (crc >> 8);
+            crc = crcTable[(crc ^ (c >> 8)) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    for (;;) {
+        if (CanLoad(name)) {
+            __m128i units = _mm_loadu_si128((const __m128i*)name), folded;
+            if (!HasNul(units) && FoldAscii(units, &folded)) {
+                crc = Crc32(crc, folded);
+                name += VECTOR_UNITS;
+                continue;
+            }
+        }
+
+        for (int i = 0; i < VECTOR_UNITS; ++i, ++name) {
+            if (*name == L'\0') {
+                return ~crc;
+            }
+            crc = _mm_crc32_u16(crc, upcase[*name]);
+        }
+    }
+}
+
+
+/// <summary>
+/// Returns true if c is an ASCII digit.
+/// </summary>
+static inline bool IsDigit(WCHAR c) {
+    return c >= L'0' && c <= L'9';
+}
+
+
+/// <summary>
+/// Writes a sort key for the name, which orders names ordinally, ignoring case, when keys are
+/// compared with memcmp, shorter keys first when one is a prefix of the other. Runs of digits are
+/// ordered by their value, so file2 comes before file10, but otherwise this is not the order of
+/// StrCmpLogicalW: punctuation such as '_' sorts by code unit, after the digits and upper cased
+/// letters, and accented letters sort after 'Z'. Returns the size of the key in bytes. key may be
+/// NULL to get just the size.
+///
+/// Every other code unit is written upper cased, big-endian. A run of digits is written in the
+/// place of a '0', followed by the count of digits without leading zeros, and then the digits, so
+/// that shorter numbers are smaller and numbers of the same length compare digit by digit.
+/// </summary>
+size_t Name::SortKey(LPCWSTR name, LPBYTE key) {
+    EnsureTables();
+
+    size_t cb = 0;
+    while (*name != L'\0') {
+        if (!IsDigit(*name)) {
+            WCHAR c = upcase[*name++];
+            if (key != NULL) {
+                key[cb] = BYTE(c >> 8);
+                key[cb + 1] = BYTE(c);
+            }
+            cb += 2;
+            continue;
+        }
+
+        // Keep the last zero, so that zero itself has a digit.
+        while (*name == L'0' && IsDigit(name[1])) {
+            ++name;
+        }
+
+        // Numbers too long for one count carry on in the next.
+        do {
+            LPCWSTR digits = name;
+            while (IsDigit(*name) && name - digits < MAX_KEY_DIGITS) {
+                ++name;
+            }
+
+            BYTE count = BYTE(name - digits);
+            if (key != NULL) {
+                key[cb] = 0;
+                key[cb + 1] = '0';
+                key[cb + 2] = count;
+                for (BYTE i = 0; i < count; ++i) {
+                    key[cb + 3 + i] = BYTE(digits[i]);
+                }
+            }
+            cb += 3 + count;
+        } while (IsDigit(*name));
+    }
+
+    return cb;
+}
+
+
+/// <summary>
+/// Returns true if the name may reach an item under another name than the one its folder lists,
+/// so that its absence from a listing proves nothing. Short 8.3 names like PROGRA~1 contain a
+/// tilde, and alternate data streams are named name:stream.
+/// </summary>
+bool Name::MayBeAlias(LPCWSTR name) {
+    return wcspbrk(name, L"~:") != NULL;
+}
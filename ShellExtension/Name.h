@@ -0,0 +1,28 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Name.h
+ *  The WinUnionFS Project
+ *
+ *  Case-insensitive comparison and hashing of item names.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace Name {
+    bool Equal(LPCWSTR name1, LPCWSTR name2);
+    int Compare(LPCWSTR name1, LPCWSTR name2);
+    WCHAR Fold(WCHAR c);
+    ULONG Hash(LPCWSTR name);
+    size_t SortKey(LPCWSTR name, LPBYTE key);
+
+    // True if the name may reach an item under another name than listings show.
+    bool MayBeAlias(LPCWSTR name);
+
+    // Adapters for the standard hashed containers.
+    struct Hasher {
+        size_t operator()(LPCWSTR name) const { return Hash(name); }
+    };
+
+    struct EqualTo {
+        bool operator()(LPCWSTR name1, LPCWSTR name2) const { return Equal(name1, name2); }
+    };
+}
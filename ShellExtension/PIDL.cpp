@@ -3,6 +3,11 @@
  *  The WinUnionFS Project
  *
  *  Functions for managing WinUnionFS PIDLs.
+ *
+ *  Items are written in the version 2 layout, which carries the hash of the
+ *  name so that different names can be told apart without comparing them.
+ *  Version 1 items, which may have been saved in shortcuts and pins by older
+ *  releases, can still be read.
  *  
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 #include <Windows.h>
@@ -11,63 +16,234 @@
 #include <ShlObj.h>
 
 #include "Group.hpp"
+#include "Name.h"
 #include "PIDL.h"
+#include "PIDLBuilder.hpp"
 
 
 /// <summary>
-/// 
+/// Returns true if the item is in the version 2 layout.
 /// </summary>
-LPITEMIDLIST PIDL::Concatenate(LPCITEMIDLIST pidl1, LPCITEMIDLIST pidl2) {
-    if (pidl1 == NULL) {
-        return Copy(pidl2);
+static inline bool IsV2(LPCITEMIDLIST pidl) {
+    return pidl->mkid.cb >= sizeof(PIDL::PIDLItem) + sizeof(WCHAR) && ((PIDL::PIDLItem*)&pidl->mkid)->tag == PIDL::ITEM_TAG_V2;
+}
+
+
+/// <summary>
+/// Returns the version 2 header of the item.
+/// </summary>
+static inline PIDL::PIDLItem* ItemV2(LPCITEMIDLIST pidl) {
+    return (PIDL::PIDLItem*)&pidl->mkid;
+}
+
+
+/// <summary>
+/// Returns the version 1 header of the item.
+/// </summary>
+static inline PIDL::PIDLItemV1* ItemV1(LPCITEMIDLIST pidl) {
+    return (PIDL::PIDLItemV1*)&pidl->mkid;
+}
+
+
+/// <summary>
+/// Returns the size of a members section covering knownMembers members, in bytes.
+/// </summary>
+static inline ULONG MembersSize(USHORT knownMembers) {
+    return knownMembers == 0 ? 0 : (sizeof(USHORT) + (knownMembers + 7)/8 + 1) & ~1;
+}
+
+
+/// <summary>
+/// Returns the member bitmap of the item, and the number of members it covers. Returns NULL if the
+/// item has none, as items from older versions don't.
+/// </summary>
+static LPBYTE Members(PCITEMID_CHILD pidl, USHORT *knownMembers) {
+    LPBYTE item = LPBYTE(pidl);
+    ULONG offset;
+
+    *knownMembers = 0;
+    if (IsV2(pidl)) {
+        if ((ItemV2(pidl)->flags & PIDL::ITEM_HAS_MEMBERS) == 0) {
+            return NULL;
+        }
+        offset = sizeof(PIDL::PIDLItem);
     }
-    if (pidl2 == NULL) {
-        return Copy(pidl1);
+    else {
+        offset = ULONG(FIELD_OFFSET(PIDL::PIDLItemV1, name) + ItemV1(pidl)->cbName);
     }
 
-    ULONG size1 = Size(pidl1);
-    ULONG size2 = Size(pidl2);
+    if (offset + sizeof(USHORT) > pidl->mkid.cb) {
+        return NULL;
+    }
 
-    LPBYTE copy = (LPBYTE)CoTaskMemAlloc(size1 + size2 - sizeof(ITEMIDLIST));
-    memcpy(copy, pidl1, size1);
-    memcpy(copy + size1 - sizeof(ITEMIDLIST), pidl2, size2);
+    USHORT known;
+    memcpy(&known, item + offset, sizeof(USHORT));
+    if (known == 0 || offset + sizeof(USHORT) + (known + 7)/8 > pidl->mkid.cb) {
+        return NULL;
+    }
 
-    return LPITEMIDLIST(copy);
+    *knownMembers = known;
+    return item + offset + sizeof(USHORT);
 }
 
 
 /// <summary>
-/// 
+/// Returns the size of a sort key section holding a key of cbKey bytes.
 /// </summary>
-LPITEMIDLIST PIDL::Create(LPCITEMIDLIST parent, LPWSTR path, SFGAOF attributes, USHORT folder) {
-    // Size of the path.
-    USHORT cbName = USHORT(sizeof(WCHAR)*wcslen(path));
-    ULONG parentSize = 0;
+static inline ULONG SortKeySize(size_t cbKey) {
+    return ULONG(sizeof(USHORT) + cbKey + 1) & ~1;
+}
 
-    if (parent != NULL) {
-        parentSize = Size(parent);
+
+/// <summary>
+/// Returns the sort key of a version 2 item, and its size. Returns NULL if the item has none, as
+/// items from older versions don't.
+/// </summary>
+static const BYTE* SortKey(PCITEMID_CHILD pidl, USHORT *cbKey) {
+    *cbKey = 0;
+    if (!IsV2(pidl) || (ItemV2(pidl)->flags & PIDL::ITEM_HAS_SORTKEY) == 0) {
+        return NULL;
     }
 
-    //
-    LPITEMIDLIST ret = (LPITEMIDLIST)CoTaskMemAlloc(parentSize + cbName + sizeof(PIDLItem) + sizeof(ITEMIDLIST));
-    PIDLItem* item = Item(ret);
+    USHORT known;
+    ULONG offset = sizeof(PIDL::PIDLItem);
+    if (Members(pidl, &known) != NULL) {
+        offset += MembersSize(known);
+    }
+    if (offset + sizeof(USHORT) > pidl->mkid.cb) {
+        return NULL;
+    }
 
-    if (parent != NULL) {
-        memcpy(ret, parent, parentSize);
-        item = Item(End(ret));
+    USHORT cb;
+    const BYTE* item = (const BYTE*)&pidl->mkid;
+    memcpy(&cb, item + offset, sizeof(USHORT));
+    if (offset + sizeof(USHORT) + cb > pidl->mkid.cb) {
+        return NULL;
     }
 
-    cbName += sizeof(WCHAR); // The terminating NULL.
+    *cbKey = cb;
+    return item + offset + sizeof(USHORT);
+}
 
-    item->cb = USHORT(cbName + sizeof(PIDLItem));
-    item->attributes = attributes;
-    item->folder = folder;
-    item->cbName = cbName;
-    memcpy(item->name, path, cbName);
 
-    Next(ret)->mkid.cb = 0;
+/// <summary>
+/// Returns the item's name, and its length in characters.
+/// </summary>
+static LPCWSTR ItemName(PCITEMID_CHILD pidl, size_t *cchName) {
+    LPCWSTR name;
+    size_t cchMax;
 
-    return ret;
+    if (IsV2(pidl)) {
+        USHORT known, cbKey;
+        ULONG offset = sizeof(PIDL::PIDLItem);
+
+        if (Members(pidl, &known) != NULL) {
+            offset += MembersSize(known);
+        }
+        if (SortKey(pidl, &cbKey) != NULL) {
+            offset += SortKeySize(cbKey);
+        }
+        offset = min(offset, ULONG(pidl->mkid.cb));
+
+        name = LPCWSTR(LPBYTE(&pidl->mkid) + offset);
+        cchMax = (pidl->mkid.cb - offset)/sizeof(WCHAR);
+    }
+    else {
+        name = ItemV1(pidl)->name;
+        cchMax = ItemV1(pidl)->cbName/sizeof(WCHAR);
+    }
+
+    *cchName = wcsnlen(name, cchMax);
+    return name;
+}
+
+
+/// <summary>
+/// Records that member has the item as well.
+/// </summary>
+void PIDL::AddMember(LPITEMIDLIST pidl, USHORT member) {
+    USHORT known;
+    LPBYTE members = Members(pidl, &known);
+
+    if (members != NULL && member < known) {
+        members[member/8] |= BYTE(1 << (member % 8));
+    }
+}
+
+
+/// <summary>
+/// Orders two items by the natural order of their names, as Name::SortKey does. Items from older
+/// versions carry no key, so one is made for them.
+/// </summary>
+int PIDL::CompareSortKeys(PCITEMID_CHILD pidl1, PCITEMID_CHILD pidl2) {
+    USHORT cbKey1, cbKey2;
+    const BYTE* key1 = SortKey(pidl1, &cbKey1);
+    const BYTE* key2 = SortKey(pidl2, &cbKey2);
+    std::vector<BYTE> made1, made2;
+
+    if (key1 == NULL) {
+        LPCWSTR name = GetName(pidl1);
+        made1.resize(Name::SortKey(name, NULL) + 1);
+        cbKey1 = USHORT(Name::SortKey(name, made1.data()));
+        key1 = made1.data();
+    }
+    if (key2 == NULL) {
+        LPCWSTR name = GetName(pidl2);
+        made2.resize(Name::SortKey(name, NULL) + 1);
+        cbKey2 = USHORT(Name::SortKey(name, made2.data()));
+        key2 = made2.data();
+    }
+
+    int result = memcmp(key1, key2, min(cbKey1, cbKey2));
+    if (result != 0) {
+        return result;
+    }
+
+    return int(cbKey1) - int(cbKey2);
+}
+
+
+/// <summary>
+/// Returns a new ITEMIDLIST with the items of pidl2 after those of pidl1, or NULL if out of memory.
+/// </summary>
+LPITEMIDLIST PIDL::Concatenate(LPCITEMIDLIST pidl1, LPCITEMIDLIST pidl2) {
+    if (pidl1 == NULL) {
+        return Copy(pidl2);
+    }
+    if (pidl2 == NULL) {
+        return Copy(pidl1);
+    }
+
+    PIDLBuilder builder;
+    builder.Reserve(Size(pidl1) + Size(pidl2) - 2*sizeof(USHORT));
+    builder.Append(pidl1);
+    builder.Append(pidl2);
+
+    return builder.Detach();
+}
+
+
+/// <summary>
+/// Returns a new ITEMIDLIST with a single item after those of parent, which may be NULL. Returns
+/// NULL if out of memory.
+/// </summary>
+LPITEMIDLIST PIDL::Create(LPCITEMIDLIST parent, LPWSTR path, SFGAOF attributes, USHORT folder, USHORT knownMembers) {
+    PIDLBuilder builder;
+    builder.Reserve((parent != NULL ? Size(parent) - sizeof(USHORT) : 0) + ChildSize(path, knownMembers) - sizeof(USHORT));
+    builder.Append(parent);
+    builder.AppendItem(path, attributes, folder, knownMembers);
+
+    return builder.Detach();
+}
+
+
+/// <summary>
+/// Returns the size, in bytes, of a single item ITEMIDLIST with the specified name, and a bitmap
+/// for knownMembers members.
+/// </summary>
+ULONG PIDL::ChildSize(LPCWSTR name, USHORT knownMembers) {
+    return ULONG(sizeof(PIDLItem) + MembersSize(knownMembers) + SortKeySize(Name::SortKey(name, NULL)) +
+        sizeof(WCHAR)*(wcslen(name) + 1) + sizeof(USHORT));
 }
 
 
@@ -124,77 +300,128 @@ void PIDL::Free(LPITEMIDLIST pidl) {
 /// 
 /// </summary>
 SFGAOF PIDL::GetAttributes(PCITEMID_CHILD pidl) {
-    return Item(pidl)->attributes;
+    return IsV2(pidl) ? ItemV2(pidl)->attributes : ItemV1(pidl)->attributes;
 }
 
 
 /// <summary>
-/// 
+/// Returns a copy of the item's name, which the caller must CoTaskMemFree.
 /// </summary>
 LPWSTR PIDL::GetDisplayName(PCITEMID_CHILD pidl) {
-    PIDLItem* item = Item(pidl);
-    LPWSTR ret = (LPWSTR)CoTaskMemAlloc(Item(pidl)->cbName);
-    memcpy(ret, Item(pidl)->name, Item(pidl)->cbName);
+    size_t cchName;
+    LPCWSTR name = ItemName(pidl, &cchName);
+
+    LPWSTR ret = (LPWSTR)CoTaskMemAlloc(sizeof(WCHAR)*(cchName + 1));
+    memcpy(ret, name, sizeof(WCHAR)*cchName);
+    ret[cchName] = L'\0';
 
     return ret;
 }
 
 
 /// <summary>
-/// Returns the full parse path of the item. Folder1\Folder2\File
+/// Returns the index of the member which provides the item.
+/// </summary>
+USHORT PIDL::GetFolder(PCITEMID_CHILD pidl) {
+    return IsV2(pidl) ? ItemV2(pidl)->folder : ItemV1(pidl)->folder;
+}
+
+
+/// <summary>
+/// Returns the full parse path of the item, Folder1\Folder2\File, which the caller must
+/// CoTaskMemFree. The length is worked out first, so that the path is allocated and written just
+/// once however deep it is, and long paths are never cut short.
 /// </summary>
-void PIDL::GetFullPath(LPCITEMIDLIST parent, PCITEMID_CHILD pidl, LPWSTR path, UINT cchPath) {
-    LPCITEMIDLIST iter = Next(parent);
-    path[0] = '\0';
+LPWSTR PIDL::GetFullPath(LPCITEMIDLIST parent, PCITEMID_CHILD pidl) {
+    size_t cchPath = 0;
 
-    while (iter->mkid.cb != 0) {
-        StringCchCatW(path, cchPath, Item(iter)->name);
-        StringCchCatW(path, cchPath, L"\\");
-        iter = Next(iter);
+    for (LPCITEMIDLIST iter = Next(parent); iter->mkid.cb != 0; iter = Next(iter)) {
+        size_t cchName;
+        ItemName(iter, &cchName);
+        cchPath += cchName + 1;
     }
     if (pidl != NULL) {
-        StringCchCatW(path, cchPath, Item(pidl)->name);
+        size_t cchName;
+        ItemName(pidl, &cchName);
+        cchPath += cchName;
+    }
+    else if (cchPath > 0) {
+        // No backslash after the last folder.
+        --cchPath;
     }
-    else if(Next(parent)->mkid.cb != 0) {
-        // Should drop that last backslash
-        path[wcslen(path)-1] = '\0';
+
+    LPWSTR path = (LPWSTR)CoTaskMemAlloc(sizeof(WCHAR)*(cchPath + 1));
+    LPWSTR end = path;
+
+    for (LPCITEMIDLIST iter = Next(parent); iter->mkid.cb != 0; iter = Next(iter)) {
+        size_t cchName;
+        LPCWSTR name = ItemName(iter, &cchName);
+        memcpy(end, name, sizeof(WCHAR)*cchName);
+        end += cchName;
+        *end++ = L'\\';
     }
+    if (pidl != NULL) {
+        size_t cchName;
+        LPCWSTR name = ItemName(pidl, &cchName);
+        memcpy(end, name, sizeof(WCHAR)*cchName);
+        end += cchName;
+    }
+    else if (end != path) {
+        --end;
+    }
+    *end = L'\0';
+
+    return path;
 }
 
 
 /// <summary>
-/// Returns the full parse path of the item. Folder1\Folder2\File
+/// Returns the group an absolute PIDL lies in, which the caller must Release, or NULL for the
+/// root folder.
 /// </summary>
-LPWSTR PIDL::GetFullPath(LPCITEMIDLIST parent, PCITEMID_CHILD pidl) {
-    WCHAR path[MAX_PATH] = L"";
+Group* PIDL::GetGroup(LPCITEMIDLIST pidl) {
+    if (pidl == NULL || pidl->mkid.cb == 0 || Next(pidl)->mkid.cb == 0) {
+        return NULL;
+    }
 
-    GetFullPath(parent, pidl, path, MAX_PATH);
+    // The first PIDL is the group.
+    return Group::Find(GetName(Next(pidl)));
+}
 
-    size_t size = (wcslen(path)+1)*sizeof(WCHAR);
-    LPWSTR ret = (LPWSTR)CoTaskMemAlloc(size);
-    memcpy(ret, path, size);
 
-    return ret;
+/// <summary>
+/// Returns the item's name. It points into the item.
+/// </summary>
+LPCWSTR PIDL::GetName(PCITEMID_CHILD pidl) {
+    size_t cchName;
+    return ItemName(pidl, &cchName);
 }
 
 
 /// <summary>
-/// Returns the size, in bytes, of the entire ITEMIDLIST.
+/// Returns the case-insensitive Name::Hash of the item's name. Version 2 items carry it with them.
 /// </summary>
-HRESULT PIDL::GetShellFoldersFor(LPCITEMIDLIST pidl, std::vector<IShellFolder*> *out) {
+ULONG PIDL::GetNameHash(PCITEMID_CHILD pidl) {
+    return IsV2(pidl) ? ItemV2(pidl)->hash : Name::Hash(GetName(pidl));
+}
+
+
+/// <summary>
+/// Retrieves the member folders of the group which make up the folder at the PIDL, one per member,
+/// and which of the members didn't answer.
+/// </summary>
+HRESULT PIDL::GetShellFoldersFor(LPCITEMIDLIST pidl, std::vector<IShellFolder*> *out, std::vector<bool> *unanswered) {
     //  ShellFolder will have to deal with the top-level folder.
     if (Next(pidl)->mkid.cb != 0) {
         // This is the group level, we should get IShellFolder interfaces for all folders included in the group.
-
-        // The first PIDL is the group.
-        Group* group = Group::Find(Item(Next(pidl))->name);
+        Group* group = GetGroup(pidl);
 
         if (group != NULL) {
-            WCHAR path[MAX_PATH];
-            LPCITEMIDLIST pathStart = Next(pidl);
+            LPWSTR path = GetFullPath(Next(pidl), NULL);
 
-            GetFullPath(pathStart, NULL, path, MAX_PATH);
-            group->GetShellFoldersFor(path, out);
+            group->GetShellFoldersFor(path, out, unanswered);
+            group->Release();
+            CoTaskMemFree(path);
         }
     }
 
@@ -203,15 +430,44 @@ HRESULT PIDL::GetShellFoldersFor(LPCITEMIDLIST pidl, std::vector<IShellFolder*>
 
 
 /// <summary>
-/// Returns the "item" of the PIDL.
+/// Writes a single item ITEMIDLIST to memory of at least ChildSize(name, knownMembers) bytes. The
+/// bitmap covers the first knownMembers members, of which only folder has the item so far. The
+/// sort key is worked out here, once, so that sorting a view only has to compare keys.
 /// </summary>
-PIDL::PIDLItem* PIDL::Item(LPCITEMIDLIST pidl) {
-    return (PIDLItem*)&pidl->mkid;
+void PIDL::Init(LPITEMIDLIST pidl, LPCWSTR name, SFGAOF attributes, USHORT folder, USHORT knownMembers) {
+    PIDLItem* item = ItemV2(pidl);
+    ULONG cbMembers = MembersSize(knownMembers);
+    LPBYTE members = LPBYTE(item) + sizeof(PIDLItem);
+    LPBYTE sortKey = members + cbMembers;
+
+    item->cb = USHORT(ChildSize(name, knownMembers) - sizeof(USHORT));
+    item->tag = ITEM_TAG_V2;
+    item->folder = folder;
+    item->flags = ITEM_HAS_SORTKEY | (knownMembers != 0 ? ITEM_HAS_MEMBERS : 0);
+    item->attributes = attributes;
+    item->hash = Name::Hash(name);
+
+    if (cbMembers != 0) {
+        memcpy(members, &knownMembers, sizeof(USHORT));
+        ZeroMemory(members + sizeof(USHORT), cbMembers - sizeof(USHORT));
+    }
+
+    USHORT cbKey = USHORT(Name::SortKey(name, sortKey + sizeof(USHORT)));
+    ULONG cbSortKey = SortKeySize(cbKey);
+    memcpy(sortKey, &cbKey, sizeof(USHORT));
+    if (cbSortKey > sizeof(USHORT) + cbKey) {
+        sortKey[cbSortKey - 1] = 0;
+    }
+
+    memcpy(sortKey + cbSortKey, name, sizeof(WCHAR)*(wcslen(name) + 1));
+    AddMember(pidl, folder);
+
+    Next(pidl)->mkid.cb = 0;
 }
 
 
 /// <summary>
-/// Returns the "item" of the PIDL.
+/// Returns the number of items in the PIDL.
 /// </summary>
 ULONG PIDL::ItemCount(LPCITEMIDLIST pidl) {
     ULONG count = 0;
@@ -235,6 +491,37 @@ LPITEMIDLIST PIDL::Last(LPCITEMIDLIST pidl) {
 }
 
 
+/// <summary>
+/// Returns false if the member is known not to have the item. Beyond the bitmap, members haven't
+/// been read, or not to the end, so they may have it. Items without a bitmap come from complete
+/// listings, where members before the item's folder never have it, since the first member to have
+/// a name provides the item.
+/// </summary>
+bool PIDL::MayHaveMember(PCITEMID_CHILD pidl, size_t member) {
+    USHORT known;
+    LPBYTE members = Members(pidl, &known);
+
+    if (members != NULL) {
+        return member >= known || (members[member/8] & (1 << (member % 8))) != 0;
+    }
+
+    return member >= GetFolder(pidl);
+}
+
+
+/// <summary>
+/// Returns true if the items have the same name, ignoring case. Version 2 items with different
+/// names are told apart by their hashes alone.
+/// </summary>
+bool PIDL::NamesEqual(PCITEMID_CHILD pidl1, PCITEMID_CHILD pidl2) {
+    if (IsV2(pidl1) && IsV2(pidl2) && ItemV2(pidl1)->hash != ItemV2(pidl2)->hash) {
+        return false;
+    }
+
+    return Name::Equal(GetName(pidl1), GetName(pidl2));
+}
+
+
 /// <summary>
 /// Returns the next item in the ITEMIDLIST.
 /// </summary>
@@ -247,7 +534,7 @@ LPITEMIDLIST PIDL::Next(LPCITEMIDLIST pidl) {
 /// Returns the size, in bytes, of the entire ITEMIDLIST.
 /// </summary>
 ULONG PIDL::Size(LPCITEMIDLIST pidl) {
-    ULONG size = sizeof(ITEMIDLIST); // Terminating item ID
+    ULONG size = sizeof(USHORT); // Terminating item ID
     for (LPCITEMIDLIST iter = pidl; iter->mkid.cb != 0; iter = Next(iter)) {
         size += iter->mkid.cb;
     }
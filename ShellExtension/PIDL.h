@@ -9,17 +9,47 @@
 
 #include <vector>
 
+class Group;
+
 namespace PIDL {
+    // Takes the place of the folder of version 1 items in newer items, and tells the versions apart.
+    const USHORT ITEM_TAG_V2 = 0xF002;
+
+    // The sections which follow the header of a version 2 item, before its name.
+    const USHORT ITEM_HAS_MEMBERS = 0x0001;
+    const USHORT ITEM_HAS_SORTKEY = 0x0002;
+
+    // A version 2 item. The header is followed by the sections flags says are there, in the order
+    // of their flags, and then by the name, which runs to the end of the item. The members section
+    // is a USHORT count of the members the item's presence is known for, and a bitmap of which of
+    // those members have the item, one bit per member, padded to an even length. The sort key
+    // section is a USHORT size and the Name::SortKey of the name, padded to an even length.
+    typedef struct {
+        USHORT cb;
+        USHORT tag;
+        USHORT folder;
+        USHORT flags;
+        SFGAOF attributes;
+
+        // The Name::Hash of the name.
+        ULONG hash;
+    } PIDLItem;
+
+    // A version 1 item, as found in shortcuts and pins made by older releases. The name may be
+    // followed by the members section.
     typedef struct {
         USHORT cb;
         USHORT folder;
         SFGAOF attributes;
         USHORT cbName;
         WCHAR name[1];
-    } PIDLItem;
+    } PIDLItemV1;
 
+    void AddMember(LPITEMIDLIST pidl, USHORT member);
+    ULONG ChildSize(LPCWSTR name, USHORT knownMembers);
+    int CompareSortKeys(PCITEMID_CHILD pidl1, PCITEMID_CHILD pidl2);
     LPITEMIDLIST Concatenate(LPCITEMIDLIST pidl1, LPCITEMIDLIST pidl2);
-    LPITEMIDLIST Create(LPCITEMIDLIST parent, LPWSTR path, SFGAOF attributes, USHORT folder);
+    LPITEMIDLIST Create(LPCITEMIDLIST parent, LPWSTR path, SFGAOF attributes, USHORT folder, USHORT knownMembers);
     LPITEMIDLIST CreateFromPath(LPCWSTR path);
     LPITEMIDLIST Copy(LPCITEMIDLIST source);
     LPITEMIDLIST Empty();
@@ -27,12 +57,17 @@ namespace PIDL {
     void Free(LPITEMIDLIST pidl);
     SFGAOF GetAttributes(PCITEMID_CHILD pidl);
     LPWSTR GetDisplayName(PCITEMID_CHILD pidl);
-    void GetFullPath(LPCITEMIDLIST parent, PCITEMID_CHILD pidl, LPWSTR path, UINT cchPath);
+    USHORT GetFolder(PCITEMID_CHILD pidl);
     LPWSTR GetFullPath(LPCITEMIDLIST parent, PCITEMID_CHILD pidl);
-    HRESULT GetShellFoldersFor(LPCITEMIDLIST pidl, std::vector<IShellFolder*> *out);
-    PIDLItem* Item(LPCITEMIDLIST pidl);
+    Group* GetGroup(LPCITEMIDLIST pidl);
+    LPCWSTR GetName(PCITEMID_CHILD pidl);
+    ULONG GetNameHash(PCITEMID_CHILD pidl);
+    HRESULT GetShellFoldersFor(LPCITEMIDLIST pidl, std::vector<IShellFolder*> *out, std::vector<bool> *unanswered);
+    void Init(LPITEMIDLIST pidl, LPCWSTR name, SFGAOF attributes, USHORT folder, USHORT knownMembers);
     ULONG ItemCount(LPCITEMIDLIST pidl);
     LPITEMIDLIST Last(LPCITEMIDLIST pidl);
+    bool MayHaveMember(PCITEMID_CHILD pidl, size_t member);
+    bool NamesEqual(PCITEMID_CHILD pidl1, PCITEMID_CHILD pidl2);
     LPITEMIDLIST Next(LPCITEMIDLIST pidl);
     ULONG Size(LPCITEMIDLIST pidl);
 }
@@ -0,0 +1,146 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  PIDLBuilder.cpp
+ *  The WinUnionFS Project
+ *
+ *  Builds an ITEMIDLIST by appending items to the end of it. The end is kept
+ *  track of, so appending doesn't walk the items before it, and the buffer
+ *  grows geometrically. Reserving the final size up front builds the whole
+ *  list in a single allocation.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShlObj.h>
+
+#include "PIDL.h"
+#include "PIDLBuilder.hpp"
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+PIDLBuilder::PIDLBuilder() {
+    this->buffer = NULL;
+    this->used = 0;
+    this->capacity = 0;
+    this->status = S_OK;
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+PIDLBuilder::~PIDLBuilder() {
+    CoTaskMemFree(this->buffer);
+}
+
+
+/// <summary>
+/// Reallocates the buffer to capacity bytes, keeping the items so far and the terminator. If that
+/// fails, the builder keeps the old buffer, which is freed along with it, and fails from then on.
+/// </summary>
+HRESULT PIDLBuilder::Resize(ULONG capacity) {
+    if (FAILED(this->status)) {
+        return this->status;
+    }
+
+    LPBYTE buffer = (LPBYTE)CoTaskMemRealloc(this->buffer, capacity);
+    if (buffer == NULL) {
+        this->status = E_OUTOFMEMORY;
+        return this->status;
+    }
+
+    this->buffer = buffer;
+    this->capacity = capacity;
+    ZeroMemory(this->buffer + this->used, sizeof(USHORT));
+
+    return S_OK;
+}
+
+
+/// <summary>
+/// Grows the buffer to at least cb bytes, at least doubling it so that appending stays linear.
+/// </summary>
+HRESULT PIDLBuilder::Grow(ULONG cb) {
+    if (cb > this->capacity) {
+        return Resize(max(cb, this->capacity*2));
+    }
+
+    return this->status;
+}
+
+
+/// <summary>
+/// Makes sure cb more bytes of items can be appended without reallocating.
+/// </summary>
+HRESULT PIDLBuilder::Reserve(ULONG cb) {
+    ULONG capacity = ULONG(this->used + cb + sizeof(USHORT));
+
+    if (capacity > this->capacity) {
+        return Resize(capacity);
+    }
+
+    return this->status;
+}
+
+
+/// <summary>
+/// Appends copies of every item of pidl, which may be NULL.
+/// </summary>
+HRESULT PIDLBuilder::Append(LPCITEMIDLIST pidl) {
+    if (pidl == NULL) {
+        return this->status;
+    }
+
+    ULONG cb = PIDL::Size(pidl) - sizeof(USHORT);
+
+    HRESULT hr = Grow(ULONG(this->used + cb + sizeof(USHORT)));
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    memcpy(this->buffer + this->used, pidl, cb + sizeof(USHORT));
+    this->used += cb;
+
+    return S_OK;
+}
+
+
+/// <summary>
+/// Appends a WinUnionFS item, and returns it, or NULL if out of memory.
+/// </summary>
+LPITEMIDLIST PIDLBuilder::AppendItem(LPCWSTR name, SFGAOF attributes, USHORT folder, USHORT knownMembers) {
+    ULONG cb = PIDL::ChildSize(name, knownMembers);
+
+    if (FAILED(Grow(this->used + cb))) {
+        return NULL;
+    }
+
+    LPITEMIDLIST item = LPITEMIDLIST(this->buffer + this->used);
+    PIDL::Init(item, name, attributes, folder, knownMembers);
+    this->used += cb - sizeof(USHORT);
+
+    return item;
+}
+
+
+/// <summary>
+/// Returns the ITEMIDLIST built so far, which the caller must free with CoTaskMemFree, and leaves
+/// the builder empty. Returns NULL, and frees what was built, if any append ran out of memory.
+/// </summary>
+LPITEMIDLIST PIDLBuilder::Detach() {
+    LPITEMIDLIST pidl = NULL;
+
+    if (SUCCEEDED(Grow(sizeof(USHORT)))) {
+        pidl = LPITEMIDLIST(this->buffer);
+    }
+    else {
+        CoTaskMemFree(this->buffer);
+    }
+
+    this->buffer = NULL;
+    this->used = 0;
+    this->capacity = 0;
+    this->status = S_OK;
+
+    return pidl;
+}
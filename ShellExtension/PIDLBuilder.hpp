@@ -0,0 +1,45 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  PIDLBuilder.hpp
+ *  The WinUnionFS Project
+ *
+ *  Builds an ITEMIDLIST by appending items to the end of it.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+class PIDLBuilder
+{
+public:
+    // Constructor/Destructor
+    explicit PIDLBuilder();
+    virtual ~PIDLBuilder();
+
+    // Makes room for cb more bytes of items.
+    HRESULT Reserve(ULONG cb);
+
+    // Appends copies of the items of another ITEMIDLIST.
+    HRESULT Append(LPCITEMIDLIST pidl);
+
+    // Appends a WinUnionFS item, and returns it, or NULL if out of memory. The item stays valid
+    // until the next append.
+    LPITEMIDLIST AppendItem(LPCWSTR name, SFGAOF attributes, USHORT folder, USHORT knownMembers);
+
+    // Returns the ITEMIDLIST, which the caller must free, and starts over. Returns NULL if any
+    // append ran out of memory.
+    LPITEMIDLIST Detach();
+
+private:
+    // Grows the buffer to hold at least cb bytes, including the terminator.
+    HRESULT Grow(ULONG cb);
+    HRESULT Resize(ULONG capacity);
+
+    // The ITEMIDLIST, allocated with CoTaskMemAlloc.
+    LPBYTE buffer;
+
+    // The number of bytes of items so far, excluding the terminator, and the size of the buffer.
+    ULONG used;
+    ULONG capacity;
+
+    // The first failure, after which nothing more is appended.
+    HRESULT status;
+};
@@ -0,0 +1,112 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ParseTask.cpp
+ *  The WinUnionFS Project
+ *
+ *  Resolves a path to an absolute ID list on the worker pool, so that the
+ *  caller can stop waiting on a member which does not answer in time.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <Shlobj.h>
+
+#include "ParseTask.hpp"
+#include "PIDL.h"
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+ParseTask::ParseTask(PCIDLIST_ABSOLUTE root, LPCWSTR path) : Task(true) {
+    this->root = PIDL::Copy(root);
+    this->path = _wcsdup(path);
+    this->hr = E_PENDING;
+    this->result = NULL;
+    this->ranInline = false;
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+ParseTask::~ParseTask() {
+    PIDL::Free(this->root);
+    PIDL::Free(this->result);
+    free(this->path);
+}
+
+
+/// <summary>
+/// Starts parsing the path on the worker pool. If the pool is unavailable the path is parsed on
+/// this thread instead.
+/// </summary>
+void ParseTask::Start() {
+    if (!Submit()) {
+        Execute();
+        this->ranInline = true;
+    }
+}
+
+
+/// <summary>
+/// Waits up to timeout ms for the task, once it has started, and hands over the resulting ID list.
+/// </summary>
+HRESULT ParseTask::Finish(DWORD timeout, PIDLIST_ABSOLUTE *idList) {
+    *idList = NULL;
+
+    if (!this->ranInline && (!WaitStarted(timeout*Task::queueDeadlines) || !Wait(timeout))) {
+        return E_PENDING;
+    }
+
+    if (SUCCEEDED(this->hr)) {
+        *idList = this->result;
+        this->result = NULL;
+    }
+
+    return this->hr;
+}
+
+
+/// <summary>
+/// Task::Execute
+/// Binds the root folder and parses the path relative to it.
+/// </summary>
+void ParseTask::Execute() {
+    IShellFolder *desktopFolder = NULL, *folder = NULL;
+    PIDLIST_RELATIVE relative = NULL;
+    HRESULT hr;
+
+    hr = SHGetDesktopFolder(&desktopFolder);
+
+    if (SUCCEEDED(hr)) {
+        if (this->root == NULL || this->root->mkid.cb == 0) {
+            folder = desktopFolder;
+            folder->AddRef();
+        }
+        else {
+            hr = desktopFolder->BindToObject(this->root, NULL, IID_IShellFolder, reinterpret_cast<LPVOID*>(&folder));
+        }
+    }
+
+    if (SUCCEEDED(hr)) {
+        hr = folder->ParseDisplayName(NULL, NULL, this->path, NULL, &relative, NULL);
+    }
+
+    if (SUCCEEDED(hr)) {
+        this->result = this->root != NULL ? PIDL::Concatenate(this->root, relative) : relative;
+        if (this->root != NULL) {
+            CoTaskMemFree(relative);
+        }
+        if (this->result == NULL) {
+            hr = E_OUTOFMEMORY;
+        }
+    }
+
+    if (folder != NULL) {
+        folder->Release();
+    }
+    if (desktopFolder != NULL) {
+        desktopFolder->Release();
+    }
+
+    this->hr = hr;
+}
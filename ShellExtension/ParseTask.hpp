@@ -0,0 +1,41 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ParseTask.hpp
+ *  The WinUnionFS Project
+ *
+ *  Resolves a path to an absolute ID list on the worker pool.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include "Task.hpp"
+
+class ParseTask : public Task
+{
+public:
+    // Constructor. The path is parsed relative to root, or the desktop if root is NULL.
+    explicit ParseTask(PCIDLIST_ABSOLUTE root, LPCWSTR path);
+
+    // Starts parsing the path on the worker pool.
+    void Start();
+
+    // Waits up to timeout ms for the result. Returns E_PENDING if the task did not finish in time.
+    HRESULT Finish(DWORD timeout, PIDLIST_ABSOLUTE *idList);
+
+protected:
+    // Destructor
+    virtual ~ParseTask();
+
+    // Task
+    void Execute();
+
+private:
+    PIDLIST_ABSOLUTE root;
+    LPWSTR path;
+
+    // True if the pool was unavailable and the task ran on the calling thread.
+    bool ranInline;
+
+    // The outcome, only valid once the task has finished.
+    HRESULT hr;
+    PIDLIST_ABSOLUTE result;
+};
@@ -0,0 +1,206 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ProbeStats.cpp
+ *  The WinUnionFS Project
+ *
+ *  Keeps track of which members of a group names are found in, so that the
+ *  likely members can be asked first.
+ *
+ *  Hits are counted per top level folder of the group, since members tend to
+ *  hold whole subtrees. Subtrees with too few hits fall back to the counts of
+ *  the whole group. Counts are halved once they add up to a few thousand, so
+ *  the order follows where names are found now rather than long ago.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <strsafe.h>
+
+#include <algorithm>
+
+#include "Debug.h"
+#include "ProbeStats.hpp"
+#include "Settings.h"
+
+
+// The most subtrees to keep counts for. Others use the counts of the whole group.
+#define MAX_SUBTREES 256
+
+// Subtrees with fewer hits than this use the counts of the whole group.
+#define MIN_HITS 8
+
+// Counts are halved when they add up to this many hits.
+#define DECAY_HITS 4096
+
+
+/// <summary>
+/// Orders members by descending hit count, and then by precedence.
+/// </summary>
+class ByHits {
+public:
+    explicit ByHits(const std::vector<ULONG> &hits) : hits(hits) {}
+
+    bool operator()(size_t member1, size_t member2) const {
+        ULONG hits1 = member1 < this->hits.size() ? this->hits[member1] : 0;
+        ULONG hits2 = member2 < this->hits.size() ? this->hits[member2] : 0;
+
+        return hits1 != hits2 ? hits1 > hits2 : member1 < member2;
+    }
+
+private:
+    const std::vector<ULONG> &hits;
+};
+
+
+/// <summary>
+/// Counts a hit for the member, halving all counts once they get large.
+/// </summary>
+static void AddHit(std::vector<ULONG> *hits, size_t member) {
+    if (member >= hits->size()) {
+        hits->resize(member + 1, 0);
+    }
+    ++(*hits)[member];
+
+    ULONG total = 0;
+    for (std::vector<ULONG>::const_iterator count = hits->begin(); count != hits->end(); ++count) {
+        total += *count;
+    }
+
+    if (total >= DECAY_HITS) {
+        for (std::vector<ULONG>::iterator count = hits->begin(); count != hits->end(); ++count) {
+            *count /= 2;
+        }
+    }
+}
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+ProbeStats::ProbeStats() {
+    InitializeSRWLock(&this->lock);
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+ProbeStats::~ProbeStats() {
+    for (HitMap::const_iterator iter = this->subtreeHits.begin(); iter != this->subtreeHits.end(); ++iter) {
+        free((LPVOID)iter->first);
+    }
+}
+
+
+/// <summary>
+/// Returns the hit counts of the top level folder path lies in, creating them if asked to and
+/// there is room. The lock must be held, exclusively when creating.
+/// </summary>
+std::vector<ULONG>* ProbeStats::Find(LPCWSTR path, bool create) {
+    size_t cchSubtree = wcscspn(path, L"\\");
+    LPWSTR subtree = new WCHAR[cchSubtree + 1];
+    memcpy(subtree, path, sizeof(WCHAR)*cchSubtree);
+    subtree[cchSubtree] = L'\0';
+
+    std::vector<ULONG>* hits = NULL;
+    HitMap::iterator iter = this->subtreeHits.find(subtree);
+    if (iter != this->subtreeHits.end()) {
+        hits = &iter->second;
+    }
+    else if (create && this->subtreeHits.size() < MAX_SUBTREES) {
+        hits = &this->subtreeHits[_wcsdup(subtree)];
+    }
+
+    delete [] subtree;
+
+    return hits;
+}
+
+
+/// <summary>
+/// Fills order with the indices of the first memberCount members, those which most names in the
+/// folder at path have been found in first.
+/// </summary>
+void ProbeStats::GetOrder(LPCWSTR path, size_t memberCount, std::vector<size_t> *order) {
+    order->clear();
+    for (size_t i = 0; i < memberCount; ++i) {
+        order->push_back(i);
+    }
+
+    AcquireSRWLockShared(&this->lock);
+    std::vector<ULONG>* hits = Find(path, false);
+    ULONG total = 0;
+
+    if (hits != NULL) {
+        for (std::vector<ULONG>::const_iterator count = hits->begin(); count != hits->end(); ++count) {
+            total += *count;
+        }
+    }
+    if (total < MIN_HITS) {
+        hits = &this->allHits;
+    }
+
+    std::stable_sort(order->begin(), order->end(), ByHits(*hits));
+    ReleaseSRWLockShared(&this->lock);
+}
+
+
+/// <summary>
+/// Records a look up of a name in the folder at path.
+/// </summary>
+void ProbeStats::Record(LPCWSTR path, size_t member, bool found, LONGLONG time) {
+    AcquireSRWLockExclusive(&this->lock);
+    if (member >= this->probes.size()) {
+        this->probes.resize(member + 1, 0);
+        this->hits.resize(member + 1, 0);
+        this->time.resize(member + 1, 0);
+    }
+
+    ++this->probes[member];
+    this->time[member] += time;
+
+    if (found) {
+        ++this->hits[member];
+        AddHit(&this->allHits, member);
+
+        std::vector<ULONG>* subtree = Find(path, true);
+        if (subtree != NULL) {
+            AddHit(subtree, member);
+        }
+    }
+    ReleaseSRWLockExclusive(&this->lock);
+}
+
+
+/// <summary>
+/// Writes the look ups, hits and time spent of every member to the registry, in a key named after
+/// the group below HKCU\SOFTWARE\WinUnionFS\Stats, and traces them. Does nothing unless
+/// Settings::statsInterval is set.
+/// </summary>
+void ProbeStats::Publish(LPCWSTR group) {
+    static LPCWSTR counterNames[] = { L"Probes", L"Hits", L"ProbeTime" };
+    WCHAR keyName[MAX_PATH], valueName[32];
+    HKEY key;
+
+    if (Settings::statsInterval == 0) {
+        return;
+    }
+    if (FAILED(StringCchPrintfW(keyName, _countof(keyName), L"SOFTWARE\\WinUnionFS\\Stats\\%s", group)) || RegCreateKeyW(HKEY_CURRENT_USER, keyName, &key) != ERROR_SUCCESS) {
+        return;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    AcquireSRWLockShared(&this->lock);
+    for (size_t i = 0; i < this->probes.size(); ++i) {
+        LONGLONG values[] = { this->probes[i], this->hits[i], this->time[i]*1000000/frequency.QuadPart };
+
+        for (size_t j = 0; j < _countof(values); ++j) {
+            StringCchPrintfW(valueName, _countof(valueName), L"Member%u%s", (ULONG)i, counterNames[j]);
+            RegSetValueExW(key, valueName, 0, REG_QWORD, (const BYTE*)&values[j], sizeof(values[j]));
+        }
+        TRACE(L"%s member %u: %I64d probes, %I64d hits, %I64dus", group, (ULONG)i, values[0], values[1], values[2]);
+    }
+    ReleaseSRWLockShared(&this->lock);
+
+    RegCloseKey(key);
+}
@@ -0,0 +1,51 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ProbeStats.hpp
+ *  The WinUnionFS Project
+ *
+ *  Keeps track of which members of a group names are found in, so that the
+ *  likely members can be asked first.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "Name.h"
+
+class ProbeStats
+{
+public:
+    // Constructor/Destructor
+    explicit ProbeStats();
+    virtual ~ProbeStats();
+
+    // Returns the members most likely to have names in the folder at path first.
+    void GetOrder(LPCWSTR path, size_t memberCount, std::vector<size_t> *order);
+
+    // Records a look up of a name in the folder at path, which took time Stats::Now() ticks.
+    void Record(LPCWSTR path, size_t member, bool found, LONGLONG time);
+
+    // Writes the counters of every member to the registry.
+    void Publish(LPCWSTR group);
+
+private:
+    typedef std::unordered_map<LPCWSTR, std::vector<ULONG>, Name::Hasher, Name::EqualTo> HitMap;
+
+    // Returns the hit counts for the subtree path lies in, or NULL. The lock must be held.
+    std::vector<ULONG>* Find(LPCWSTR path, bool create);
+
+    // The recent hits of each member, by the top level folder they were in.
+    HitMap subtreeHits;
+
+    // The recent hits of each member, in any folder.
+    std::vector<ULONG> allHits;
+
+    // The number of look ups, names found, and ticks spent, by member.
+    std::vector<LONGLONG> probes;
+    std::vector<LONGLONG> hits;
+    std::vector<LONGLONG> time;
+
+    // Guards everything above.
+    SRWLOCK lock;
+};
@@ -0,0 +1,115 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Settings.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tunables, read from HKCU\SOFTWARE\WinUnionFS.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include "Settings.h"
+
+
+// The number of items to request per IEnumIDList::Next call on a member folder.
+DWORD Settings::enumBatchSize = 256;
+
+// The maximum number of worker threads used to enumerate member folders concurrently, and
+// separately to bind and parse paths in them.
+DWORD Settings::workerThreads = 4;
+
+// How long, in ms, to wait for a member folder to bind, parse a path, or produce a batch.
+DWORD Settings::memberTimeout = 3000;
+
+// How long, in ms, to stop trying a member folder after it missed a deadline.
+DWORD Settings::memberBackoff = 30000;
+
+// The maximum number of bytes of merged listings to keep, 0 to disable the listing cache.
+DWORD Settings::cacheSize = 8*1024*1024;
+
+// How long, in ms, a cached listing may be served for.
+DWORD Settings::cacheTimeout = 10000;
+
+// The maximum number of bytes to spend on remembering which members have which folders, 0 to
+// disable it.
+DWORD Settings::trieSize = 1024*1024;
+
+// Set to read member folders in full and merge them in the order the view sorts items in,
+// rather than streaming items in member order as they arrive.
+DWORD Settings::sortedMerge = 0;
+
+// How long, in ms, to wait for changes in member folders to settle before invalidating listings.
+DWORD Settings::watchDelay = 100;
+
+// How long, in ms, to keep the groups loaded after the last object using them went away.
+DWORD Settings::idleTimeout = 60000;
+
+// How often, in ms, to write the performance counters to HKCU\SOFTWARE\WinUnionFS\Stats, 0 to
+// never write them.
+DWORD Settings::statsInterval = 0;
+
+// The binary group configuration file, or NULL to read the groups from the registry.
+LPWSTR Settings::configFile = NULL;
+
+
+/// <summary>
+/// Reads a DWORD value, clamped to [minimum, maximum]. Returns defaultValue if it is not set.
+/// </summary>
+static DWORD ReadDWORD(HKEY key, LPCWSTR value, DWORD defaultValue, DWORD minimum, DWORD maximum) {
+    DWORD data, cbData = sizeof(DWORD);
+
+    if (RegGetValueW(key, NULL, value, RRF_RT_REG_DWORD, NULL, &data, &cbData) != ERROR_SUCCESS) {
+        return defaultValue;
+    }
+
+    return min(max(data, minimum), maximum);
+}
+
+
+/// <summary>
+/// Reads a string value, expanding environment variables. Returns NULL if it is not set, otherwise
+/// a string the caller must free.
+/// </summary>
+static LPWSTR ReadString(HKEY key, LPCWSTR value) {
+    DWORD cbData = 0;
+
+    if (RegGetValueW(key, NULL, value, RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ, NULL, NULL, &cbData) != ERROR_SUCCESS || cbData <= sizeof(WCHAR)) {
+        return NULL;
+    }
+
+    LPWSTR data = (LPWSTR)malloc(cbData);
+    if (RegGetValueW(key, NULL, value, RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ, NULL, data, &cbData) != ERROR_SUCCESS) {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+
+/// <summary>
+/// Loads the settings from the registry.
+/// </summary>
+void Settings::Load() {
+    HKEY key;
+
+    if (RegOpenKeyExW(HKEY_CURRENT_USER, L"SOFTWARE\\WinUnionFS", 0, KEY_READ, &key) != ERROR_SUCCESS) {
+        return;
+    }
+
+    Settings::enumBatchSize = ReadDWORD(key, L"EnumBatchSize", 256, 1, 4096);
+    Settings::workerThreads = ReadDWORD(key, L"WorkerThreads", 4, 1, 64);
+    Settings::memberTimeout = ReadDWORD(key, L"MemberTimeout", 3000, 100, 600000);
+    Settings::memberBackoff = ReadDWORD(key, L"MemberBackoff", 30000, 1000, 3600000);
+    Settings::cacheSize = ReadDWORD(key, L"CacheSize", 8*1024*1024, 0, 1024*1024*1024);
+    Settings::cacheTimeout = ReadDWORD(key, L"CacheTimeout", 10000, 0, 3600000);
+    Settings::trieSize = ReadDWORD(key, L"TrieSize", 1024*1024, 0, 256*1024*1024);
+    Settings::sortedMerge = ReadDWORD(key, L"SortedMerge", 0, 0, 1);
+    Settings::watchDelay = ReadDWORD(key, L"WatchDelay", 100, 0, 10000);
+    Settings::idleTimeout = ReadDWORD(key, L"IdleTimeout", 60000, 0, 3600000);
+    Settings::statsInterval = ReadDWORD(key, L"StatsInterval", 0, 0, 86400000);
+
+    free(Settings::configFile);
+    Settings::configFile = ReadString(key, L"ConfigFile");
+
+    RegCloseKey(key);
+}
@@ -0,0 +1,52 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Settings.h
+ *  The WinUnionFS Project
+ *
+ *  Tunables, read from HKCU\SOFTWARE\WinUnionFS.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace Settings {
+    void Load();
+
+    // The number of items to request per IEnumIDList::Next call on a member folder.
+    extern DWORD enumBatchSize;
+
+    // The maximum number of worker threads used to enumerate member folders concurrently, and
+    // separately to bind and parse paths in them.
+    extern DWORD workerThreads;
+
+    // How long, in ms, to wait for a member folder to bind, parse a path, or produce a batch.
+    extern DWORD memberTimeout;
+
+    // How long, in ms, to stop trying a member folder after it missed a deadline.
+    extern DWORD memberBackoff;
+
+    // The maximum number of bytes of merged listings to keep, 0 to disable the listing cache.
+    extern DWORD cacheSize;
+
+    // How long, in ms, a cached listing may be served for.
+    extern DWORD cacheTimeout;
+
+    // The maximum number of bytes to spend on remembering which members have which folders, 0 to
+    // disable it.
+    extern DWORD trieSize;
+
+    // Set to read member folders in full and merge them in the order the view sorts items in,
+    // rather than streaming items in member order as they arrive.
+    extern DWORD sortedMerge;
+
+    // How long, in ms, to wait for changes in member folders to settle before invalidating listings.
+    extern DWORD watchDelay;
+
+    // How long, in ms, to keep the groups loaded after the last object using them went away.
+    extern DWORD idleTimeout;
+
+    // How often, in ms, to write the performance counters to HKCU\SOFTWARE\WinUnionFS\Stats, 0 to
+    // never write them.
+    extern DWORD statsInterval;
+
+    // The binary group configuration file, or NULL to read the groups from the registry.
+    extern LPWSTR configFile;
+}
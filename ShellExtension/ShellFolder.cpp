@@ -11,14 +11,24 @@
 #include <strsafe.h>
 #include <Shlobj.h>
 #include <Shlwapi.h>
+#include <limits.h>
 
+#include <algorithm>
+
+#include "BloomFilter.hpp"
 #include "Debug.h"
+#include "DirectoryTrie.h"
 #include "EnumIDList.hpp"
 #include "Group.hpp"
+#include "ListingCache.h"
 #include "Macros.h"
+#include "Name.h"
 #include "PIDL.h"
+#include "PIDLBuilder.hpp"
 #include "ShellFolder.hpp"
 #include "ShellView.hpp"
+#include "Stats.h"
+#include "UnionEnumIDList.hpp"
 
 
 // The number of in-use objects.
@@ -28,6 +38,31 @@ extern long objectCounter;
 extern const CLSID CLSID_WinUnionFS;
 
 
+/// <summary>
+/// Returns the path of name within the folder at path, with forward slashes turned into
+/// backslashes. The caller must delete [] it.
+/// </summary>
+static LPWSTR JoinPath(LPCWSTR path, LPCWSTR name) {
+    size_t cchPath = wcslen(path) + 1 + wcslen(name) + 1;
+    LPWSTR joined = new WCHAR[cchPath];
+
+    if (*path != L'\0') {
+        StringCchPrintfW(joined, cchPath, L"%s\\%s", path, name);
+    }
+    else {
+        StringCchCopyW(joined, cchPath, name);
+    }
+
+    for (LPWSTR c = joined; *c != L'\0'; ++c) {
+        if (*c == L'/') {
+            *c = L'\\';
+        }
+    }
+
+    return joined;
+}
+
+
 /// <summary>
 /// Constructor.
 /// </summary>
@@ -38,11 +73,24 @@ ShellFolder::ShellFolder(LPCITEMIDLIST path) {
     this->folder = PIDL::Copy(path);
 
     if (path != NULL) {
-        PIDL::GetShellFoldersFor(path, &this->folders);
+        PIDL::GetShellFoldersFor(path, &this->folders, &this->unanswered);
     }
 }
 
 
+/// <summary>
+/// Constructor. Takes over the references to folders, which are already bound for path.
+/// </summary>
+ShellFolder::ShellFolder(LPCITEMIDLIST path, const std::vector<IShellFolder*> &folders, const std::vector<bool> &unanswered) {
+    this->refCount = 1;
+    InterlockedIncrement(&::objectCounter);
+    Group::AddUser();
+    this->folder = PIDL::Copy(path);
+    this->folders = folders;
+    this->unanswered = unanswered;
+}
+
+
 /// <summary>
 /// Destructor.
 /// </summary>
@@ -52,7 +100,9 @@ ShellFolder::~ShellFolder() {
     PIDL::Free(this->folder);
 
     for (std::vector<IShellFolder*>::const_iterator folder = this->folders.begin(); folder != this->folders.end(); ++folder) {
-        (*folder)->Release();
+        if (*folder != NULL) {
+            (*folder)->Release();
+        }
     }
 }
 
@@ -134,7 +184,24 @@ HRESULT ShellFolder::BindToObject(PCUIDLIST_RELATIVE pidl, IBindCtx *pbc, REFIID
 
     if (riid == IID_IShellFolder) {
         LPITEMIDLIST newPidl = PIDL::Concatenate(this->folder, pidl);
-        *ppvOut = (IShellFolder*)(new ShellFolder(newPidl));
+        Group* group = NULL;
+
+        // A direct child of a folder inside a group can be bound from our own member folders.
+        if (PIDL::ItemCount(this->folder) > 1 && PIDL::Next(pidl)->mkid.cb == 0) {
+            group = PIDL::GetGroup(this->folder);
+        }
+
+        if (group != NULL) {
+            std::vector<IShellFolder*> children;
+            std::vector<bool> unanswered;
+            group->GetChildFoldersFor(this->folders, this->unanswered, pidl, &children, &unanswered);
+            group->Release();
+            *ppvOut = (IShellFolder*)(new ShellFolder(newPidl, children, unanswered));
+        }
+        else {
+            *ppvOut = (IShellFolder*)(new ShellFolder(newPidl));
+        }
+
         PIDL::Free(newPidl);
         return S_OK;
     }
@@ -155,9 +222,21 @@ HRESULT ShellFolder::BindToStorage(PCUIDLIST_RELATIVE pidl, IBindCtx *pbc, REFII
 /// <summary>
 /// IShellFolder::CompareIDs
 /// Determines the relative order of two file objects or folders, given their item identifier lists.
+/// Items are in natural order, by the sort keys they were made with, and names which only differ
+/// in ways the keys ignore, like leading zeros, are ordered by Name::Compare.
 /// </summary>
 HRESULT ShellFolder::CompareIDs(LPARAM lParam, PCUIDLIST_RELATIVE pidl1, PCUIDLIST_RELATIVE pidl2) {
-    return MAKE_HRESULT(0, 0, (USHORT)wcscmp(PIDL::Item(pidl1)->name, PIDL::Item(pidl2)->name));
+    if (PIDL::NamesEqual(pidl1, pidl2)) {
+        return MAKE_HRESULT(0, 0, 0);
+    }
+
+    int result = PIDL::CompareSortKeys(pidl1, pidl2);
+    if (result == 0) {
+        result = Name::Compare(PIDL::GetName(pidl1), PIDL::GetName(pidl2));
+    }
+
+    // Only the sign counts, and a raw difference may not survive being cut down to a USHORT.
+    return MAKE_HRESULT(0, 0, (USHORT)(result < 0 ? -1 : 1));
 }
 
 
@@ -204,46 +283,42 @@ HRESULT ShellFolder::EnumObjects(HWND hwndOwner, SHCONTF grfFlags, IEnumIDList *
         return E_POINTER;
     }
 
-    EnumIDList* list = new EnumIDList();
-
     if (PIDL::ItemCount(this->folder) == 1) {
         // This is the root folder, we should list the groups
+        EnumIDList* list = new EnumIDList();
+
         if (FLAGSET(grfFlags, SHCONTF_CHECKING_FOR_CHILDREN) || FLAGSET(grfFlags, SHCONTF_FOLDERS)) {
-            int groupIndex = 0;
-            Group* group;
-            while ((group = Group::Find(groupIndex++)) != NULL) {
-                list->AddItem(PIDL::Create(NULL, (LPWSTR)group->name, SFGAO_FOLDER | SFGAO_BROWSABLE | SFGAO_HASSUBFOLDER, 0));
+            GroupSnapshot* snapshot = GroupSnapshot::Current();
+            if (snapshot != NULL) {
+                for (size_t i = 0; i < snapshot->Count(); ++i) {
+                    list->AddItem(snapshot->Get(i)->name, SFGAO_FOLDER | SFGAO_BROWSABLE | SFGAO_HASSUBFOLDER, 0, 0);
+                }
+                snapshot->Release();
             }
         }
+
+        list->QueryInterface(IID_IEnumIDList, reinterpret_cast<LPVOID*>(ppenumIDList));
+        list->Release();
     }
     else {
-        // Enumerate the contents of all the shell folders
-        int f = 0;
-        for (std::vector<IShellFolder*>::const_iterator folder = this->folders.begin(); folder != this->folders.end(); ++folder) {
-            IEnumIDList* enumIDList;
-            PIDLIST_RELATIVE idNext = NULL;
+        Group* group = PIDL::GetGroup(this->folder);
+        LPWSTR path = PIDL::GetFullPath(PIDL::Next(this->folder), NULL);
 
-            (*folder)->EnumObjects(hwndOwner, grfFlags, &enumIDList);
+        // Serve a recent listing of this folder if we have one, otherwise merge the contents of all
+        // the shell folders as the caller asks for them, and remember the result.
+        if (group == NULL || !ListingCache::Lookup(group->name, path, grfFlags, ppenumIDList)) {
+            UnionEnumIDList* list = new UnionEnumIDList(group, this->folders, this->unanswered, hwndOwner, grfFlags);
+            list->CacheAs(path);
 
-            while (enumIDList->Next(1, &idNext, NULL) != S_FALSE) {
-                WCHAR fileName[MAX_PATH];
-                STRRET name;
-                SFGAOF attributes = SFGAOF(-1);
-
-                (*folder)->GetAttributesOf(1, (LPCITEMIDLIST *)&idNext, &attributes);
-                (*folder)->GetDisplayNameOf(idNext, SHGDN_NORMAL, &name);
-                StrRetToBufW(&name, idNext, fileName, MAX_PATH);
-                list->AddItem(PIDL::Create(NULL, fileName, SFGAO_FOLDER | SFGAO_BROWSABLE | SFGAO_HASSUBFOLDER, f));
+            list->QueryInterface(IID_IEnumIDList, reinterpret_cast<LPVOID*>(ppenumIDList));
+            list->Release();
+        }
 
-                ILFree(idNext);
-            }
-            ++f;
-            enumIDList->Release();
+        if (group != NULL) {
+            group->Release();
         }
+        CoTaskMemFree(path);
     }
-    
-    list->QueryInterface(IID_IEnumIDList, reinterpret_cast<LPVOID*>(ppenumIDList));
-    list->Release();
 
     return S_OK;
 }
@@ -305,14 +380,14 @@ HRESULT ShellFolder::GetUIObjectOf(HWND hwndOwner, UINT cidl, PCUITEMID_CHILD_AR
     // TODO::We need to override some things to make navigation work properly...
     if (PIDL::ItemCount(this->folder) > 1) {
         PIDLIST_ABSOLUTE idList = NULL;
-        PIDL::PIDLItem* item = PIDL::Item(apidl[0]);
+        USHORT folder = PIDL::GetFolder(apidl[0]);
 
-        if (item->folder >= this->folders.size()) {
+        if (folder >= this->folders.size() || this->folders[folder] == NULL) {
             return E_FAIL;
         }
 
-        hr = this->folders[item->folder]->ParseDisplayName(hwndOwner, NULL, item->name, NULL, &idList, NULL);
-        hr = this->folders[item->folder]->GetUIObjectOf(hwndOwner, 1, (LPCITEMIDLIST *)&idList, riid, rgfReserved, ppv);
+        hr = this->folders[folder]->ParseDisplayName(hwndOwner, NULL, (LPWSTR)PIDL::GetName(apidl[0]), NULL, &idList, NULL);
+        hr = this->folders[folder]->GetUIObjectOf(hwndOwner, 1, (LPCITEMIDLIST *)&idList, riid, rgfReserved, ppv);
         ILFree(idList);
     }
     else {
@@ -335,41 +410,203 @@ HRESULT ShellFolder::GetUIObjectOf(HWND hwndOwner, UINT cidl, PCUITEMID_CHILD_AR
 /// Translates the display name of a file object or a folder into an item identifier list.
 /// </summary>
 HRESULT ShellFolder::ParseDisplayName(HWND hwnd, IBindCtx *pbc, LPWSTR pszDisplayName, ULONG *pchEaten, PIDLIST_RELATIVE *ppidl, ULONG *pdwAttributes) {
-    HRESULT hr = E_FAIL;
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
 
     ULONG attributes = ULONG(-1);
-    
-    PIDLIST_ABSOLUTE idList = NULL;
-    int i;
-    for (i = 0; i < this->folders.size(); ++i) {
-        if (SUCCEEDED(hr = this->folders[i]->ParseDisplayName(hwnd, NULL, pszDisplayName, pchEaten, &idList, &attributes))) {
-            ILFree(idList);
+
+    // Names which recently turned out not to exist in any member aren't looked for again, and
+    // members whose filter lacks the first part of the name don't need to be asked at all.
+    BloomFilter* filter = NULL;
+    LPWSTR path = NULL, first = NULL, fullPath = NULL;
+    ULONG generation = 0;
+    bool knownAbsent = false, singlePart = false;
+    Group* group = PIDL::GetGroup(this->folder);
+    if (group != NULL) {
+        generation = ListingCache::Generation(group->name);
+        path = PIDL::GetFullPath(PIDL::Next(this->folder), NULL);
+        fullPath = JoinPath(path, pszDisplayName);
+        knownAbsent = ListingCache::IsAbsent(group->name, fullPath);
+        if (!knownAbsent) {
+            filter = ListingCache::LookupFilter(group->name, path);
+        }
+    }
+    if (filter != NULL) {
+        size_t cchFirst = wcscspn(pszDisplayName, L"\\/");
+        first = new WCHAR[cchFirst + 1];
+        StringCchCopyNW(first, cchFirst + 1, pszDisplayName, cchFirst);
+        singlePart = pszDisplayName[cchFirst] == L'\0';
+
+        // The filter only holds the names the listing showed, so a short name or a stream has to
+        // be asked for regardless.
+        if (Name::MayBeAlias(first)) {
+            filter->Release();
+            filter = NULL;
+            delete [] first;
+            first = NULL;
+        }
+    }
+
+    // The members which may have the first part of the name, and those which may have all of it.
+    // A name which only the filter ruled out somewhere isn't known to be absent.
+    std::vector<bool> present(this->folders.size(), false);
+    std::vector<bool> mayHave(this->folders.size(), false);
+    bool filtered = false;
+    for (size_t i = 0; i < this->folders.size(); ++i) {
+        if (this->folders[i] == NULL) {
+            continue;
+        }
+        if (filter != NULL) {
+            Stats::Add(Stats::FILTER_CHECKS, 1);
+            if (!filter->MayContain(i, first)) {
+                Stats::Add(Stats::FILTER_SKIPS, 1);
+                filtered = true;
+                continue;
+            }
+        }
+        present[i] = true;
+        mayHave[i] = !knownAbsent;
+    }
+
+    // Nor can members which lack one of the folders on the way have it.
+    if (group != NULL && !knownAbsent) {
+        DirectoryTrie::Prune(group->name, fullPath, false, &mayHave);
+    }
+
+    // Ask the members the name is most likely to be in first.
+    std::vector<size_t> order;
+    if (group != NULL) {
+        group->GetProbeOrder(path, &order);
+    }
+    else {
+        for (size_t i = 0; i < this->folders.size(); ++i) {
+            order.push_back(i);
+        }
+    }
+
+    // Only a name which every member reported missing is remembered as such, so not one which a
+    // member that didn't answer for this folder might have, or one the filter kept us from asking.
+    bool absent = !filtered && std::find(this->unanswered.begin(), this->unanswered.end(), true) == this->unanswered.end();
+    size_t found = this->folders.size();
+    ULONG probes = 0;
+
+    for (std::vector<size_t>::const_iterator member = order.begin(); member != order.end(); ++member) {
+        if (*member >= this->folders.size() || !mayHave[*member]) {
+            continue;
+        }
+
+        ++probes;
+        if (SUCCEEDED(hr = Probe(*member, group, path, hwnd, pszDisplayName, pchEaten, &attributes))) {
+            found = *member;
             break;
         }
+
+        // The filter only vouched for the first part of the name, so only a single part name it let
+        // through which turned out to be missing is a false positive.
+        mayHave[*member] = false;
+        if (filter != NULL && singlePart && NOTFOUND(hr)) {
+            Stats::Add(Stats::FILTER_FALSE_POSITIVES, 1);
+        }
+        if (!NOTFOUND(hr)) {
+            absent = false;
+        }
     }
 
+    // The name belongs to the first member which has it, as in listings: a file there hides folders
+    // of later members, and a folder there hides their files. So the members before the one which
+    // answered must be asked, in order, whether it found a file or a folder. The first of them
+    // which has the name wins, and if it has a folder, the folders of the rest are merged into it.
     if (SUCCEEDED(hr)) {
-        WCHAR path[MAX_PATH];
-        WCHAR *context, *token;
-        LPITEMIDLIST pidl, temp;
+        for (size_t i = 0; i < found; ++i) {
+            ULONG memberAttributes = ULONG(-1);
+
+            if (!mayHave[i]) {
+                continue;
+            }
+
+            ++probes;
+            HRESULT memberHr = Probe(i, group, path, hwnd, pszDisplayName, pchEaten, &memberAttributes);
+            if (SUCCEEDED(memberHr)) {
+                found = i;
+                attributes = memberAttributes;
+                break;
+            }
+
+            mayHave[i] = false;
+            if (filter != NULL && singlePart && NOTFOUND(memberHr)) {
+                Stats::Add(Stats::FILTER_FALSE_POSITIVES, 1);
+            }
+        }
+    }
 
-        StringCchCopyW(path, MAX_PATH, pszDisplayName);
+    if (SUCCEEDED(hr) && probes == 1) {
+        Stats::Add(Stats::PROBE_FIRST_HITS, 1);
+    }
 
-        token = wcstok_s(path, L"/", &context);
-        pidl = PIDL::Create(NULL, token, SFGAO_BROWSABLE | SFGAO_FOLDER | SFGAO_HASSUBFOLDER, i);
+    if (FAILED(hr) && absent && !knownAbsent && group != NULL) {
+        ListingCache::StoreAbsent(group->name, fullPath, generation);
+    }
 
-        while ((token = wcstok_s(NULL, L"/", &context)) != NULL) {
-            temp = PIDL::Create(pidl, token, SFGAO_BROWSABLE | SFGAO_FOLDER | SFGAO_HASSUBFOLDER, i);
-            PIDL::Free(pidl);
-            pidl = temp;
+    if (filter != NULL) {
+        filter->Release();
+        delete [] first;
+    }
+    if (group != NULL) {
+        group->Release();
+    }
+    CoTaskMemFree(path);
+    delete [] fullPath;
+
+    if (SUCCEEDED(hr)) {
+        LPWSTR parts = _wcsdup(pszDisplayName);
+        WCHAR *context, *token;
+        std::vector<LPCWSTR> tokens;
+        USHORT known = USHORT(this->folders.size());
+        ULONG cbItems = 0;
+
+        // Display names may use either separator. An item's size has to fit in its USHORT cb.
+        for (token = wcstok_s(parts, L"\\/", &context); token != NULL; token = wcstok_s(NULL, L"\\/", &context)) {
+            ULONG cbItem = PIDL::ChildSize(token, known) - sizeof(USHORT);
+            if (cbItem > USHRT_MAX) {
+                hr = HRESULT_FROM_WIN32(ERROR_FILENAME_EXCED_RANGE);
+                break;
+            }
+
+            tokens.push_back(token);
+            cbItems += cbItem;
         }
 
-        PIDL::Item(PIDL::Last(pidl))->attributes = attributes;
-        *ppidl = pidl;
+        if (SUCCEEDED(hr)) {
+            PIDLBuilder builder;
+            builder.Reserve(cbItems);
+
+            // Every member which may have the first part of the name may have the folders on the
+            // way, but only those which weren't ruled out may have the last part.
+            for (size_t part = 0; part < tokens.size(); ++part) {
+                bool last = part + 1 == tokens.size();
+                LPITEMIDLIST item = builder.AppendItem(tokens[part], last ? attributes : SFGAO_BROWSABLE | SFGAO_FOLDER | SFGAO_HASSUBFOLDER, USHORT(found), known);
+                if (item == NULL) {
+                    break;
+                }
+
+                for (size_t i = 0; i < this->folders.size(); ++i) {
+                    if (last ? mayHave[i] : present[i]) {
+                        PIDL::AddMember(item, USHORT(i));
+                    }
+                }
+            }
 
-        if (pdwAttributes != NULL) {
-            *pdwAttributes &= attributes;
+            LPITEMIDLIST pidl = builder.Detach();
+            if (pidl != NULL) {
+                *ppidl = pidl;
+                if (pdwAttributes != NULL) {
+                    *pdwAttributes &= attributes;
+                }
+            }
+            else {
+                hr = E_OUTOFMEMORY;
+            }
         }
+        free(parts);
     }
 
     return hr;
@@ -622,10 +859,14 @@ HRESULT ShellFolder::Initialize(LPCITEMIDLIST pidl) {
     this->folder = PIDL::Copy(pidl);
     
     for (std::vector<IShellFolder*>::const_iterator folder = this->folders.begin(); folder != this->folders.end(); ++folder) {
-        (*folder)->Release();
+        if (*folder != NULL) {
+            (*folder)->Release();
+        }
     }
+    this->folders.clear();
+    this->unanswered.clear();
 
-    PIDL::GetShellFoldersFor(this->folder, &this->folders);
+    PIDL::GetShellFoldersFor(this->folder, &this->folders, &this->unanswered);
 
     return S_OK;
 }
@@ -663,3 +904,21 @@ HRESULT ShellFolder::InitializeEx(IBindCtx *pbc, LPCITEMIDLIST pidlRoot, const P
 
     return E_NOTIMPL;
 }
+
+
+/// <summary>
+/// Asks a single member to parse the name, recording whether it had it and how long it took.
+/// </summary>
+HRESULT ShellFolder::Probe(size_t member, Group* group, LPCWSTR path, HWND hwnd, LPWSTR name, ULONG *pchEaten, ULONG *attributes) {
+    PIDLIST_RELATIVE idList = NULL;
+    LONGLONG start = Stats::Now();
+
+    HRESULT hr = this->folders[member]->ParseDisplayName(hwnd, NULL, name, pchEaten, &idList, attributes);
+    CoTaskMemFree(idList);
+
+    if (group != NULL) {
+        group->ProbeFinished(path, member, SUCCEEDED(hr), Stats::Now() - start);
+    }
+
+    return hr;
+}
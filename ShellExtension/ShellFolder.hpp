@@ -9,6 +9,8 @@
 
 #include <vector>
 
+class Group;
+
 class ShellFolder :
     public IShellFolder2,
     public IPersistIDList,
@@ -17,6 +19,7 @@ class ShellFolder :
 public:
     // Constructor
     explicit ShellFolder(LPCITEMIDLIST path);
+    explicit ShellFolder(LPCITEMIDLIST path, const std::vector<IShellFolder*> &folders, const std::vector<bool> &unanswered);
 
     // IUnknown
     ULONG STDMETHODCALLTYPE AddRef();
@@ -65,11 +68,18 @@ private:
     // Destructor
     virtual ~ShellFolder();
 
+    // Asks a single member to parse a name.
+    HRESULT Probe(size_t member, Group* group, LPCWSTR path, HWND hwnd, LPWSTR name, ULONG *pchEaten, ULONG *attributes);
+
     ULONG refCount;
 
     LPITEMIDLIST folder;
 
     std::vector<IShellFolder*> folders;
 
+    // Set for the members whose folder is NULL because they didn't answer, rather than because
+    // they lack this folder. Nothing learned without them may be remembered.
+    std::vector<bool> unanswered;
+
     PERSIST_FOLDER_TARGET_INFO folderTargetInfo;
 };
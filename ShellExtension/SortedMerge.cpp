@@ -0,0 +1,162 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  SortedMerge.cpp
+ *  The WinUnionFS Project
+ *
+ *  K-way merge of the sorted listings of several member folders. Each
+ *  listing is sorted by the items' sort keys, and the members are kept in a
+ *  heap ordered by the item at the head of their listing, so that the next
+ *  item of the union is always at the top. Items with the same name sort
+ *  next to each other, in order of precedence, so duplicates are folded into
+ *  the item of the first member which has them as they come off the heap.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <algorithm>
+
+#include "Name.h"
+#include "SortedMerge.hpp"
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+SortedMerge::SortedMerge() {
+    this->sorted = false;
+}
+
+
+/// <summary>
+/// Starts over with memberCount empty listings.
+/// </summary>
+void SortedMerge::Reset(size_t memberCount) {
+    this->entries.clear();
+    this->entries.resize(memberCount);
+    this->positions.assign(memberCount, 0);
+    this->heap.clear();
+    this->sorted = false;
+    this->keys.Clear();
+}
+
+
+/// <summary>
+/// Adds an item to a member's listing, working out its sort key.
+/// </summary>
+void SortedMerge::Add(size_t member, LPCWSTR name, SFGAOF attributes) {
+    Entry entry;
+
+    entry.name = name;
+    entry.cbKey = ULONG(Name::SortKey(name, NULL));
+    entry.key = (LPBYTE)this->keys.Allocate(max(entry.cbKey, ULONG(1)));
+    Name::SortKey(name, entry.key);
+    entry.attributes = attributes;
+    this->entries[member].push_back(entry);
+}
+
+
+/// <summary>
+/// Sorts each listing, and builds the heap of the members which have any items.
+/// </summary>
+void SortedMerge::Sort() {
+    this->heap.clear();
+
+    for (size_t i = 0; i < this->entries.size(); ++i) {
+        std::sort(this->entries[i].begin(), this->entries[i].end(), EntryLess());
+        if (!this->entries[i].empty()) {
+            this->heap.push_back(i);
+        }
+    }
+
+    std::make_heap(this->heap.begin(), this->heap.end(), HeadGreater(this));
+    this->sorted = true;
+}
+
+
+/// <summary>
+/// True once the listings have been sorted.
+/// </summary>
+bool SortedMerge::IsSorted() const {
+    return this->sorted;
+}
+
+
+/// <summary>
+/// Takes the smallest entry off the heap of members, along with the entries of later members with
+/// the same name, which sort right after it.
+/// </summary>
+bool SortedMerge::Next(const Entry **entry, size_t *member, std::vector<size_t> *duplicates) {
+    duplicates->clear();
+
+    if (this->heap.empty()) {
+        return false;
+    }
+
+    *member = this->heap.front();
+    *entry = &this->entries[*member][this->positions[*member]];
+    Advance(*member);
+
+    while (!this->heap.empty()) {
+        size_t next = this->heap.front();
+        if (!Name::Equal(this->entries[next][this->positions[next]].name, (*entry)->name)) {
+            break;
+        }
+
+        duplicates->push_back(next);
+        Advance(next);
+    }
+
+    return true;
+}
+
+
+/// <summary>
+/// Moves the member at the top of the heap past its head entry, dropping it once it runs out.
+/// </summary>
+void SortedMerge::Advance(size_t member) {
+    HeadGreater greater(this);
+
+    std::pop_heap(this->heap.begin(), this->heap.end(), greater);
+    if (++this->positions[member] == this->entries[member].size()) {
+        this->heap.pop_back();
+    }
+    else {
+        std::push_heap(this->heap.begin(), this->heap.end(), greater);
+    }
+}
+
+
+/// <summary>
+/// Returns true if the first entry sorts before the second.
+/// </summary>
+bool SortedMerge::EntryLess::operator()(const Entry &entry1, const Entry &entry2) const {
+    int result = memcmp(entry1.key, entry2.key, min(entry1.cbKey, entry2.cbKey));
+    if (result == 0) {
+        result = int(entry1.cbKey) - int(entry2.cbKey);
+    }
+    if (result == 0) {
+        result = Name::Compare(entry1.name, entry2.name);
+    }
+
+    return result < 0;
+}
+
+
+/// <summary>
+/// Returns true if the next entry of member1 comes after the next entry of member2. Members with
+/// the same name come out in order of precedence, so the member which provides the item is first.
+/// </summary>
+bool SortedMerge::HeadGreater::operator()(size_t member1, size_t member2) const {
+    const Entry &entry1 = this->merge->entries[member1][this->merge->positions[member1]];
+    const Entry &entry2 = this->merge->entries[member2][this->merge->positions[member2]];
+    EntryLess less;
+
+    if (less(entry2, entry1)) {
+        return true;
+    }
+    if (less(entry1, entry2)) {
+        return false;
+    }
+
+    return member1 > member2;
+}
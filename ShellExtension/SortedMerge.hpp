@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  SortedMerge.hpp
+ *  The WinUnionFS Project
+ *
+ *  K-way merge of the sorted listings of several member folders.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <vector>
+
+#include "Arena.hpp"
+
+class SortedMerge
+{
+public:
+    // An item of a member's listing. The key is stored in the merge's arena.
+    typedef struct {
+        LPCWSTR name;
+        LPBYTE key;
+        ULONG cbKey;
+        SFGAOF attributes;
+    } Entry;
+
+    // Constructor
+    explicit SortedMerge();
+
+    // Starts over with memberCount empty listings, in order of precedence.
+    void Reset(size_t memberCount);
+
+    // Adds an item to a member's listing. The name must stay valid until the merge is reset.
+    void Add(size_t member, LPCWSTR name, SFGAOF attributes);
+
+    // Sorts the listings, once every item has been added, and starts merging them.
+    void Sort();
+
+    // True once the listings have been sorted.
+    bool IsSorted() const;
+
+    // Retrieves the next item, from the member of highest precedence which has it. The later
+    // members with the same name are put in duplicates. Returns false once every listing is merged.
+    bool Next(const Entry **entry, size_t *member, std::vector<size_t> *duplicates);
+
+private:
+    // Orders entries the way ShellFolder::CompareIDs orders items.
+    class EntryLess {
+    public:
+        bool operator()(const Entry &entry1, const Entry &entry2) const;
+    };
+
+    // Orders members by their next entry, and then by precedence, with the greatest first, which
+    // makes the heap of members a min-heap.
+    class HeadGreater {
+    public:
+        explicit HeadGreater(SortedMerge* merge) : merge(merge) {}
+        bool operator()(size_t member1, size_t member2) const;
+
+    private:
+        SortedMerge* merge;
+    };
+
+    // Moves a member past the entry at its head, which must be the top of the heap.
+    void Advance(size_t member);
+
+    // The listing of each member, and how far into it the merge has got.
+    std::vector<std::vector<Entry> > entries;
+    std::vector<size_t> positions;
+
+    // The members which have entries left, as a heap ordered by HeadGreater.
+    std::vector<size_t> heap;
+
+    // Set once the listings have been sorted.
+    bool sorted;
+
+    // The sort keys of the entries.
+    Arena keys;
+};
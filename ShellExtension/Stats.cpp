@@ -0,0 +1,134 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Stats.cpp
+ *  The WinUnionFS Project
+ *
+ *  Process-wide performance counters. Counters whose name ends in "Time" are
+ *  accumulated in performance counter ticks, and published in microseconds.
+ *
+ *  As enumerations finish, at most every Settings::statsInterval ms, the
+ *  counters are written to values named after them under
+ *  HKCU\SOFTWARE\WinUnionFS\Stats, so that they can be read with any registry
+ *  tool in any build.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include "Debug.h"
+#include "Settings.h"
+#include "Stats.h"
+
+
+// The current value of every counter.
+static volatile LONGLONG counters[Stats::COUNTER_COUNT];
+
+// The names of the counters, which they are published under.
+static LPCWSTR counterNames[Stats::COUNTER_COUNT] = {
+    L"EnumNextCalls",
+    L"EnumNextTime",
+    L"EnumAttributesCalls",
+    L"EnumAttributesTime",
+    L"EnumDisplayNameCalls",
+    L"EnumDisplayNameTime",
+    L"EnumItems",
+    L"MemberTimeouts",
+    L"MemberFailures",
+    L"MemberSkipped",
+    L"MemberBinds",
+    L"MemberBindTime",
+    L"CacheHits",
+    L"CacheMisses",
+    L"CacheEvictions",
+    L"CacheInvalidations",
+    L"WatchEvents",
+    L"WatchOverflows",
+    L"ConfigReloads",
+    L"ConfigGroupsKept",
+    L"ConfigGroupsRebuilt",
+    L"FilterChecks",
+    L"FilterSkips",
+    L"FilterFalsePositives",
+    L"AbsentHits",
+    L"AbsentMisses",
+    L"AbsentStores",
+    L"Probes",
+    L"ProbeTime",
+    L"ProbeFirstHits",
+    L"TriePrunes",
+    L"TrieEvictions"
+};
+
+// When the counters were last published, in GetTickCount64 time.
+static volatile LONGLONG lastPublished;
+
+
+/// <summary>
+/// Adds value to the specified counter.
+/// </summary>
+void Stats::Add(Counter counter, LONGLONG value) {
+    InterlockedExchangeAdd64(&counters[counter], value);
+}
+
+
+/// <summary>
+/// Returns the current value of the specified counter.
+/// </summary>
+LONGLONG Stats::Get(Counter counter) {
+    return counters[counter];
+}
+
+
+/// <summary>
+/// Returns the name of the specified counter.
+/// </summary>
+LPCWSTR Stats::GetName(Counter counter) {
+    return counterNames[counter];
+}
+
+
+/// <summary>
+/// Returns the current time, in performance counter ticks.
+/// </summary>
+LONGLONG Stats::Now() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+
+/// <summary>
+/// Writes all counters to the registry, and traces them, unless they were written less than
+/// Settings::statsInterval ms ago or another thread is writing them. Returns true if they were.
+/// </summary>
+bool Stats::Publish() {
+    LONGLONG last = lastPublished;
+    LONGLONG now = LONGLONG(GetTickCount64());
+    HKEY key;
+
+    if (Settings::statsInterval == 0 || (last != 0 && now - last < LONGLONG(Settings::statsInterval))) {
+        return false;
+    }
+    if (InterlockedCompareExchange64(&lastPublished, now, last) != last) {
+        return false;
+    }
+    if (RegCreateKeyW(HKEY_CURRENT_USER, L"SOFTWARE\\WinUnionFS\\Stats", &key) != ERROR_SUCCESS) {
+        return false;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        LONGLONG value = counters[i];
+        size_t length = wcslen(counterNames[i]);
+
+        if (length > 4 && wcscmp(counterNames[i] + length - 4, L"Time") == 0) {
+            value = value*1000000/frequency.QuadPart;
+        }
+
+        RegSetValueExW(key, counterNames[i], 0, REG_QWORD, (const BYTE*)&value, sizeof(value));
+        TRACE(L"%s: %I64d", counterNames[i], value);
+    }
+
+    RegCloseKey(key);
+    return true;
+}
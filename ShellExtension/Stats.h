@@ -0,0 +1,75 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Stats.h
+ *  The WinUnionFS Project
+ *
+ *  Process-wide performance counters.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace Stats {
+    typedef enum {
+        // Round trips to member folders while enumerating, and the time spent in them.
+        ENUM_NEXT_CALLS,
+        ENUM_NEXT_TIME,
+        ENUM_ATTRIBUTES_CALLS,
+        ENUM_ATTRIBUTES_TIME,
+        ENUM_DISPLAYNAME_CALLS,
+        ENUM_DISPLAYNAME_TIME,
+        ENUM_ITEMS,
+
+        // Member folders which missed a deadline, failed to bind, or were skipped by their breaker.
+        MEMBER_TIMEOUTS,
+        MEMBER_FAILURES,
+        MEMBER_SKIPPED,
+
+        // Child folders bound relative to a member's parent folder, and the time spent on it.
+        MEMBER_BINDS,
+        MEMBER_BIND_TIME,
+
+        // Merged listings served from, missing from, evicted from, and invalidated in the cache.
+        CACHE_HITS,
+        CACHE_MISSES,
+        CACHE_EVICTIONS,
+        CACHE_INVALIDATIONS,
+
+        // Changes reported by watched member folders, and reads which lost track of the changes.
+        WATCH_EVENTS,
+        WATCH_OVERFLOWS,
+
+        // Configuration reloads, and the groups they carried over as they were or had to rebuild.
+        CONFIG_RELOADS,
+        CONFIG_GROUPS_KEPT,
+        CONFIG_GROUPS_REBUILT,
+
+        // Member probes while parsing names which were checked against the member's filter, which
+        // the filter ruled out, and single part names the filter allowed which the member lacked.
+        FILTER_CHECKS,
+        FILTER_SKIPS,
+        FILTER_FALSE_POSITIVES,
+
+        // Lookups of paths no member had, which were answered by, missing from, and added to the cache.
+        ABSENT_HITS,
+        ABSENT_MISSES,
+        ABSENT_STORES,
+
+        // Members asked for a name while parsing, the time spent on it, and names found by the
+        // first member asked.
+        PROBES,
+        PROBE_TIME,
+        PROBE_FIRST_HITS,
+
+        // Members left out of binds and look ups because they lack a folder on the way, and
+        // folders whose contents were forgotten to stay within the budget.
+        TRIE_PRUNES,
+        TRIE_EVICTIONS,
+
+        COUNTER_COUNT
+    } Counter;
+
+    void Add(Counter counter, LONGLONG value);
+    LONGLONG Get(Counter counter);
+    LPCWSTR GetName(Counter counter);
+    LONGLONG Now();
+    bool Publish();
+}
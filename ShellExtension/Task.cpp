@@ -0,0 +1,175 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Task.cpp
+ *  The WinUnionFS Project
+ *
+ *  A unit of work which runs on one of the shared, bounded worker pools.
+ *
+ *  Long tasks, like reading a whole member folder, and short tasks which a
+ *  caller waits on with a deadline, like binding or parsing a path, have
+ *  pools of their own, so that a deadline is never spent waiting behind
+ *  enumerations. Deadlines are also only counted once a task has started.
+ *
+ *  Worker threads join the MTA for the duration of each task. Tasks never
+ *  touch COM objects owned by the thread which created them; anything they
+ *  need is bound again on the worker from plain data such as an ID list.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <Objbase.h>
+
+#include "Settings.h"
+#include "Task.hpp"
+
+
+// The handle to this DLL.
+extern HMODULE module;
+
+// The number of in-use objects.
+extern long objectCounter;
+
+// The worker pools, for long and short tasks, and the environments callbacks are queued in.
+PTP_POOL Task::pools[2] = { NULL, NULL };
+TP_CALLBACK_ENVIRON Task::environments[2];
+INIT_ONCE Task::poolOnce = INIT_ONCE_STATIC_INIT;
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+Task::Task(bool shortTask) {
+    this->refCount = 1;
+    this->shortTask = shortTask;
+    this->started = CreateEventW(NULL, TRUE, FALSE, NULL);
+    this->done = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    InterlockedIncrement(&::objectCounter);
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+Task::~Task() {
+    if (this->started != NULL) {
+        CloseHandle(this->started);
+    }
+    if (this->done != NULL) {
+        CloseHandle(this->done);
+    }
+
+    InterlockedDecrement(&::objectCounter);
+}
+
+
+/// <summary>
+/// Increments the reference count.
+/// </summary>
+ULONG Task::AddRef() {
+    return InterlockedIncrement(&this->refCount);
+}
+
+
+/// <summary>
+/// Decrements the reference count, deleting the task when it reaches 0.
+/// </summary>
+ULONG Task::Release() {
+    if (InterlockedDecrement(&this->refCount) == 0) {
+        delete this;
+        return 0;
+    }
+
+    return this->refCount;
+}
+
+
+/// <summary>
+/// Creates the worker pools, each with at most Settings::workerThreads threads.
+/// </summary>
+BOOL CALLBACK Task::CreatePool(PINIT_ONCE, PVOID, PVOID*) {
+    for (int i = 0; i < 2; ++i) {
+        Task::pools[i] = CreateThreadpool(NULL);
+        if (Task::pools[i] == NULL) {
+            return FALSE;
+        }
+
+        SetThreadpoolThreadMaximum(Task::pools[i], Settings::workerThreads);
+        SetThreadpoolThreadMinimum(Task::pools[i], 1);
+
+        InitializeThreadpoolEnvironment(&Task::environments[i]);
+        SetThreadpoolCallbackPool(&Task::environments[i], Task::pools[i]);
+
+        // Keeps the DLL loaded while a callback is running.
+        SetThreadpoolCallbackLibrary(&Task::environments[i], ::module);
+    }
+
+    return TRUE;
+}
+
+
+/// <summary>
+/// Queues the task on the worker pool.
+/// </summary>
+bool Task::Submit() {
+    if (this->started == NULL || this->done == NULL || !InitOnceExecuteOnce(&Task::poolOnce, Task::CreatePool, NULL, NULL)) {
+        return false;
+    }
+
+    AddRef();
+    if (!TrySubmitThreadpoolCallback(Task::Callback, this, &Task::environments[this->shortTask ? 1 : 0])) {
+        Release();
+        return false;
+    }
+
+    return true;
+}
+
+
+/// <summary>
+/// Runs a task on a worker thread.
+/// </summary>
+void CALLBACK Task::Callback(PTP_CALLBACK_INSTANCE instance, PVOID context) {
+    Task* task = (Task*)context;
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+    SetEvent(task->started);
+    task->Execute();
+
+    if (SUCCEEDED(hr)) {
+        CoUninitialize();
+    }
+
+    SetEvent(task->done);
+    task->Release();
+}
+
+
+/// <summary>
+/// Waits for the task to finish.
+/// </summary>
+bool Task::Wait(DWORD timeout) {
+    return WaitFor(this->done, timeout);
+}
+
+
+/// <summary>
+/// Waits for a worker to start running the task.
+/// </summary>
+bool Task::WaitStarted(DWORD timeout) {
+    return WaitFor(this->started, timeout);
+}
+
+
+/// <summary>
+/// Waits for an event. On STA threads incoming COM calls and window messages keep being
+/// dispatched while waiting, so the caller's apartment is never blocked outright.
+/// </summary>
+bool Task::WaitFor(HANDLE event, DWORD timeout) {
+    DWORD index;
+    HRESULT hr = CoWaitForMultipleHandles(COWAIT_DEFAULT, timeout, 1, &event, &index);
+
+    if (hr == CO_E_NOTINITIALIZED) {
+        return WaitForSingleObject(event, timeout) == WAIT_OBJECT_0;
+    }
+
+    return hr == S_OK;
+}
@@ -0,0 +1,61 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Task.hpp
+ *  The WinUnionFS Project
+ *
+ *  A unit of work which runs on one of the shared, bounded worker pools.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+class Task
+{
+public:
+    // How many deadlines a caller waits for a task to be picked up by a worker before giving up
+    // on it. The deadline itself only starts once the task runs.
+    static const DWORD queueDeadlines = 10;
+
+    // Constructor. Short tasks, which callers wait on with a deadline, run on a pool of their own
+    // so that they never queue behind long-running enumerations.
+    explicit Task(bool shortTask);
+
+    // Reference counting. The pool holds a reference while the task is queued or running.
+    ULONG AddRef();
+    ULONG Release();
+
+    // Queues the task on the worker pool. Returns false if it could not be queued.
+    bool Submit();
+
+    // Waits for the task to finish. Returns false if it did not finish within timeout ms.
+    bool Wait(DWORD timeout);
+
+    // Waits for a worker to start running the task. Returns false if none did within timeout ms.
+    bool WaitStarted(DWORD timeout);
+
+    // Waits for an event, pumping COM calls if this is an STA thread.
+    static bool WaitFor(HANDLE event, DWORD timeout);
+
+protected:
+    // Destructor
+    virtual ~Task();
+
+    // Does the actual work, on a worker thread which has joined the MTA.
+    virtual void Execute() = 0;
+
+private:
+    static void CALLBACK Callback(PTP_CALLBACK_INSTANCE instance, PVOID context);
+    static BOOL CALLBACK CreatePool(PINIT_ONCE, PVOID, PVOID*);
+
+    // The worker pools, for long and short tasks, and the environments callbacks are queued in.
+    static PTP_POOL pools[2];
+    static TP_CALLBACK_ENVIRON environments[2];
+    static INIT_ONCE poolOnce;
+
+    // Which of the pools the task runs on.
+    bool shortTask;
+
+    // Signaled once a worker has picked the task up, and once Execute has returned.
+    HANDLE started;
+    HANDLE done;
+
+    ULONG refCount;
+};
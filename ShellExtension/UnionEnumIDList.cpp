@@ -0,0 +1,534 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  UnionEnumIDList.cpp
+ *  The WinUnionFS Project
+ *
+ *  Lazily enumerates the union of the contents of several folders. All
+ *  folders are read concurrently on the worker pool, and items are merged in
+ *  folder order as the caller asks for them. The first items are available
+ *  as soon as the first folder produces them, and the whole listing takes
+ *  about as long as the slowest folder rather than the sum of all of them.
+ *
+ *  A folder which doesn't produce its next batch within the member deadline
+ *  is left out, and its breaker keeps it out of later listings for a while.
+ *
+ *  With the SortedMerge setting, every folder is read in full first instead,
+ *  each listing is sorted by the items' sort keys, and the listings are
+ *  combined by a SortedMerge. Duplicates are then adjacent, and the items
+ *  come out in the order the view shows them in.
+ *
+ *  Complete listings can be recorded into the ListingCache as they are read,
+ *  along with filters of the names each member has when the listing covers
+ *  everything in the folder, and the folders each member has for the
+ *  DirectoryTrie when it covers every folder.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+#include <Shlobj.h>
+#include <Shlwapi.h>
+
+#include "BloomFilter.hpp"
+#include "Debug.h"
+#include "Group.hpp"
+#include "ListingCache.h"
+#include "Macros.h"
+#include "PIDL.h"
+#include "Settings.h"
+#include "Stats.h"
+#include "UnionEnumIDList.hpp"
+
+
+// The number of in-use objects.
+extern long objectCounter;
+
+// The flags of a listing which includes every item, so that it can tell which names a member lacks.
+#define EVERYTHING (SHCONTF_FOLDERS | SHCONTF_NONFOLDERS | SHCONTF_INCLUDEHIDDEN | SHCONTF_INCLUDESUPERHIDDEN)
+
+// The flags of a listing which includes every folder.
+#define ALL_FOLDERS (SHCONTF_FOLDERS | SHCONTF_INCLUDEHIDDEN | SHCONTF_INCLUDESUPERHIDDEN)
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+UnionEnumIDList::UnionEnumIDList(Group* group, const std::vector<IShellFolder*> &folders, const std::vector<bool> &unanswered, HWND hwndOwner, SHCONTF flags) {
+    Group::AddUser();
+
+    this->refCount = 1;
+    this->group = group;
+    if (this->group != NULL) {
+        this->group->AddRef();
+    }
+    this->partial = false;
+    this->position = 0;
+    this->current = 0;
+    this->batch = NULL;
+    this->batchIndex = 0;
+    this->hwndOwner = hwndOwner;
+    this->flags = flags;
+    this->folders = folders;
+    this->unanswered = unanswered;
+    this->record = NULL;
+    this->recordPath = NULL;
+    this->recordGeneration = 0;
+    this->recordFolders = false;
+    this->sorted = Settings::sortedMerge != 0;
+
+    for (std::vector<IShellFolder*>::const_iterator folder = this->folders.begin(); folder != this->folders.end(); ++folder) {
+        if (*folder != NULL) {
+            (*folder)->AddRef();
+        }
+    }
+
+    StartMembers();
+
+    InterlockedIncrement(&::objectCounter);
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+UnionEnumIDList::~UnionEnumIDList() {
+    StopMembers();
+
+    for (std::vector<IShellFolder*>::const_iterator folder = this->folders.begin(); folder != this->folders.end(); ++folder) {
+        if (*folder != NULL) {
+            (*folder)->Release();
+        }
+    }
+
+    if (this->record != NULL) {
+        this->record->Release();
+    }
+    free(this->recordPath);
+
+    // Every so often, whoever finishes an enumeration publishes the counters.
+    if (this->group != NULL) {
+        if (Stats::Publish()) {
+            this->group->PublishStats();
+        }
+        this->group->Release();
+    }
+    Group::RemoveUser();
+    InterlockedDecrement(&::objectCounter);
+}
+
+
+/// <summary>
+/// IUnknown::AddRef
+/// Increments the reference count for an interface on an object.
+/// </summary>
+ULONG UnionEnumIDList::AddRef() {
+    return InterlockedIncrement(&this->refCount);
+}
+
+
+/// <summary>
+/// IUnknown::Release
+/// Decrements the reference count for an interface on an object.
+/// </summary>
+ULONG UnionEnumIDList::Release() {
+    if (InterlockedDecrement(&this->refCount) == 0) {
+        delete this;
+        return 0;
+    }
+
+    return this->refCount;
+}
+
+
+/// <summary>
+/// IUnknown::QueryInterface
+/// Retrieves pointers to the supported interfaces on an object.
+/// </summary>
+HRESULT UnionEnumIDList::QueryInterface(REFIID riid, void **ppvObject) {
+    if (ppvObject == NULL) {
+        return E_POINTER;
+    }
+
+    if (riid == IID_IUnknown) {
+        *ppvObject = (IUnknown*)this;
+    }
+    else if (riid == IID_IEnumIDList) {
+        *ppvObject = (IEnumIDList*)this;
+    }
+    else {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+
+/// <summary>
+/// IEnumIDList::Clone
+/// Creates a new item enumeration object with the same contents and state as the current one.
+/// </summary>
+HRESULT UnionEnumIDList::Clone(IEnumIDList **ppenum) {
+    if (ppenum == NULL) {
+        return E_POINTER;
+    }
+
+    UnionEnumIDList* clone = new UnionEnumIDList(this->group, this->folders, this->unanswered, this->hwndOwner, this->flags);
+    clone->Skip(this->position);
+
+    *ppenum = clone;
+
+    return S_OK;
+}
+
+
+/// <summary>
+/// IEnumIDList::Next
+/// Retrieves the specified number of item identifiers in the enumeration sequence and advances
+/// the current position by the number of items retrieved.
+/// </summary>
+HRESULT UnionEnumIDList::Next(ULONG celt, LPITEMIDLIST *rgelt, ULONG *pceltFetched) {
+    ULONG fetched = 0;
+
+    while (fetched < celt && Fetch(&rgelt[fetched])) {
+        ++fetched;
+    }
+    this->position += fetched;
+
+    if (pceltFetched != NULL) {
+        *pceltFetched = fetched;
+    }
+
+    return fetched == celt ? S_OK : S_FALSE;
+}
+
+
+/// <summary>
+/// IEnumIDList::Reset
+/// Returns to the beginning of the enumeration sequence.
+/// </summary>
+HRESULT UnionEnumIDList::Reset() {
+    StopMembers();
+    this->position = 0;
+    this->partial = false;
+    this->names.clear();
+    this->arena.Clear();
+    if (this->record != NULL) {
+        this->record->Release();
+        this->record = new EnumIDList();
+        this->recordGeneration = ListingCache::Generation(this->group->name);
+    }
+    for (std::vector<std::vector<ULONG> >::iterator hashes = this->recordHashes.begin(); hashes != this->recordHashes.end(); ++hashes) {
+        hashes->clear();
+    }
+    this->folderNames.clear();
+    this->merge.Reset(0);
+    StartMembers();
+
+    return S_OK;
+}
+
+
+/// <summary>
+/// IEnumIDList::Skip
+/// Skips the specified number of elements in the enumeration sequence.
+/// </summary>
+HRESULT UnionEnumIDList::Skip(ULONG celt) {
+    LPITEMIDLIST item;
+
+    while (celt > 0 && Fetch(&item)) {
+        PIDL::Free(item);
+        ++this->position;
+        --celt;
+    }
+
+    return celt == 0 ? S_OK : S_FALSE;
+}
+
+
+/// <summary>
+/// Returns true if a member was skipped or missed its deadline, so the listing is incomplete.
+/// </summary>
+bool UnionEnumIDList::IsPartial() {
+    return this->partial;
+}
+
+
+/// <summary>
+/// Records the listing as it is read, and stores it in the ListingCache under the group and path
+/// once every member has been read completely. Must be called before the first item is fetched.
+/// </summary>
+void UnionEnumIDList::CacheAs(LPCWSTR path) {
+    if (this->group == NULL || this->record != NULL) {
+        return;
+    }
+
+    this->recordGeneration = ListingCache::Generation(this->group->name);
+    this->recordPath = _wcsdup(path);
+    this->record = new EnumIDList();
+
+    if (FLAGSET(this->flags, EVERYTHING)) {
+        this->recordHashes.resize(this->folders.size());
+    }
+    this->recordFolders = FLAGSET(this->flags, ALL_FOLDERS);
+}
+
+
+/// <summary>
+/// Pulls items from the underlying folders until one is found whose name has not been returned
+/// yet. Returns false once every folder has been exhausted.
+/// </summary>
+bool UnionEnumIDList::Fetch(LPITEMIDLIST *item) {
+    if (this->sorted) {
+        return FetchSorted(item);
+    }
+
+    while (this->current < this->members.size()) {
+        if (this->batch == NULL || this->batchIndex == this->batch->entries.size()) {
+            delete this->batch;
+            this->batch = NULL;
+            this->batchIndex = 0;
+
+            if (NextBatch(this->current, &this->batch) != S_OK) {
+                ++this->current;
+            }
+            continue;
+        }
+
+        const MemberEnumerator::Entry &entry = this->batch->entries[this->batchIndex++];
+
+        std::unordered_set<LPCWSTR, Name::Hasher, Name::EqualTo>::const_iterator name = this->names.find(entry.name);
+        bool unique = name == this->names.end();
+
+        if (unique) {
+            ULONG cbName = ULONG(sizeof(WCHAR)*(wcslen(entry.name) + 1));
+            LPWSTR copy = (LPWSTR)this->arena.Allocate(cbName);
+            memcpy(copy, entry.name, cbName);
+            name = this->names.insert(copy).first;
+        }
+
+        RecordEntry(this->current, *name, entry.attributes);
+
+        if (unique) {
+            // The recorded listing is only kept once every member has been read, so by then it
+            // knows about all of them.
+            if (this->record != NULL) {
+                this->record->AddItem(entry.name, entry.attributes, USHORT(this->current), USHORT(this->members.size()));
+            }
+
+            // We only know about the members up to this one yet.
+            *item = PIDL::Create(NULL, (LPWSTR)entry.name, entry.attributes, USHORT(this->current), KnownMembers(this->current, this->current + 1));
+            return true;
+        }
+        else if (this->record != NULL) {
+            this->record->AddMember(entry.name, USHORT(this->current));
+        }
+    }
+
+    FinishRecording();
+    return false;
+}
+
+
+/// <summary>
+/// Takes the next item off the merge of the members' sorted listings, along with the later members
+/// which have the same name. Returns false once every listing has been merged.
+/// </summary>
+bool UnionEnumIDList::FetchSorted(LPITEMIDLIST *item) {
+    const SortedMerge::Entry* entry;
+    size_t folder;
+
+    if (!this->merge.IsSorted()) {
+        ReadSorted();
+    }
+
+    if (!this->merge.Next(&entry, &folder, &this->duplicates)) {
+        FinishRecording();
+        return false;
+    }
+
+    // Every member has been read, so the item can know about all of them, unless some were left
+    // out.
+    *item = PIDL::Create(NULL, (LPWSTR)entry->name, entry->attributes, USHORT(folder), KnownMembers(folder, this->members.size()));
+    if (this->record != NULL) {
+        this->record->AddItem(entry->name, entry->attributes, USHORT(folder), USHORT(this->members.size()));
+    }
+
+    for (std::vector<size_t>::const_iterator next = this->duplicates.begin(); next != this->duplicates.end(); ++next) {
+        PIDL::AddMember(*item, USHORT(*next));
+        if (this->record != NULL) {
+            this->record->AddMember(entry->name, USHORT(*next));
+        }
+    }
+
+    return true;
+}
+
+
+/// <summary>
+/// Retrieves the next batch of a member. A member which misses its deadline is reported to the
+/// group and left out of the rest of the listing. Returns S_OK if there is a batch.
+/// </summary>
+HRESULT UnionEnumIDList::NextBatch(size_t index, MemberEnumerator::Batch **batch) {
+    MemberEnumerator* member = this->members[index];
+    HRESULT hr = S_FALSE;
+
+    *batch = NULL;
+    if (member != NULL) {
+        hr = member->NextBatch(Settings::memberTimeout, batch);
+    }
+
+    if (hr == E_PENDING) {
+        TRACE(L"Member %u of %s did not respond in time", (ULONG)index, this->group != NULL ? this->group->name : L"");
+        Stats::Add(Stats::MEMBER_TIMEOUTS, 1);
+        if (this->group != NULL) {
+            this->group->MemberFailed(index);
+        }
+        this->partial = true;
+        this->incomplete[index] = true;
+    }
+    else if (hr == S_FALSE && member != NULL && this->group != NULL) {
+        this->group->MemberSucceeded(index);
+    }
+
+    return hr;
+}
+
+
+/// <summary>
+/// Reads every member to the end, or until it misses its deadline, and sorts each listing by the
+/// sort keys of the names. Members are still read concurrently, so this takes about as long as
+/// the slowest of them.
+/// </summary>
+void UnionEnumIDList::ReadSorted() {
+    this->merge.Reset(this->members.size());
+
+    for (size_t i = 0; i < this->members.size(); ++i) {
+        MemberEnumerator::Batch* batch;
+
+        while (NextBatch(i, &batch) == S_OK) {
+            for (std::vector<MemberEnumerator::Entry>::const_iterator entry = batch->entries.begin(); entry != batch->entries.end(); ++entry) {
+                ULONG cbName = ULONG(sizeof(WCHAR)*(wcslen(entry->name) + 1));
+                LPWSTR name = (LPWSTR)this->arena.Allocate(cbName);
+                memcpy(name, entry->name, cbName);
+
+                this->merge.Add(i, name, entry->attributes);
+                RecordEntry(i, name, entry->attributes);
+            }
+            delete batch;
+        }
+    }
+
+    this->merge.Sort();
+}
+
+
+/// <summary>
+/// Notes that a member has the name, in the filter and folder records when those are being kept.
+/// </summary>
+void UnionEnumIDList::RecordEntry(size_t member, LPCWSTR name, SFGAOF attributes) {
+    if (!this->recordHashes.empty()) {
+        this->recordHashes[member].push_back(Name::Hash(name));
+    }
+
+    if (this->recordFolders && (attributes & SFGAO_FOLDER) != 0) {
+        this->folderNames.push_back(DirectoryTrie::MemberFolder(name, member));
+    }
+}
+
+
+/// <summary>
+/// Stores the recorded listing, its filter, and its folders once every member has been read,
+/// provided none was left out, and stops recording.
+/// </summary>
+void UnionEnumIDList::FinishRecording() {
+    if (this->record == NULL) {
+        return;
+    }
+
+    // Only complete listings are worth caching.
+    if (!this->partial) {
+        ListingCache::Store(this->group->name, this->recordPath, this->flags, this->recordGeneration, this->record);
+
+        if (!this->recordHashes.empty()) {
+            BloomFilter* filter = new BloomFilter(this->recordHashes);
+            ListingCache::StoreFilter(this->group->name, this->recordPath, this->recordGeneration, filter);
+            filter->Release();
+        }
+
+        if (this->recordFolders) {
+            DirectoryTrie::Store(this->group->name, this->recordPath, this->recordGeneration, this->members.size(), this->folderNames);
+        }
+    }
+    this->record->Release();
+    this->record = NULL;
+    this->recordHashes.clear();
+    this->recordFolders = false;
+    this->folderNames.clear();
+}
+
+
+/// <summary>
+/// Starts enumerating every member folder.
+/// </summary>
+void UnionEnumIDList::StartMembers() {
+    this->incomplete.assign(this->folders.size(), false);
+
+    for (size_t i = 0; i < this->folders.size(); ++i) {
+        MemberEnumerator* member = NULL;
+
+        if (this->folders[i] != NULL) {
+            if (this->group == NULL || this->group->IsMemberAvailable(i)) {
+                member = new MemberEnumerator(this->folders[i], this->hwndOwner, this->flags);
+                member->Start();
+            }
+            else {
+                Stats::Add(Stats::MEMBER_SKIPPED, 1);
+                this->partial = true;
+                this->incomplete[i] = true;
+            }
+        }
+        else if (i < this->unanswered.size() && this->unanswered[i]) {
+            this->partial = true;
+            this->incomplete[i] = true;
+        }
+
+        this->members.push_back(member);
+    }
+    this->current = 0;
+}
+
+
+/// <summary>
+/// Returns the number of members, of the first count, whose presence an item found in member
+/// folder can be sure of. An item which no earlier member returned is missing from them only if
+/// they were read to the end; the bitmap stops short of the first one which wasn't. The folder
+/// itself is sure to have the item however far it was read.
+/// </summary>
+USHORT UnionEnumIDList::KnownMembers(size_t folder, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (this->incomplete[i] && i != folder) {
+            return USHORT(i);
+        }
+    }
+
+    return USHORT(count);
+}
+
+
+/// <summary>
+/// Cancels and releases the member enumerations. Workers which are still running finish their
+/// current batch and then let go of their enumeration.
+/// </summary>
+void UnionEnumIDList::StopMembers() {
+    delete this->batch;
+    this->batch = NULL;
+    this->batchIndex = 0;
+
+    for (std::vector<MemberEnumerator*>::const_iterator member = this->members.begin(); member != this->members.end(); ++member) {
+        if (*member != NULL) {
+            (*member)->Cancel();
+            (*member)->Release();
+        }
+    }
+    this->members.clear();
+}
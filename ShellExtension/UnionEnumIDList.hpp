@@ -0,0 +1,128 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  UnionEnumIDList.hpp
+ *  The WinUnionFS Project
+ *
+ *  Lazily enumerates the union of the contents of several folders.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <unordered_set>
+#include <vector>
+
+#include "Arena.hpp"
+#include "DirectoryTrie.h"
+#include "EnumIDList.hpp"
+#include "MemberEnumerator.hpp"
+#include "Name.h"
+#include "SortedMerge.hpp"
+
+class Group;
+
+class UnionEnumIDList : public IEnumIDList {
+public:
+    explicit UnionEnumIDList(Group* group, const std::vector<IShellFolder*> &folders, const std::vector<bool> &unanswered, HWND hwndOwner, SHCONTF flags);
+
+    // IUnknown
+    ULONG STDMETHODCALLTYPE AddRef();
+    STDMETHOD(QueryInterface) (REFIID, void**);
+    ULONG STDMETHODCALLTYPE Release();
+
+    // IEnumIDList
+    STDMETHOD(Clone) (IEnumIDList**);
+    STDMETHOD(Next) (ULONG, LPITEMIDLIST*, ULONG*);
+    STDMETHOD(Reset) ();
+    STDMETHOD(Skip) (ULONG);
+
+    // True if a member was skipped or missed its deadline, so the listing is incomplete.
+    bool IsPartial();
+
+    // Stores the listing in the ListingCache under path once it has been read completely.
+    void CacheAs(LPCWSTR path);
+
+private:
+    virtual ~UnionEnumIDList();
+
+    // Retrieves the next item which has not been returned yet.
+    bool Fetch(LPITEMIDLIST *item);
+
+    // Retrieves the next item of the sorted merge.
+    bool FetchSorted(LPITEMIDLIST *item);
+
+    // Retrieves the next batch of a member, and deals with it missing its deadline.
+    HRESULT NextBatch(size_t member, MemberEnumerator::Batch **batch);
+
+    // Reads every member in full, and sorts each of their listings for the sorted merge.
+    void ReadSorted();
+
+    // Notes a name a member has in the filter and folder records. The name must be in the arena.
+    void RecordEntry(size_t member, LPCWSTR name, SFGAOF attributes);
+
+    // Hands the recorded listing to the caches, if it is complete, and stops recording.
+    void FinishRecording();
+
+    // Starts enumerating every member folder concurrently.
+    void StartMembers();
+
+    // The number of members an item of member folder knows about, of the first count.
+    USHORT KnownMembers(size_t folder, size_t count);
+
+    // Cancels and releases the member enumerations.
+    void StopMembers();
+
+    // The group the folders belong to, whose circuit breakers we report to. We hold a reference.
+    Group* group;
+
+    // The folders being merged, in order of precedence. NULL for members which lack this folder,
+    // or didn't answer, in which case unanswered is set for them and the listing is partial.
+    std::vector<IShellFolder*> folders;
+    std::vector<bool> unanswered;
+
+    // The arguments to pass on to IShellFolder::EnumObjects.
+    HWND hwndOwner;
+    SHCONTF flags;
+
+    // One enumeration per folder. Items are merged in folder order, whichever finishes first.
+    std::vector<MemberEnumerator*> members;
+
+    // Set when a member is left out of the listing.
+    bool partial;
+
+    // The members which were left out, or only read in part, by index. Items can't tell whether
+    // those have them.
+    std::vector<bool> incomplete;
+
+    // The folder currently being merged, its current batch, and the position within it.
+    size_t current;
+    MemberEnumerator::Batch* batch;
+    size_t batchIndex;
+
+    // The names returned so far. The strings are stored in the arena.
+    Arena arena;
+    std::unordered_set<LPCWSTR, Name::Hasher, Name::EqualTo> names;
+
+    // Set to read every member in full and merge their sorted listings, so that items come out in
+    // view order, rather than streaming them in member order.
+    bool sorted;
+
+    // The merge of the members' sorted listings. Not sorted until the members have been read.
+    SortedMerge merge;
+    std::vector<size_t> duplicates;
+
+    // A copy of the listing so far, handed to the ListingCache when complete. NULL if not caching.
+    EnumIDList* record;
+    LPWSTR recordPath;
+    ULONG recordGeneration;
+
+    // The hashes of the names each member has, when recording a listing of everything in the
+    // folder. Empty otherwise. The ListingCache gets a BloomFilter built from them.
+    std::vector<std::vector<ULONG> > recordHashes;
+
+    // The folders each member has, when recording a listing which includes every folder. The
+    // names are stored in the arena. The DirectoryTrie gets them once the listing is complete.
+    bool recordFolders;
+    std::vector<DirectoryTrie::MemberFolder> folderNames;
+
+    ULONG position;
+    ULONG refCount;
+};
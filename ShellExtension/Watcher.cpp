@@ -0,0 +1,344 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Watcher.cpp
+ *  The WinUnionFS Project
+ *
+ *  Watches the member folders of all groups for changes, and invalidates the
+ *  affected cached listings.
+ *
+ *  Every member which lives in the file system gets one recursive
+ *  ReadDirectoryChangesW on its root, and all of them complete to a single
+ *  I/O completion port serviced by one thread, so the cost is one handle per
+ *  member rather than one thread per folder. Changes are turned into paths
+ *  within the group and handed to a ChangeQueue, which coalesces them and
+ *  applies them to the ListingCache once they have settled. Members which
+ *  aren't in the file system rely on the cache timeout alone.
+ *
+ *  Change buffers start small and only grow, up to the 64KB limit of reads
+ *  over the network, for watches which overflow them, so that thousands of
+ *  quiet members don't cost a large buffer each.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShlObj.h>
+#include <strsafe.h>
+
+#include <vector>
+
+#include "ChangeQueue.hpp"
+#include "Debug.h"
+#include "Name.h"
+#include "Stats.h"
+#include "Watcher.h"
+
+
+// The size a watch's change buffer starts at, and the most it grows to. 64KB is the most
+// ReadDirectoryChangesW will return over the network.
+#define MIN_BUFFER_SIZE (4*1024)
+#define MAX_BUFFER_SIZE (64*1024)
+
+
+// A member root being watched.
+typedef struct {
+    // Must come first, completions are mapped back to their watch through it.
+    OVERLAPPED overlapped;
+
+    // The directory, opened for overlapped I/O.
+    HANDLE directory;
+
+    // The group the directory is a member of.
+    LPWSTR group;
+
+    // Set once the group no longer uses the directory. The watch is freed when its read completes.
+    bool removed;
+
+    // Receives the changes, and its size in bytes. Grown when it overflows.
+    LPDWORD buffer;
+    DWORD cbBuffer;
+} Watch;
+
+// The completion keys of the packets sent to the watcher thread.
+enum {
+    KEY_CHANGES,    // A ReadDirectoryChangesW on a watch completed.
+    KEY_ADD,        // The overlapped is a new watch, whose first read should be started.
+    KEY_REMOVE,     // The overlapped is the name of a group whose watches should be cancelled.
+    KEY_STOP        // The thread should cancel all watches and exit.
+};
+
+// The changes waiting to be applied. Only used by the watcher thread.
+static ChangeQueue changes;
+
+// The completion port and the thread servicing it, created with the first watch.
+static HANDLE port = NULL;
+static HANDLE thread = NULL;
+
+// Guards port and thread.
+static SRWLOCK lock = SRWLOCK_INIT;
+
+
+/// <summary>
+/// Closes the directory and frees a watch.
+/// </summary>
+static void Free(Watch* watch) {
+    CloseHandle(watch->directory);
+    free(watch->buffer);
+    free(watch->group);
+    delete watch;
+}
+
+
+/// <summary>
+/// Doubles the change buffer of a watch whose changes didn't fit, unless it is as large as it
+/// gets. No read may be outstanding on the watch.
+/// </summary>
+static void Grow(Watch* watch) {
+    if (watch->cbBuffer >= MAX_BUFFER_SIZE) {
+        return;
+    }
+
+    LPDWORD buffer = (LPDWORD)realloc(watch->buffer, 2*watch->cbBuffer);
+    if (buffer != NULL) {
+        watch->buffer = buffer;
+        watch->cbBuffer *= 2;
+    }
+}
+
+
+/// <summary>
+/// Starts the next read of changes on a watch.
+/// </summary>
+static bool Read(Watch* watch) {
+    ZeroMemory(&watch->overlapped, sizeof(OVERLAPPED));
+
+    // Listings hold names and attributes, so changes to contents and times don't matter.
+    return ReadDirectoryChangesW(watch->directory, watch->buffer, watch->cbBuffer, TRUE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_ATTRIBUTES,
+        NULL, &watch->overlapped, NULL) != FALSE;
+}
+
+
+/// <summary>
+/// Queues the listings affected by the changes a read on the watch returned.
+/// </summary>
+static void Parse(Watch* watch) {
+    PFILE_NOTIFY_INFORMATION info = PFILE_NOTIFY_INFORMATION(watch->buffer);
+
+    for (;;) {
+        bool moved = info->Action == FILE_ACTION_REMOVED || info->Action == FILE_ACTION_RENAMED_OLD_NAME || info->Action == FILE_ACTION_RENAMED_NEW_NAME;
+
+        changes.Change(watch->group, info->FileName, info->FileNameLength/sizeof(WCHAR), moved);
+        Stats::Add(Stats::WATCH_EVENTS, 1);
+
+        if (info->NextEntryOffset == 0) {
+            break;
+        }
+        info = PFILE_NOTIFY_INFORMATION(LPBYTE(info) + info->NextEntryOffset);
+    }
+}
+
+
+/// <summary>
+/// Services the completion port until told to stop.
+/// </summary>
+static DWORD WINAPI Run(LPVOID param) {
+    HANDLE port = HANDLE(param);
+    std::vector<Watch*> watches;
+
+    for (;;) {
+        DWORD bytes = 0, timeout = INFINITE;
+        ULONG_PTR key = 0;
+        LPOVERLAPPED overlapped = NULL;
+
+        if (!changes.IsEmpty()) {
+            ULONGLONG now = GetTickCount64(), flushTime = changes.FlushTime();
+            timeout = flushTime > now ? DWORD(flushTime - now) : 0;
+        }
+
+        BOOL success = GetQueuedCompletionStatus(port, &bytes, &key, &overlapped, timeout);
+
+        if (overlapped == NULL) {
+            if (success && key == KEY_STOP) {
+                break;
+            }
+            changes.Flush();
+            continue;
+        }
+
+        if (key == KEY_REMOVE) {
+            LPWSTR group = (LPWSTR)overlapped;
+            for (std::vector<Watch*>::const_iterator watch = watches.begin(); watch != watches.end(); ++watch) {
+                if (!(*watch)->removed && Name::Equal((*watch)->group, group)) {
+                    (*watch)->removed = true;
+                    CancelIoEx((*watch)->directory, &(*watch)->overlapped);
+                }
+            }
+            free(group);
+            continue;
+        }
+
+        Watch* watch = (Watch*)overlapped;
+
+        if (key == KEY_ADD) {
+            if (Read(watch)) {
+                watches.push_back(watch);
+            }
+            else {
+                Free(watch);
+            }
+            continue;
+        }
+
+        // Whatever a removed watch reported belongs to a group which has been reloaded.
+        if (!watch->removed) {
+            if (success && bytes != 0) {
+                Parse(watch);
+            }
+            else {
+                // The buffer overflowed, or the directory went away. Either way we don't know what
+                // changed, so the whole group is suspect.
+                changes.Queue(watch->group, L"", 0, true);
+                Stats::Add(Stats::WATCH_OVERFLOWS, 1);
+                if (success) {
+                    Grow(watch);
+                }
+            }
+        }
+
+        if (watch->removed || !success || !Read(watch)) {
+            TRACE(L"Stopped watching a member of %s (%u)", watch->group, GetLastError());
+            for (std::vector<Watch*>::iterator iter = watches.begin(); iter != watches.end(); ++iter) {
+                if (*iter == watch) {
+                    watches.erase(iter);
+                    break;
+                }
+            }
+            Free(watch);
+        }
+    }
+
+    // Cancel all reads, and wait for them to complete before freeing their buffers.
+    for (std::vector<Watch*>::const_iterator watch = watches.begin(); watch != watches.end(); ++watch) {
+        CancelIoEx((*watch)->directory, NULL);
+    }
+    for (size_t outstanding = watches.size(); outstanding > 0;) {
+        DWORD bytes;
+        ULONG_PTR key;
+        LPOVERLAPPED overlapped = NULL;
+
+        GetQueuedCompletionStatus(port, &bytes, &key, &overlapped, INFINITE);
+        if (overlapped != NULL && key == KEY_CHANGES) {
+            --outstanding;
+        }
+    }
+    for (std::vector<Watch*>::const_iterator watch = watches.begin(); watch != watches.end(); ++watch) {
+        Free(*watch);
+    }
+
+    changes.Clear();
+
+    return 0;
+}
+
+
+/// <summary>
+/// Opens a directory for watching. Paths too long for the plain form are opened through the \\?\
+/// form, which has no length limit.
+/// </summary>
+static HANDLE OpenDirectory(LPCWSTR path) {
+    LPWSTR longPath = NULL;
+
+    if (wcslen(path) >= MAX_PATH) {
+        bool unc = path[0] == L'\\' && path[1] == L'\\';
+        LPCWSTR prefix = unc ? L"\\\\?\\UNC\\" : L"\\\\?\\";
+        size_t cchLongPath = wcslen(prefix) + wcslen(path) + 1;
+
+        longPath = new WCHAR[cchLongPath];
+        StringCchCopyW(longPath, cchLongPath, prefix);
+        StringCchCatW(longPath, cchLongPath, unc ? path + 2 : path);
+    }
+
+    HANDLE directory = CreateFileW(longPath != NULL ? longPath : path, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+
+    delete [] longPath;
+    return directory;
+}
+
+
+/// <summary>
+/// Starts watching a member root of the group, if it is a file system folder.
+/// </summary>
+void Watcher::Add(LPCWSTR group, PCIDLIST_ABSOLUTE root) {
+    LPWSTR path = NULL;
+
+    // Unlike SHGetPathFromIDList, this isn't limited to MAX_PATH characters.
+    if (FAILED(SHGetNameFromIDList(root, SIGDN_FILESYSPATH, &path))) {
+        return;
+    }
+
+    HANDLE directory = OpenDirectory(path);
+    CoTaskMemFree(path);
+    if (directory == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    LPDWORD buffer = (LPDWORD)malloc(MIN_BUFFER_SIZE);
+    if (buffer == NULL) {
+        CloseHandle(directory);
+        return;
+    }
+
+    Watch* watch = new Watch();
+    watch->directory = directory;
+    watch->group = _wcsdup(group);
+    watch->buffer = buffer;
+    watch->cbBuffer = MIN_BUFFER_SIZE;
+
+    AcquireSRWLockExclusive(&lock);
+    if (::port == NULL) {
+        ::port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    }
+    if (::port != NULL && ::thread == NULL) {
+        ::thread = CreateThread(NULL, 0, Run, ::port, 0, NULL);
+    }
+
+    // The first read is started by the watcher thread, so that all reads are issued by it.
+    if (::thread == NULL || CreateIoCompletionPort(directory, ::port, KEY_CHANGES, 0) == NULL
+        || !PostQueuedCompletionStatus(::port, 0, KEY_ADD, &watch->overlapped)) {
+        Free(watch);
+    }
+    ReleaseSRWLockExclusive(&lock);
+}
+
+
+/// <summary>
+/// Stops watching the members of a group.
+/// </summary>
+void Watcher::Remove(LPCWSTR group) {
+    AcquireSRWLockExclusive(&lock);
+    if (::thread != NULL) {
+        LPWSTR name = _wcsdup(group);
+        if (!PostQueuedCompletionStatus(::port, 0, KEY_REMOVE, LPOVERLAPPED(name))) {
+            free(name);
+        }
+    }
+    ReleaseSRWLockExclusive(&lock);
+}
+
+
+/// <summary>
+/// Stops watching all members, and waits for the watcher thread to exit.
+/// </summary>
+void Watcher::Stop() {
+    AcquireSRWLockExclusive(&lock);
+    if (::thread != NULL) {
+        PostQueuedCompletionStatus(::port, 0, KEY_STOP, NULL);
+        WaitForSingleObject(::thread, INFINITE);
+        CloseHandle(::thread);
+        ::thread = NULL;
+    }
+    if (::port != NULL) {
+        CloseHandle(::port);
+        ::port = NULL;
+    }
+    ReleaseSRWLockExclusive(&lock);
+}
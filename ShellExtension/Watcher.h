@@ -0,0 +1,15 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Watcher.h
+ *  The WinUnionFS Project
+ *
+ *  Watches the member folders of all groups for changes, and invalidates the
+ *  affected cached listings.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace Watcher {
+    void Add(LPCWSTR group, PCIDLIST_ABSOLUTE root);
+    void Remove(LPCWSTR group);
+    void Stop();
+}
@@ -0,0 +1,138 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Benchmark.cpp
+ *  The WinUnionFS Project
+ *
+ *  A minimal benchmark runner. Each benchmark is run with a growing number
+ *  of iterations until a run takes at least MIN_RUN_TIME, and then the best
+ *  of RUNS runs of that many is reported, which is the least disturbed by
+ *  whatever else the machine is doing. Benchmarks which handle many items
+ *  per iteration get the time per item as well, and may report other
+ *  measurements, which are printed below the timing.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Benchmark.h"
+
+
+// How long a run has to take for its timing to count, in seconds.
+#define MIN_RUN_TIME 0.1
+
+// The number of runs each benchmark gets once its count is known.
+#define RUNS 5
+
+
+typedef std::pair<const char*, Benchmark::Function> Entry;
+
+// The registered benchmarks. A function, so that it exists before the first registration runs.
+static std::vector<Entry>& Benchmarks() {
+    static std::vector<Entry> benchmarks;
+    return benchmarks;
+}
+
+// Where Use puts results.
+static volatile ULONG_PTR sink;
+
+// The number of items per iteration of the current benchmark, and what else it reported.
+static ULONG items;
+static std::vector<std::pair<const char*, double> > reports;
+
+
+/// <summary>
+/// Adds a benchmark to the list the runner goes through.
+/// </summary>
+Benchmark::Registration::Registration(const char* name, Function function) {
+    Benchmarks().push_back(Entry(name, function));
+}
+
+
+/// <summary>
+/// Keeps the compiler from leaving out work whose result isn't otherwise used.
+/// </summary>
+void Benchmark::Use(ULONG_PTR value) {
+    sink = sink + value;
+}
+
+
+/// <summary>
+/// Sets how many items each iteration handles, so that the time per item is reported too.
+/// </summary>
+void Benchmark::Items(ULONG count) {
+    items = count;
+}
+
+
+/// <summary>
+/// Reports a measurement other than time. Only the last value reported under a name is kept.
+/// </summary>
+void Benchmark::Report(const char* name, double value) {
+    for (std::vector<std::pair<const char*, double> >::iterator report = reports.begin(); report != reports.end(); ++report) {
+        if (strcmp(report->first, name) == 0) {
+            report->second = value;
+            return;
+        }
+    }
+    reports.push_back(std::make_pair(name, value));
+}
+
+
+/// <summary>
+/// Returns the time one run of function takes, in seconds.
+/// </summary>
+static double Time(Benchmark::Function function, ULONG iterations) {
+    LARGE_INTEGER frequency, start, end;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    function(iterations);
+    QueryPerformanceCounter(&end);
+
+    return double(end.QuadPart - start.QuadPart)/double(frequency.QuadPart);
+}
+
+
+/// <summary>
+/// Runs the benchmarks whose names contain filter, or all of them if it is NULL.
+/// </summary>
+void Benchmark::Run(const char* filter) {
+    for (std::vector<Entry>::const_iterator benchmark = Benchmarks().begin(); benchmark != Benchmarks().end(); ++benchmark) {
+        if (filter != NULL && strstr(benchmark->first, filter) == NULL) {
+            continue;
+        }
+
+        items = 0;
+        reports.clear();
+
+        ULONG iterations = 1;
+        double time = Time(benchmark->second, iterations);
+        while (time < MIN_RUN_TIME && iterations < 0x40000000) {
+            iterations *= time > MIN_RUN_TIME/100 ? 2 : 16;
+            time = Time(benchmark->second, iterations);
+        }
+
+        for (int run = 1; run < RUNS; ++run) {
+            time = min(time, Time(benchmark->second, iterations));
+        }
+
+        printf("%-48s %14.1f ns %10lu iterations", benchmark->first, 1e9*time/iterations, (unsigned long)iterations);
+        if (items != 0) {
+            printf(" %10.1f ns/item", 1e9*time/iterations/items);
+        }
+        printf("\n");
+
+        for (std::vector<std::pair<const char*, double> >::const_iterator report = reports.begin(); report != reports.end(); ++report) {
+            printf("    %-44s %14.1f\n", report->first, report->second);
+        }
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    Benchmark::Run(argc > 1 ? argv[1] : NULL);
+    return 0;
+}
@@ -0,0 +1,36 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Benchmark.h
+ *  The WinUnionFS Project
+ *
+ *  A minimal benchmark runner. BENCHMARK defines a function which does the
+ *  measured work a given number of times; the runner picks the count so that
+ *  each runs long enough to time, and reports the time per iteration.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace Benchmark {
+    typedef void (*Function)(ULONG iterations);
+
+    // Adds a benchmark to the list the runner goes through.
+    struct Registration {
+        Registration(const char* name, Function function);
+    };
+
+    // Keeps the compiler from leaving out work whose result isn't otherwise used.
+    void Use(ULONG_PTR value);
+
+    // Sets how many items each iteration handles, so that the time per item is reported too.
+    void Items(ULONG items);
+
+    // Reports a measurement other than time, such as the memory used, alongside the timing.
+    void Report(const char* name, double value);
+
+    // Runs the benchmarks whose names contain filter, or all of them if it is NULL.
+    void Run(const char* filter);
+}
+
+#define BENCHMARK(name) \
+    static void name(ULONG iterations); \
+    static Benchmark::Registration name##Registration(#name, name); \
+    static void name(ULONG iterations)
@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  BloomFilterBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Measures building the filters of a folder's members from their listings,
+ *  and checking names against them, and reports the false positive rate and
+ *  the memory used.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <vector>
+
+#include "Benchmark.h"
+#include "BloomFilter.hpp"
+#include "Name.h"
+#include "Strings.h"
+
+
+// The number of members, and of names each member has.
+#define MEMBER_COUNT 4
+#define NAME_COUNT 10000
+
+
+static Strings strings;
+
+// Names the members have, by member, their hashes, and names no member has.
+static std::vector<std::vector<LPCWSTR> > present;
+static std::vector<std::vector<ULONG> > hashes;
+static std::vector<LPCWSTR> absent;
+
+
+/// <summary>
+/// Makes the names, the first time they are needed.
+/// </summary>
+static void EnsureNames() {
+    if (!present.empty()) {
+        return;
+    }
+
+    present.resize(MEMBER_COUNT);
+    hashes.resize(MEMBER_COUNT);
+    for (int member = 0; member < MEMBER_COUNT; ++member) {
+        for (int i = 0; i < NAME_COUNT; ++i) {
+            LPCWSTR name = strings.Format("Member %d file %05d.dat", member, i);
+            present[member].push_back(name);
+            hashes[member].push_back(Name::Hash(name));
+        }
+    }
+    for (int i = 0; i < NAME_COUNT; ++i) {
+        absent.push_back(strings.Format("Missing file %05d.dat", i));
+    }
+}
+
+
+BENCHMARK(BloomFilter_Build_4x10k) {
+    EnsureNames();
+    Benchmark::Items(MEMBER_COUNT*NAME_COUNT);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        BloomFilter* filter = new BloomFilter(hashes);
+        Benchmark::Report("bytes per name", double(filter->Size())/(MEMBER_COUNT*NAME_COUNT));
+        filter->Release();
+    }
+}
+
+
+/// <summary>
+/// Checks every name against the filter of member 0.
+/// </summary>
+static void Check(ULONG iterations, const std::vector<LPCWSTR> &names) {
+    EnsureNames();
+    BloomFilter* filter = new BloomFilter(hashes);
+    ULONG found = 0;
+    Benchmark::Items(ULONG(names.size()));
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        found = 0;
+        for (std::vector<LPCWSTR>::const_iterator name = names.begin(); name != names.end(); ++name) {
+            found += filter->MayContain(0, *name) ? 1 : 0;
+        }
+    }
+
+    Benchmark::Report("% may contain", 100.0*found/names.size());
+    filter->Release();
+}
+
+
+BENCHMARK(BloomFilter_MayContain_Present) {
+    EnsureNames();
+    Check(iterations, present[0]);
+}
+
+BENCHMARK(BloomFilter_MayContain_OtherMember) {
+    EnsureNames();
+    Check(iterations, present[1]);
+}
+
+BENCHMARK(BloomFilter_MayContain_Absent) {
+    EnsureNames();
+    Check(iterations, absent);
+}
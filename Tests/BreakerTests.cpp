@@ -0,0 +1,137 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  BreakerTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of the circuit breaker which keeps failing members out: closed, it
+ *  lets every attempt through; open, none; half-open, once the backoff has
+ *  passed, a single one, whose outcome closes it or opens it for longer. The
+ *  tick count is moved on rather than waited for.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include "Breaker.hpp"
+#include "Settings.h"
+#include "Test.h"
+
+
+// The backoff and member deadline the tests use, in ms.
+#define BACKOFF 1000
+#define TIMEOUT 100
+
+
+/// <summary>
+/// Sets the backoff and deadline the tests expect, for as long as it is in scope.
+/// </summary>
+class TestSettings {
+public:
+    TestSettings() {
+        this->backoff = Settings::memberBackoff;
+        this->timeout = Settings::memberTimeout;
+        Settings::memberBackoff = BACKOFF;
+        Settings::memberTimeout = TIMEOUT;
+    }
+
+    ~TestSettings() {
+        Settings::memberBackoff = this->backoff;
+        Settings::memberTimeout = this->timeout;
+    }
+
+private:
+    DWORD backoff;
+    DWORD timeout;
+};
+
+
+TEST(Breaker_Closed_AllowsEveryAttempt) {
+    TestSettings settings;
+    Breaker breaker;
+
+    CHECK(breaker.Allow());
+    CHECK(breaker.Allow());
+
+    breaker.Succeeded();
+    CHECK(breaker.Allow());
+}
+
+
+TEST(Breaker_Failed_OpensUntilTheBackoffHasPassed) {
+    TestSettings settings;
+    Breaker breaker;
+
+    breaker.Failed();
+    CHECK(!breaker.Allow());
+
+    Compat_AdvanceTickCount(BACKOFF/2);
+    CHECK(!breaker.Allow());
+
+    // Half-open, a single attempt gets through.
+    Compat_AdvanceTickCount(BACKOFF/2 + 10);
+    CHECK(breaker.Allow());
+    CHECK(!breaker.Allow());
+}
+
+
+TEST(Breaker_HalfOpen_SuccessCloses) {
+    TestSettings settings;
+    Breaker breaker;
+
+    breaker.Failed();
+    Compat_AdvanceTickCount(BACKOFF + 10);
+    CHECK(breaker.Allow());
+
+    breaker.Succeeded();
+    CHECK(breaker.Allow());
+    CHECK(breaker.Allow());
+
+    // The next failure starts from the shortest backoff again.
+    breaker.Failed();
+    Compat_AdvanceTickCount(BACKOFF + 10);
+    CHECK(breaker.Allow());
+}
+
+
+TEST(Breaker_HalfOpen_FailureDoublesTheBackoff) {
+    TestSettings settings;
+    Breaker breaker;
+
+    breaker.Failed();
+    Compat_AdvanceTickCount(BACKOFF + 10);
+    CHECK(breaker.Allow());
+
+    breaker.Failed();
+    Compat_AdvanceTickCount(BACKOFF + 10);
+    CHECK(!breaker.Allow());
+    Compat_AdvanceTickCount(BACKOFF);
+    CHECK(breaker.Allow());
+}
+
+
+TEST(Breaker_Backoff_StopsGrowingAt32Times) {
+    TestSettings settings;
+    Breaker breaker;
+
+    for (int i = 0; i < 10; ++i) {
+        breaker.Failed();
+    }
+
+    Compat_AdvanceTickCount(31*BACKOFF);
+    CHECK(!breaker.Allow());
+    Compat_AdvanceTickCount(BACKOFF + 10);
+    CHECK(breaker.Allow());
+}
+
+
+TEST(Breaker_HalfOpen_TriesAgainIfTheAttemptNeverReports) {
+    TestSettings settings;
+    Breaker breaker;
+
+    breaker.Failed();
+    Compat_AdvanceTickCount(BACKOFF + 10);
+    CHECK(breaker.Allow());
+
+    // The attempt hangs; once it is past its deadline, someone else may try.
+    CHECK(!breaker.Allow());
+    Compat_AdvanceTickCount(TIMEOUT + 10);
+    CHECK(breaker.Allow());
+}
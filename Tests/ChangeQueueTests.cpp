@@ -0,0 +1,179 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ChangeQueueTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of how the watcher turns changes into invalidations: changes to the
+ *  same folder are applied once, removing or renaming a folder drops what is
+ *  cached below it, and changes are held back until they settle, but never
+ *  for long. What a flush dropped is read back from the real ListingCache.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <vector>
+
+#include "BloomFilter.hpp"
+#include "ChangeQueue.hpp"
+#include "ListingCache.h"
+#include "Settings.h"
+#include "Test.h"
+
+
+// The delay the tests expect, in ms.
+#define DELAY 100
+
+
+/// <summary>
+/// Caches a filter for the folder at path, as if it had been listed.
+/// </summary>
+static void Cache(LPCWSTR group, LPCWSTR path) {
+    BloomFilter* filter = new BloomFilter(std::vector<std::vector<ULONG> >(1));
+
+    ListingCache::StoreFilter(group, path, ListingCache::Generation(group), filter);
+    filter->Release();
+}
+
+
+/// <summary>
+/// Returns whether the folder at path is still cached.
+/// </summary>
+static bool IsCached(LPCWSTR group, LPCWSTR path) {
+    BloomFilter* filter = ListingCache::LookupFilter(group, path);
+
+    if (filter == NULL) {
+        return false;
+    }
+    filter->Release();
+    return true;
+}
+
+
+TEST(ChangeQueue_Change_IsAppliedOncePerFolder) {
+    ListingCache::Clear();
+    ChangeQueue changes;
+
+    changes.Change(L"Group", L"A\\One.txt", 9, false);
+    changes.Change(L"Group", L"A\\Two.txt", 9, false);
+    changes.Change(L"Group", L"a\\Three.txt", 11, false);
+    CHECK(changes.Size() == 1);
+
+    // Every invalidation moves the generation on.
+    ULONG generation = ListingCache::Generation(L"Group");
+    changes.Flush();
+    CHECK(ListingCache::Generation(L"Group") == generation + 1);
+    CHECK(changes.IsEmpty());
+}
+
+
+TEST(ChangeQueue_Change_DropsTheParentOnly) {
+    ListingCache::Clear();
+    ChangeQueue changes;
+
+    Cache(L"Group", L"");
+    Cache(L"Group", L"A");
+    Cache(L"Group", L"A\\B");
+    Cache(L"Other", L"A");
+
+    changes.Change(L"Group", L"A\\New.txt", 9, false);
+    changes.Flush();
+    CHECK(IsCached(L"Group", L""));
+    CHECK(!IsCached(L"Group", L"A"));
+    CHECK(IsCached(L"Group", L"A\\B"));
+    CHECK(IsCached(L"Other", L"A"));
+}
+
+
+TEST(ChangeQueue_Moved_DropsEverythingBelow) {
+    ListingCache::Clear();
+    ChangeQueue changes;
+
+    Cache(L"Group", L"");
+    Cache(L"Group", L"A");
+    Cache(L"Group", L"A\\B");
+    Cache(L"Group", L"A\\B\\C");
+    Cache(L"Group", L"A\\Bee");
+
+    // Removing A\B queues A for its listing, and A\B with everything below it.
+    changes.Change(L"Group", L"A\\B", 3, true);
+    CHECK(changes.Size() == 2);
+
+    changes.Flush();
+    CHECK(IsCached(L"Group", L""));
+    CHECK(!IsCached(L"Group", L"A"));
+    CHECK(!IsCached(L"Group", L"A\\B"));
+    CHECK(!IsCached(L"Group", L"A\\B\\C"));
+    CHECK(IsCached(L"Group", L"A\\Bee"));
+}
+
+
+TEST(ChangeQueue_Queue_KeepsEverythingBelowWhenAnyChangeAskedForIt) {
+    ListingCache::Clear();
+    ChangeQueue changes;
+
+    Cache(L"Group", L"A");
+    Cache(L"Group", L"A\\B");
+
+    changes.Queue(L"Group", L"A", 1, true);
+    changes.Queue(L"Group", L"A", 1, false);
+    CHECK(changes.Size() == 1);
+
+    changes.Flush();
+    CHECK(!IsCached(L"Group", L"A"));
+    CHECK(!IsCached(L"Group", L"A\\B"));
+}
+
+
+TEST(ChangeQueue_Change_AtTheRootDropsTheGroupsListing) {
+    ListingCache::Clear();
+    ChangeQueue changes;
+
+    Cache(L"Group", L"");
+    Cache(L"Group", L"A");
+
+    changes.Change(L"Group", L"New.txt", 7, false);
+    changes.Flush();
+    CHECK(!IsCached(L"Group", L""));
+    CHECK(IsCached(L"Group", L"A"));
+}
+
+
+TEST(ChangeQueue_FlushTime_WaitsForChangesToSettle) {
+    DWORD delay = Settings::watchDelay;
+    Settings::watchDelay = DELAY;
+    ChangeQueue changes;
+
+    ULONGLONG first = GetTickCount64();
+    changes.Change(L"Group", L"A\\One.txt", 9, false);
+    CHECK(changes.FlushTime() == first + DELAY);
+
+    // Each change puts it off again.
+    Compat_AdvanceTickCount(DELAY/2);
+    changes.Change(L"Group", L"A\\Two.txt", 9, false);
+    CHECK(changes.FlushTime() == first + DELAY/2 + DELAY);
+
+    Settings::watchDelay = delay;
+}
+
+
+TEST(ChangeQueue_FlushTime_IsPutOffOnlyAFewDelays) {
+    DWORD delay = Settings::watchDelay;
+    Settings::watchDelay = DELAY;
+    ChangeQueue changes;
+
+    // A folder which never stops changing is still applied a few delays after its first change.
+    ULONGLONG first = GetTickCount64();
+    for (int i = 0; i < 10; ++i) {
+        changes.Change(L"Group", L"A\\Busy.log", 10, false);
+        Compat_AdvanceTickCount(DELAY/2);
+    }
+    CHECK(changes.FlushTime() == first + 4*DELAY);
+
+    // Once applied, the next change starts over.
+    changes.Clear();
+    ULONGLONG next = GetTickCount64();
+    changes.Change(L"Group", L"A\\Busy.log", 10, false);
+    CHECK(changes.FlushTime() == next + DELAY);
+
+    Settings::watchDelay = delay;
+}
@@ -0,0 +1,26 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/Objbase.h
+ *  The WinUnionFS Project
+ *
+ *  COM initialization, which there is none of here. Threads are never in an
+ *  apartment, so waits always fall back to plain ones.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <Windows.h>
+
+#define COINIT_MULTITHREADED 0x0
+#define COWAIT_DEFAULT 0
+#define CO_E_NOTINITIALIZED ((HRESULT)0x800401F0)
+
+inline HRESULT CoInitializeEx(LPVOID, DWORD) {
+    return S_FALSE;
+}
+
+inline void CoUninitialize() {
+}
+
+inline HRESULT CoWaitForMultipleHandles(DWORD, DWORD, ULONG, HANDLE*, LPDWORD) {
+    return CO_E_NOTINITIALIZED;
+}
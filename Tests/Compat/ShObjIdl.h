@@ -0,0 +1,107 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/ShObjIdl.h
+ *  The WinUnionFS Project
+ *
+ *  The shell types which the units built here use. Item ID lists are laid
+ *  out as on Windows; interfaces only have what the units implement or call.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <Windows.h>
+
+typedef struct _GUID {
+    DWORD Data1;
+    USHORT Data2;
+    USHORT Data3;
+    BYTE Data4[8];
+} GUID, IID;
+typedef const IID& REFIID;
+
+inline bool operator==(const GUID& guid1, const GUID& guid2) {
+    return memcmp(&guid1, &guid2, sizeof(GUID)) == 0;
+}
+
+#define STDMETHODCALLTYPE
+#define STDMETHOD(method) virtual HRESULT STDMETHODCALLTYPE method
+
+struct IUnknown {
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) = 0;
+    virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+    virtual ULONG STDMETHODCALLTYPE Release() = 0;
+};
+
+#pragma pack(push, 1)
+typedef struct {
+    USHORT cb;
+    BYTE abID[1];
+} SHITEMID;
+
+typedef struct _ITEMIDLIST {
+    SHITEMID mkid;
+} ITEMIDLIST;
+#pragma pack(pop)
+
+typedef ITEMIDLIST *LPITEMIDLIST, *PIDLIST_ABSOLUTE, *PIDLIST_RELATIVE, *PITEMID_CHILD;
+typedef const ITEMIDLIST *LPCITEMIDLIST, *PCIDLIST_ABSOLUTE, *PCUIDLIST_RELATIVE, *PCITEMID_CHILD, *PCUITEMID_CHILD;
+
+typedef const PCUITEMID_CHILD *PCUITEMID_CHILD_ARRAY;
+
+typedef ULONG SFGAOF;
+typedef DWORD SHCONTF;
+typedef DWORD SHGDNF;
+
+#define SFGAO_LINK 0x00010000
+#define SFGAO_READONLY 0x00040000
+#define SFGAO_HIDDEN 0x00080000
+#define SFGAO_FOLDER 0x20000000
+#define SFGAO_HASSUBFOLDER 0x80000000
+#define SFGAO_BROWSABLE 0x08000000
+
+#define SHCONTF_FOLDERS 0x00020
+#define SHCONTF_NONFOLDERS 0x00040
+#define SHCONTF_INCLUDEHIDDEN 0x00080
+#define SHCONTF_INCLUDESUPERHIDDEN 0x10000
+
+#define SHGDN_NORMAL 0x0000
+#define SHGDN_INFOLDER 0x0001
+#define SHGDN_FORPARSING 0x8000
+
+// Names returned by folders. Only the allocated kind is used here.
+#define STRRET_WSTR 0x0000
+
+typedef struct {
+    UINT uType;
+    union {
+        LPWSTR pOleStr;
+        UINT uOffset;
+        char cStr[MAX_PATH];
+    };
+} STRRET;
+
+struct IEnumIDList : public IUnknown {
+    virtual HRESULT STDMETHODCALLTYPE Next(ULONG celt, LPITEMIDLIST* rgelt, ULONG* pceltFetched) = 0;
+    virtual HRESULT STDMETHODCALLTYPE Skip(ULONG celt) = 0;
+    virtual HRESULT STDMETHODCALLTYPE Reset() = 0;
+    virtual HRESULT STDMETHODCALLTYPE Clone(IEnumIDList** ppenum) = 0;
+};
+
+static const IID IID_IUnknown = { 0x00000000, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+static const IID IID_IEnumIDList = { 0x000214F2, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+
+struct IBindCtx;
+
+struct IShellFolder : public IUnknown {
+    virtual HRESULT STDMETHODCALLTYPE ParseDisplayName(HWND hwnd, IBindCtx* pbc, LPWSTR pszDisplayName, ULONG* pchEaten, PIDLIST_RELATIVE* ppidl, ULONG* pdwAttributes) = 0;
+    virtual HRESULT STDMETHODCALLTYPE EnumObjects(HWND hwnd, SHCONTF grfFlags, IEnumIDList** ppenumIDList) = 0;
+    virtual HRESULT STDMETHODCALLTYPE BindToObject(PCUIDLIST_RELATIVE pidl, IBindCtx* pbc, REFIID riid, void** ppv) = 0;
+    virtual HRESULT STDMETHODCALLTYPE BindToStorage(PCUIDLIST_RELATIVE pidl, IBindCtx* pbc, REFIID riid, void** ppv) = 0;
+    virtual HRESULT STDMETHODCALLTYPE CompareIDs(LPARAM lParam, PCUIDLIST_RELATIVE pidl1, PCUIDLIST_RELATIVE pidl2) = 0;
+    virtual HRESULT STDMETHODCALLTYPE CreateViewObject(HWND hwndOwner, REFIID riid, void** ppv) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetAttributesOf(UINT cidl, PCUITEMID_CHILD_ARRAY apidl, SFGAOF* rgfInOut) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetUIObjectOf(HWND hwndOwner, UINT cidl, PCUITEMID_CHILD_ARRAY apidl, REFIID riid, UINT* rgfReserved, void** ppv) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetDisplayNameOf(PCUITEMID_CHILD pidl, SHGDNF uFlags, STRRET* pName) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetNameOf(HWND hwnd, PCUITEMID_CHILD pidl, LPCWSTR pszName, SHGDNF uFlags, PITEMID_CHILD* ppidlOut) = 0;
+};
+
+static const IID IID_IShellFolder = { 0x000214E6, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
@@ -0,0 +1,22 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/ShlObj.h
+ *  The WinUnionFS Project
+ *
+ *  The shell functions the units built here call. Binding folders and
+ *  reading item data go through the fake shell in FakeFolder.cpp; ID lists
+ *  are allocated like any other shell memory.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <ShObjIdl.h>
+
+#define SHGDFIL_FINDDATA 1
+
+HRESULT SHGetDesktopFolder(IShellFolder** ppshf);
+HRESULT SHGetIDListFromObject(IUnknown* punk, PIDLIST_ABSOLUTE* ppidl);
+HRESULT SHGetDataFromIDListW(IShellFolder* psf, PCUITEMID_CHILD pidl, int nFormat, void* pv, int cb);
+
+inline void ILFree(LPITEMIDLIST pidl) {
+    CoTaskMemFree(pidl);
+}
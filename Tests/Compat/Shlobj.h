@@ -0,0 +1,10 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/Shlobj.h
+ *  The WinUnionFS Project
+ *
+ *  Included under this name by some units, and case matters here.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <ShlObj.h>
@@ -0,0 +1,40 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/Shlwapi.h
+ *  The WinUnionFS Project
+ *
+ *  The shell string helpers the units built here use.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <ShObjIdl.h>
+
+#include "Name.h"
+
+// Hands over the name, which is always allocated here.
+inline HRESULT StrRetToStrW(STRRET* strret, PCUITEMID_CHILD, LPWSTR* name) {
+    if (strret->uType != STRRET_WSTR) {
+        *name = NULL;
+        return E_NOTIMPL;
+    }
+    *name = strret->pOleStr;
+    strret->pOleStr = NULL;
+    return S_OK;
+}
+
+inline LPWSTR PathFindExtensionW(LPCWSTR path) {
+    LPCWSTR extension = NULL;
+    for (; *path != L'\0'; ++path) {
+        if (*path == L'.') {
+            extension = path;
+        }
+        else if (*path == L'\\' || *path == L' ') {
+            extension = NULL;
+        }
+    }
+    return (LPWSTR)(extension != NULL ? extension : path);
+}
+
+inline int StrCmpIW(LPCWSTR string1, LPCWSTR string2) {
+    return Name::Compare(string1, string2);
+}
@@ -0,0 +1,10 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/Shobjidl.h
+ *  The WinUnionFS Project
+ *
+ *  Included under this name by some units, and case matters here.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <ShObjIdl.h>
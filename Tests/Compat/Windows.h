@@ -0,0 +1,705 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/Windows.h
+ *  The WinUnionFS Project
+ *
+ *  Just enough of the Windows API for the platform independent units to be
+ *  built and tested with GCC or Clang elsewhere. Must be built with
+ *  -fshort-wchar, so that wchar_t is UTF-16 like WCHAR; the C library's wide
+ *  string functions assume 32-bit wchar_t, and are replaced below.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+// Everything from the C++ library comes before the replacements of its functions.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+#include <wctype.h>
+
+static_assert(sizeof(wchar_t) == 2, "Build with -fshort-wchar");
+
+// What MSVC predefines for the architecture.
+#if defined(__x86_64__) && !defined(_M_X64)
+#define _M_X64 1
+#elif defined(__i386__) && !defined(_M_IX86)
+#define _M_IX86 1
+#endif
+
+
+// Types
+typedef wchar_t WCHAR;
+typedef WCHAR *LPWSTR, *PWSTR;
+typedef const WCHAR *LPCWSTR, *PCWSTR;
+typedef unsigned char BYTE;
+typedef BYTE *LPBYTE, *PBYTE;
+typedef unsigned short USHORT, WORD;
+typedef uint32_t ULONG, DWORD, UINT;
+typedef int32_t LONG, BOOL, INT;
+typedef DWORD *LPDWORD;
+typedef ULONG *PULONG;
+typedef int64_t LONGLONG, LONG64;
+typedef uint64_t ULONGLONG, ULONG64, DWORD64;
+typedef void VOID;
+typedef void *LPVOID, *PVOID, *HANDLE;
+typedef const void *LPCVOID;
+typedef uintptr_t ULONG_PTR, UINT_PTR, SIZE_T, DWORD_PTR;
+typedef intptr_t LONG_PTR, INT_PTR;
+typedef LONG HRESULT;
+typedef LONG_PTR LPARAM;
+typedef union {
+    struct { DWORD LowPart; LONG HighPart; };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+// Handles which units' headers declare, but which nothing here uses.
+typedef struct HKEY__ *HKEY;
+typedef struct HWND__ *HWND;
+typedef struct HMODULE__ *HMODULE;
+typedef struct TP_WAIT *PTP_WAIT;
+typedef struct TP_TIMER *PTP_TIMER;
+typedef DWORD TP_WAIT_RESULT;
+typedef struct { PVOID Ptr; } CONDITION_VARIABLE;
+
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define CALLBACK
+#define __stdcall
+#define MAX_PATH 260
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_NOTIMPL ((HRESULT)0x80004001)
+#define E_POINTER ((HRESULT)0x80004003)
+#define E_ABORT ((HRESULT)0x80004004)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_PENDING ((HRESULT)0x8000000A)
+#define E_UNEXPECTED ((HRESULT)0x8000FFFF)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define HRESULT_FROM_WIN32(x) ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000)))
+#define ERROR_SUCCESS 0L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_PATH_NOT_FOUND 3L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_DATA 13L
+#define ERROR_MORE_DATA 234L
+#define ERROR_NO_MORE_ITEMS 259L
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define INFINITE 0xFFFFFFFF
+
+#define ZeroMemory(p, n) memset((p), 0, (n))
+#define CopyMemory(d, s, n) memcpy((d), (s), (n))
+#define UNREFERENCED_PARAMETER(p) (void)(p)
+#define __noop(...) ((void)0)
+#define _countof(a) (sizeof(a)/sizeof((a)[0]))
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+
+// Wide strings, on 16-bit wchar_t.
+inline size_t Compat_wcsnlen(const WCHAR* s, size_t max) {
+    size_t n = 0;
+    while (n < max && s[n] != L'\0') {
+        ++n;
+    }
+    return n;
+}
+
+inline size_t Compat_wcslen(const WCHAR* s) {
+    return Compat_wcsnlen(s, SIZE_MAX);
+}
+
+inline int Compat_wcscmp(const WCHAR* a, const WCHAR* b) {
+    while (*a != L'\0' && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return int(USHORT(*a)) - int(USHORT(*b));
+}
+
+inline int Compat_wcsncmp(const WCHAR* a, const WCHAR* b, size_t n) {
+    for (; n > 0; --n, ++a, ++b) {
+        if (*a != *b || *a == L'\0') {
+            return int(USHORT(*a)) - int(USHORT(*b));
+        }
+    }
+    return 0;
+}
+
+inline WCHAR* Compat_wcschr(const WCHAR* s, WCHAR c) {
+    for (;; ++s) {
+        if (*s == c) {
+            return (WCHAR*)s;
+        }
+        if (*s == L'\0') {
+            return NULL;
+        }
+    }
+}
+
+inline WCHAR* Compat_wcsrchr(const WCHAR* s, WCHAR c) {
+    const WCHAR* last = NULL;
+    for (;; ++s) {
+        if (*s == c) {
+            last = s;
+        }
+        if (*s == L'\0') {
+            return (WCHAR*)last;
+        }
+    }
+}
+
+inline size_t Compat_wcscspn(const WCHAR* s, const WCHAR* reject) {
+    size_t n = 0;
+    while (s[n] != L'\0' && Compat_wcschr(reject, s[n]) == NULL) {
+        ++n;
+    }
+    return n;
+}
+
+inline WCHAR* Compat_wcspbrk(const WCHAR* s, const WCHAR* accept) {
+    s += Compat_wcscspn(s, accept);
+    return *s != L'\0' ? (WCHAR*)s : NULL;
+}
+
+inline WCHAR* Compat_wcsdup(const WCHAR* s) {
+    size_t size = (Compat_wcslen(s) + 1)*sizeof(WCHAR);
+    WCHAR* copy = (WCHAR*)malloc(size);
+    if (copy != NULL) {
+        memcpy(copy, s, size);
+    }
+    return copy;
+}
+
+#define wcsnlen Compat_wcsnlen
+#define wcslen Compat_wcslen
+#define wcscmp Compat_wcscmp
+#define wcsncmp Compat_wcsncmp
+#define wcschr Compat_wcschr
+#define wcsrchr Compat_wcsrchr
+#define wcscspn Compat_wcscspn
+#define wcspbrk Compat_wcspbrk
+#define _wcsdup Compat_wcsdup
+
+
+// Case mapping, through the C library's Unicode locale.
+#define LOCALE_NAME_INVARIANT L""
+#define LCMAP_UPPERCASE 0x00000200
+
+inline int LCMapStringEx(LPCWSTR, DWORD, LPCWSTR source, int count, LPWSTR destination, int, LPVOID, LPVOID, LPARAM) {
+    static locale_t locale = newlocale(LC_CTYPE_MASK, "C.UTF-8", (locale_t)0);
+    for (int i = 0; i < count; ++i) {
+        wint_t upper = locale != (locale_t)0 ? towupper_l(USHORT(source[i]), locale) : towupper(USHORT(source[i]));
+        destination[i] = upper <= 0xFFFF ? WCHAR(upper) : source[i];
+    }
+    return count;
+}
+
+
+// Interlocked operations.
+inline LONG InterlockedIncrement(volatile LONG* p) {
+    return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* p) {
+    return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+// The DLL's object counter is a long, which is wider than LONG here.
+inline long InterlockedIncrement(volatile long* p) {
+    return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+inline long InterlockedDecrement(volatile long* p) {
+    return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+inline ULONG InterlockedIncrement(volatile ULONG* p) {
+    return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+inline ULONG InterlockedDecrement(volatile ULONG* p) {
+    return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchange(volatile LONG* p, LONG value) {
+    return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedCompareExchange(volatile LONG* p, LONG value, LONG comparand) {
+    __atomic_compare_exchange_n(p, &comparand, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+inline LONG InterlockedExchangeAdd(volatile LONG* p, LONG value) {
+    return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONGLONG InterlockedExchangeAdd64(volatile LONGLONG* p, LONGLONG value) {
+    return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONGLONG InterlockedExchange64(volatile LONGLONG* p, LONGLONG value) {
+    return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONGLONG InterlockedCompareExchange64(volatile LONGLONG* p, LONGLONG value, LONGLONG comparand) {
+    __atomic_compare_exchange_n(p, &comparand, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+
+// One-time initialization.
+typedef struct {
+    volatile LONG state;
+} INIT_ONCE, *PINIT_ONCE;
+typedef BOOL (CALLBACK *PINIT_ONCE_FN)(PINIT_ONCE, PVOID, PVOID*);
+#define INIT_ONCE_STATIC_INIT { 0 }
+
+inline BOOL InitOnceExecuteOnce(PINIT_ONCE initOnce, PINIT_ONCE_FN function, PVOID parameter, LPVOID* context) {
+    if (InterlockedCompareExchange(&initOnce->state, 1, 0) == 0) {
+        function(initOnce, parameter, context);
+        InterlockedExchange(&initOnce->state, 2);
+    }
+    while (__atomic_load_n(&initOnce->state, __ATOMIC_ACQUIRE) != 2) {
+        sched_yield();
+    }
+    return TRUE;
+}
+
+
+// Slim reader/writer locks.
+typedef struct {
+    pthread_rwlock_t lock;
+} SRWLOCK, *PSRWLOCK;
+#define SRWLOCK_INIT { PTHREAD_RWLOCK_INITIALIZER }
+
+inline void InitializeSRWLock(PSRWLOCK lock) {
+    pthread_rwlock_init(&lock->lock, NULL);
+}
+
+inline void AcquireSRWLockShared(PSRWLOCK lock) {
+    pthread_rwlock_rdlock(&lock->lock);
+}
+
+inline void ReleaseSRWLockShared(PSRWLOCK lock) {
+    pthread_rwlock_unlock(&lock->lock);
+}
+
+inline void AcquireSRWLockExclusive(PSRWLOCK lock) {
+    pthread_rwlock_wrlock(&lock->lock);
+}
+
+inline void ReleaseSRWLockExclusive(PSRWLOCK lock) {
+    pthread_rwlock_unlock(&lock->lock);
+}
+
+
+// Memory.
+#define HEAP_ZERO_MEMORY 0x00000008
+
+inline HANDLE GetProcessHeap() {
+    return (HANDLE)1;
+}
+
+inline LPVOID HeapAlloc(HANDLE, DWORD flags, SIZE_T size) {
+    return (flags & HEAP_ZERO_MEMORY) != 0 ? calloc(1, size) : malloc(size);
+}
+
+inline BOOL HeapFree(HANDLE, DWORD, LPVOID p) {
+    free(p);
+    return TRUE;
+}
+
+inline LPVOID CoTaskMemAlloc(SIZE_T size) {
+    return malloc(size);
+}
+
+inline LPVOID CoTaskMemRealloc(LPVOID p, SIZE_T size) {
+    return realloc(p, size);
+}
+
+inline void CoTaskMemFree(LPVOID p) {
+    free(p);
+}
+
+
+// Time. Tests can move the tick count on, rather than wait for deadlines to pass.
+inline volatile LONGLONG& Compat_tickOffset() {
+    static volatile LONGLONG offset = 0;
+    return offset;
+}
+
+inline void Compat_AdvanceTickCount(DWORD ms) {
+    __atomic_add_fetch(&Compat_tickOffset(), LONGLONG(ms), __ATOMIC_SEQ_CST);
+}
+
+inline ULONGLONG GetTickCount64() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ULONGLONG(now.tv_sec)*1000 + ULONGLONG(now.tv_nsec)/1000000 + ULONGLONG(__atomic_load_n(&Compat_tickOffset(), __ATOMIC_SEQ_CST));
+}
+
+inline void Sleep(DWORD ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* counter) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    counter->QuadPart = LONGLONG(now.tv_sec)*1000000000 + now.tv_nsec;
+    return TRUE;
+}
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+    frequency->QuadPart = 1000000000;
+    return TRUE;
+}
+
+
+// Errors.
+inline DWORD& Compat_lastError() {
+    static thread_local DWORD lastError = 0;
+    return lastError;
+}
+
+inline DWORD GetLastError() {
+    return Compat_lastError();
+}
+
+inline void SetLastError(DWORD error) {
+    Compat_lastError() = error;
+}
+
+
+// Events. Their handles point at the event, while file handles are small numbers, see below.
+#define WAIT_OBJECT_0 0x00000000L
+#define WAIT_TIMEOUT 0x00000102L
+
+struct Compat_Event {
+    std::mutex lock;
+    std::condition_variable changed;
+    bool manualReset;
+    bool signaled;
+};
+
+inline bool Compat_isEvent(HANDLE handle) {
+    return ULONG_PTR(handle) > 0x10000;
+}
+
+inline HANDLE CreateEventW(LPVOID, BOOL manualReset, BOOL initialState, LPCWSTR) {
+    Compat_Event* event = new Compat_Event();
+    event->manualReset = manualReset != FALSE;
+    event->signaled = initialState != FALSE;
+    return event;
+}
+
+inline BOOL SetEvent(HANDLE handle) {
+    Compat_Event* event = (Compat_Event*)handle;
+    std::lock_guard<std::mutex> guard(event->lock);
+    event->signaled = true;
+    event->changed.notify_all();
+    return TRUE;
+}
+
+inline BOOL ResetEvent(HANDLE handle) {
+    Compat_Event* event = (Compat_Event*)handle;
+    std::lock_guard<std::mutex> guard(event->lock);
+    event->signaled = false;
+    return TRUE;
+}
+
+inline DWORD WaitForSingleObject(HANDLE handle, DWORD timeout) {
+    Compat_Event* event = (Compat_Event*)handle;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    std::unique_lock<std::mutex> guard(event->lock);
+    while (!event->signaled) {
+        if (timeout == INFINITE) {
+            event->changed.wait(guard);
+        }
+        else if (event->changed.wait_until(guard, deadline) == std::cv_status::timeout && !event->signaled) {
+            return WAIT_TIMEOUT;
+        }
+    }
+    if (!event->manualReset) {
+        event->signaled = false;
+    }
+    return WAIT_OBJECT_0;
+}
+
+
+// Thread pools. Threads are started as work is queued, up to the maximum, and then kept for good.
+typedef struct TP_CALLBACK_INSTANCE *PTP_CALLBACK_INSTANCE;
+typedef void (CALLBACK *PTP_SIMPLE_CALLBACK)(PTP_CALLBACK_INSTANCE, PVOID);
+
+typedef struct TP_POOL {
+    std::mutex lock;
+    std::condition_variable queued;
+    std::deque<std::pair<PTP_SIMPLE_CALLBACK, PVOID> > work;
+    DWORD maximum;
+    DWORD threads;
+    DWORD idle;
+} *PTP_POOL;
+
+typedef struct {
+    PTP_POOL pool;
+} TP_CALLBACK_ENVIRON, *PTP_CALLBACK_ENVIRON;
+
+inline PTP_POOL CreateThreadpool(PVOID) {
+    PTP_POOL pool = new TP_POOL();
+    pool->maximum = 500;
+    pool->threads = 0;
+    pool->idle = 0;
+    return pool;
+}
+
+inline void SetThreadpoolThreadMaximum(PTP_POOL pool, DWORD maximum) {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->maximum = max(maximum, DWORD(1));
+}
+
+inline BOOL SetThreadpoolThreadMinimum(PTP_POOL, DWORD) {
+    return TRUE;
+}
+
+inline void InitializeThreadpoolEnvironment(PTP_CALLBACK_ENVIRON environment) {
+    environment->pool = NULL;
+}
+
+inline void DestroyThreadpoolEnvironment(PTP_CALLBACK_ENVIRON) {
+}
+
+inline void SetThreadpoolCallbackPool(PTP_CALLBACK_ENVIRON environment, PTP_POOL pool) {
+    environment->pool = pool;
+}
+
+inline void SetThreadpoolCallbackLibrary(PTP_CALLBACK_ENVIRON, PVOID) {
+}
+
+inline void Compat_Worker(PTP_POOL pool) {
+    std::unique_lock<std::mutex> guard(pool->lock);
+    for (;;) {
+        ++pool->idle;
+        while (pool->work.empty()) {
+            pool->queued.wait(guard);
+        }
+        --pool->idle;
+
+        std::pair<PTP_SIMPLE_CALLBACK, PVOID> work = pool->work.front();
+        pool->work.pop_front();
+        guard.unlock();
+        work.first(NULL, work.second);
+        guard.lock();
+    }
+}
+
+inline BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK callback, PVOID context, PTP_CALLBACK_ENVIRON environment) {
+    static PTP_POOL defaultPool = CreateThreadpool(NULL);
+    PTP_POOL pool = environment != NULL && environment->pool != NULL ? environment->pool : defaultPool;
+
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->work.push_back(std::make_pair(callback, context));
+    if (pool->idle < pool->work.size() && pool->threads < pool->maximum) {
+        ++pool->threads;
+        std::thread(Compat_Worker, pool).detach();
+    }
+    pool->queued.notify_one();
+    return TRUE;
+}
+
+
+// Files, through file descriptors. Paths are narrowed to ASCII, which is all the tests use.
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define FILE_SHARE_READ 0x00000001
+#define FILE_SHARE_DELETE 0x00000004
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_READONLY 0x00000001
+#define FILE_ATTRIBUTE_HIDDEN 0x00000002
+#define FILE_ATTRIBUTE_SYSTEM 0x00000004
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x0004
+#define MOVEFILE_REPLACE_EXISTING 0x00000001
+
+typedef struct {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+    DWORD dwReserved0;
+    DWORD dwReserved1;
+    WCHAR cFileName[MAX_PATH];
+    WCHAR cAlternateFileName[14];
+} WIN32_FIND_DATAW;
+
+typedef struct {
+    DWORD nLength;
+    LPVOID lpSecurityDescriptor;
+    BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+
+inline std::string Compat_path(LPCWSTR path) {
+    std::string narrow;
+    for (; *path != L'\0'; ++path) {
+        narrow += *path == L'\\' ? '/' : char(*path < 0x80 ? *path : '?');
+    }
+    return narrow;
+}
+
+inline DWORD Compat_error(int error) {
+    return error == ENOENT ? ERROR_FILE_NOT_FOUND : error == EACCES ? ERROR_ACCESS_DENIED : ERROR_INVALID_DATA;
+}
+
+// File and mapping handles are both a descriptor, plus one so that 0 stays free for NULL.
+inline HANDLE CreateFileW(LPCWSTR path, DWORD access, DWORD, LPSECURITY_ATTRIBUTES, DWORD disposition, DWORD, HANDLE) {
+    int flags = (access & GENERIC_WRITE) != 0 ? O_WRONLY : O_RDONLY;
+    if (disposition == CREATE_ALWAYS) {
+        flags |= O_CREAT | O_TRUNC;
+    }
+    int fd = open(Compat_path(path).c_str(), flags | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        SetLastError(Compat_error(errno));
+        return INVALID_HANDLE_VALUE;
+    }
+    return (HANDLE)(LONG_PTR)(fd + 1);
+}
+
+inline BOOL CloseHandle(HANDLE handle) {
+    if (Compat_isEvent(handle)) {
+        delete (Compat_Event*)handle;
+        return TRUE;
+    }
+    return close(int((LONG_PTR)handle) - 1) == 0;
+}
+
+inline BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size) {
+    struct stat status;
+    if (fstat(int((LONG_PTR)file) - 1, &status) != 0) {
+        return FALSE;
+    }
+    size->QuadPart = status.st_size;
+    return TRUE;
+}
+
+inline BOOL WriteFile(HANDLE file, LPCVOID buffer, DWORD cb, LPDWORD written, LPVOID) {
+    ssize_t result = write(int((LONG_PTR)file) - 1, buffer, cb);
+    *written = result > 0 ? DWORD(result) : 0;
+    return result >= 0;
+}
+
+inline HANDLE CreateFileMappingW(HANDLE file, LPSECURITY_ATTRIBUTES, DWORD, DWORD, DWORD, LPCWSTR) {
+    int fd = dup(int((LONG_PTR)file) - 1);
+    return fd >= 0 ? (HANDLE)(LONG_PTR)(fd + 1) : NULL;
+}
+
+// munmap needs the size of the view, which UnmapViewOfFile isn't given.
+inline std::map<LPCVOID, size_t>& Compat_views() {
+    static std::map<LPCVOID, size_t> views;
+    return views;
+}
+
+inline std::mutex& Compat_viewsLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+inline LPVOID MapViewOfFile(HANDLE mapping, DWORD, DWORD, DWORD, SIZE_T) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapping, &size) || size.QuadPart == 0) {
+        return NULL;
+    }
+    LPVOID view = mmap(NULL, size_t(size.QuadPart), PROT_READ, MAP_SHARED, int((LONG_PTR)mapping) - 1, 0);
+    if (view == MAP_FAILED) {
+        return NULL;
+    }
+    std::lock_guard<std::mutex> guard(Compat_viewsLock());
+    Compat_views()[view] = size_t(size.QuadPart);
+    return view;
+}
+
+inline BOOL UnmapViewOfFile(LPCVOID view) {
+    std::lock_guard<std::mutex> guard(Compat_viewsLock());
+    std::map<LPCVOID, size_t>::iterator iter = Compat_views().find(view);
+    if (iter == Compat_views().end()) {
+        return FALSE;
+    }
+    munmap((LPVOID)view, iter->second);
+    Compat_views().erase(iter);
+    return TRUE;
+}
+
+inline BOOL MoveFileExW(LPCWSTR from, LPCWSTR to, DWORD) {
+    if (rename(Compat_path(from).c_str(), Compat_path(to).c_str()) != 0) {
+        SetLastError(Compat_error(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+inline BOOL DeleteFileW(LPCWSTR path) {
+    return unlink(Compat_path(path).c_str()) == 0;
+}
+
+
+// The registry, which RegistryFake.cpp keeps in memory.
+typedef LONG LSTATUS;
+typedef DWORD REGSAM;
+#define HKEY_CURRENT_USER ((HKEY)(ULONG_PTR)0x80000001)
+#define KEY_READ 0x20019
+#define REG_SZ 1
+#define REG_EXPAND_SZ 2
+#define REG_DWORD 4
+#define REG_QWORD 11
+#define RRF_RT_REG_SZ 0x00000002
+#define RRF_RT_REG_EXPAND_SZ 0x00000004
+#define RRF_RT_REG_DWORD 0x00000010
+#define RRF_RT_REG_QWORD 0x00000040
+
+LSTATUS RegCreateKeyW(HKEY key, LPCWSTR subKey, HKEY* result);
+LSTATUS RegOpenKeyExW(HKEY key, LPCWSTR subKey, DWORD options, REGSAM access, HKEY* result);
+LSTATUS RegEnumKeyExW(HKEY key, DWORD index, LPWSTR name, LPDWORD cchName, LPDWORD reserved, LPWSTR className, LPDWORD cchClassName, LPVOID lastWriteTime);
+LSTATUS RegGetValueW(HKEY key, LPCWSTR subKey, LPCWSTR value, DWORD flags, LPDWORD type, PVOID data, LPDWORD cbData);
+LSTATUS RegSetValueExW(HKEY key, LPCWSTR value, DWORD reserved, DWORD type, const BYTE* data, DWORD cbData);
+LSTATUS RegCloseKey(HKEY key);
@@ -0,0 +1,15 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/intrin.h
+ *  The WinUnionFS Project
+ *
+ *  The MSVC intrinsics the units use, in terms of GCC's.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+// cpuid.h has __cpuidex like MSVC's, but __cpuid is a macro with a different signature.
+#undef __cpuid
+#define __cpuid(info, function) __cpuidex(info, function, 0)
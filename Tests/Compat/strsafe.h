@@ -0,0 +1,88 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Compat/strsafe.h
+ *  The WinUnionFS Project
+ *
+ *  The safe string functions the units built here use. Formatting supports
+ *  %s with a wide string, %d, %u, %x and %X with an optional zero padded
+ *  width, and %%, which is all they ask for.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <Windows.h>
+
+#define STRSAFE_E_INSUFFICIENT_BUFFER ((HRESULT)0x8007007A)
+
+inline HRESULT StringCchCopyW(LPWSTR destination, size_t cchDestination, LPCWSTR source) {
+    size_t cch = wcslen(source);
+    if (cch >= cchDestination) {
+        return STRSAFE_E_INSUFFICIENT_BUFFER;
+    }
+    memcpy(destination, source, sizeof(WCHAR)*(cch + 1));
+    return S_OK;
+}
+
+inline HRESULT StringCchPrintfW(LPWSTR destination, size_t cchDestination, LPCWSTR format, ...) {
+    va_list args;
+    size_t cch = 0;
+    bool overflow = false;
+
+    va_start(args, format);
+    for (; *format != L'\0'; ++format) {
+        char number[16];
+        const char* narrow = NULL;
+        LPCWSTR wide = NULL;
+        WCHAR single[2] = { *format, L'\0' };
+
+        if (*format != L'%') {
+            wide = single;
+        }
+        else if (format[1] == L'\0') {
+            break;
+        }
+        else if (*++format == L's') {
+            wide = va_arg(args, LPCWSTR);
+        }
+        else {
+            char spec[8] = "%";
+            size_t cchSpec = 1;
+
+            for (; *format >= L'0' && *format <= L'9' && cchSpec < sizeof(spec) - 2; ++format) {
+                spec[cchSpec++] = char(*format);
+            }
+            if (*format == L'\0') {
+                break;
+            }
+
+            if (*format == L'd' || *format == L'u' || *format == L'x' || *format == L'X') {
+                spec[cchSpec++] = char(*format);
+                spec[cchSpec] = '\0';
+                snprintf(number, sizeof(number), spec, va_arg(args, int));
+                narrow = number;
+            }
+            else {
+                single[0] = *format;
+                wide = single;
+            }
+        }
+
+        for (; wide != NULL && *wide != L'\0'; ++wide) {
+            overflow = overflow || cch + 1 >= cchDestination;
+            if (!overflow) {
+                destination[cch++] = *wide;
+            }
+        }
+        for (; narrow != NULL && *narrow != '\0'; ++narrow) {
+            overflow = overflow || cch + 1 >= cchDestination;
+            if (!overflow) {
+                destination[cch++] = WCHAR(*narrow);
+            }
+        }
+    }
+    va_end(args);
+
+    if (cchDestination > 0) {
+        destination[cch] = L'\0';
+    }
+    return overflow ? STRSAFE_E_INSUFFICIENT_BUFFER : S_OK;
+}
@@ -0,0 +1,288 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ConfigDiffTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of the configuration diff. A group whose members haven't changed
+ *  must never be rebuilt, since that rebinds its members and throws away its
+ *  cached listings.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "ConfigDiff.h"
+#include "Name.h"
+#include "Strings.h"
+#include "Test.h"
+
+
+typedef std::vector<ConfigDiff::GroupConfig> Configuration;
+typedef std::vector<ConfigDiff::Step> Steps;
+
+
+/// <summary>
+/// Adds a group with the given member paths to a configuration. paths is NULL terminated.
+/// </summary>
+static void AddGroup(Configuration *configuration, LPCWSTR name, LPCWSTR* paths) {
+    ConfigDiff::GroupConfig group;
+    group.name = name;
+    for (; paths != NULL && *paths != NULL; ++paths) {
+        group.paths.push_back(*paths);
+    }
+    configuration->push_back(group);
+}
+
+
+/// <summary>
+/// Returns the step for the group at index in after, or NULL if there is none.
+/// </summary>
+static const ConfigDiff::Step* StepFor(const Steps &steps, size_t index) {
+    for (Steps::const_iterator step = steps.begin(); step != steps.end(); ++step) {
+        if (step->action != ConfigDiff::REMOVE && step->after == index) {
+            return &*step;
+        }
+    }
+    return NULL;
+}
+
+
+/// <summary>
+/// Returns the number of steps with the given action.
+/// </summary>
+static size_t CountOf(const Steps &steps, ConfigDiff::Action action) {
+    size_t count = 0;
+    for (Steps::const_iterator step = steps.begin(); step != steps.end(); ++step) {
+        if (step->action == action) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+
+TEST(ConfigDiff_NothingLoaded_AddsEveryGroup) {
+    Strings strings;
+    LPCWSTR paths[] = { strings.Add("C:\\A"), strings.Add("D:\\A"), NULL };
+    Configuration before, after;
+    Steps steps;
+
+    AddGroup(&after, strings.Add("One"), paths);
+    AddGroup(&after, strings.Add("Two"), paths);
+    ConfigDiff::Diff(before, after, &steps);
+
+    CHECK(steps.size() == 2);
+    CHECK(steps[0].action == ConfigDiff::ADD && steps[0].after == 0);
+    CHECK(steps[1].action == ConfigDiff::ADD && steps[1].after == 1);
+}
+
+
+TEST(ConfigDiff_SameConfiguration_KeepsEveryGroup) {
+    Strings strings;
+    LPCWSTR paths1[] = { strings.Add("C:\\Music"), strings.Add("\\\\server\\Music"), NULL };
+    LPCWSTR paths2[] = { strings.Add("C:\\Photos"), NULL };
+    Configuration before, after;
+    Steps steps;
+
+    AddGroup(&before, strings.Add("Music"), paths1);
+    AddGroup(&before, strings.Add("Photos"), paths2);
+    AddGroup(&after, strings.Add("Music"), paths1);
+    AddGroup(&after, strings.Add("Photos"), paths2);
+    ConfigDiff::Diff(before, after, &steps);
+
+    CHECK(steps.size() == 2);
+    CHECK(CountOf(steps, ConfigDiff::KEEP) == 2);
+    CHECK(steps[0].before == 0 && steps[0].after == 0);
+    CHECK(steps[1].before == 1 && steps[1].after == 1);
+}
+
+
+TEST(ConfigDiff_CaseChanges_KeepGroup) {
+    Strings strings;
+    LPCWSTR pathsBefore[] = { strings.Add("C:\\Music"), strings.Add("D:\\music"), NULL };
+    LPCWSTR pathsAfter[] = { strings.Add("c:\\MUSIC"), strings.Add("D:\\Music"), NULL };
+    Configuration before, after;
+    Steps steps;
+
+    AddGroup(&before, strings.Add("Music"), pathsBefore);
+    AddGroup(&after, strings.Add("MUSIC"), pathsAfter);
+    ConfigDiff::Diff(before, after, &steps);
+
+    CHECK(steps.size() == 1);
+    CHECK(steps[0].action == ConfigDiff::KEEP);
+}
+
+
+TEST(ConfigDiff_ChangedMembers_RebuildOnlyThatGroup) {
+    Strings strings;
+    LPCWSTR paths[] = { strings.Add("C:\\A"), strings.Add("D:\\A"), NULL };
+    LPCWSTR reordered[] = { strings.Add("D:\\A"), strings.Add("C:\\A"), NULL };
+    LPCWSTR added[] = { strings.Add("C:\\A"), strings.Add("D:\\A"), strings.Add("E:\\A"), NULL };
+    LPCWSTR removed[] = { strings.Add("C:\\A"), NULL };
+    Configuration before, after;
+    Steps steps;
+
+    AddGroup(&before, strings.Add("Same"), paths);
+    AddGroup(&before, strings.Add("Reordered"), paths);
+    AddGroup(&before, strings.Add("Added"), paths);
+    AddGroup(&before, strings.Add("Removed"), paths);
+    AddGroup(&after, strings.Add("Same"), paths);
+    AddGroup(&after, strings.Add("Reordered"), reordered);
+    AddGroup(&after, strings.Add("Added"), added);
+    AddGroup(&after, strings.Add("Removed"), removed);
+    ConfigDiff::Diff(before, after, &steps);
+
+    CHECK(steps.size() == 4);
+    CHECK(StepFor(steps, 0)->action == ConfigDiff::KEEP);
+    CHECK(StepFor(steps, 1)->action == ConfigDiff::REBUILD && StepFor(steps, 1)->before == 1);
+    CHECK(StepFor(steps, 2)->action == ConfigDiff::REBUILD && StepFor(steps, 2)->before == 2);
+    CHECK(StepFor(steps, 3)->action == ConfigDiff::REBUILD && StepFor(steps, 3)->before == 3);
+}
+
+
+TEST(ConfigDiff_GroupsGone_AreRemovedLast) {
+    Strings strings;
+    LPCWSTR paths[] = { strings.Add("C:\\A"), NULL };
+    Configuration before, after;
+    Steps steps;
+
+    AddGroup(&before, strings.Add("Gone"), paths);
+    AddGroup(&before, strings.Add("Stays"), paths);
+    AddGroup(&after, strings.Add("New"), paths);
+    AddGroup(&after, strings.Add("Stays"), paths);
+    ConfigDiff::Diff(before, after, &steps);
+
+    CHECK(steps.size() == 3);
+    CHECK(steps[0].action == ConfigDiff::ADD && steps[0].after == 0);
+    CHECK(steps[1].action == ConfigDiff::KEEP && steps[1].before == 1 && steps[1].after == 1);
+    CHECK(steps[2].action == ConfigDiff::REMOVE && steps[2].before == 0);
+}
+
+
+TEST(ConfigDiff_DuplicateAndDamagedNames_AreSkipped) {
+    Strings strings;
+    LPCWSTR paths[] = { strings.Add("C:\\A"), NULL };
+    LPCWSTR other[] = { strings.Add("C:\\B"), NULL };
+    Configuration before, after;
+    Steps steps;
+
+    AddGroup(&before, strings.Add("Group"), paths);
+    AddGroup(&after, NULL, paths);
+    AddGroup(&after, strings.Add("Group"), paths);
+    AddGroup(&after, strings.Add("GROUP"), other);
+    ConfigDiff::Diff(before, after, &steps);
+
+    CHECK(steps.size() == 1);
+    CHECK(steps[0].action == ConfigDiff::KEEP && steps[0].after == 1);
+}
+
+
+TEST(ConfigDiff_RandomEdits_NeverRebuildUntouchedGroups) {
+    srand(13);
+
+    for (int round = 0; round < 2000; ++round) {
+        Strings strings;
+        Configuration before, after;
+        std::vector<bool> touched;
+        Steps steps;
+
+        // Members are drawn from a small pool, so that edits often produce the same paths again.
+        size_t groupCount = rand() % 12;
+        for (size_t i = 0; i < groupCount; ++i) {
+            ConfigDiff::GroupConfig group;
+            group.name = strings.Format("Group%u", unsigned(i));
+            for (int j = rand() % 5; j > 0; --j) {
+                group.paths.push_back(strings.Format("C:\\Member%d", rand() % 6));
+            }
+            before.push_back(group);
+        }
+
+        // Edit some groups, rename some in case only, drop some, add some, and shuffle the order.
+        for (size_t i = 0; i < groupCount; ++i) {
+            ConfigDiff::GroupConfig group = before[i];
+            bool edited = false;
+
+            switch (rand() % 6) {
+            case 0:
+                continue;
+            case 1:
+                group.paths.push_back(strings.Format("C:\\Member%d", rand() % 6));
+                edited = true;
+                break;
+            case 2:
+                if (!group.paths.empty()) {
+                    group.paths.erase(group.paths.begin() + rand() % group.paths.size());
+                    edited = true;
+                }
+                break;
+            case 3:
+                group.name = strings.Format("GROUP%u", unsigned(i));
+                break;
+            }
+
+            after.push_back(group);
+            touched.push_back(edited);
+        }
+        for (int j = rand() % 3; j > 0; --j) {
+            ConfigDiff::GroupConfig group;
+            group.name = strings.Format("New%d", j);
+            after.push_back(group);
+            touched.push_back(true);
+        }
+        for (size_t i = after.size(); i > 1; --i) {
+            size_t j = rand() % i;
+            std::swap(after[i - 1], after[j]);
+            std::vector<bool>::swap(touched[i - 1], touched[j]);
+        }
+
+        ConfigDiff::Diff(before, after, &steps);
+
+        std::vector<int> beforeSeen(before.size(), 0);
+        std::vector<int> afterSeen(after.size(), 0);
+
+        for (Steps::const_iterator step = steps.begin(); step != steps.end(); ++step) {
+            if (step->action == ConfigDiff::REMOVE) {
+                CHECK(step->before < before.size());
+                ++beforeSeen[step->before];
+                continue;
+            }
+
+            CHECK(step->after < after.size());
+            ++afterSeen[step->after];
+
+            const ConfigDiff::GroupConfig &group = after[step->after];
+            bool same = false;
+
+            if (step->action == ConfigDiff::ADD) {
+                for (size_t i = 0; i < before.size(); ++i) {
+                    CHECK(!Name::Equal(before[i].name, group.name));
+                }
+                continue;
+            }
+
+            CHECK(step->before < before.size());
+            CHECK(Name::Equal(before[step->before].name, group.name));
+            ++beforeSeen[step->before];
+
+            // Whether or not the edit changed the members in the end, the diff must see it.
+            same = before[step->before].paths.size() == group.paths.size();
+            for (size_t i = 0; same && i < group.paths.size(); ++i) {
+                same = Name::Equal(before[step->before].paths[i], group.paths[i]);
+            }
+            CHECK(same == (step->action == ConfigDiff::KEEP));
+            if (!touched[step->after]) {
+                CHECK(step->action == ConfigDiff::KEEP);
+            }
+        }
+
+        // Every group is accounted for exactly once.
+        for (size_t i = 0; i < beforeSeen.size(); ++i) {
+            CHECK(beforeSeen[i] == 1);
+        }
+        for (size_t i = 0; i < afterSeen.size(); ++i) {
+            CHECK(afterSeen[i] == 1);
+        }
+    }
+}
@@ -0,0 +1,122 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ConfigFileBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Measures loading a configuration of 1000 groups of 20 members, imported
+ *  from the registry and mapped from a file, and mapping the file to read a
+ *  single group, which only touches the pages that group is in. The file is
+ *  written once and stays in the page cache, so this is the cost of parsing
+ *  rather than of the disk.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Benchmark.h"
+#include "ConfigFile.hpp"
+#include "RegistryFake.h"
+#include "Strings.h"
+
+
+// The size of the configuration.
+#define GROUP_COUNT 1000
+#define MEMBER_COUNT 20
+
+
+static Strings strings;
+
+// The configuration file, once it has been written.
+static LPCWSTR configPath;
+
+
+/// <summary>
+/// Deletes the configuration file when the benchmarks are done.
+/// </summary>
+static void DeleteConfiguration() {
+    DeleteFileW(configPath);
+}
+
+
+/// <summary>
+/// Fills the registry with the configuration and writes the file, the first time they are needed.
+/// </summary>
+static void EnsureConfiguration() {
+    if (configPath != NULL) {
+        return;
+    }
+
+    RegistryFake::Clear();
+    for (int group = 0; group < GROUP_COUNT; ++group) {
+        for (int member = 0; member < MEMBER_COUNT; ++member) {
+            RegistryFake::SetString(strings.Format("SOFTWARE\\WinUnionFS\\Groups\\Group %04d\\Folders\\%d", group, member), L"Path",
+                strings.Format("\\\\server%02d\\share\\Group %04d", member, group));
+        }
+    }
+
+    const char* directory = getenv("TMPDIR");
+    configPath = strings.Format("%s/WinUnionFS-%d.config", directory != NULL ? directory : "/tmp", int(getpid()));
+
+    ConfigFile* config = ConfigFile::Import();
+    if (config == NULL || FAILED(config->Save(configPath))) {
+        fprintf(stderr, "Failed to write the configuration file\n");
+        exit(1);
+    }
+    delete config;
+    atexit(DeleteConfiguration);
+}
+
+
+/// <summary>
+/// Reads every group and member, the way Group::Apply does.
+/// </summary>
+static void ReadAll(ConfigFile* config) {
+    ULONG_PTR total = 0;
+
+    for (DWORD group = 0; group < config->GroupCount(); ++group) {
+        total += ULONG_PTR(config->GroupName(group));
+        for (DWORD member = 0; member < config->MemberCount(group); ++member) {
+            total += ULONG_PTR(config->MemberPath(group, member));
+        }
+    }
+
+    Benchmark::Use(total);
+}
+
+
+BENCHMARK(ConfigFile_Import_1000x20) {
+    EnsureConfiguration();
+    Benchmark::Items(GROUP_COUNT*MEMBER_COUNT);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        ConfigFile* config = ConfigFile::Import();
+        ReadAll(config);
+        delete config;
+    }
+}
+
+
+BENCHMARK(ConfigFile_Map_1000x20) {
+    EnsureConfiguration();
+    Benchmark::Items(GROUP_COUNT*MEMBER_COUNT);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        ConfigFile* config = ConfigFile::Map(configPath);
+        ReadAll(config);
+        delete config;
+    }
+}
+
+
+BENCHMARK(ConfigFile_Map_OneGroup) {
+    EnsureConfiguration();
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        ConfigFile* config = ConfigFile::Map(configPath);
+        DWORD group = config->GroupCount()/2;
+        Benchmark::Use(ULONG_PTR(config->GroupName(group)) + ULONG_PTR(config->MemberPath(group, 0)));
+        delete config;
+    }
+}
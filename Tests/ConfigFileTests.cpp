@@ -0,0 +1,171 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ConfigFileTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of the binary configuration: importing it from the registry, and
+ *  saving and mapping it, which must give back the same groups in order, and
+ *  refusing files which aren't configurations.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "ConfigFile.hpp"
+#include "Name.h"
+#include "RegistryFake.h"
+#include "Strings.h"
+#include "Test.h"
+
+
+/// <summary>
+/// Returns a path for a temporary file.
+/// </summary>
+static LPCWSTR TempPath(Strings &strings, const char* name) {
+    const char* directory = getenv("TMPDIR");
+    return strings.Format("%s/WinUnionFS-%d-%s", directory != NULL ? directory : "/tmp", int(getpid()), name);
+}
+
+
+/// <summary>
+/// Writes bytes to a file.
+/// </summary>
+static void WriteBytes(LPCWSTR path, const void* data, DWORD cb) {
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    DWORD written;
+    WriteFile(file, data, cb, &written, NULL);
+    CloseHandle(file);
+}
+
+
+/// <summary>
+/// Fills the registry with two groups, the second of which has a long path.
+/// </summary>
+static void FillRegistry(Strings &strings, LPCWSTR longPath) {
+    RegistryFake::Clear();
+    RegistryFake::SetString(L"SOFTWARE\\WinUnionFS\\Groups\\Music\\Folders\\0", L"Path", L"C:\\Music");
+    RegistryFake::SetString(L"SOFTWARE\\WinUnionFS\\Groups\\Music\\Folders\\1", L"Path", L"\\\\server\\music");
+    RegistryFake::SetString(L"SOFTWARE\\WinUnionFS\\Groups\\Photos\\Folders\\0", L"Path", longPath);
+}
+
+
+/// <summary>
+/// Checks that a configuration holds the groups FillRegistry puts in the registry.
+/// </summary>
+static void CheckGroups(ConfigFile* config, LPCWSTR longPath) {
+    CHECK(config->GroupCount() == 2);
+    CHECK(Name::Equal(config->GroupName(0), L"Music"));
+    CHECK(config->MemberCount(0) == 2);
+    CHECK(wcscmp(config->MemberPath(0, 0), L"C:\\Music") == 0);
+    CHECK(wcscmp(config->MemberPath(0, 1), L"\\\\server\\music") == 0);
+    CHECK(Name::Equal(config->GroupName(1), L"Photos"));
+    CHECK(config->MemberCount(1) == 1);
+    CHECK(wcscmp(config->MemberPath(1, 0), longPath) == 0);
+}
+
+
+/// <summary>
+/// Returns a path longer than MAX_PATH.
+/// </summary>
+static LPCWSTR LongPath(Strings &strings) {
+    std::string path = "D:";
+    while (path.size() <= 2*MAX_PATH) {
+        path += "\\A rather long folder name";
+    }
+    return strings.Add(path.c_str());
+}
+
+
+TEST(ConfigFile_Import_ReadsGroupsInOrder) {
+    Strings strings;
+    LPCWSTR longPath = LongPath(strings);
+    FillRegistry(strings, longPath);
+
+    ConfigFile* config = ConfigFile::Import();
+    CHECK(config != NULL);
+    if (config != NULL) {
+        CheckGroups(config, longPath);
+        delete config;
+    }
+
+    RegistryFake::Clear();
+}
+
+
+TEST(ConfigFile_SaveAndMap_GivesBackTheSameGroups) {
+    Strings strings;
+    LPCWSTR longPath = LongPath(strings);
+    LPCWSTR path = TempPath(strings, "roundtrip.config");
+    FillRegistry(strings, longPath);
+
+    ConfigFile* imported = ConfigFile::Import();
+    CHECK(SUCCEEDED(imported->Save(path)));
+    delete imported;
+
+    ConfigFile* mapped = ConfigFile::Map(path);
+    CHECK(mapped != NULL);
+    if (mapped != NULL) {
+        CheckGroups(mapped, longPath);
+        delete mapped;
+    }
+
+    DeleteFileW(path);
+    RegistryFake::Clear();
+}
+
+
+TEST(ConfigFile_Map_RefusesWhatIsntAConfiguration) {
+    Strings strings;
+    LPCWSTR path = TempPath(strings, "damaged.config");
+    BYTE bytes[64] = { 'W', 'U', 'F', 'S' };
+
+    CHECK(ConfigFile::Map(TempPath(strings, "missing.config")) == NULL);
+
+    WriteBytes(path, "Not a configuration", 19);
+    CHECK(ConfigFile::Map(path) == NULL);
+
+    // The right magic, but the wrong version and size.
+    WriteBytes(path, bytes, sizeof(bytes));
+    CHECK(ConfigFile::Map(path) == NULL);
+
+    DeleteFileW(path);
+}
+
+
+TEST(ConfigFile_Map_ReturnsNothingPastTheEnd) {
+    Strings strings;
+    LPCWSTR path = TempPath(strings, "truncated.config");
+    RegistryFake::Clear();
+    RegistryFake::SetString(L"SOFTWARE\\WinUnionFS\\Groups\\Music\\Folders\\0", L"Path", L"C:\\Music");
+
+    ConfigFile* imported = ConfigFile::Import();
+    imported->Save(path);
+    delete imported;
+
+    // Point the group table past the end of the file. Its size still matches, so it maps.
+    FILE* stream = fopen(Compat_path(path).c_str(), "rb");
+    fseek(stream, 0, SEEK_END);
+    std::vector<BYTE> bytes(size_t(ftell(stream)));
+    fseek(stream, 0, SEEK_SET);
+    CHECK(fread(&bytes[0], 1, bytes.size(), stream) == bytes.size());
+    fclose(stream);
+
+    DWORD groupsOffset = DWORD(bytes.size()) + 4;
+    memcpy(&bytes[16], &groupsOffset, sizeof(DWORD));
+    WriteBytes(path, &bytes[0], DWORD(bytes.size()));
+
+    ConfigFile* mapped = ConfigFile::Map(path);
+    CHECK(mapped != NULL);
+    if (mapped != NULL) {
+        CHECK(mapped->GroupCount() == 0);
+        delete mapped;
+    }
+
+    DeleteFileW(path);
+    RegistryFake::Clear();
+}
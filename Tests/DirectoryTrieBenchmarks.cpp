@@ -0,0 +1,89 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  DirectoryTrieBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Measures recording the folders members have from a listing, and leaving
+ *  members out of a deep path, which every bind and parse below the top of
+ *  a group does.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "DirectoryTrie.h"
+#include "Strings.h"
+
+
+// The number of members, and of folders in a listing.
+#define MEMBER_COUNT 4
+#define FOLDER_COUNT 1000
+
+// The depth of the path pruned.
+#define DEPTH 8
+
+
+static Strings strings;
+
+
+/// <summary>
+/// Makes a listing of FOLDER_COUNT folders. Every member has the first of them, and each of the
+/// rest is in one member only.
+/// </summary>
+static std::vector<DirectoryTrie::MemberFolder> MakeListing() {
+    std::vector<DirectoryTrie::MemberFolder> folders;
+
+    for (size_t member = 0; member < MEMBER_COUNT; ++member) {
+        folders.push_back(DirectoryTrie::MemberFolder(L"Shared", member));
+    }
+    for (int i = 1; i < FOLDER_COUNT; ++i) {
+        folders.push_back(DirectoryTrie::MemberFolder(strings.Format("Folder %04d", i), i % MEMBER_COUNT));
+    }
+
+    return folders;
+}
+
+
+BENCHMARK(DirectoryTrie_Store_1000Folders) {
+    std::vector<DirectoryTrie::MemberFolder> folders = MakeListing();
+    Benchmark::Items(ULONG(folders.size()));
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        DirectoryTrie::Store(L"Benchmark", L"", 0, MEMBER_COUNT, folders);
+    }
+
+    DirectoryTrie::Clear();
+}
+
+
+BENCHMARK(DirectoryTrie_Prune_Depth8) {
+    std::vector<DirectoryTrie::MemberFolder> folders = MakeListing();
+    std::vector<bool> mayHave;
+    std::string narrow;
+    ULONG left = 0;
+
+    // Every folder on the path has the same listing, in which the path goes on through Shared.
+    for (int depth = 0; depth < DEPTH; ++depth) {
+        if (depth != 0) {
+            narrow += depth == 1 ? "Shared" : "\\Shared";
+        }
+        DirectoryTrie::Store(L"Benchmark", strings.Add(narrow.c_str()), 0, MEMBER_COUNT, folders);
+    }
+    LPCWSTR path = strings.Add((narrow + "\\Folder 0001").c_str());
+    Benchmark::Items(DEPTH);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        mayHave.assign(MEMBER_COUNT, true);
+        DirectoryTrie::Prune(L"Benchmark", path, true, &mayHave);
+
+        left = 0;
+        for (size_t member = 0; member < mayHave.size(); ++member) {
+            left += mayHave[member] ? 1 : 0;
+        }
+    }
+
+    Benchmark::Report("members left", left);
+    DirectoryTrie::Clear();
+}
@@ -0,0 +1,179 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  EnumIDListBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Measures merging member listings into an EnumIDList, which drops names an
+ *  earlier member already had, and handing the items out again. Listings of
+ *  10k to 1M names should merge in about the same time per name. Also
+ *  compares the arena the items are kept in with allocating each one.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <vector>
+
+#include "Arena.hpp"
+#include "Benchmark.h"
+#include "EnumIDList.hpp"
+#include "PIDL.h"
+#include "Strings.h"
+
+
+// The number of members the names are spread over.
+#define MEMBER_COUNT 4
+
+// The number of items to fetch per call to Next, as Explorer does.
+#define BATCH_SIZE 256
+
+
+typedef std::vector<std::vector<LPCWSTR> > Listings;
+
+static Strings strings;
+
+
+/// <summary>
+/// Returns listings of count names in all, spread over the members. Half the names of every
+/// member but the first are also in the first, in another case, so that they are dropped as
+/// duplicates. The listings are made once per count.
+/// </summary>
+static const Listings& MakeListings(ULONG count) {
+    static std::vector<std::pair<ULONG, Listings*> > made;
+
+    for (size_t i = 0; i < made.size(); ++i) {
+        if (made[i].first == count) {
+            return *made[i].second;
+        }
+    }
+
+    Listings* listings = new Listings(MEMBER_COUNT);
+    ULONG perMember = count/MEMBER_COUNT;
+    for (ULONG member = 0; member < MEMBER_COUNT; ++member) {
+        for (ULONG i = 0; i < perMember; ++i) {
+            if (member != 0 && i % 2 == 0) {
+                (*listings)[member].push_back(strings.Format("DOCUMENT %07u.TXT", i));
+            }
+            else {
+                (*listings)[member].push_back(strings.Format("Document %07u.txt", member*perMember + i));
+            }
+        }
+    }
+
+    made.push_back(std::make_pair(count, listings));
+    return *listings;
+}
+
+
+/// <summary>
+/// Merges the listings into a new list, in member order, and counts the items kept.
+/// </summary>
+static EnumIDList* Merge(const Listings &listings, ULONG* kept) {
+    EnumIDList* list = new EnumIDList();
+
+    *kept = 0;
+    for (size_t member = 0; member < listings.size(); ++member) {
+        for (std::vector<LPCWSTR>::const_iterator name = listings[member].begin(); name != listings[member].end(); ++name) {
+            if (list->AddItem(*name, 0, USHORT(member), MEMBER_COUNT)) {
+                ++*kept;
+            }
+            else {
+                list->AddMember(*name, USHORT(member));
+            }
+        }
+    }
+
+    return list;
+}
+
+
+/// <summary>
+/// Merges listings of count names, reporting the memory used per item kept.
+/// </summary>
+static void MergeNames(ULONG iterations, ULONG count) {
+    const Listings &listings = MakeListings(count);
+    Benchmark::Items(count);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        ULONG kept;
+        EnumIDList* list = Merge(listings, &kept);
+
+        Benchmark::Report("items kept", kept);
+        Benchmark::Report("bytes per item kept", double(list->Size())/kept);
+
+        list->Release();
+    }
+}
+
+
+BENCHMARK(EnumIDList_Merge_10k) {
+    MergeNames(iterations, 10000);
+}
+
+BENCHMARK(EnumIDList_Merge_100k) {
+    MergeNames(iterations, 100000);
+}
+
+BENCHMARK(EnumIDList_Merge_1M) {
+    MergeNames(iterations, 1000000);
+}
+
+
+BENCHMARK(EnumIDList_Next_100k) {
+    ULONG kept;
+    EnumIDList* list = Merge(MakeListings(100000), &kept);
+    LPITEMIDLIST batch[BATCH_SIZE];
+    ULONG fetched;
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        list->Reset();
+        do {
+            list->Next(BATCH_SIZE, batch, &fetched);
+            for (ULONG j = 0; j < fetched; ++j) {
+                PIDL::Free(batch[j]);
+            }
+        } while (fetched == BATCH_SIZE);
+    }
+
+    Benchmark::Items(kept);
+    list->Release();
+}
+
+
+/// <summary>
+/// Makes the items of the first member, in an arena or one allocation each.
+/// </summary>
+static void MakeItems(ULONG iterations, bool arena) {
+    const std::vector<LPCWSTR> &names = MakeListings(100000)[0];
+    std::vector<LPITEMIDLIST> items(names.size());
+    Benchmark::Items(ULONG(names.size()));
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        Arena itemArena;
+
+        for (size_t j = 0; j < names.size(); ++j) {
+            ULONG cb = PIDL::ChildSize(names[j], MEMBER_COUNT);
+            items[j] = (LPITEMIDLIST)(arena ? itemArena.Allocate(cb) : CoTaskMemAlloc(cb));
+            PIDL::Init(items[j], names[j], 0, 0, MEMBER_COUNT);
+        }
+
+        if (arena) {
+            Benchmark::Report("allocations per 1000 items", 1000.0*itemArena.BlockCount()/names.size());
+            Benchmark::Report("bytes per item", double(itemArena.BytesUsed())/names.size());
+        }
+        else {
+            for (size_t j = 0; j < names.size(); ++j) {
+                CoTaskMemFree(items[j]);
+            }
+            Benchmark::Report("allocations per 1000 items", 1000.0);
+        }
+    }
+}
+
+
+BENCHMARK(Arena_Items_25k) {
+    MakeItems(iterations, true);
+}
+
+BENCHMARK(CoTaskMemAlloc_Items_25k) {
+    MakeItems(iterations, false);
+}
@@ -0,0 +1,529 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  FakeFolder.cpp
+ *  The WinUnionFS Project
+ *
+ *  An in-memory shell folder, and the little of the shell around it which
+ *  the enumeration needs: binding a folder again from its ID list, on any
+ *  thread, and reading the find data out of item IDs.
+ *
+ *  Item IDs hold the index of the item, and folders' ID lists the index of
+ *  the folder in a list of every live one, which the desktop binds from.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShlObj.h>
+
+#include "FakeFolder.hpp"
+#include "Macros.h"
+#include "Name.h"
+
+
+// Every live folder, by index, so that they can be bound from their ID lists.
+static std::vector<FakeFolder*> folders;
+static SRWLOCK foldersLock = SRWLOCK_INIT;
+
+// An ID holding an index, followed by the terminator.
+#pragma pack(push, 1)
+typedef struct {
+    USHORT cb;
+    ULONG index;
+    USHORT terminator;
+} IndexID;
+#pragma pack(pop)
+
+
+/// <summary>
+/// Returns a new ID list holding the index.
+/// </summary>
+static LPITEMIDLIST CreateIndexID(ULONG index) {
+    IndexID* id = (IndexID*)CoTaskMemAlloc(sizeof(IndexID));
+
+    id->cb = USHORT(FIELD_OFFSET(IndexID, terminator));
+    id->index = index;
+    id->terminator = 0;
+
+    return (LPITEMIDLIST)id;
+}
+
+
+/// <summary>
+/// Reads the index out of an ID list from CreateIndexID. Returns false for any other ID list.
+/// </summary>
+static bool ReadIndexID(PCUIDLIST_RELATIVE idList, ULONG* index) {
+    const IndexID* id = (const IndexID*)idList;
+
+    if (id == NULL || id->cb != FIELD_OFFSET(IndexID, terminator)) {
+        return false;
+    }
+
+    *index = id->index;
+    return true;
+}
+
+
+/// <summary>
+/// Returns the live folder an ID list stands for, or NULL. The caller must hold foldersLock.
+/// </summary>
+static FakeFolder* FindFolder(PCUIDLIST_RELATIVE idList) {
+    ULONG index;
+
+    if (!ReadIndexID(idList, &index) || index >= folders.size()) {
+        return NULL;
+    }
+
+    return folders[index];
+}
+
+
+/// <summary>
+/// Enumerates the items of a folder, which match the flags.
+/// </summary>
+class FakeFolder::Enumerator : public IEnumIDList
+{
+public:
+    explicit Enumerator(FakeFolder* folder, SHCONTF flags) {
+        this->folder = folder;
+        this->folder->AddRef();
+        this->flags = flags;
+        this->position = 0;
+        this->refCount = 1;
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() {
+        return InterlockedIncrement(&this->refCount);
+    }
+
+    STDMETHOD(QueryInterface) (REFIID riid, void** ppvObject) {
+        if (riid == IID_IUnknown || riid == IID_IEnumIDList) {
+            *ppvObject = (IEnumIDList*)this;
+            AddRef();
+            return S_OK;
+        }
+
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    ULONG STDMETHODCALLTYPE Release() {
+        ULONG refCount = InterlockedDecrement(&this->refCount);
+        if (refCount == 0) {
+            delete this;
+        }
+
+        return refCount;
+    }
+
+    STDMETHOD(Next) (ULONG celt, LPITEMIDLIST* rgelt, ULONG* pceltFetched) {
+        ULONG fetched = 0;
+
+        InterlockedIncrement(&this->folder->nextCalls);
+        if (this->folder->delay != 0) {
+            Sleep(this->folder->delay);
+        }
+        WaitForSingleObject(this->folder->awake, INFINITE);
+
+        while (fetched < celt && this->position < this->folder->items.size()) {
+            const Item &item = this->folder->items[this->position];
+            bool isFolder = FLAGSET(item.attributes, SFGAO_FOLDER);
+
+            if (isFolder ? FLAGSET(this->flags, SHCONTF_FOLDERS) : FLAGSET(this->flags, SHCONTF_NONFOLDERS)) {
+                if (!FLAGSET(item.attributes, SFGAO_HIDDEN) || FLAGSET(this->flags, SHCONTF_INCLUDEHIDDEN)) {
+                    rgelt[fetched++] = CreateIndexID(ULONG(this->position));
+                }
+            }
+            ++this->position;
+        }
+
+        if (pceltFetched != NULL) {
+            *pceltFetched = fetched;
+        }
+
+        return fetched == celt ? S_OK : S_FALSE;
+    }
+
+    STDMETHOD(Skip) (ULONG) {
+        return E_NOTIMPL;
+    }
+
+    STDMETHOD(Reset) () {
+        this->position = 0;
+        return S_OK;
+    }
+
+    STDMETHOD(Clone) (IEnumIDList** ppenum) {
+        *ppenum = NULL;
+        return E_NOTIMPL;
+    }
+
+private:
+    virtual ~Enumerator() {
+        this->folder->Release();
+    }
+
+    FakeFolder* folder;
+    SHCONTF flags;
+    size_t position;
+    volatile ULONG refCount;
+};
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+FakeFolder::FakeFolder() {
+    this->refCount = 1;
+    this->fileSystem = true;
+    this->delay = 0;
+    this->awake = CreateEventW(NULL, TRUE, TRUE, NULL);
+    this->nextCalls = 0;
+    this->attributeCalls = 0;
+
+    AcquireSRWLockExclusive(&foldersLock);
+    this->index = ULONG(folders.size());
+    folders.push_back(this);
+    ReleaseSRWLockExclusive(&foldersLock);
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+FakeFolder::~FakeFolder() {
+    AcquireSRWLockExclusive(&foldersLock);
+    folders[this->index] = NULL;
+    ReleaseSRWLockExclusive(&foldersLock);
+
+    for (std::vector<Item>::const_iterator item = this->items.begin(); item != this->items.end(); ++item) {
+        free(item->name);
+    }
+    CloseHandle(this->awake);
+}
+
+
+/// <summary>
+/// Adds an item.
+/// </summary>
+void FakeFolder::Add(LPCWSTR name, SFGAOF attributes) {
+    Item item;
+
+    item.name = _wcsdup(name);
+    item.attributes = attributes;
+    this->items.push_back(item);
+}
+
+
+/// <summary>
+/// Makes the item IDs carry find data or not.
+/// </summary>
+void FakeFolder::SetFileSystem(bool fileSystem) {
+    this->fileSystem = fileSystem;
+}
+
+
+/// <summary>
+/// Makes every IEnumIDList::Next take at least delay ms.
+/// </summary>
+void FakeFolder::SetDelay(DWORD delay) {
+    this->delay = delay;
+}
+
+
+/// <summary>
+/// Makes IEnumIDList::Next block until Wake is called.
+/// </summary>
+void FakeFolder::Hang() {
+    ResetEvent(this->awake);
+}
+
+
+/// <summary>
+/// Lets blocked and later calls to IEnumIDList::Next through.
+/// </summary>
+void FakeFolder::Wake() {
+    SetEvent(this->awake);
+}
+
+
+/// <summary>
+/// Returns the number of IEnumIDList::Next calls so far.
+/// </summary>
+LONG FakeFolder::NextCalls() {
+    return InterlockedCompareExchange(&this->nextCalls, 0, 0);
+}
+
+
+/// <summary>
+/// Returns the number of GetAttributesOf calls so far.
+/// </summary>
+LONG FakeFolder::AttributeCalls() {
+    return InterlockedCompareExchange(&this->attributeCalls, 0, 0);
+}
+
+
+/// <summary>
+/// Waits for the reference count to drop back to the caller's.
+/// </summary>
+bool FakeFolder::WaitReleased(DWORD timeout) {
+    ULONGLONG deadline = GetTickCount64() + timeout;
+
+    while (__atomic_load_n(&this->refCount, __ATOMIC_SEQ_CST) > 1) {
+        if (GetTickCount64() >= deadline) {
+            return false;
+        }
+        Sleep(1);
+    }
+
+    return true;
+}
+
+
+/// <summary>
+/// Returns a new ID list the folder can be bound from again.
+/// </summary>
+PIDLIST_ABSOLUTE FakeFolder::CreateIDList() {
+    return CreateIndexID(this->index);
+}
+
+
+/// <summary>
+/// Returns the item an ID stands for, or NULL.
+/// </summary>
+const FakeFolder::Item* FakeFolder::Find(PCUITEMID_CHILD id) {
+    ULONG index;
+
+    if (!ReadIndexID(id, &index) || index >= this->items.size()) {
+        return NULL;
+    }
+
+    return &this->items[index];
+}
+
+
+/// <summary>
+/// Returns the name of the item an ID stands for, or NULL.
+/// </summary>
+LPCWSTR FakeFolder::GetName(PCUITEMID_CHILD id) {
+    const Item* item = Find(id);
+    return item != NULL ? item->name : NULL;
+}
+
+
+/// <summary>
+/// Fills in the find data of the item an ID stands for, if the folder is in the file system.
+/// </summary>
+bool FakeFolder::GetFindData(PCUITEMID_CHILD id, WIN32_FIND_DATAW* findData) {
+    const Item* item = Find(id);
+
+    if (item == NULL || !this->fileSystem) {
+        return false;
+    }
+
+    ZeroMemory(findData, sizeof(*findData));
+    findData->dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+    if (FLAGSET(item->attributes, SFGAO_FOLDER)) {
+        findData->dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+    }
+    if (FLAGSET(item->attributes, SFGAO_HIDDEN)) {
+        findData->dwFileAttributes |= FILE_ATTRIBUTE_HIDDEN;
+    }
+    if (FLAGSET(item->attributes, SFGAO_READONLY)) {
+        findData->dwFileAttributes |= FILE_ATTRIBUTE_READONLY;
+    }
+
+    size_t cchName = min(wcslen(item->name), size_t(MAX_PATH - 1));
+    memcpy(findData->cFileName, item->name, sizeof(WCHAR)*cchName);
+    return true;
+}
+
+
+/// <summary>
+/// IUnknown::AddRef
+/// </summary>
+ULONG FakeFolder::AddRef() {
+    return InterlockedIncrement(&this->refCount);
+}
+
+
+/// <summary>
+/// IUnknown::QueryInterface
+/// </summary>
+HRESULT FakeFolder::QueryInterface(REFIID riid, void** ppvObject) {
+    if (riid == IID_IUnknown || riid == IID_IShellFolder) {
+        *ppvObject = (IShellFolder*)this;
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+
+/// <summary>
+/// IUnknown::Release
+/// </summary>
+ULONG FakeFolder::Release() {
+    ULONG refCount = InterlockedDecrement(&this->refCount);
+    if (refCount == 0) {
+        delete this;
+    }
+
+    return refCount;
+}
+
+
+/// <summary>
+/// IShellFolder::BindToObject
+/// Binds any live folder from its ID list, as the desktop does.
+/// </summary>
+HRESULT FakeFolder::BindToObject(PCUIDLIST_RELATIVE pidl, IBindCtx*, REFIID riid, void** ppv) {
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND);
+
+    *ppv = NULL;
+
+    AcquireSRWLockShared(&foldersLock);
+    FakeFolder* folder = FindFolder(pidl);
+    if (folder != NULL) {
+        hr = folder->QueryInterface(riid, ppv);
+    }
+    ReleaseSRWLockShared(&foldersLock);
+
+    return hr;
+}
+
+
+/// <summary>
+/// IShellFolder::EnumObjects
+/// </summary>
+HRESULT FakeFolder::EnumObjects(HWND, SHCONTF grfFlags, IEnumIDList** ppenumIDList) {
+    *ppenumIDList = new Enumerator(this, grfFlags);
+    return S_OK;
+}
+
+
+/// <summary>
+/// IShellFolder::GetAttributesOf
+/// Reports the attributes all the items have in common.
+/// </summary>
+HRESULT FakeFolder::GetAttributesOf(UINT cidl, PCUITEMID_CHILD_ARRAY apidl, SFGAOF* rgfInOut) {
+    InterlockedIncrement(&this->attributeCalls);
+
+    for (UINT i = 0; i < cidl; ++i) {
+        const Item* item = Find(apidl[i]);
+        if (item == NULL) {
+            return E_INVALIDARG;
+        }
+        *rgfInOut &= item->attributes;
+    }
+
+    return S_OK;
+}
+
+
+/// <summary>
+/// IShellFolder::GetDisplayNameOf
+/// </summary>
+HRESULT FakeFolder::GetDisplayNameOf(PCUITEMID_CHILD pidl, SHGDNF, STRRET* pName) {
+    LPCWSTR name = GetName(pidl);
+
+    if (name == NULL) {
+        return E_INVALIDARG;
+    }
+
+    size_t cbName = sizeof(WCHAR)*(wcslen(name) + 1);
+    pName->uType = STRRET_WSTR;
+    pName->pOleStr = (LPWSTR)CoTaskMemAlloc(cbName);
+    memcpy(pName->pOleStr, name, cbName);
+
+    return S_OK;
+}
+
+
+/// <summary>
+/// IShellFolder::ParseDisplayName
+/// Finds an item by name. Only names of items directly in the folder are understood.
+/// </summary>
+HRESULT FakeFolder::ParseDisplayName(HWND, IBindCtx*, LPWSTR pszDisplayName, ULONG* pchEaten, PIDLIST_RELATIVE* ppidl, ULONG* pdwAttributes) {
+    *ppidl = NULL;
+
+    for (size_t i = 0; i < this->items.size(); ++i) {
+        if (Name::Equal(this->items[i].name, pszDisplayName)) {
+            if (pchEaten != NULL) {
+                *pchEaten = ULONG(wcslen(pszDisplayName));
+            }
+            if (pdwAttributes != NULL) {
+                *pdwAttributes &= this->items[i].attributes;
+            }
+            *ppidl = CreateIndexID(ULONG(i));
+            return S_OK;
+        }
+    }
+
+    return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+}
+
+
+/// <summary>
+/// The rest of IShellFolder isn't used by the enumeration.
+/// </summary>
+HRESULT FakeFolder::BindToStorage(PCUIDLIST_RELATIVE, IBindCtx*, REFIID, void**) {
+    return E_NOTIMPL;
+}
+
+HRESULT FakeFolder::CompareIDs(LPARAM, PCUIDLIST_RELATIVE, PCUIDLIST_RELATIVE) {
+    return E_NOTIMPL;
+}
+
+HRESULT FakeFolder::CreateViewObject(HWND, REFIID, void**) {
+    return E_NOTIMPL;
+}
+
+HRESULT FakeFolder::GetUIObjectOf(HWND, UINT, PCUITEMID_CHILD_ARRAY, REFIID, UINT*, void**) {
+    return E_NOTIMPL;
+}
+
+HRESULT FakeFolder::SetNameOf(HWND, PCUITEMID_CHILD, LPCWSTR, SHGDNF, PITEMID_CHILD*) {
+    return E_NOTIMPL;
+}
+
+
+/// <summary>
+/// Returns the desktop, which binds every fake folder.
+/// </summary>
+HRESULT SHGetDesktopFolder(IShellFolder** ppshf) {
+    static FakeFolder* desktop = new FakeFolder();
+
+    desktop->AddRef();
+    *ppshf = desktop;
+    return S_OK;
+}
+
+
+/// <summary>
+/// Returns the ID list a fake folder can be bound from again.
+/// </summary>
+HRESULT SHGetIDListFromObject(IUnknown* punk, PIDLIST_ABSOLUTE* ppidl) {
+    FakeFolder* folder = dynamic_cast<FakeFolder*>(punk);
+
+    if (folder == NULL) {
+        *ppidl = NULL;
+        return E_NOINTERFACE;
+    }
+
+    *ppidl = folder->CreateIDList();
+    return S_OK;
+}
+
+
+/// <summary>
+/// Reads the find data out of an item ID of a fake folder in the file system.
+/// </summary>
+HRESULT SHGetDataFromIDListW(IShellFolder* psf, PCUITEMID_CHILD pidl, int nFormat, void* pv, int cb) {
+    FakeFolder* folder = dynamic_cast<FakeFolder*>(psf);
+
+    if (folder == NULL || nFormat != SHGDFIL_FINDDATA || cb < int(sizeof(WIN32_FIND_DATAW)) || !folder->GetFindData(pidl, (WIN32_FIND_DATAW*)pv)) {
+        return E_INVALIDARG;
+    }
+
+    return S_OK;
+}
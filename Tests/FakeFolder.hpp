@@ -0,0 +1,91 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  FakeFolder.hpp
+ *  The WinUnionFS Project
+ *
+ *  An in-memory shell folder, which stands in for a member folder. It can be
+ *  slowed down, or made to hang, like a folder on a slow or dead share.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <vector>
+
+class FakeFolder : public IShellFolder
+{
+public:
+    // Constructor
+    explicit FakeFolder();
+
+    // Adds an item. SFGAO_FOLDER, SFGAO_HIDDEN, SFGAO_READONLY and SFGAO_LINK are reported for it.
+    void Add(LPCWSTR name, SFGAOF attributes);
+
+    // Makes the item IDs carry no find data, like those of folders outside the file system.
+    void SetFileSystem(bool fileSystem);
+
+    // Makes every IEnumIDList::Next take at least delay ms.
+    void SetDelay(DWORD delay);
+
+    // Makes IEnumIDList::Next block until Wake is called, like a folder on a dead share.
+    void Hang();
+    void Wake();
+
+    // The calls the folder has had.
+    LONG NextCalls();
+    LONG AttributeCalls();
+
+    // Waits up to timeout ms for everything but the caller to release the folder.
+    bool WaitReleased(DWORD timeout);
+
+    // Returns a new ID list the folder can be bound from again, from the desktop.
+    PIDLIST_ABSOLUTE CreateIDList();
+
+    // IUnknown
+    ULONG STDMETHODCALLTYPE AddRef();
+    STDMETHOD(QueryInterface) (REFIID, void**);
+    ULONG STDMETHODCALLTYPE Release();
+
+    // IShellFolder
+    STDMETHOD(BindToObject) (PCUIDLIST_RELATIVE, IBindCtx*, REFIID, void**);
+    STDMETHOD(BindToStorage) (PCUIDLIST_RELATIVE, IBindCtx*, REFIID, void**);
+    STDMETHOD(CompareIDs) (LPARAM, PCUIDLIST_RELATIVE, PCUIDLIST_RELATIVE);
+    STDMETHOD(CreateViewObject) (HWND, REFIID, void**);
+    STDMETHOD(EnumObjects) (HWND, SHCONTF, IEnumIDList**);
+    STDMETHOD(GetAttributesOf) (UINT, PCUITEMID_CHILD_ARRAY, SFGAOF*);
+    STDMETHOD(GetDisplayNameOf) (PCUITEMID_CHILD, SHGDNF, STRRET*);
+    STDMETHOD(GetUIObjectOf) (HWND, UINT, PCUITEMID_CHILD_ARRAY, REFIID, UINT*, void**);
+    STDMETHOD(ParseDisplayName) (HWND, IBindCtx*, LPWSTR, ULONG*, PIDLIST_RELATIVE*, ULONG*);
+    STDMETHOD(SetNameOf) (HWND, PCUITEMID_CHILD, LPCWSTR, SHGDNF, PITEMID_CHILD*);
+
+    // The item an ID stands for, and its find data if the folder is in the file system.
+    LPCWSTR GetName(PCUITEMID_CHILD id);
+    bool GetFindData(PCUITEMID_CHILD id, WIN32_FIND_DATAW* findData);
+
+private:
+    class Enumerator;
+
+    typedef struct {
+        LPWSTR name;
+        SFGAOF attributes;
+    } Item;
+
+    virtual ~FakeFolder();
+
+    // Returns the item an ID stands for, or NULL.
+    const Item* Find(PCUITEMID_CHILD id);
+
+    // The items, which can't change once the folder is enumerated.
+    std::vector<Item> items;
+
+    // Where the folder is in the list of folders which can be bound by ID.
+    ULONG index;
+
+    bool fileSystem;
+    DWORD delay;
+
+    // Signaled unless the folder hangs.
+    HANDLE awake;
+
+    volatile LONG nextCalls;
+    volatile LONG attributeCalls;
+    volatile ULONG refCount;
+};
@@ -0,0 +1,187 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Fakes.cpp
+ *  The WinUnionFS Project
+ *
+ *  Stands in for the parts of the extension which need the shell, so that
+ *  the units which use them can be built on their own. Groups here have a
+ *  name, a reference count and a circuit breaker for each member they are
+ *  asked about, but no member folders, and count how many of them are
+ *  alive. They are never loaded or unloaded.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include "Fakes.h"
+#include "Group.hpp"
+
+
+// The handle to the DLL, which there is none of.
+HMODULE module = NULL;
+
+// The number of in-use objects, which keeps the DLL loaded.
+long objectCounter = 0;
+
+// The number of groups which have been created but not deleted.
+static volatile LONG liveGroups = 0;
+
+
+/// <summary>
+/// Creates a group without any members.
+/// </summary>
+Group* Group::Create(LPCWSTR name) {
+    return new Group(name);
+}
+
+
+/// <summary>
+/// Finds a group in the published snapshot, like Group::Find. The caller must Release it.
+/// </summary>
+Group* Group::Find(LPCWSTR name) {
+    GroupSnapshot* snapshot = GroupSnapshot::Current();
+    Group* group = NULL;
+
+    if (snapshot != NULL) {
+        group = snapshot->Find(name);
+        if (group != NULL) {
+            group->AddRef();
+        }
+        snapshot->Release();
+    }
+
+    return group;
+}
+
+
+/// <summary>
+/// Groups are never loaded, so using them needs nothing.
+/// </summary>
+void Group::AddUser() {
+}
+
+
+/// <summary>
+/// Groups are never unloaded.
+/// </summary>
+void Group::RemoveUser() {
+}
+
+
+/// <summary>
+/// Groups here have no member folders, so there are no folders.
+/// </summary>
+void Group::GetShellFoldersFor(LPCWSTR /* path */, std::vector<IShellFolder*> * /* out */, std::vector<bool> * /* unanswered */) {
+}
+
+
+/// <summary>
+/// Constructor.
+/// </summary>
+Group::Group(LPCWSTR name) {
+    this->refCount = 1;
+    this->name = _wcsdup(name);
+    InitializeSRWLock(&this->bindLock);
+    InterlockedIncrement(&liveGroups);
+}
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+Group::~Group() {
+    for (std::vector<Member*>::const_iterator member = this->members.begin(); member != this->members.end(); ++member) {
+        delete *member;
+    }
+    free((LPVOID)this->name);
+    InterlockedDecrement(&liveGroups);
+}
+
+
+/// <summary>
+/// Increments the reference count.
+/// </summary>
+ULONG Group::AddRef() {
+    return InterlockedIncrement(&this->refCount);
+}
+
+
+/// <summary>
+/// Decrements the reference count, deleting the group when it reaches 0.
+/// </summary>
+ULONG Group::Release() {
+    ULONG refCount = InterlockedDecrement(&this->refCount);
+    if (refCount == 0) {
+        delete this;
+    }
+
+    return refCount;
+}
+
+
+/// <summary>
+/// Adds a member without a folder, which only has a circuit breaker.
+/// </summary>
+HRESULT Group::AddPath(LPCWSTR path, Group* /* previous */) {
+    Member* member = new Member();
+
+    member->path = (LPWSTR)path;
+    member->idList = NULL;
+    member->folder = NULL;
+    member->context = NULL;
+    this->members.push_back(member);
+
+    return S_OK;
+}
+
+
+/// <summary>
+/// Returns false while the member's breaker is open. Members are added as they are asked about.
+/// </summary>
+bool Group::IsMemberAvailable(size_t member) {
+    while (this->members.size() <= member) {
+        AddPath(NULL, NULL);
+    }
+
+    return this->members[member]->breaker.Allow();
+}
+
+
+/// <summary>
+/// Records that a member failed to respond in time.
+/// </summary>
+void Group::MemberFailed(size_t member) {
+    while (this->members.size() <= member) {
+        AddPath(NULL, NULL);
+    }
+
+    this->members[member]->breaker.Failed();
+}
+
+
+/// <summary>
+/// Records that a member responded in time.
+/// </summary>
+void Group::MemberSucceeded(size_t member) {
+    while (this->members.size() <= member) {
+        AddPath(NULL, NULL);
+    }
+
+    this->members[member]->breaker.Succeeded();
+}
+
+
+/// <summary>
+/// Publishes where names have been found.
+/// </summary>
+void Group::PublishStats() {
+    this->probeStats.Publish(this->name);
+}
+
+
+/// <summary>
+/// Returns the number of groups which have been created but not deleted.
+/// </summary>
+LONG Fakes::LiveGroups() {
+    return InterlockedCompareExchange(&liveGroups, 0, 0);
+}
+
@@ -0,0 +1,14 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Fakes.h
+ *  The WinUnionFS Project
+ *
+ *  What the stand-ins for the parts of the extension which need the shell
+ *  tell the tests.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace Fakes {
+    // Returns the number of groups which have been created but not deleted.
+    LONG LiveGroups();
+}
@@ -0,0 +1,67 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  GroupSnapshotBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Measures looking groups up by name, which every folder does when it is
+ *  created, with 10 to 10000 groups loaded. The time per lookup shouldn't
+ *  grow with the number of groups. Group::Find is the stand-in from
+ *  Fakes.cpp, which goes through the snapshot the way the real one does.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "Benchmark.h"
+#include "Group.hpp"
+#include "GroupSnapshot.hpp"
+#include "Strings.h"
+
+
+// The number of lookups per iteration.
+#define LOOKUP_COUNT 1024
+
+
+/// <summary>
+/// Publishes count groups, and looks random ones up, in another case than they were named in.
+/// </summary>
+static void Find(ULONG iterations, int count) {
+    Strings strings;
+    std::vector<LPCWSTR> lookups;
+    GroupSnapshot* snapshot = new GroupSnapshot();
+    unsigned seed = count;
+
+    for (int i = 0; i < count; ++i) {
+        snapshot->Add(Group::Create(strings.Format("Group %d", i)));
+    }
+    for (int i = 0; i < LOOKUP_COUNT; ++i) {
+        lookups.push_back(strings.Format("GROUP %d", rand_r(&seed) % count));
+    }
+    GroupSnapshot::Publish(snapshot);
+    Benchmark::Items(LOOKUP_COUNT);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        for (std::vector<LPCWSTR>::const_iterator name = lookups.begin(); name != lookups.end(); ++name) {
+            Group* group = Group::Find(*name);
+            group->Release();
+        }
+    }
+
+    GroupSnapshot::Publish(NULL)->Release();
+}
+
+
+BENCHMARK(Group_Find_10Groups) {
+    Find(iterations, 10);
+}
+
+BENCHMARK(Group_Find_1000Groups) {
+    Find(iterations, 1000);
+}
+
+BENCHMARK(Group_Find_10000Groups) {
+    Find(iterations, 10000);
+}
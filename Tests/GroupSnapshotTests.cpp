@@ -0,0 +1,210 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  GroupSnapshotTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of publishing group snapshots, including a stress test of readers
+ *  looking groups up while reloads replace the snapshot under them. Reloads
+ *  keep some groups and rebuild others, the way Group::Apply does. A reader
+ *  taking its reference after letting go of the lock crashes this within a
+ *  few thousand reloads.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include "Fakes.h"
+#include "Group.hpp"
+#include "GroupSnapshot.hpp"
+#include "Name.h"
+#include "Strings.h"
+#include "Test.h"
+
+
+// The number of groups in each snapshot.
+#define GROUP_COUNT 16
+
+// The number of threads looking groups up during the stress test.
+#define READER_COUNT 4
+
+// The number of reloads during the stress test.
+#define RELOAD_COUNT 20000
+
+
+// The names of the groups, and the same names in upper case, which lookups must match.
+static Strings strings;
+static LPCWSTR names[GROUP_COUNT];
+static LPCWSTR upperNames[GROUP_COUNT];
+
+// Set once the stress test's reloads are done.
+static volatile LONG reloadsDone;
+
+
+/// <summary>
+/// Builds the names of the groups, the first time they are needed.
+/// </summary>
+static void EnsureNames() {
+    if (names[0] == NULL) {
+        for (int i = 0; i < GROUP_COUNT; ++i) {
+            names[i] = strings.Format("Group %d", i);
+            upperNames[i] = strings.Format("GROUP %d", i);
+        }
+    }
+}
+
+
+/// <summary>
+/// Builds a snapshot with every group. Groups for which keep returns true are carried over from
+/// previous, if there is one, and the others are created anew.
+/// </summary>
+static GroupSnapshot* Reload(GroupSnapshot* previous, unsigned seed) {
+    GroupSnapshot* snapshot = new GroupSnapshot();
+
+    for (int i = 0; i < GROUP_COUNT; ++i) {
+        Group* group = previous != NULL && ((seed >> i) & 1) != 0 ? previous->Get(i) : NULL;
+        if (group != NULL) {
+            group->AddRef();
+        }
+        else {
+            group = Group::Create(names[i]);
+        }
+        snapshot->Add(group);
+    }
+
+    return snapshot;
+}
+
+
+/// <summary>
+/// Checks that a snapshot is whole: every group is there once, and found by its name.
+/// </summary>
+static bool IsWhole(const GroupSnapshot* snapshot) {
+    if (snapshot->Count() != GROUP_COUNT) {
+        return false;
+    }
+
+    for (int i = 0; i < GROUP_COUNT; ++i) {
+        Group* group = snapshot->Get(i);
+        if (group == NULL || !Name::Equal(group->name, names[i]) || snapshot->Find(upperNames[i]) != group) {
+            return false;
+        }
+    }
+
+    return snapshot->Find(L"No such group") == NULL;
+}
+
+
+/// <summary>
+/// Looks groups up until the reloads are done, the way Group::Find and the folders do. Counts
+/// the lookups in reads, and those which saw something wrong in failures.
+/// </summary>
+static void ReadUntilDone(unsigned seed, LONG* failures, LONG* reads) {
+    while (InterlockedCompareExchange(&reloadsDone, 0, 0) == 0) {
+        GroupSnapshot* snapshot = GroupSnapshot::Current();
+        if (snapshot == NULL) {
+            ++*failures;
+            continue;
+        }
+
+        int index = rand_r(&seed) % GROUP_COUNT;
+        Group* group = snapshot->Find(upperNames[index]);
+        if (group != NULL) {
+            group->AddRef();
+        }
+        if (!IsWhole(snapshot)) {
+            ++*failures;
+        }
+        snapshot->Release();
+
+        // The group must outlive the snapshot it was found in, for as long as it is referenced.
+        if (group == NULL || !Name::Equal(group->name, names[index])) {
+            ++*failures;
+        }
+        if (group != NULL) {
+            group->Release();
+        }
+        ++*reads;
+    }
+}
+
+
+TEST(GroupSnapshot_PublishReplacesCurrent) {
+    EnsureNames();
+    LONG live = Fakes::LiveGroups();
+
+    CHECK(!GroupSnapshot::IsPublished());
+    CHECK(GroupSnapshot::Current() == NULL);
+
+    GroupSnapshot* first = Reload(NULL, 0);
+    CHECK(GroupSnapshot::Publish(first) == NULL);
+    CHECK(GroupSnapshot::IsPublished());
+
+    // A reader holding the first snapshot keeps it, and its groups, across a reload.
+    GroupSnapshot* held = GroupSnapshot::Current();
+    CHECK(held == first);
+
+    GroupSnapshot* second = Reload(first, 0x5555);
+    CHECK(GroupSnapshot::Publish(second) == first);
+    first->Release();
+
+    CHECK(IsWhole(held));
+    CHECK(held->Get(0) == second->Get(0));
+    CHECK(held->Get(1) != second->Get(1));
+    held->Release();
+
+    // Only the groups carried over are still alive.
+    CHECK(Fakes::LiveGroups() == live + GROUP_COUNT);
+
+    GroupSnapshot* current = GroupSnapshot::Current();
+    CHECK(current == second);
+    CHECK(IsWhole(current));
+    current->Release();
+
+    GroupSnapshot::Publish(NULL)->Release();
+    CHECK(!GroupSnapshot::IsPublished());
+    CHECK(Fakes::LiveGroups() == live);
+}
+
+
+TEST(GroupSnapshot_ReadersDuringReloads) {
+    EnsureNames();
+    LONG live = Fakes::LiveGroups();
+    LONG failures[READER_COUNT] = {};
+    LONG reads[READER_COUNT] = {};
+    std::vector<std::thread> readers;
+
+    GroupSnapshot::Publish(Reload(NULL, 0));
+    reloadsDone = 0;
+
+    for (int i = 0; i < READER_COUNT; ++i) {
+        readers.push_back(std::thread(ReadUntilDone, 1 + i, &failures[i], &reads[i]));
+    }
+
+    // Reload like the loader does: build from the current snapshot, publish, release the old one.
+    unsigned seed = 1;
+    for (int i = 0; i < RELOAD_COUNT; ++i) {
+        GroupSnapshot* current = GroupSnapshot::Current();
+        GroupSnapshot* snapshot = Reload(current, rand_r(&seed));
+        current->Release();
+
+        GroupSnapshot* old = GroupSnapshot::Publish(snapshot);
+        old->Release();
+    }
+    InterlockedExchange(&reloadsDone, 1);
+
+    for (std::vector<std::thread>::iterator reader = readers.begin(); reader != readers.end(); ++reader) {
+        reader->join();
+    }
+
+    for (int i = 0; i < READER_COUNT; ++i) {
+        CHECK(failures[i] == 0);
+        CHECK(reads[i] > 0);
+    }
+
+    GroupSnapshot::Publish(NULL)->Release();
+    CHECK(Fakes::LiveGroups() == live);
+}
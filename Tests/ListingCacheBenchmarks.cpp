@@ -0,0 +1,349 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  ListingCacheBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Replays traces of what Explorer asks of a union against the ListingCache.
+ *
+ *  The navigation trace is a walk through a tree of folders the way a user
+ *  browses: mostly into a subfolder and back out again, now and then back to
+ *  a folder from the history, while the watcher invalidates a folder every
+ *  so often. Each step opens the folder as ShellFolder::EnumObjects does,
+ *  serving it from the cache if it can and merging the members otherwise,
+ *  and reads the whole listing. The trace is the same on every run.
+ *
+ *  The desktop.ini trace follows the same walk, but with the names Explorer
+ *  looks for in each folder it opens: desktop.ini, twice, Thumbs.db, and
+ *  autorun.inf at the root, which are hardly ever there, and one file which
+ *  is. Each is resolved as ShellFolder::ParseDisplayName does, asking every
+ *  member unless the cache knows the name to be absent.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FakeFolder.hpp"
+#include "Group.hpp"
+#include "ListingCache.h"
+#include "PIDL.h"
+#include "Settings.h"
+#include "Stats.h"
+#include "Strings.h"
+#include "UnionEnumIDList.hpp"
+
+
+// The shape of the folder tree: the subfolders of each folder, and how deep it goes.
+#define FANOUT 5
+#define DEPTH 3
+
+// The files each member has in every folder. Half of the second member's files are also in the
+// first member.
+#define FILES 200
+
+// The steps in the navigation trace, and how many of them apart the watcher invalidates the
+// folder being shown.
+#define NAVIGATION_STEPS 2000
+#define CHANGE_INTERVAL 50
+
+// The number of items to fetch per call to Next, as Explorer does.
+#define BATCH_SIZE 256
+
+#define EVERYTHING (SHCONTF_FOLDERS | SHCONTF_NONFOLDERS | SHCONTF_INCLUDEHIDDEN)
+
+
+// A folder of the union, and its folder in each member. The path is kept narrow as well, to build
+// the paths of its children from.
+typedef struct {
+    std::string text;
+    LPCWSTR path;
+    size_t parent;
+    std::vector<size_t> children;
+    std::vector<IShellFolder*> members;
+} Folder;
+
+// A step of the navigation trace: the folder opened, and whether it changed just before.
+typedef struct {
+    size_t folder;
+    bool changed;
+} Step;
+
+// A name looked for in a folder, and its path within the group.
+typedef struct {
+    size_t folder;
+    LPCWSTR name;
+    LPCWSTR path;
+    bool changed;
+} Lookup;
+
+
+static Strings strings;
+
+
+/// <summary>
+/// Returns the folder tree, root first, which is made once.
+/// </summary>
+static const std::vector<Folder>& Folders() {
+    static std::vector<Folder> folders;
+
+    if (!folders.empty()) {
+        return folders;
+    }
+
+    Folder root;
+    root.path = strings.Add("");
+    root.parent = 0;
+    folders.push_back(root);
+
+    // Breadth first, so every folder's children come after it.
+    for (size_t i = 0, level = 0, levelEnd = 1; level < DEPTH; ++level) {
+        for (; i < levelEnd; ++i) {
+            for (ULONG j = 0; j < FANOUT; ++j) {
+                Folder child;
+                child.text = folders[i].text.empty() ? std::string() : folders[i].text + "\\";
+                child.text += "Folder " + std::to_string(j);
+                child.path = strings.Add(child.text.c_str());
+                child.parent = i;
+                folders[i].children.push_back(folders.size());
+                folders.push_back(child);
+            }
+        }
+        levelEnd = folders.size();
+    }
+
+    for (std::vector<Folder>::iterator folder = folders.begin(); folder != folders.end(); ++folder) {
+        FakeFolder* first = new FakeFolder();
+        FakeFolder* second = new FakeFolder();
+
+        for (ULONG j = 0; j < folder->children.size(); ++j) {
+            first->Add(strings.Format("Folder %u", j), SFGAO_FOLDER);
+        }
+        for (ULONG j = 0; j < FILES; ++j) {
+            first->Add(strings.Format("File %04u.txt", j), 0);
+            second->Add(strings.Format("File %04u.txt", FILES/2 + j), 0);
+        }
+
+        folder->members.push_back(first);
+        folder->members.push_back(second);
+    }
+
+    return folders;
+}
+
+
+/// <summary>
+/// Returns the navigation trace, which is made once.
+/// </summary>
+static const std::vector<Step>& NavigationTrace() {
+    static std::vector<Step> trace;
+
+    if (!trace.empty()) {
+        return trace;
+    }
+
+    const std::vector<Folder> &folders = Folders();
+    std::vector<size_t> history;
+    size_t current = 0;
+
+    srand(7);
+    for (ULONG i = 0; i < NAVIGATION_STEPS; ++i) {
+        int choice = rand() % 100;
+
+        if (choice < 45 && !folders[current].children.empty()) {
+            current = folders[current].children[rand() % folders[current].children.size()];
+        }
+        else if (choice < 85 && current != 0) {
+            current = folders[current].parent;
+        }
+        else if (!history.empty()) {
+            current = history[history.size() - 1 - rand() % min(history.size(), size_t(20))];
+        }
+        history.push_back(current);
+
+        Step step;
+        step.folder = current;
+        step.changed = i % CHANGE_INTERVAL == CHANGE_INTERVAL - 1;
+        trace.push_back(step);
+    }
+
+    return trace;
+}
+
+
+/// <summary>
+/// Adds a lookup of the name in the folder to the trace.
+/// </summary>
+static void AddLookup(std::vector<Lookup>* trace, const Folder &folder, size_t index, const char* name, bool changed) {
+    Lookup lookup;
+
+    lookup.folder = index;
+    lookup.name = strings.Add(name);
+    lookup.path = strings.Add((folder.text.empty() ? std::string(name) : folder.text + "\\" + name).c_str());
+    lookup.changed = changed;
+    trace->push_back(lookup);
+}
+
+
+/// <summary>
+/// Returns the desktop.ini trace, which is made once from the navigation trace.
+/// </summary>
+static const std::vector<Lookup>& DesktopIniTrace() {
+    static std::vector<Lookup> trace;
+
+    if (!trace.empty()) {
+        return trace;
+    }
+
+    const std::vector<Folder> &folders = Folders();
+    const std::vector<Step> &steps = NavigationTrace();
+
+    srand(11);
+    for (std::vector<Step>::const_iterator step = steps.begin(); step != steps.end(); ++step) {
+        const Folder &folder = folders[step->folder];
+        char file[32];
+
+        AddLookup(&trace, folder, step->folder, "desktop.ini", step->changed);
+        AddLookup(&trace, folder, step->folder, "desktop.ini", false);
+        AddLookup(&trace, folder, step->folder, "Thumbs.db", false);
+        if (step->folder == 0) {
+            AddLookup(&trace, folder, step->folder, "autorun.inf", false);
+        }
+        snprintf(file, sizeof(file), "File %04u.txt", rand() % FILES);
+        AddLookup(&trace, folder, step->folder, file, false);
+    }
+
+    return trace;
+}
+
+
+/// <summary>
+/// Opens a folder as ShellFolder::EnumObjects does, and reads all of it.
+/// </summary>
+static void Open(Group* group, const Folder &folder) {
+    IEnumIDList* list = NULL;
+
+    if (!ListingCache::Lookup(group->name, folder.path, EVERYTHING, &list)) {
+        UnionEnumIDList* merged = new UnionEnumIDList(group, folder.members, std::vector<bool>(), NULL, EVERYTHING);
+        merged->CacheAs(folder.path);
+        list = merged;
+    }
+
+    LPITEMIDLIST items[BATCH_SIZE];
+    ULONG fetched;
+    do {
+        list->Next(BATCH_SIZE, items, &fetched);
+        for (ULONG i = 0; i < fetched; ++i) {
+            PIDL::Free(items[i]);
+        }
+    } while (fetched == BATCH_SIZE);
+    list->Release();
+}
+
+
+/// <summary>
+/// Replays the navigation trace from an empty cache, and reports how many steps the cache served.
+/// </summary>
+static void Navigate(ULONG iterations) {
+    const std::vector<Folder> &folders = Folders();
+    const std::vector<Step> &trace = NavigationTrace();
+    Group* group = Group::Create(L"Navigation");
+    LONGLONG hits = Stats::Get(Stats::CACHE_HITS);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        ListingCache::Clear();
+        for (std::vector<Step>::const_iterator step = trace.begin(); step != trace.end(); ++step) {
+            if (step->changed) {
+                ListingCache::Invalidate(group->name, folders[step->folder].path, false);
+            }
+            Open(group, folders[step->folder]);
+        }
+    }
+
+    group->Release();
+    Benchmark::Items(ULONG(trace.size()));
+    Benchmark::Report("% served from cache", 100.0*(Stats::Get(Stats::CACHE_HITS) - hits)/iterations/trace.size());
+}
+
+
+/// <summary>
+/// Resolves a name as ShellFolder::ParseDisplayName does: not at all if it is known to be absent,
+/// otherwise by asking the members in turn, remembering it as absent if none has it. Returns the
+/// number of members asked.
+/// </summary>
+static ULONG Resolve(Group* group, const Folder &folder, const Lookup &lookup) {
+    ULONG generation = ListingCache::Generation(group->name);
+    ULONG probes = 0;
+
+    if (ListingCache::IsAbsent(group->name, lookup.path)) {
+        return probes;
+    }
+
+    for (std::vector<IShellFolder*>::const_iterator member = folder.members.begin(); member != folder.members.end(); ++member) {
+        PIDLIST_RELATIVE idList = NULL;
+
+        ++probes;
+        if (SUCCEEDED((*member)->ParseDisplayName(NULL, NULL, (LPWSTR)lookup.name, NULL, &idList, NULL))) {
+            PIDL::Free(idList);
+            return probes;
+        }
+    }
+
+    ListingCache::StoreAbsent(group->name, lookup.path, generation);
+    return probes;
+}
+
+
+/// <summary>
+/// Replays the desktop.ini trace from an empty cache, and reports how many members each lookup
+/// asked, and how many lookups the cache answered.
+/// </summary>
+static void LookForDesktopIni(ULONG iterations) {
+    const std::vector<Folder> &folders = Folders();
+    const std::vector<Lookup> &trace = DesktopIniTrace();
+    Group* group = Group::Create(L"DesktopIni");
+    LONGLONG hits = Stats::Get(Stats::ABSENT_HITS);
+    ULONGLONG probes = 0;
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        ListingCache::Clear();
+        for (std::vector<Lookup>::const_iterator lookup = trace.begin(); lookup != trace.end(); ++lookup) {
+            if (lookup->changed) {
+                ListingCache::Invalidate(group->name, folders[lookup->folder].path, false);
+            }
+            probes += Resolve(group, folders[lookup->folder], *lookup);
+        }
+    }
+
+    group->Release();
+    Benchmark::Items(ULONG(trace.size()));
+    Benchmark::Report("members asked per lookup", double(probes)/iterations/trace.size());
+    Benchmark::Report("% answered from cache", 100.0*(Stats::Get(Stats::ABSENT_HITS) - hits)/iterations/trace.size());
+}
+
+
+BENCHMARK(ListingCache_NavigationTrace) {
+    Navigate(iterations);
+}
+
+
+BENCHMARK(ListingCache_NavigationTrace_Uncached) {
+    DWORD cacheSize = Settings::cacheSize;
+    Settings::cacheSize = 0;
+    Navigate(iterations);
+    Settings::cacheSize = cacheSize;
+}
+
+
+BENCHMARK(ListingCache_DesktopIniTrace) {
+    LookForDesktopIni(iterations);
+}
+
+
+BENCHMARK(ListingCache_DesktopIniTrace_Uncached) {
+    DWORD cacheSize = Settings::cacheSize;
+    Settings::cacheSize = 0;
+    LookForDesktopIni(iterations);
+    Settings::cacheSize = cacheSize;
+}
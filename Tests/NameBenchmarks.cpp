@@ -0,0 +1,152 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  NameBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Measures the vectorized name comparison and hashing against the plain
+ *  reference, on names like those found in real folders. Each iteration
+ *  handles every name of the set once.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <vector>
+
+#include "Benchmark.h"
+#include "Name.h"
+#include "Reference.h"
+#include "Strings.h"
+
+
+// The number of names in each set.
+#define SET_SIZE 256
+
+
+// The sets of names, and an upper cased copy of each for the comparisons.
+static Strings strings;
+static std::vector<LPCWSTR> shortNames, shortUpper;
+static std::vector<LPCWSTR> longNames, longUpper;
+static std::vector<LPCWSTR> accentedNames, accentedUpper;
+
+
+/// <summary>
+/// Adds a name, and an upper cased copy of it, to a set.
+/// </summary>
+static void Add(std::vector<LPCWSTR> *names, std::vector<LPCWSTR> *upper, LPWSTR name) {
+    size_t cch = wcslen(name);
+    LPWSTR copy = strings.Copy(name, cch);
+
+    for (size_t i = 0; i < cch; ++i) {
+        copy[i] = Name::Fold(copy[i]);
+    }
+
+    names->push_back(name);
+    upper->push_back(copy);
+}
+
+
+/// <summary>
+/// Builds the sets of names, the first time they are needed.
+/// </summary>
+static void EnsureNames() {
+    if (!shortNames.empty()) {
+        return;
+    }
+
+    for (unsigned i = 0; i < SET_SIZE; ++i) {
+        // Camera and document names, mostly under 16 characters.
+        Add(&shortNames, &shortUpper, strings.Format(i % 2 == 0 ? "IMG_%04u.jpg" : "Notes %u.txt", i));
+
+        // Names of songs and reports, around 50 characters.
+        Add(&longNames, &longUpper, strings.Format("%02u - The Quarterly Report on Everything, Draft %u.docx", i % 20, i));
+
+        // The same, with a few accented letters which the vector path can't fold.
+        LPWSTR accented = strings.Format("%02u - Resume of the Cafe Project, Revision %u.docx", i % 20, i);
+        accented[6] = 0xE9;
+        accented[12] = 0xE9;
+        accented[19] = 0xE9;
+        Add(&accentedNames, &accentedUpper, accented);
+    }
+}
+
+
+/// <summary>
+/// Hashes every name of the set, with the function given.
+/// </summary>
+static void HashAll(ULONG iterations, const std::vector<LPCWSTR> &names, ULONG (*hash)(LPCWSTR)) {
+    ULONG result = 0;
+
+    EnsureNames();
+    for (ULONG i = 0; i < iterations; ++i) {
+        for (std::vector<LPCWSTR>::const_iterator name = names.begin(); name != names.end(); ++name) {
+            result += hash(*name);
+        }
+    }
+
+    Benchmark::Use(result);
+}
+
+
+/// <summary>
+/// Compares every name of the set with its upper cased copy, with the function given.
+/// </summary>
+static void EqualAll(ULONG iterations, const std::vector<LPCWSTR> &names, const std::vector<LPCWSTR> &upper, bool (*equal)(LPCWSTR, LPCWSTR)) {
+    ULONG result = 0;
+
+    EnsureNames();
+    for (ULONG i = 0; i < iterations; ++i) {
+        for (size_t j = 0; j < names.size(); ++j) {
+            result += equal(names[j], upper[j]) ? 1 : 0;
+        }
+    }
+
+    Benchmark::Use(result);
+}
+
+
+BENCHMARK(Name_Hash_Short) {
+    HashAll(iterations, shortNames, Name::Hash);
+}
+
+BENCHMARK(Reference_Hash_Short) {
+    HashAll(iterations, shortNames, Reference::Hash);
+}
+
+BENCHMARK(Name_Hash_Long) {
+    HashAll(iterations, longNames, Name::Hash);
+}
+
+BENCHMARK(Reference_Hash_Long) {
+    HashAll(iterations, longNames, Reference::Hash);
+}
+
+BENCHMARK(Name_Hash_Accented) {
+    HashAll(iterations, accentedNames, Name::Hash);
+}
+
+BENCHMARK(Reference_Hash_Accented) {
+    HashAll(iterations, accentedNames, Reference::Hash);
+}
+
+BENCHMARK(Name_Equal_Short) {
+    EqualAll(iterations, shortNames, shortUpper, Name::Equal);
+}
+
+BENCHMARK(Reference_Equal_Short) {
+    EqualAll(iterations, shortNames, shortUpper, Reference::Equal);
+}
+
+BENCHMARK(Name_Equal_Long) {
+    EqualAll(iterations, longNames, longUpper, Name::Equal);
+}
+
+BENCHMARK(Reference_Equal_Long) {
+    EqualAll(iterations, longNames, longUpper, Reference::Equal);
+}
+
+BENCHMARK(Name_Equal_Accented) {
+    EqualAll(iterations, accentedNames, accentedUpper, Name::Equal);
+}
+
+BENCHMARK(Reference_Equal_Accented) {
+    EqualAll(iterations, accentedNames, accentedUpper, Reference::Equal);
+}
@@ -0,0 +1,279 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  NameTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of the vectorized name comparison and hashing against the plain
+ *  reference, which goes through the same upcase table one code unit at a
+ *  time. Hashes are stored in PIDLs and filters, so the two must agree on
+ *  every name, not just the likely ones.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#if defined(_WIN32)
+#else
+#include <sys/mman.h>
+#endif
+#include <stdlib.h>
+
+#include "Name.h"
+#include "Reference.h"
+#include "Strings.h"
+#include "Test.h"
+
+
+// The size of a page, which the vector loads must never cross into.
+#define PAGE_SIZE 4096
+
+// Code units which exercise each path: ASCII letters of both cases and other ASCII, Latin-1 and
+// Greek letters which only the table folds, characters without case, and surrogates.
+static const WCHAR interesting[] = {
+    L'a', L'z', L'A', L'Z', L'm', L'M', L'0', L'9', L'.', L' ', L'~', L'_', L'@', L'[', L'`', L'{',
+    0x7F, 0x80, 0xDF, 0xE9, 0xC9, 0xFF, 0x131, 0x17F, 0x3B1, 0x391, 0x4E00, 0xD800, 0xDC00, 0xFFFF
+};
+
+
+/// <summary>
+/// Returns a random code unit, ASCII only or from the whole interesting set.
+/// </summary>
+static WCHAR RandomUnit(bool ascii) {
+    if (ascii) {
+        return WCHAR(0x20 + rand() % 0x5F);
+    }
+    return interesting[rand() % _countof(interesting)];
+}
+
+
+/// <summary>
+/// Returns a copy of the name with the case of some code units flipped, and sometimes one unit
+/// changed outright.
+/// </summary>
+static void Mangle(LPCWSTR name, LPWSTR copy, size_t cch) {
+    for (size_t i = 0; i <= cch; ++i) {
+        WCHAR c = name[i];
+        if (c != L'\0' && rand() % 3 == 0) {
+            if (c >= L'a' && c <= L'z') {
+                c = WCHAR(c - 'a' + 'A');
+            }
+            else if (c >= L'A' && c <= L'Z') {
+                c = WCHAR(c - 'A' + 'a');
+            }
+            else if (c == 0xE9) {
+                c = 0xC9;
+            }
+            else if (c == 0x3B1) {
+                c = 0x391;
+            }
+        }
+        copy[i] = c;
+    }
+
+    if (cch != 0 && rand() % 8 == 0) {
+        copy[rand() % cch] = L'q';
+    }
+}
+
+
+/// <summary>
+/// Allocates two pages, the second of which can't be touched, and returns the first.
+/// </summary>
+static LPWSTR AllocateGuarded() {
+#if defined(_WIN32)
+    LPBYTE pages = (LPBYTE)VirtualAlloc(NULL, 2*PAGE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    DWORD protection;
+    VirtualProtect(pages + PAGE_SIZE, PAGE_SIZE, PAGE_NOACCESS, &protection);
+#else
+    LPBYTE pages = (LPBYTE)mmap(NULL, 2*PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    mprotect(pages + PAGE_SIZE, PAGE_SIZE, PROT_NONE);
+#endif
+    return LPWSTR(pages);
+}
+
+
+/// <summary>
+/// Frees pages from AllocateGuarded.
+/// </summary>
+static void FreeGuarded(LPWSTR pages) {
+#if defined(_WIN32)
+    VirtualFree(pages, 0, MEM_RELEASE);
+#else
+    munmap(pages, 2*PAGE_SIZE);
+#endif
+}
+
+
+/// <summary>
+/// Checks Equal, Compare and Hash on a pair of names against the reference.
+/// </summary>
+static void CheckPair(LPCWSTR name1, LPCWSTR name2) {
+    bool equal = Reference::Equal(name1, name2);
+
+    CHECK(Name::Equal(name1, name2) == equal);
+    CHECK(Name::Equal(name2, name1) == equal);
+    CHECK((Name::Compare(name1, name2) == 0) == equal);
+    CHECK(Name::Hash(name1) == Reference::Hash(name1));
+    CHECK(Name::Hash(name2) == Reference::Hash(name2));
+    if (equal) {
+        CHECK(Name::Hash(name1) == Name::Hash(name2));
+    }
+}
+
+
+TEST(Name_KnownHashes_MatchCrc32c) {
+    Strings strings;
+
+    // CRC-32C of the upper cased UTF-16LE code units, worked out independently.
+    CHECK(Name::Hash(strings.Add("")) == 0);
+    CHECK(Name::Hash(strings.Add("a")) == 0x1DD429A1);
+    CHECK(Name::Hash(strings.Add("abc")) == 0x692F5E83);
+    CHECK(Name::Hash(strings.Add("Program Files")) == 0x09B3D06A);
+    CHECK(Name::Equal(strings.Add("Program Files"), strings.Add("PROGRAM FILES")));
+    CHECK(!Name::Equal(strings.Add("Program Files"), strings.Add("Program File")));
+    CHECK(!Name::Equal(strings.Add("Program File"), strings.Add("Program Files")));
+}
+
+
+TEST(Name_NulInEachLane_EndsTheName) {
+    // A name of every length up to two vectors, followed by different garbage in each copy, which
+    // the vector loads read but must not compare or hash.
+    WCHAR buffer1[64], buffer2[64];
+
+    srand(23);
+    for (int length = 0; length <= 16; ++length) {
+        for (int round = 0; round < 200; ++round) {
+            bool ascii = round % 2 == 0;
+            for (int i = 0; i < 64; ++i) {
+                buffer1[i] = RandomUnit(ascii);
+                buffer2[i] = RandomUnit(ascii);
+            }
+            for (int i = 0; i < length; ++i) {
+                buffer2[i] = buffer1[i];
+            }
+            buffer1[length] = L'\0';
+            buffer2[length] = L'\0';
+
+            CHECK(Name::Equal(buffer1, buffer2));
+            CHECK(Name::Compare(buffer1, buffer2) == 0);
+            CHECK(Name::Hash(buffer1) == Name::Hash(buffer2));
+            CHECK(Name::Hash(buffer1) == Reference::Hash(buffer1));
+
+            // Ending one name a unit early must make them differ, whichever lane the NUL is in.
+            if (length > 0) {
+                WCHAR c = buffer2[length - 1];
+                buffer2[length - 1] = L'\0';
+                CHECK(!Name::Equal(buffer1, buffer2));
+                CHECK(!Name::Equal(buffer2, buffer1));
+                buffer2[length - 1] = c;
+            }
+        }
+    }
+}
+
+
+TEST(Name_OddLengthsAndOffsets_MatchReference) {
+    // Every alignment of both names, and lengths which leave every possible tail.
+    WCHAR buffer1[80], buffer2[80];
+
+    srand(2323);
+    for (int offset1 = 0; offset1 < 8; ++offset1) {
+        for (int offset2 = 0; offset2 < 8; ++offset2) {
+            for (int length = 0; length < 40; ++length) {
+                bool ascii = (offset1 + offset2 + length) % 3 != 0;
+                LPWSTR name1 = buffer1 + offset1;
+                LPWSTR name2 = buffer2 + offset2;
+
+                for (int i = 0; i < length; ++i) {
+                    name1[i] = RandomUnit(ascii);
+                }
+                name1[length] = L'\0';
+                Mangle(name1, name2, length);
+
+                CheckPair(name1, name2);
+            }
+        }
+    }
+}
+
+
+TEST(Name_RandomMixes_MatchReference) {
+    WCHAR buffer1[128], buffer2[128];
+
+    srand(230023);
+    for (int round = 0; round < 200000; ++round) {
+        int length = rand() % 100;
+        int kind = rand() % 3;
+
+        // All ASCII, mostly ASCII with the odd other unit, or anything.
+        for (int i = 0; i < length; ++i) {
+            buffer1[i] = RandomUnit(kind == 0 || (kind == 1 && rand() % 16 != 0));
+        }
+        buffer1[length] = L'\0';
+        Mangle(buffer1, buffer2, length);
+
+        CheckPair(buffer1, buffer2);
+    }
+}
+
+
+TEST(Name_PageEnds_NeverLoadAcross) {
+    // Names which end right at an inaccessible page. A vector load past the end would fault.
+    LPWSTR pages = AllocateGuarded();
+    LPWSTR end = pages + PAGE_SIZE/sizeof(WCHAR);
+    Strings strings;
+
+    srand(42);
+    for (int length = 0; length < 40; ++length) {
+        for (int round = 0; round < 50; ++round) {
+            LPWSTR name1 = end - length - 1;
+            bool ascii = round % 2 == 0;
+
+            for (int i = 0; i < length; ++i) {
+                name1[i] = RandomUnit(ascii);
+            }
+            name1[length] = L'\0';
+
+            LPWSTR name2 = strings.Copy(name1, length);
+            CheckPair(name1, name2);
+
+            // And both at once, the second name just before the first.
+            LPWSTR name3 = name1 - length - 1;
+            Mangle(name1, name3, length);
+            CheckPair(name1, name3);
+        }
+    }
+
+    FreeGuarded(pages);
+}
+
+
+TEST(Name_Compare_IsAnOrder) {
+    WCHAR buffer1[32], buffer2[32];
+
+    srand(7);
+    for (int round = 0; round < 50000; ++round) {
+        int length1 = rand() % 20, length2 = rand() % 20;
+        for (int i = 0; i < length1; ++i) {
+            buffer1[i] = RandomUnit(round % 2 == 0);
+        }
+        for (int i = 0; i < length2; ++i) {
+            buffer2[i] = RandomUnit(round % 2 == 0);
+        }
+        buffer1[length1] = L'\0';
+        buffer2[length2] = L'\0';
+
+        int result1 = Name::Compare(buffer1, buffer2);
+        int result2 = Name::Compare(buffer2, buffer1);
+        CHECK((result1 < 0) == (result2 > 0));
+        CHECK((result1 == 0) == Reference::Equal(buffer1, buffer2));
+    }
+}
+
+
+TEST(Name_MayBeAlias_FindsShortNamesAndStreams) {
+    Strings strings;
+
+    CHECK(Name::MayBeAlias(strings.Add("PROGRA~1")));
+    CHECK(Name::MayBeAlias(strings.Add("file.txt:Zone.Identifier")));
+    CHECK(!Name::MayBeAlias(strings.Add("Program Files")));
+    CHECK(!Name::MayBeAlias(strings.Add("")));
+}
@@ -0,0 +1,298 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  PIDLBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Measures building ID lists of 1 to 200 items, appending to a PIDLBuilder
+ *  as parsing does and with PIDL::Create per item as it used to, making full
+ *  paths from them, telling item names apart, and sorting views by the
+ *  natural order keys items carry, against making the keys while sorting
+ *  and against Name::Compare.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Name.h"
+#include "PIDL.h"
+#include "PIDLBuilder.hpp"
+#include "Strings.h"
+
+
+// The number of item pairs compared per iteration of the name comparisons.
+#define PAIR_COUNT 4096
+
+
+static Strings strings;
+
+
+/// <summary>
+/// Returns the names of count folders, which a path of that depth goes through.
+/// </summary>
+static std::vector<LPWSTR> MakeFolderNames(ULONG count) {
+    std::vector<LPWSTR> names;
+    for (ULONG i = 0; i < count; ++i) {
+        names.push_back(strings.Format("Folder %u of the path", i));
+    }
+    return names;
+}
+
+
+/// <summary>
+/// Builds an ID list of the names, with one allocation, the way ShellFolder::ParseDisplayName does.
+/// </summary>
+static LPITEMIDLIST Build(const std::vector<LPWSTR> &names) {
+    PIDLBuilder builder;
+    for (std::vector<LPWSTR>::const_iterator name = names.begin(); name != names.end(); ++name) {
+        builder.AppendItem(*name, 0, 0, 0);
+    }
+    return builder.Detach();
+}
+
+
+/// <summary>
+/// Builds ID lists of depth items with the builder.
+/// </summary>
+static void BuildWithBuilder(ULONG iterations, ULONG depth) {
+    std::vector<LPWSTR> names = MakeFolderNames(depth);
+    Benchmark::Items(depth);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        PIDL::Free(Build(names));
+    }
+}
+
+
+/// <summary>
+/// Builds ID lists of depth items with PIDL::Create, copying the list so far for every item.
+/// </summary>
+static void BuildWithCreate(ULONG iterations, ULONG depth) {
+    std::vector<LPWSTR> names = MakeFolderNames(depth);
+    Benchmark::Items(depth);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        LPITEMIDLIST pidl = NULL;
+        for (std::vector<LPWSTR>::const_iterator name = names.begin(); name != names.end(); ++name) {
+            LPITEMIDLIST longer = PIDL::Create(pidl, *name, 0, 0, 0);
+            PIDL::Free(pidl);
+            pidl = longer;
+        }
+        PIDL::Free(pidl);
+    }
+}
+
+
+BENCHMARK(PIDL_Builder_Depth_1) {
+    BuildWithBuilder(iterations, 1);
+}
+
+BENCHMARK(PIDL_Builder_Depth_10) {
+    BuildWithBuilder(iterations, 10);
+}
+
+BENCHMARK(PIDL_Builder_Depth_50) {
+    BuildWithBuilder(iterations, 50);
+}
+
+BENCHMARK(PIDL_Builder_Depth_200) {
+    BuildWithBuilder(iterations, 200);
+}
+
+BENCHMARK(PIDL_Create_Depth_1) {
+    BuildWithCreate(iterations, 1);
+}
+
+BENCHMARK(PIDL_Create_Depth_10) {
+    BuildWithCreate(iterations, 10);
+}
+
+BENCHMARK(PIDL_Create_Depth_50) {
+    BuildWithCreate(iterations, 50);
+}
+
+BENCHMARK(PIDL_Create_Depth_200) {
+    BuildWithCreate(iterations, 200);
+}
+
+
+/// <summary>
+/// Makes the path of an ID list of the group and depth folders below it.
+/// </summary>
+static void FullPath(ULONG iterations, ULONG depth) {
+    std::vector<LPWSTR> names = MakeFolderNames(depth + 1);
+    LPITEMIDLIST pidl = Build(names);
+    Benchmark::Items(depth);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        LPWSTR path = PIDL::GetFullPath(pidl, NULL);
+        Benchmark::Use(ULONG_PTR(path[0]));
+        CoTaskMemFree(path);
+    }
+
+    PIDL::Free(pidl);
+}
+
+
+BENCHMARK(PIDL_FullPath_Depth_1) {
+    FullPath(iterations, 1);
+}
+
+BENCHMARK(PIDL_FullPath_Depth_10) {
+    FullPath(iterations, 10);
+}
+
+BENCHMARK(PIDL_FullPath_Depth_50) {
+    FullPath(iterations, 50);
+}
+
+BENCHMARK(PIDL_FullPath_Depth_200) {
+    FullPath(iterations, 200);
+}
+
+
+/// <summary>
+/// Makes an item in the version 1 layout, which carries neither a hash nor a sort key.
+/// </summary>
+static LPITEMIDLIST MakeItemV1(LPCWSTR name) {
+    USHORT cbName = USHORT(sizeof(WCHAR)*(wcslen(name) + 1));
+    USHORT cb = USHORT(FIELD_OFFSET(PIDL::PIDLItemV1, name) + cbName);
+    LPITEMIDLIST pidl = (LPITEMIDLIST)CoTaskMemAlloc(cb + sizeof(USHORT));
+    PIDL::PIDLItemV1* item = (PIDL::PIDLItemV1*)&pidl->mkid;
+
+    item->cb = cb;
+    item->folder = 0;
+    item->attributes = 0;
+    item->cbName = cbName;
+    memcpy(item->name, name, cbName);
+    PIDL::Next(pidl)->mkid.cb = 0;
+
+    return pidl;
+}
+
+
+/// <summary>
+/// Makes count items of names in a view, such as IMG_0001.jpg, in either layout.
+/// </summary>
+static std::vector<LPITEMIDLIST> MakeItems(ULONG count, bool v2) {
+    std::vector<LPITEMIDLIST> items;
+    unsigned seed = count;
+
+    for (ULONG i = 0; i < count; ++i) {
+        LPWSTR name = strings.Format(i % 3 == 0 ? "IMG_%u.jpg" : i % 3 == 1 ? "Report %u (final).docx" : "track%u.mp3", rand_r(&seed) % (count*4));
+        items.push_back(v2 ? PIDL::Create(NULL, name, 0, 0, 0) : MakeItemV1(name));
+    }
+
+    return items;
+}
+
+
+/// <summary>
+/// Frees the items.
+/// </summary>
+static void FreeItems(std::vector<LPITEMIDLIST> &items) {
+    for (std::vector<LPITEMIDLIST>::const_iterator item = items.begin(); item != items.end(); ++item) {
+        PIDL::Free(*item);
+    }
+}
+
+
+/// <summary>
+/// Compares items with different names, and with names which differ only in case.
+/// </summary>
+static void NamesEqual(ULONG iterations, bool v2, bool same) {
+    std::vector<LPITEMIDLIST> items = MakeItems(PAIR_COUNT + 1, v2);
+    std::vector<LPITEMIDLIST> upper;
+    ULONG equal = 0;
+
+    for (ULONG i = 0; i < PAIR_COUNT; ++i) {
+        LPWSTR name = strings.Copy(PIDL::GetName(items[i]), wcslen(PIDL::GetName(items[i])));
+        for (LPWSTR c = name; *c != L'\0'; ++c) {
+            *c = Name::Fold(*c);
+        }
+        upper.push_back(v2 ? PIDL::Create(NULL, name, 0, 0, 0) : MakeItemV1(name));
+    }
+    Benchmark::Items(PAIR_COUNT);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        for (ULONG j = 0; j < PAIR_COUNT; ++j) {
+            equal += PIDL::NamesEqual(items[j], same ? upper[j] : items[j + 1]) ? 1 : 0;
+        }
+    }
+
+    Benchmark::Use(equal);
+    FreeItems(items);
+    FreeItems(upper);
+}
+
+
+BENCHMARK(PIDL_NamesEqual_Different) {
+    NamesEqual(iterations, true, false);
+}
+
+BENCHMARK(PIDL_NamesEqual_Different_V1) {
+    NamesEqual(iterations, false, false);
+}
+
+BENCHMARK(PIDL_NamesEqual_Same) {
+    NamesEqual(iterations, true, true);
+}
+
+
+// Orders items by their sort keys, as ShellFolder::CompareIDs does.
+struct BySortKey {
+    bool operator()(LPCITEMIDLIST pidl1, LPCITEMIDLIST pidl2) const {
+        return PIDL::CompareSortKeys(pidl1, pidl2) < 0;
+    }
+};
+
+// Orders items by comparing their names each time.
+struct ByName {
+    bool operator()(LPCITEMIDLIST pidl1, LPCITEMIDLIST pidl2) const {
+        return Name::Compare(PIDL::GetName(pidl1), PIDL::GetName(pidl2)) < 0;
+    }
+};
+
+
+/// <summary>
+/// Sorts count items in a random order, the way a view of a folder does.
+/// </summary>
+template <typename Order>
+static void Sort(ULONG iterations, ULONG count, bool v2) {
+    std::vector<LPITEMIDLIST> items = MakeItems(count, v2);
+    std::vector<LPITEMIDLIST> sorted;
+    Benchmark::Items(count);
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        sorted = items;
+        std::sort(sorted.begin(), sorted.end(), Order());
+    }
+
+    Benchmark::Use(ULONG_PTR(sorted[0]));
+    FreeItems(items);
+}
+
+
+BENCHMARK(PIDL_Sort_SortKeys_100k) {
+    Sort<BySortKey>(iterations, 100000, true);
+}
+
+BENCHMARK(PIDL_Sort_SortKeys_1M) {
+    Sort<BySortKey>(iterations, 1000000, true);
+}
+
+BENCHMARK(PIDL_Sort_SortKeysMade_100k) {
+    Sort<BySortKey>(iterations, 100000, false);
+}
+
+BENCHMARK(PIDL_Sort_NameCompare_100k) {
+    Sort<ByName>(iterations, 100000, true);
+}
+
+BENCHMARK(PIDL_Sort_NameCompare_1M) {
+    Sort<ByName>(iterations, 1000000, true);
+}
@@ -0,0 +1,144 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  PIDLTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of ID lists: paths must come out whole however deep they are.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <stdio.h>
+
+#include <string>
+
+#include "PIDL.h"
+#include "PIDLBuilder.hpp"
+#include "Strings.h"
+#include "Test.h"
+
+
+TEST(PIDL_FullPath_IsWholeBeyondMaxPath) {
+    Strings strings;
+    PIDLBuilder builder;
+    std::string expected;
+
+    builder.AppendItem(L"Group", 0, 0, 0);
+    for (int i = 0; i < 200; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "Folder %03d", i);
+        builder.AppendItem(strings.Add(name), 0, 0, 0);
+
+        expected += i == 0 ? "" : "\\";
+        expected += name;
+    }
+    LPITEMIDLIST pidl = builder.Detach();
+
+    // The group's item is left out of the path.
+    LPWSTR path = PIDL::GetFullPath(pidl, NULL);
+    CHECK(wcslen(path) > MAX_PATH);
+    CHECK(wcscmp(path, strings.Add(expected.c_str())) == 0);
+    CoTaskMemFree(path);
+
+    // The same path from the parent and its last item.
+    LPITEMIDLIST parent = PIDL::Copy(pidl);
+    PIDL::Last(parent)->mkid.cb = 0;
+    path = PIDL::GetFullPath(parent, PIDL::Last(pidl));
+    CHECK(wcscmp(path, strings.Add(expected.c_str())) == 0);
+    CoTaskMemFree(path);
+
+    PIDL::Free(parent);
+    PIDL::Free(pidl);
+}
+
+TEST(PIDL_Builder_MatchesCreateAndConcatenate) {
+    Strings strings;
+    PIDLBuilder builder;
+    LPITEMIDLIST created = NULL;
+
+    for (int i = 0; i < 50; ++i) {
+        LPWSTR name = strings.Format("Folder %d", i);
+        CHECK(builder.AppendItem(name, 0, USHORT(i % 3), 4) != NULL);
+
+        LPITEMIDLIST longer = PIDL::Create(created, name, 0, USHORT(i % 3), 4);
+        PIDL::Free(created);
+        created = longer;
+    }
+
+    LPITEMIDLIST built = builder.Detach();
+    CHECK(PIDL::ItemCount(built) == 50);
+    CHECK(PIDL::Size(built) == PIDL::Size(created));
+    CHECK(memcmp(built, created, PIDL::Size(built)) == 0);
+
+    LPITEMIDLIST doubled = PIDL::Concatenate(built, created);
+    CHECK(PIDL::ItemCount(doubled) == 100);
+    CHECK(PIDL::Size(doubled) == 2*PIDL::Size(built) - sizeof(USHORT));
+
+    PIDL::Free(doubled);
+    PIDL::Free(built);
+    PIDL::Free(created);
+}
+
+/// <summary>
+/// Makes an item in the version 1 layout, which carries neither a hash nor a sort key.
+/// </summary>
+static LPITEMIDLIST MakeItemV1(LPCWSTR name, USHORT folder) {
+    USHORT cbName = USHORT(sizeof(WCHAR)*(wcslen(name) + 1));
+    USHORT cb = USHORT(FIELD_OFFSET(PIDL::PIDLItemV1, name) + cbName);
+    LPITEMIDLIST pidl = (LPITEMIDLIST)CoTaskMemAlloc(cb + sizeof(USHORT));
+    PIDL::PIDLItemV1* item = (PIDL::PIDLItemV1*)&pidl->mkid;
+
+    item->cb = cb;
+    item->folder = folder;
+    item->attributes = 0;
+    item->cbName = cbName;
+    memcpy(item->name, name, cbName);
+    PIDL::Next(pidl)->mkid.cb = 0;
+
+    return pidl;
+}
+
+
+TEST(PIDL_V1Items_StillRead) {
+    LPITEMIDLIST v1 = MakeItemV1(L"Holiday.jpg", 2);
+    LPITEMIDLIST v2 = PIDL::Create(NULL, (LPWSTR)L"HOLIDAY.JPG", 0, 0, 0);
+    LPITEMIDLIST other = PIDL::Create(NULL, (LPWSTR)L"Holiday.png", 0, 0, 0);
+
+    CHECK(wcscmp(PIDL::GetName(v1), L"Holiday.jpg") == 0);
+    CHECK(PIDL::GetFolder(v1) == 2);
+    CHECK(PIDL::GetNameHash(v1) == PIDL::GetNameHash(v2));
+    CHECK(PIDL::NamesEqual(v1, v2));
+    CHECK(!PIDL::NamesEqual(v1, other));
+
+    // Members before the item's folder never have it.
+    CHECK(!PIDL::MayHaveMember(v1, 1));
+    CHECK(PIDL::MayHaveMember(v1, 2));
+
+    PIDL::Free(other);
+    PIDL::Free(v2);
+    PIDL::Free(v1);
+}
+
+TEST(PIDL_SortKeys_OrderNumbersByValue) {
+    static LPCWSTR ordered[] = {
+        L"file.txt", L"file1.txt", L"File2.txt", L"file10.txt", L"FILE20.txt", L"file100.txt", L"fileA.txt",
+        L"track2.mp3", L"Track10.mp3"
+    };
+    Strings strings;
+
+    for (size_t i = 0; i < _countof(ordered); ++i) {
+        for (size_t j = 0; j < _countof(ordered); ++j) {
+            LPITEMIDLIST v2 = PIDL::Create(NULL, strings.Copy(ordered[i], wcslen(ordered[i])), 0, 0, 0);
+            LPITEMIDLIST v1 = MakeItemV1(ordered[j], 0);
+
+            // Keys are made for version 1 items, which carry none, and order them like the rest.
+            int result = PIDL::CompareSortKeys(v2, v1);
+            CHECK(i < j ? result < 0 : i > j ? result > 0 : result == 0);
+            result = PIDL::CompareSortKeys(v1, v2);
+            CHECK(j < i ? result < 0 : j > i ? result > 0 : result == 0);
+
+            PIDL::Free(v1);
+            PIDL::Free(v2);
+        }
+    }
+}
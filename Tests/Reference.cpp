@@ -0,0 +1,68 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Reference.cpp
+ *  The WinUnionFS Project
+ *
+ *  Plain implementations of the name functions, one code unit at a time and
+ *  table driven, which the vectorized ones are tested and measured against.
+ *  Case is folded through Name::Fold, so only the vector paths differ.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include "Name.h"
+#include "Reference.h"
+
+
+// Lookup table for CRC-32C (Castagnoli), reflected.
+static ULONG crcTable[256];
+
+
+/// <summary>
+/// Builds the CRC table, the first time it is needed.
+/// </summary>
+static void EnsureTable() {
+    static bool built = false;
+
+    if (!built) {
+        for (ULONG i = 0; i < 256; ++i) {
+            ULONG crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+            }
+            crcTable[i] = crc;
+        }
+        built = true;
+    }
+}
+
+
+/// <summary>
+/// Returns true if the two names are equal, ignoring case.
+/// </summary>
+bool Reference::Equal(LPCWSTR name1, LPCWSTR name2) {
+    for (;; ++name1, ++name2) {
+        if (Name::Fold(*name1) != Name::Fold(*name2)) {
+            return false;
+        }
+        if (*name1 == L'\0') {
+            return true;
+        }
+    }
+}
+
+
+/// <summary>
+/// Returns the CRC-32C of the upper cased UTF-16LE code units of the name.
+/// </summary>
+ULONG Reference::Hash(LPCWSTR name) {
+    EnsureTable();
+
+    ULONG crc = 0xFFFFFFFF;
+    for (; *name != L'\0'; ++name) {
+        WCHAR c = Name::Fold(*name);
+        crc = crcTable[(crc ^ c) & 0xFF] ^ (crc >> 8);
+        crc = crcTable[(crc ^ (c >> 8)) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
@@ -0,0 +1,14 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Reference.h
+ *  The WinUnionFS Project
+ *
+ *  Plain implementations of the name functions, one code unit at a time and
+ *  table driven, which the vectorized ones are tested and measured against.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace Reference {
+    bool Equal(LPCWSTR name1, LPCWSTR name2);
+    ULONG Hash(LPCWSTR name);
+}
@@ -0,0 +1,240 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  RegistryFake.cpp
+ *  The WinUnionFS Project
+ *
+ *  An in-memory registry behind the Reg functions of Compat. Keys are a tree
+ *  whose names compare ignoring ASCII case and are enumerated in order, like
+ *  the real registry's. Handles point at the keys, which live until Clear,
+ *  so closing them does nothing.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "RegistryFake.h"
+
+
+// Names, upper cased, as keys of the maps.
+typedef std::u16string Folded;
+
+struct Value {
+    DWORD type;
+    std::vector<BYTE> data;
+};
+
+struct Key {
+    // The name as it was created.
+    std::vector<WCHAR> name;
+
+    std::map<Folded, Key*> subKeys;
+    std::map<Folded, Value> values;
+};
+
+// HKEY_CURRENT_USER.
+static Key currentUser;
+
+// Serializes everything, as units may read the registry from several threads.
+static SRWLOCK lock = SRWLOCK_INIT;
+
+
+/// <summary>
+/// Returns the key a handle stands for.
+/// </summary>
+static Key* FromHandle(HKEY key) {
+    return key == HKEY_CURRENT_USER ? &currentUser : (Key*)key;
+}
+
+
+/// <summary>
+/// Upper cases the first cch characters of name.
+/// </summary>
+static Folded Fold(LPCWSTR name, size_t cch) {
+    Folded folded;
+    for (size_t i = 0; i < cch; ++i) {
+        folded += char16_t(name[i] >= L'a' && name[i] <= L'z' ? name[i] - L'a' + L'A' : name[i]);
+    }
+    return folded;
+}
+
+
+/// <summary>
+/// Follows a backslash separated path below key, creating missing keys if create is set.
+/// Returns NULL if a key is missing.
+/// </summary>
+static Key* Walk(Key* key, LPCWSTR path, bool create) {
+    while (key != NULL && path != NULL && *path != L'\0') {
+        size_t cch = wcscspn(path, L"\\");
+        if (cch > 0) {
+            Folded folded = Fold(path, cch);
+            std::map<Folded, Key*>::iterator subKey = key->subKeys.find(folded);
+            if (subKey != key->subKeys.end()) {
+                key = subKey->second;
+            }
+            else if (create) {
+                Key* created = new Key();
+                created->name.assign(path, path + cch);
+                created->name.push_back(L'\0');
+                key->subKeys[folded] = created;
+                key = created;
+            }
+            else {
+                key = NULL;
+            }
+        }
+        path += cch;
+        if (*path == L'\\') {
+            ++path;
+        }
+    }
+
+    return key;
+}
+
+
+/// <summary>
+/// Deletes every key below key.
+/// </summary>
+static void DeleteSubKeys(Key* key) {
+    for (std::map<Folded, Key*>::iterator subKey = key->subKeys.begin(); subKey != key->subKeys.end(); ++subKey) {
+        DeleteSubKeys(subKey->second);
+        delete subKey->second;
+    }
+    key->subKeys.clear();
+}
+
+
+/// <summary>
+/// Sets a value under HKEY_CURRENT_USER, creating the keys on the way.
+/// </summary>
+static void SetValue(LPCWSTR path, LPCWSTR name, DWORD type, LPCVOID data, DWORD cbData) {
+    AcquireSRWLockExclusive(&lock);
+    Value &value = Walk(&currentUser, path, true)->values[Fold(name, wcslen(name))];
+    value.type = type;
+    value.data.assign((const BYTE*)data, (const BYTE*)data + cbData);
+    ReleaseSRWLockExclusive(&lock);
+}
+
+
+/// <summary>
+/// Sets a string value.
+/// </summary>
+void RegistryFake::SetString(LPCWSTR key, LPCWSTR value, LPCWSTR data) {
+    SetValue(key, value, REG_SZ, data, DWORD(sizeof(WCHAR)*(wcslen(data) + 1)));
+}
+
+
+/// <summary>
+/// Sets a DWORD value.
+/// </summary>
+void RegistryFake::SetDWORD(LPCWSTR key, LPCWSTR value, DWORD data) {
+    SetValue(key, value, REG_DWORD, &data, sizeof(DWORD));
+}
+
+
+/// <summary>
+/// Removes every key and value.
+/// </summary>
+void RegistryFake::Clear() {
+    AcquireSRWLockExclusive(&lock);
+    DeleteSubKeys(&currentUser);
+    currentUser.values.clear();
+    ReleaseSRWLockExclusive(&lock);
+}
+
+
+LSTATUS RegCreateKeyW(HKEY key, LPCWSTR subKey, HKEY* result) {
+    AcquireSRWLockExclusive(&lock);
+    *result = (HKEY)Walk(FromHandle(key), subKey, true);
+    ReleaseSRWLockExclusive(&lock);
+
+    return ERROR_SUCCESS;
+}
+
+
+LSTATUS RegOpenKeyExW(HKEY key, LPCWSTR subKey, DWORD /* options */, REGSAM /* access */, HKEY* result) {
+    AcquireSRWLockShared(&lock);
+    *result = (HKEY)Walk(FromHandle(key), subKey, false);
+    ReleaseSRWLockShared(&lock);
+
+    return *result != NULL ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND;
+}
+
+
+LSTATUS RegEnumKeyExW(HKEY key, DWORD index, LPWSTR name, LPDWORD cchName, LPDWORD, LPWSTR, LPDWORD, LPVOID) {
+    LSTATUS status = ERROR_NO_MORE_ITEMS;
+
+    AcquireSRWLockShared(&lock);
+    Key* parent = FromHandle(key);
+    if (index < parent->subKeys.size()) {
+        std::map<Folded, Key*>::const_iterator subKey = parent->subKeys.begin();
+        std::advance(subKey, index);
+
+        const std::vector<WCHAR> &subKeyName = subKey->second->name;
+        if (subKeyName.size() > *cchName) {
+            status = ERROR_MORE_DATA;
+        }
+        else {
+            memcpy(name, &subKeyName[0], sizeof(WCHAR)*subKeyName.size());
+            *cchName = DWORD(subKeyName.size() - 1);
+            status = ERROR_SUCCESS;
+        }
+    }
+    ReleaseSRWLockShared(&lock);
+
+    return status;
+}
+
+
+LSTATUS RegGetValueW(HKEY key, LPCWSTR subKey, LPCWSTR name, DWORD flags, LPDWORD type, PVOID data, LPDWORD cbData) {
+    LSTATUS status = ERROR_FILE_NOT_FOUND;
+
+    AcquireSRWLockShared(&lock);
+    Key* parent = Walk(FromHandle(key), subKey, false);
+    if (parent != NULL) {
+        std::map<Folded, Value>::const_iterator value = parent->values.find(Fold(name, wcslen(name)));
+        if (value != parent->values.end()) {
+            DWORD allowed = value->second.type == REG_SZ ? RRF_RT_REG_SZ : value->second.type == REG_EXPAND_SZ ? RRF_RT_REG_EXPAND_SZ :
+                value->second.type == REG_QWORD ? RRF_RT_REG_QWORD : RRF_RT_REG_DWORD;
+            DWORD cb = DWORD(value->second.data.size());
+
+            if ((flags & allowed) == 0) {
+                status = ERROR_INVALID_DATA;
+            }
+            else if (data != NULL && *cbData < cb) {
+                status = ERROR_MORE_DATA;
+            }
+            else {
+                if (data != NULL && cb > 0) {
+                    memcpy(data, &value->second.data[0], cb);
+                }
+                if (type != NULL) {
+                    *type = value->second.type;
+                }
+                status = ERROR_SUCCESS;
+            }
+            *cbData = cb;
+        }
+    }
+    ReleaseSRWLockShared(&lock);
+
+    return status;
+}
+
+
+LSTATUS RegSetValueExW(HKEY key, LPCWSTR name, DWORD /* reserved */, DWORD type, const BYTE* data, DWORD cbData) {
+    AcquireSRWLockExclusive(&lock);
+    Value &value = FromHandle(key)->values[Fold(name, wcslen(name))];
+    value.type = type;
+    value.data.assign(data, data + cbData);
+    ReleaseSRWLockExclusive(&lock);
+
+    return ERROR_SUCCESS;
+}
+
+
+LSTATUS RegCloseKey(HKEY /* key */) {
+    return ERROR_SUCCESS;
+}
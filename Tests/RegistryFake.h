@@ -0,0 +1,17 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  RegistryFake.h
+ *  The WinUnionFS Project
+ *
+ *  Fills in the in-memory registry the units read through Compat.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace RegistryFake {
+    // Sets a value under HKEY_CURRENT_USER, creating the keys on the way.
+    void SetString(LPCWSTR key, LPCWSTR value, LPCWSTR data);
+    void SetDWORD(LPCWSTR key, LPCWSTR value, DWORD data);
+
+    // Removes every key and value.
+    void Clear();
+}
@@ -0,0 +1,248 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  SortedMergeTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of the k-way merge of the members' sorted listings against a plain
+ *  reference, which concatenates every listing, sorts the lot and drops the
+ *  duplicates. Names which only differ in case, numbers which only differ in
+ *  leading zeroes and members which run out early are where the two could
+ *  part ways.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#include <algorithm>
+#include <stdlib.h>
+#include <vector>
+
+#include "Name.h"
+#include "SortedMerge.hpp"
+#include "Strings.h"
+#include "Test.h"
+
+
+// An item which came out of a merge, with the member which provided it and the others which have it.
+typedef struct {
+    LPCWSTR name;
+    SFGAOF attributes;
+    size_t member;
+    std::vector<size_t> duplicates;
+} MergedItem;
+
+// An item of a member's listing.
+typedef struct {
+    LPCWSTR name;
+    SFGAOF attributes;
+    size_t member;
+} ListedItem;
+
+
+/// <summary>
+/// Orders items by their sort keys, then names, then members.
+/// </summary>
+class ListedLess {
+public:
+    bool operator()(const ListedItem &item1, const ListedItem &item2) const {
+        std::vector<BYTE> key1(Name::SortKey(item1.name, NULL) + 1), key2(Name::SortKey(item2.name, NULL) + 1);
+        Name::SortKey(item1.name, &key1[0]);
+        Name::SortKey(item2.name, &key2[0]);
+        key1.pop_back();
+        key2.pop_back();
+
+        if (key1 != key2) {
+            return key1 < key2;
+        }
+
+        int result = Name::Compare(item1.name, item2.name);
+        if (result != 0) {
+            return result < 0;
+        }
+
+        return item1.member < item2.member;
+    }
+};
+
+
+/// <summary>
+/// Runs the merge over the listings.
+/// </summary>
+static std::vector<MergedItem> Merge(const std::vector<std::vector<ListedItem> > &listings) {
+    SortedMerge merge;
+    std::vector<MergedItem> result;
+    const SortedMerge::Entry* entry;
+    MergedItem item;
+
+    merge.Reset(listings.size());
+    for (size_t i = 0; i < listings.size(); ++i) {
+        for (std::vector<ListedItem>::const_iterator listed = listings[i].begin(); listed != listings[i].end(); ++listed) {
+            merge.Add(i, listed->name, listed->attributes);
+        }
+    }
+    merge.Sort();
+
+    while (merge.Next(&entry, &item.member, &item.duplicates)) {
+        item.name = entry->name;
+        item.attributes = entry->attributes;
+        result.push_back(item);
+    }
+
+    return result;
+}
+
+
+/// <summary>
+/// Concatenates the listings, sorts them, and keeps the first of every name, noting the members
+/// of the others.
+/// </summary>
+static std::vector<MergedItem> ReferenceMerge(const std::vector<std::vector<ListedItem> > &listings) {
+    std::vector<ListedItem> all;
+    std::vector<MergedItem> result;
+
+    for (size_t i = 0; i < listings.size(); ++i) {
+        all.insert(all.end(), listings[i].begin(), listings[i].end());
+    }
+    std::sort(all.begin(), all.end(), ListedLess());
+
+    for (size_t i = 0; i < all.size(); ++i) {
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; ++j) {
+            seen = Name::Equal(all[j].name, all[i].name);
+        }
+        if (seen) {
+            continue;
+        }
+
+        MergedItem item;
+        item.name = all[i].name;
+        item.attributes = all[i].attributes;
+        item.member = all[i].member;
+        for (size_t member = 0; member < listings.size(); ++member) {
+            for (std::vector<ListedItem>::const_iterator listed = listings[member].begin(); listed != listings[member].end(); ++listed) {
+                if (member != item.member && Name::Equal(listed->name, item.name)) {
+                    item.duplicates.push_back(member);
+                }
+            }
+        }
+        result.push_back(item);
+    }
+
+    return result;
+}
+
+
+/// <summary>
+/// Returns true if the merges came out the same.
+/// </summary>
+static bool SameItems(const std::vector<MergedItem> &items1, const std::vector<MergedItem> &items2) {
+    if (items1.size() != items2.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < items1.size(); ++i) {
+        if (items1[i].name != items2[i].name || items1[i].attributes != items2[i].attributes ||
+            items1[i].member != items2[i].member || items1[i].duplicates != items2[i].duplicates) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/// <summary>
+/// Adds an item to a member's listing.
+/// </summary>
+static void List(std::vector<std::vector<ListedItem> > &listings, size_t member, LPCWSTR name) {
+    ListedItem item;
+
+    item.name = name;
+    item.attributes = SFGAOF(member);
+    item.member = member;
+    listings[member].push_back(item);
+}
+
+
+TEST(SortedMerge_Duplicates_ComeFromTheFirstMember) {
+    Strings strings;
+    std::vector<std::vector<ListedItem> > listings(3);
+
+    List(listings, 2, strings.Add("Readme.txt"));
+    List(listings, 1, strings.Add("README.TXT"));
+    List(listings, 1, strings.Add("b"));
+    List(listings, 2, strings.Add("a"));
+
+    std::vector<MergedItem> items = Merge(listings);
+    CHECK(items.size() == 3);
+    CHECK(items[0].member == 2 && items[0].duplicates.empty());
+    CHECK(items[1].member == 1 && items[1].duplicates.empty());
+    CHECK(items[2].member == 1 && items[2].name == listings[1][0].name);
+    CHECK(items[2].duplicates.size() == 1 && items[2].duplicates[0] == 2);
+    CHECK(SameItems(items, ReferenceMerge(listings)));
+}
+
+
+TEST(SortedMerge_Numbers_OrderByValue) {
+    Strings strings;
+    std::vector<std::vector<ListedItem> > listings(2);
+
+    List(listings, 0, strings.Add("file10"));
+    List(listings, 0, strings.Add("file2"));
+    List(listings, 1, strings.Add("file02"));
+    List(listings, 1, strings.Add("file1"));
+
+    std::vector<MergedItem> items = Merge(listings);
+    CHECK(items.size() == 4);
+    CHECK(items[0].name == listings[1][1].name);
+    CHECK(items[3].name == listings[0][0].name);
+    CHECK(SameItems(items, ReferenceMerge(listings)));
+}
+
+
+TEST(SortedMerge_EmptyMembers_AreSkipped) {
+    Strings strings;
+    std::vector<std::vector<ListedItem> > listings(4);
+
+    CHECK(Merge(listings).empty());
+
+    List(listings, 3, strings.Add("z"));
+    std::vector<MergedItem> items = Merge(listings);
+    CHECK(items.size() == 1 && items[0].member == 3);
+}
+
+
+TEST(SortedMerge_RandomListings_MatchReference) {
+    static const char alphabet[] = "aAbB019.~";
+    Strings strings;
+
+    srand(25);
+    for (int round = 0; round < 500; ++round) {
+        std::vector<std::vector<ListedItem> > listings(1 + rand() % 6);
+
+        for (size_t member = 0; member < listings.size(); ++member) {
+            // Members run out at different points, some straight away.
+            int count = rand() % 3 == 0 ? 0 : rand() % 40;
+
+            for (int i = 0; i < count; ++i) {
+                char name[6];
+                int length = 1 + rand() % (sizeof(name) - 1);
+                for (int j = 0; j < length; ++j) {
+                    name[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+                }
+                name[length] = '\0';
+
+                // A folder can't have the same name twice.
+                LPCWSTR wideName = strings.Add(name);
+                bool listed = false;
+                for (std::vector<ListedItem>::const_iterator item = listings[member].begin(); item != listings[member].end() && !listed; ++item) {
+                    listed = Name::Equal(item->name, wideName);
+                }
+                if (!listed) {
+                    List(listings, member, wideName);
+                }
+            }
+        }
+
+        CHECK(SameItems(Merge(listings), ReferenceMerge(listings)));
+    }
+}
@@ -0,0 +1,87 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  StatsTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of publishing the performance counters, which is how they are read
+ *  in release builds. They are written to the registry only when asked to,
+ *  and then no more often than the interval allows.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include "ProbeStats.hpp"
+#include "RegistryFake.h"
+#include "Settings.h"
+#include "Stats.h"
+#include "Test.h"
+
+
+#define STATS_KEY L"SOFTWARE\\WinUnionFS\\Stats"
+
+
+/// <summary>
+/// Reads a published counter, or returns -1 if it hasn't been.
+/// </summary>
+static LONGLONG ReadCounter(LPCWSTR key, LPCWSTR name) {
+    LONGLONG value;
+    DWORD cbValue = sizeof(value);
+
+    if (RegGetValueW(HKEY_CURRENT_USER, key, name, RRF_RT_REG_QWORD, NULL, &value, &cbValue) != ERROR_SUCCESS) {
+        return -1;
+    }
+
+    return value;
+}
+
+
+TEST(Stats_Publish_WritesNothingUnlessAsked) {
+    RegistryFake::Clear();
+    Settings::statsInterval = 0;
+
+    Stats::Add(Stats::CACHE_HITS, 1);
+    CHECK(!Stats::Publish());
+    CHECK(ReadCounter(STATS_KEY, L"CacheHits") == -1);
+}
+
+
+TEST(Stats_Publish_WritesEveryCounterOncePerInterval) {
+    RegistryFake::Clear();
+    Settings::statsInterval = 3600000;
+
+    Stats::Add(Stats::CACHE_HITS, 3);
+    CHECK(Stats::Publish());
+    CHECK(ReadCounter(STATS_KEY, L"CacheHits") == Stats::Get(Stats::CACHE_HITS));
+    for (int i = 0; i < Stats::COUNTER_COUNT; ++i) {
+        CHECK(ReadCounter(STATS_KEY, Stats::GetName(Stats::Counter(i))) >= 0);
+    }
+
+    // Not again until the interval is up.
+    Stats::Add(Stats::CACHE_HITS, 1);
+    CHECK(!Stats::Publish());
+    CHECK(ReadCounter(STATS_KEY, L"CacheHits") == Stats::Get(Stats::CACHE_HITS) - 1);
+
+    Settings::statsInterval = 0;
+}
+
+
+TEST(ProbeStats_Publish_WritesEveryMemberUnderTheGroup) {
+    RegistryFake::Clear();
+    Settings::statsInterval = 3600000;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    ProbeStats stats;
+    stats.Record(L"Documents", 0, false, frequency.QuadPart/1000);
+    stats.Record(L"Documents", 1, true, frequency.QuadPart/1000);
+    stats.Record(L"Pictures", 1, true, frequency.QuadPart/1000);
+    stats.Publish(L"Library");
+
+    CHECK(ReadCounter(STATS_KEY L"\\Library", L"Member0Probes") == 1);
+    CHECK(ReadCounter(STATS_KEY L"\\Library", L"Member0Hits") == 0);
+    CHECK(ReadCounter(STATS_KEY L"\\Library", L"Member1Probes") == 2);
+    CHECK(ReadCounter(STATS_KEY L"\\Library", L"Member1Hits") == 2);
+    CHECK(ReadCounter(STATS_KEY L"\\Library", L"Member1ProbeTime") == 2000);
+
+    Settings::statsInterval = 0;
+}
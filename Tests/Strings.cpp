@@ -0,0 +1,68 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Strings.cpp
+ *  The WinUnionFS Project
+ *
+ *  Builds the wide strings tests need, which stay valid until the test ends.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "Strings.h"
+
+
+/// <summary>
+/// Destructor.
+/// </summary>
+Strings::~Strings() {
+    for (std::vector<LPWSTR>::const_iterator string = this->strings.begin(); string != this->strings.end(); ++string) {
+        delete [] *string;
+    }
+}
+
+
+/// <summary>
+/// Widens an ASCII string.
+/// </summary>
+LPWSTR Strings::Add(const char* text) {
+    size_t count = strlen(text);
+    LPWSTR string = new WCHAR[count + 1];
+
+    for (size_t i = 0; i <= count; ++i) {
+        string[i] = WCHAR((unsigned char)text[i]);
+    }
+
+    this->strings.push_back(string);
+    return string;
+}
+
+
+/// <summary>
+/// Formats an ASCII string, and widens it.
+/// </summary>
+LPWSTR Strings::Format(const char* format, ...) {
+    char text[1024];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    return Add(text);
+}
+
+
+/// <summary>
+/// Copies a wide string of count code units, adding a NUL.
+/// </summary>
+LPWSTR Strings::Copy(const WCHAR* text, size_t count) {
+    LPWSTR string = new WCHAR[count + 1];
+
+    memcpy(string, text, count*sizeof(WCHAR));
+    string[count] = L'\0';
+
+    this->strings.push_back(string);
+    return string;
+}
@@ -0,0 +1,27 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Strings.h
+ *  The WinUnionFS Project
+ *
+ *  Builds the wide strings tests need, which stay valid until the test ends.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+#include <vector>
+
+class Strings {
+public:
+    ~Strings();
+
+    // Widens an ASCII string.
+    LPWSTR Add(const char* text);
+
+    // Formats an ASCII string, and widens it.
+    LPWSTR Format(const char* format, ...);
+
+    // Copies a wide string of count code units, adding a NUL.
+    LPWSTR Copy(const WCHAR* text, size_t count);
+
+private:
+    std::vector<LPWSTR> strings;
+};
@@ -0,0 +1,80 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Test.cpp
+ *  The WinUnionFS Project
+ *
+ *  A minimal unit test runner.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Test.h"
+
+
+typedef std::pair<const char*, Test::Function> Entry;
+
+// The registered tests. A function, so that it exists before the first registration runs.
+static std::vector<Entry>& Tests() {
+    static std::vector<Entry> tests;
+    return tests;
+}
+
+// The failed checks of the test which is running. Tests may check from several threads.
+static volatile LONG failures = 0;
+
+
+/// <summary>
+/// Adds a test to the list the runner goes through.
+/// </summary>
+Test::Registration::Registration(const char* name, Function function) {
+    Tests().push_back(Entry(name, function));
+}
+
+
+/// <summary>
+/// Records a failed check.
+/// </summary>
+void Test::Fail(const char* condition, const char* file, int line) {
+    if (InterlockedIncrement(&failures) <= 10) {
+        printf("  %s:%d: CHECK(%s) failed\n", file, line, condition);
+    }
+}
+
+
+/// <summary>
+/// Runs the tests whose names contain filter, or all of them if it is NULL.
+/// </summary>
+int Test::Run(const char* filter) {
+    int failed = 0;
+    int run = 0;
+
+    for (std::vector<Entry>::const_iterator test = Tests().begin(); test != Tests().end(); ++test) {
+        if (filter != NULL && strstr(test->first, filter) == NULL) {
+            continue;
+        }
+
+        failures = 0;
+        test->second();
+        ++run;
+
+        if (failures != 0) {
+            printf("FAILED %s (%d checks)\n", test->first, int(failures));
+            ++failed;
+        }
+        else {
+            printf("ok     %s\n", test->first);
+        }
+    }
+
+    printf("%d of %d tests failed\n", failed, run);
+    return failed;
+}
+
+
+int main(int argc, char* argv[]) {
+    return Test::Run(argc > 1 ? argv[1] : NULL) == 0 ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  Test.h
+ *  The WinUnionFS Project
+ *
+ *  A minimal unit test runner. TEST defines a test, which registers itself
+ *  with the runner; CHECK records a failure and carries on.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+
+namespace Test {
+    typedef void (*Function)();
+
+    // Adds a test to the list the runner goes through.
+    struct Registration {
+        Registration(const char* name, Function function);
+    };
+
+    // Records a failed check.
+    void Fail(const char* condition, const char* file, int line);
+
+    // Runs the tests whose names contain filter, or all of them if it is NULL. Returns the number
+    // which failed.
+    int Run(const char* filter);
+}
+
+#define TEST(name) \
+    static void name(); \
+    static Test::Registration name##Registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            Test::Fail(#condition, __FILE__, __LINE__); \
+        } \
+    } while (0)
@@ -0,0 +1,160 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  UnionEnumIDListBenchmarks.cpp
+ *  The WinUnionFS Project
+ *
+ *  Measures enumerating a union whose first member is slow, like a share
+ *  over a poor link, which hands out a batch per IEnumIDList::Next every
+ *  THROTTLE ms. Streaming should show the first items after one batch, and
+ *  when only the first screenful is read, hold no more than a few batches
+ *  however large the folder. The sorted merge has to read everything before
+ *  the first item.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShObjIdl.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <vector>
+
+#include "Benchmark.h"
+#include "FakeFolder.hpp"
+#include "PIDL.h"
+#include "Settings.h"
+#include "Strings.h"
+#include "UnionEnumIDList.hpp"
+
+
+// How long the slow member takes per batch, in ms.
+#define THROTTLE 1
+
+// The number of items in the slow member, and in the fast one after it.
+#define SLOW_ITEMS 20000
+#define FAST_ITEMS 2000
+
+// The number of items to fetch per call to Next, as Explorer does.
+#define BATCH_SIZE 256
+
+#define EVERYTHING (SHCONTF_FOLDERS | SHCONTF_NONFOLDERS | SHCONTF_INCLUDEHIDDEN)
+
+
+static Strings strings;
+
+
+/// <summary>
+/// Returns the bytes of heap in use, or 0 where that can't be told.
+/// </summary>
+static size_t HeapInUse() {
+#if defined(__GLIBC__)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+
+/// <summary>
+/// Returns the members, slow one first, which are made once.
+/// </summary>
+static const std::vector<IShellFolder*>& Members() {
+    static std::vector<IShellFolder*> members;
+
+    if (members.empty()) {
+        FakeFolder* slow = new FakeFolder();
+        FakeFolder* fast = new FakeFolder();
+
+        for (ULONG i = 0; i < SLOW_ITEMS; ++i) {
+            slow->Add(strings.Format("Photo %06u.jpg", i), 0);
+        }
+        for (ULONG i = 0; i < FAST_ITEMS; ++i) {
+            fast->Add(strings.Format("Document %06u.txt", i), 0);
+        }
+        slow->SetDelay(THROTTLE);
+
+        members.push_back(slow);
+        members.push_back(fast);
+    }
+
+    return members;
+}
+
+
+/// <summary>
+/// Waits for the workers to let go of the members, so that runs don't overlap.
+/// </summary>
+static void WaitForMembers() {
+    const std::vector<IShellFolder*> &members = Members();
+
+    for (std::vector<IShellFolder*>::const_iterator member = members.begin(); member != members.end(); ++member) {
+        ((FakeFolder*)*member)->WaitReleased(INFINITE);
+    }
+}
+
+
+/// <summary>
+/// Enumerates the union up to limit items, and reports the time to the first item and the most
+/// heap the enumeration had in use at once.
+/// </summary>
+static void Enumerate(ULONG iterations, ULONG limit) {
+    const std::vector<IShellFolder*> &members = Members();
+    LARGE_INTEGER frequency;
+    double firstItemTime = 0;
+    size_t peak = 0;
+    ULONG read = 0;
+
+    QueryPerformanceFrequency(&frequency);
+    DWORD batchSize = Settings::enumBatchSize;
+    Settings::enumBatchSize = BATCH_SIZE;
+
+    for (ULONG i = 0; i < iterations; ++i) {
+        LPITEMIDLIST items[BATCH_SIZE];
+        LARGE_INTEGER start, first;
+        ULONG fetched;
+
+        size_t baseline = HeapInUse();
+        QueryPerformanceCounter(&start);
+
+        UnionEnumIDList* list = new UnionEnumIDList(NULL, members, std::vector<bool>(), NULL, EVERYTHING);
+        read = 0;
+        do {
+            list->Next(BATCH_SIZE, items, &fetched);
+            if (read == 0) {
+                QueryPerformanceCounter(&first);
+                firstItemTime += double(first.QuadPart - start.QuadPart)/frequency.QuadPart;
+            }
+            peak = max(peak, HeapInUse() - min(baseline, HeapInUse()));
+
+            for (ULONG j = 0; j < fetched; ++j) {
+                PIDL::Free(items[j]);
+            }
+            read += fetched;
+        } while (fetched == BATCH_SIZE && read < limit);
+        list->Release();
+
+        WaitForMembers();
+    }
+
+    Settings::enumBatchSize = batchSize;
+    Benchmark::Items(read);
+    Benchmark::Report("ms to first item", 1000*firstItemTime/iterations);
+    Benchmark::Report("peak KB in use", double(peak)/1024);
+}
+
+
+BENCHMARK(UnionEnumIDList_Streaming_SlowMember) {
+    Enumerate(iterations, ~ULONG(0));
+}
+
+
+BENCHMARK(UnionEnumIDList_Streaming_FirstScreenOfSlowMember) {
+    Enumerate(iterations, BATCH_SIZE);
+}
+
+
+BENCHMARK(UnionEnumIDList_Sorted_SlowMember) {
+    Settings::sortedMerge = 1;
+    Enumerate(iterations, ~ULONG(0));
+    Settings::sortedMerge = 0;
+}
@@ -0,0 +1,407 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *  UnionEnumIDListTests.cpp
+ *  The WinUnionFS Project
+ *
+ *  Tests of enumerating a union of fake member folders, which are read on
+ *  the worker pool in small batches. Whichever worker gets ahead, items must
+ *  come out once each, from the first member which has them, with that
+ *  member's attributes.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <Windows.h>
+#include <ShlObj.h>
+
+#include <vector>
+
+#include "FakeFolder.hpp"
+#include "Group.hpp"
+#include "Macros.h"
+#include "Name.h"
+#include "PIDL.h"
+#include "Settings.h"
+#include "Strings.h"
+#include "Test.h"
+#include "UnionEnumIDList.hpp"
+
+
+// The number of members the tests merge.
+#define MEMBER_COUNT 3
+
+// Every item, folders first, in each member.
+#define EVERYTHING (SHCONTF_FOLDERS | SHCONTF_NONFOLDERS | SHCONTF_INCLUDEHIDDEN)
+
+// The attributes which the members' items pass on.
+#define PASSED_ON (SFGAO_HIDDEN | SFGAO_READONLY | SFGAO_LINK)
+
+
+// An item the union should have.
+typedef struct {
+    LPCWSTR name;
+    SFGAOF attributes;
+    size_t member;
+    std::vector<bool> members;
+} ExpectedItem;
+
+
+/// <summary>
+/// Returns the attributes an item of a member has. They differ between members, so that it shows
+/// which member an item came from.
+/// </summary>
+static SFGAOF MakeAttributes(size_t member, ULONG i, bool folder) {
+    SFGAOF attributes = folder ? SFGAO_FOLDER : 0;
+
+    if ((i + member) % 7 == 0) {
+        attributes |= SFGAO_HIDDEN;
+    }
+    if ((i + member) % 5 == 0) {
+        attributes |= SFGAO_READONLY;
+    }
+
+    return attributes;
+}
+
+
+/// <summary>
+/// Fills the members with overlapping folders, files and shortcuts. Later members have many of the
+/// names of earlier ones, in another case.
+/// </summary>
+static void FillMembers(Strings &strings, std::vector<FakeFolder*> &members) {
+    for (size_t member = 0; member < members.size(); ++member) {
+        FakeFolder* folder = members[member];
+        ULONG first = ULONG(member)*20;
+
+        for (ULONG i = first; i < first + 40; ++i) {
+            if (i % 4 == 0) {
+                folder->Add(strings.Format(member % 2 == 0 ? "Folder %03u" : "FOLDER %03u", i), MakeAttributes(member, i, true));
+            }
+            else if (i % 9 == 0) {
+                folder->Add(strings.Format("Shortcut %03u.lnk", i), MakeAttributes(member, i, false) | SFGAO_LINK);
+            }
+            else {
+                folder->Add(strings.Format(member % 2 == 0 ? "File %03u.txt" : "FILE %03u.TXT", i), MakeAttributes(member, i, false));
+            }
+        }
+    }
+}
+
+
+/// <summary>
+/// Returns the attributes the union gives an item with the member's attributes.
+/// </summary>
+static SFGAOF UnionAttributes(SFGAOF attributes) {
+    if (FLAGSET(attributes, SFGAO_FOLDER)) {
+        return (attributes & PASSED_ON) | SFGAO_FOLDER | SFGAO_BROWSABLE | SFGAO_HASSUBFOLDER;
+    }
+
+    return attributes & PASSED_ON;
+}
+
+
+/// <summary>
+/// Lists what the union should have, in member order with each member's folders first, from
+/// the members' items as Strings made them.
+/// </summary>
+static std::vector<ExpectedItem> Expect(Strings &strings, size_t memberCount) {
+    std::vector<FakeFolder*> members;
+    std::vector<ExpectedItem> expected;
+
+    // The same items again, whose names and attributes can be read back in order.
+    for (size_t member = 0; member < memberCount; ++member) {
+        members.push_back(new FakeFolder());
+    }
+    FillMembers(strings, members);
+
+    for (size_t member = 0; member < memberCount; ++member) {
+        for (int pass = 0; pass < 2; ++pass) {
+            IEnumIDList* enumerator;
+            LPITEMIDLIST id;
+
+            members[member]->EnumObjects(NULL, (pass == 0 ? SHCONTF_FOLDERS : SHCONTF_NONFOLDERS) | SHCONTF_INCLUDEHIDDEN, &enumerator);
+            while (enumerator->Next(1, &id, NULL) == S_OK) {
+                LPCWSTR name = members[member]->GetName(id);
+                SFGAOF attributes = ~SFGAOF(0);
+                members[member]->GetAttributesOf(1, (PCUITEMID_CHILD_ARRAY)&id, &attributes);
+                ILFree(id);
+
+                bool found = false;
+                for (std::vector<ExpectedItem>::iterator item = expected.begin(); item != expected.end(); ++item) {
+                    if (Name::Equal(item->name, name)) {
+                        item->members[member] = true;
+                        found = true;
+                    }
+                }
+                if (!found) {
+                    ExpectedItem item;
+                    item.name = strings.Copy(name, wcslen(name));
+                    item.attributes = UnionAttributes(attributes);
+                    item.member = member;
+                    item.members.assign(memberCount, false);
+                    item.members[member] = true;
+                    expected.push_back(item);
+                }
+            }
+            enumerator->Release();
+        }
+    }
+
+    for (size_t member = 0; member < memberCount; ++member) {
+        members[member]->Release();
+    }
+
+    return expected;
+}
+
+
+/// <summary>
+/// Returns the expected item with the name, or NULL.
+/// </summary>
+static const ExpectedItem* FindExpected(const std::vector<ExpectedItem> &expected, LPCWSTR name) {
+    for (std::vector<ExpectedItem>::const_iterator item = expected.begin(); item != expected.end(); ++item) {
+        if (wcscmp(item->name, name) == 0) {
+            return &*item;
+        }
+    }
+
+    return NULL;
+}
+
+
+/// <summary>
+/// Reads the whole union, a few items at a time like Explorer.
+/// </summary>
+static std::vector<LPITEMIDLIST> ReadAll(IEnumIDList* list) {
+    std::vector<LPITEMIDLIST> items;
+    LPITEMIDLIST batch[16];
+    ULONG fetched;
+
+    do {
+        list->Next(_countof(batch), batch, &fetched);
+        items.insert(items.end(), batch, batch + fetched);
+    } while (fetched == _countof(batch));
+
+    return items;
+}
+
+
+/// <summary>
+/// Frees the items.
+/// </summary>
+static void FreeItems(std::vector<LPITEMIDLIST> &items) {
+    for (std::vector<LPITEMIDLIST>::const_iterator item = items.begin(); item != items.end(); ++item) {
+        PIDL::Free(*item);
+    }
+    items.clear();
+}
+
+
+/// <summary>
+/// Frees the items, and lets go of the members once their workers are done with them.
+/// </summary>
+static void Finish(std::vector<LPITEMIDLIST> &items, std::vector<FakeFolder*> &members) {
+    FreeItems(items);
+    for (std::vector<FakeFolder*>::const_iterator member = members.begin(); member != members.end(); ++member) {
+        CHECK((*member)->WaitReleased(5000));
+        (*member)->Release();
+    }
+}
+
+
+TEST(UnionEnumIDList_Streaming_KeepsTheFirstMembersItems) {
+    Strings strings;
+    std::vector<FakeFolder*> members;
+    std::vector<IShellFolder*> folders;
+
+    DWORD batchSize = Settings::enumBatchSize;
+    Settings::enumBatchSize = 5;
+
+    for (size_t member = 0; member < MEMBER_COUNT; ++member) {
+        members.push_back(new FakeFolder());
+        members[member]->SetDelay(DWORD(member));
+        folders.push_back(members[member]);
+    }
+    FillMembers(strings, members);
+    std::vector<ExpectedItem> expected = Expect(strings, MEMBER_COUNT);
+
+    UnionEnumIDList* list = new UnionEnumIDList(NULL, folders, std::vector<bool>(), NULL, EVERYTHING);
+    std::vector<LPITEMIDLIST> items = ReadAll(list);
+    CHECK(!list->IsPartial());
+    list->Release();
+
+    // Items come out in member order, each member's folders first.
+    CHECK(items.size() == expected.size());
+    for (size_t i = 0; i < items.size() && i < expected.size(); ++i) {
+        LPWSTR name = PIDL::GetDisplayName(items[i]);
+        CHECK(wcscmp(name, expected[i].name) == 0);
+        CHECK(PIDL::GetFolder(items[i]) == expected[i].member);
+        CHECK(PIDL::GetAttributes(items[i]) == expected[i].attributes);
+        CoTaskMemFree(name);
+    }
+
+    Finish(items, members);
+    Settings::enumBatchSize = batchSize;
+}
+
+
+TEST(UnionEnumIDList_Sorted_KnowsEveryMemberWithTheName) {
+    Strings strings;
+    std::vector<FakeFolder*> members;
+    std::vector<IShellFolder*> folders;
+
+    DWORD batchSize = Settings::enumBatchSize;
+    Settings::enumBatchSize = 5;
+    Settings::sortedMerge = 1;
+
+    for (size_t member = 0; member < MEMBER_COUNT; ++member) {
+        members.push_back(new FakeFolder());
+        members[member]->SetDelay(DWORD(MEMBER_COUNT - member));
+        folders.push_back(members[member]);
+    }
+    FillMembers(strings, members);
+    std::vector<ExpectedItem> expected = Expect(strings, MEMBER_COUNT);
+
+    UnionEnumIDList* list = new UnionEnumIDList(NULL, folders, std::vector<bool>(), NULL, EVERYTHING);
+    std::vector<LPITEMIDLIST> items = ReadAll(list);
+    CHECK(!list->IsPartial());
+    list->Release();
+
+    // Items come out in view order, each once, from the first member which has it.
+    CHECK(items.size() == expected.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        LPWSTR name = PIDL::GetDisplayName(items[i]);
+        const ExpectedItem* item = FindExpected(expected, name);
+
+        CHECK(item != NULL);
+        if (item != NULL) {
+            CHECK(PIDL::GetFolder(items[i]) == item->member);
+            CHECK(PIDL::GetAttributes(items[i]) == item->attributes);
+            for (size_t member = 0; member < MEMBER_COUNT; ++member) {
+                CHECK(PIDL::MayHaveMember(items[i], member) == item->members[member]);
+            }
+        }
+        if (i > 0) {
+            CHECK(PIDL::CompareSortKeys(items[i - 1], items[i]) < 0);
+        }
+        CoTaskMemFree(name);
+    }
+
+    Finish(items, members);
+    Settings::sortedMerge = 0;
+    Settings::enumBatchSize = batchSize;
+}
+
+
+TEST(UnionEnumIDList_OutsideTheFileSystem_StillHasAttributes) {
+    Strings strings;
+    std::vector<FakeFolder*> members;
+    std::vector<IShellFolder*> folders;
+
+    members.push_back(new FakeFolder());
+    members[0]->SetFileSystem(false);
+    folders.push_back(members[0]);
+    FillMembers(strings, members);
+    std::vector<ExpectedItem> expected = Expect(strings, 1);
+
+    UnionEnumIDList* list = new UnionEnumIDList(NULL, folders, std::vector<bool>(), NULL, EVERYTHING);
+    std::vector<LPITEMIDLIST> items = ReadAll(list);
+    list->Release();
+
+    CHECK(items.size() == expected.size());
+    for (size_t i = 0; i < items.size() && i < expected.size(); ++i) {
+        CHECK(PIDL::GetAttributes(items[i]) == expected[i].attributes);
+    }
+
+    Finish(items, members);
+}
+
+
+TEST(UnionEnumIDList_Attributes_AskedOncePerKindOfItem) {
+    static const char* extensions[] = { "txt", "lnk", "jpg" };
+    Strings strings;
+    std::vector<FakeFolder*> members;
+    std::vector<IShellFolder*> folders;
+
+    members.push_back(new FakeFolder());
+    folders.push_back(members[0]);
+    for (ULONG i = 0; i < 60; ++i) {
+        SFGAOF attributes = MakeAttributes(0, i, false) | (i % 3 == 1 ? SFGAO_LINK : 0);
+        members[0]->Add(strings.Format("Item %03u.%s", i, extensions[i % 3]), attributes);
+    }
+
+    UnionEnumIDList* list = new UnionEnumIDList(NULL, folders, std::vector<bool>(), NULL, SHCONTF_NONFOLDERS | SHCONTF_INCLUDEHIDDEN);
+    std::vector<LPITEMIDLIST> items = ReadAll(list);
+    list->Release();
+
+    // The hidden and read-only bits come from the item IDs, and each type is asked if it's a shortcut.
+    CHECK(items.size() == 60);
+    CHECK(members[0]->AttributeCalls() == _countof(extensions));
+    for (size_t i = 0; i < items.size(); ++i) {
+        CHECK(PIDL::GetAttributes(items[i]) == (MakeAttributes(0, ULONG(i), false) | (i % 3 == 1 ? SFGAO_LINK : 0)));
+    }
+
+    Finish(items, members);
+}
+
+
+TEST(UnionEnumIDList_HungMember_IsLeftOutUntilTheBackoffHasPassed) {
+    Strings strings;
+    std::vector<FakeFolder*> members;
+    std::vector<IShellFolder*> folders;
+    Group* group = Group::Create(L"Hung");
+
+    DWORD timeout = Settings::memberTimeout, backoff = Settings::memberBackoff;
+    Settings::memberTimeout = 200;
+    Settings::memberBackoff = 1000;
+
+    for (size_t member = 0; member < MEMBER_COUNT; ++member) {
+        members.push_back(new FakeFolder());
+        folders.push_back(members[member]);
+    }
+    FillMembers(strings, members);
+    members[1]->Hang();
+
+    // The hung member is left out once it misses its deadline, and the others are listed.
+    ULONGLONG start = GetTickCount64();
+    UnionEnumIDList* list = new UnionEnumIDList(group, folders, std::vector<bool>(), NULL, EVERYTHING);
+    std::vector<LPITEMIDLIST> items = ReadAll(list);
+    CHECK(list->IsPartial());
+    list->Release();
+    CHECK(GetTickCount64() - start < 2000);
+
+    size_t fromLast = 0;
+    for (std::vector<LPITEMIDLIST>::const_iterator item = items.begin(); item != items.end(); ++item) {
+        CHECK(PIDL::GetFolder(*item) != 1);
+        if (PIDL::GetFolder(*item) == 2) {
+            // Whether the hung member has the item is unknown.
+            CHECK(PIDL::MayHaveMember(*item, 1));
+            ++fromLast;
+        }
+    }
+    CHECK(fromLast > 0);
+    FreeItems(items);
+
+    // Then its breaker keeps it out without asking it again.
+    LONG nextCalls = members[1]->NextCalls();
+    start = GetTickCount64();
+    list = new UnionEnumIDList(group, folders, std::vector<bool>(), NULL, EVERYTHING);
+    items = ReadAll(list);
+    CHECK(list->IsPartial());
+    list->Release();
+    CHECK(GetTickCount64() - start < Settings::memberTimeout);
+    CHECK(members[1]->NextCalls() == nextCalls);
+
+    // Once the backoff has passed, it is tried again, and closes its breaker by answering.
+    members[1]->Wake();
+    Compat_AdvanceTickCount(Settings::memberBackoff + 10);
+    FreeItems(items);
+    list = new UnionEnumIDList(group, folders, std::vector<bool>(), NULL, EVERYTHING);
+    items = ReadAll(list);
+    CHECK(!list->IsPartial());
+    list->Release();
+    CHECK(group->IsMemberAvailable(1));
+    CHECK(group->IsMemberAvailable(1));
+
+    Finish(items, members);
+    group->Release();
+    Settings::memberTimeout = timeout;
+    Settings::memberBackoff = backoff;
+}